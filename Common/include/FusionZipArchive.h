@@ -37,6 +37,9 @@
 
 #include "FusionPrerequisites.h"
 
+#include <set>
+#include <string>
+
 #include <boost/filesystem/path.hpp>
 
 #include "minizip/zip.h"
@@ -102,8 +105,19 @@ namespace FusionEngine
 			void Close();
 
 			//! Add the file or folder at the given path to the archive
+			/*!
+			* Files are read and compressed on worker threads (several at once), and
+			* written to the archive in order.
+			*/
 			void AddPath(const boost::filesystem::path& path, boost::filesystem::path path_in_archive = boost::filesystem::path());
 
+			//! Files with the given extensions (e.g. ".celldata") are stored rather than compressed
+			/*!
+			* For files whose content is already compressed, where deflating again would
+			* take time for little or no gain.
+			*/
+			void SetStoredExtensions(const std::set<std::string>& extensions);
+
 			//! Create an archive from the given folder
 			static ZipArchive Create(const boost::filesystem::path& path, boost::filesystem::path path_in_archive = boost::filesystem::path());
 
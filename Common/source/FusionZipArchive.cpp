@@ -45,6 +45,10 @@
 #endif
 
 #include <array>
+#include <vector>
+
+#include <tbb/pipeline.h>
+#include <tbb/task_scheduler_init.h>
 
 namespace bfs = boost::filesystem;
 namespace bio = boost::iostreams;
@@ -66,13 +70,14 @@ namespace FusionEngine { namespace IO { namespace FileType
 			//! Add the file or folder at the given path to the archive
 			void AddPath(const boost::filesystem::path& path, boost::filesystem::path path_in_archive = boost::filesystem::path());
 
-			void AddFolder(const boost::filesystem::path& path, const boost::filesystem::path& arc_path);
-			void AddFile(const boost::filesystem::path& path, const boost::filesystem::path& arc_path);
+			void SetStoredExtensions(const std::set<std::string>& extensions) { m_StoredExtensions = extensions; }
 
 		private:
 			zipFile m_File;
 			boost::filesystem::path m_WorkingDir;
 
+			std::set<std::string> m_StoredExtensions;
+
 			struct ArchiveInfo
 			{
 				int fileCount;
@@ -84,6 +89,30 @@ namespace FusionEngine { namespace IO { namespace FileType
 					memset(this, 0, sizeof(ArchiveInfo));
 				}
 			} m_Info;
+
+			//! A file or folder to add to the archive
+			struct Entry
+			{
+				boost::filesystem::path path;
+				boost::filesystem::path archivePath;
+				zip_fileinfo fileinfo;
+				bool folder;
+				bool store;
+
+				// Filled in by compressEntry
+				std::vector<char> data; // Raw deflated data (or the file content, if it's stored)
+				uLong crc;
+				uLong uncompressedSize;
+
+				Entry() : folder(false), store(false), crc(0), uncompressedSize(0) {}
+			};
+
+			//! Lists the given file or folder (and the folder's content) in the order that they will be added
+			void listEntries(const boost::filesystem::path& path, const boost::filesystem::path& archive_path, std::vector<Entry>& entries) const;
+			//! Reads and compresses the given file (called on worker threads)
+			static void compressEntry(Entry& entry);
+			//! Writes the given (compressed) entry to the archive
+			void writeEntry(Entry& entry);
 		};
 
 	}
@@ -91,42 +120,14 @@ namespace FusionEngine { namespace IO { namespace FileType
 	namespace detail
 	{
 
-		ZipArchiveImpl::ZipArchiveImpl(const boost::filesystem::path& file_path)
-			: m_File(nullptr)
+		//! Files that are compressed at once (each holds the whole file in memory)
+		static size_t maxFilesInFlight()
 		{
-			m_File = zipOpen(file_path.generic_string().c_str(), APPEND_STATUS_CREATE);
+			return (size_t)tbb::task_scheduler_init::default_num_threads() * 2;
 		}
 
-		ZipArchiveImpl::~ZipArchiveImpl()
+		static zip_fileinfo getFileInfo(const bfs::path& path)
 		{
-			int r = ZIP_OK;
-			if (m_File)
-				r = zipClose(m_File, ":)");
-			m_File = nullptr;
-			m_Info = ArchiveInfo();
-		}
-
-		void ZipArchiveImpl::AddPath(const bfs::path& path, bfs::path archive_path)
-		{
-			if (archive_path.empty())
-			{
-				archive_path = path;
-			}
-
-			if (bfs::is_regular_file(path))
-				AddFile(path, archive_path);
-			else if (bfs::is_directory(path))
-				AddFolder(path, archive_path);
-			else
-			{
-				FSN_EXCEPT(FileSystemException, "Failed to build ZipArchive: unknown filesystem item type: " + path.string());
-			}
-		}
-
-		void ZipArchiveImpl::AddFolder(const bfs::path& path, const bfs::path& archive_path)
-		{
-			++m_Info.folderCount;
-
 			zip_fileinfo fileinfo;
 			fileinfo.internal_fa = 0;
 #ifdef _WIN32
@@ -162,86 +163,180 @@ namespace FusionEngine { namespace IO { namespace FileType
 			fileinfo.tmz_date.tm_mon = tm.tm_mon;
 			fileinfo.tmz_date.tm_mday = tm.tm_mday;
 
-			auto r = zipOpenNewFileInZip(m_File, (archive_path.generic_string() + "/").c_str(),
-				&fileinfo,
-				nullptr, 0,
-				nullptr, 0,
-				nullptr,
-				Z_DEFLATED,
-				Z_BEST_SPEED);
+			return fileinfo;
+		}
 
-			zipCloseFileInZip(m_File);
+		ZipArchiveImpl::ZipArchiveImpl(const boost::filesystem::path& file_path)
+			: m_File(nullptr)
+		{
+			m_File = zipOpen(file_path.generic_string().c_str(), APPEND_STATUS_CREATE);
+		}
+
+		ZipArchiveImpl::~ZipArchiveImpl()
+		{
+			int r = ZIP_OK;
+			if (m_File)
+				r = zipClose(m_File, ":)");
+			m_File = nullptr;
+			m_Info = ArchiveInfo();
+		}
 
-			for (bfs::directory_iterator it(path), end = bfs::directory_iterator(); it != end; ++it)
+		void ZipArchiveImpl::AddPath(const bfs::path& path, bfs::path archive_path)
+		{
+			if (archive_path.empty())
 			{
-				AddPath(it->path(), archive_path / it->path().filename());
+				archive_path = path;
 			}
+
+			std::vector<Entry> entries;
+			listEntries(path, archive_path, entries);
+
+			// Files are compressed in parallel, but written in order (minizip can only write one at a time)
+			size_t nextEntry = 0;
+			tbb::parallel_pipeline(maxFilesInFlight(),
+				tbb::make_filter<void, Entry*>(tbb::filter::serial_in_order, [&](tbb::flow_control& control)->Entry*
+				{
+					if (nextEntry == entries.size())
+					{
+						control.stop();
+						return nullptr;
+					}
+					return &entries[nextEntry++];
+				}) &
+				tbb::make_filter<Entry*, Entry*>(tbb::filter::parallel, [](Entry* entry)->Entry*
+				{
+					if (!entry->folder)
+						compressEntry(*entry);
+					return entry;
+				}) &
+				tbb::make_filter<Entry*, void>(tbb::filter::serial_in_order, [this](Entry* entry)
+				{
+					writeEntry(*entry);
+				}));
 		}
 
-		void ZipArchiveImpl::AddFile(const bfs::path& path, const bfs::path& archive_path)
+		void ZipArchiveImpl::listEntries(const bfs::path& path, const bfs::path& archive_path, std::vector<Entry>& entries) const
 		{
-			zip_fileinfo fileinfo;
-			fileinfo.internal_fa = 0;
-#ifdef _WIN32
-			fileinfo.external_fa = ::GetFileAttributesW(path.native().c_str());
-#else
+			Entry entry;
+			entry.path = path;
+			entry.archivePath = archive_path;
+
+			if (bfs::is_regular_file(path))
 			{
-				struct stat path_stat;
-				if (::stat(path.native().c_str(), &path_stat) == 0)
+				entry.fileinfo = getFileInfo(path);
+				entry.store = m_StoredExtensions.find(path.extension().string()) != m_StoredExtensions.end();
+				entries.push_back(entry);
+			}
+			else if (bfs::is_directory(path))
+			{
+				entry.fileinfo = getFileInfo(path);
+				entry.folder = true;
+				entries.push_back(entry);
+
+				for (bfs::directory_iterator it(path), end = bfs::directory_iterator(); it != end; ++it)
 				{
-					fileinfo.external_fa = path_stat.st_mode;
+					listEntries(it->path(), archive_path / it->path().filename(), entries);
 				}
 			}
-#endif
-			// Read the time from the filesystem and convert it
-			auto fsTime = boost::filesystem::last_write_time(path);
-			auto posixTime = boost::posix_time::from_time_t(fsTime);
-			auto tm = boost::posix_time::to_tm(posixTime);
-
-			fileinfo.tmz_date.tm_hour = tm.tm_hour;
-			fileinfo.tmz_date.tm_min = tm.tm_min;
-			fileinfo.tmz_date.tm_sec = tm.tm_sec;
-			fileinfo.tmz_date.tm_year = tm.tm_year;
-			fileinfo.tmz_date.tm_mon = tm.tm_mon;
-			fileinfo.tmz_date.tm_mday = tm.tm_mday;
+			else
+			{
+				FSN_EXCEPT(FileSystemException, "Failed to build ZipArchive: unknown filesystem item type: " + path.string());
+			}
+		}
 
-			bio::stream<bio::file_descriptor_source> input(path, std::ios::in | std::ios::binary);
+		void ZipArchiveImpl::compressEntry(Entry& entry)
+		{
+			bio::stream<bio::file_descriptor_source> input(entry.path, std::ios::in | std::ios::binary);
 			if (!input.is_open())
 			{
-				FSN_EXCEPT(FileSystemException, "Couldn't open input file to compress: " + path.string());
+				FSN_EXCEPT(FileSystemException, "Couldn't open input file to compress: " + entry.path.string());
+			}
+
+			std::vector<char> content;
+			std::array<char, 4096> buffer;
+			while (input.good())
+			{
+				input.read(buffer.data(), buffer.size());
+				content.insert(content.end(), buffer.data(), buffer.data() + input.gcount());
+			}
+
+			entry.uncompressedSize = (uLong)content.size();
+			entry.crc = crc32(0L, Z_NULL, 0);
+			if (!content.empty())
+				entry.crc = crc32(entry.crc, reinterpret_cast<const Bytef*>(content.data()), (uInt)content.size());
+
+			if (entry.store)
+			{
+				entry.data.swap(content);
+				return;
+			}
+
+			// Raw deflate (no zlib header), as minizip would write it
+			z_stream stream;
+			memset(&stream, 0, sizeof(stream));
+			if (deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			{
+				FSN_EXCEPT(FileSystemException, "Failed to initialise compression for: " + entry.path.string());
+			}
+			entry.data.resize(deflateBound(&stream, (uLong)content.size()));
+			stream.next_in = reinterpret_cast<Bytef*>(content.data());
+			stream.avail_in = (uInt)content.size();
+			stream.next_out = reinterpret_cast<Bytef*>(entry.data.data());
+			stream.avail_out = (uInt)entry.data.size();
+			const int r = deflate(&stream, Z_FINISH);
+			entry.data.resize(stream.total_out);
+			deflateEnd(&stream);
+
+			if (r != Z_STREAM_END)
+			{
+				FSN_EXCEPT(FileSystemException, "Failed to compress: " + entry.path.string());
+			}
+		}
+
+		void ZipArchiveImpl::writeEntry(Entry& entry)
+		{
+			if (entry.folder)
+			{
+				++m_Info.folderCount;
+
+				auto r = zipOpenNewFileInZip(m_File, (entry.archivePath.generic_string() + "/").c_str(),
+					&entry.fileinfo,
+					nullptr, 0,
+					nullptr, 0,
+					nullptr,
+					Z_DEFLATED,
+					Z_BEST_SPEED);
+
+				zipCloseFileInZip(m_File);
+				return;
 			}
 
-			auto r = zipOpenNewFileInZip(m_File, archive_path.generic_string().c_str(),
-				&fileinfo,
+			// The data has already been compressed (or is to be stored), so it's written raw
+			auto r = zipOpenNewFileInZip2(m_File, entry.archivePath.generic_string().c_str(),
+				&entry.fileinfo,
 				nullptr, 0,
 				nullptr, 0,
 				nullptr,
-				Z_DEFLATED,
-				Z_BEST_SPEED);
+				entry.store ? 0 : Z_DEFLATED,
+				entry.store ? 0 : Z_BEST_SPEED,
+				1);
 
 			if (r == ZIP_OK)
 			{
 				++m_Info.fileCount;
 
-				std::array<char, 4096> buffer;
-				unsigned int bytesRead = 0, fileSize = 0;
-				while (r == ZIP_OK && input.good())
-				{
-					input.read(buffer.data(), buffer.size());
-					auto gcount = input.gcount();
-					bytesRead = static_cast<unsigned int>(gcount);
-					fileSize += bytesRead;
-
-					if (gcount > 0)
-						r = zipWriteInFileInZip(m_File, buffer.data(), bytesRead);
-					else
-						break;
-				}
+				if (!entry.data.empty())
+					r = zipWriteInFileInZip(m_File, entry.data.data(), (unsigned int)entry.data.size());
+
+				m_Info.uncompressedSize += entry.uncompressedSize;
 
-				m_Info.uncompressedSize += fileSize;
+				const int closeResult = zipCloseFileInZipRaw(m_File, entry.uncompressedSize, entry.crc);
+				if (r == ZIP_OK)
+					r = closeResult;
 			}
 
-			zipCloseFileInZip(m_File);
+			// Release the data now that it's written
+			std::vector<char>().swap(entry.data);
 
 			if (r != ZIP_OK)
 			{
@@ -290,4 +385,9 @@ namespace FusionEngine { namespace IO { namespace FileType
 		m_Impl->AddPath(path, archive_path);
 	}
 
+	void ZipArchive::SetStoredExtensions(const std::set<std::string>& extensions)
+	{
+		m_Impl->SetStoredExtensions(extensions);
+	}
+
 } } }
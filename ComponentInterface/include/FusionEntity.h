@@ -345,6 +345,16 @@ namespace FusionEngine
 		void SetStreamingCellIndex(CellHandle index);
 		CellHandle GetStreamingCellIndex() const;
 
+		//! Sets the index of this entity's entry within its streaming cell (maintained by Cell)
+		void SetStreamingCellSlot(size_t slot);
+		//! Returns the index of this entity's entry within its streaming cell
+		size_t GetStreamingCellSlot() const;
+
+		//! Sets the cell this entity is waiting for while it is held in The Void (maintained by StreamingManager)
+		void SetStreamingTargetCell(CellHandle index);
+		//! Returns the cell this entity is waiting for while it is held in The Void
+		CellHandle GetStreamingTargetCell() const;
+
 		void SetPaused(bool is_paused);
 		bool IsPaused() const;
 
@@ -440,6 +450,8 @@ namespace FusionEngine
 		unsigned int m_Flags;
 
 		CellHandle m_CellIndex;
+		size_t m_CellSlot;
+		CellHandle m_TargetCellIndex;
 
 		// EntityManager domain (1-8)
 		EntityDomain m_Domain;
@@ -53,6 +53,8 @@ namespace FusionEngine
 		m_Manager(manager),
 		m_Flags(0),
 		m_CellIndex(0xFFFFFFFF, 0xFFFFFFFF),
+		m_CellSlot(~size_t(0)),
+		m_TargetCellIndex(0xFFFFFFFF, 0xFFFFFFFF),
 		m_Domain(GAME_DOMAIN),
 		m_Layer(0),
 		m_Depth(0),
@@ -560,6 +562,26 @@ namespace FusionEngine
 		return m_CellIndex;
 	}
 
+	void Entity::SetStreamingCellSlot(size_t slot)
+	{
+		m_CellSlot = slot;
+	}
+
+	size_t Entity::GetStreamingCellSlot() const
+	{
+		return m_CellSlot;
+	}
+
+	void Entity::SetStreamingTargetCell(CellHandle index)
+	{
+		m_TargetCellIndex = index;
+	}
+
+	CellHandle Entity::GetStreamingTargetCell() const
+	{
+		return m_TargetCellIndex;
+	}
+
 	void Entity::SetPaused(bool is_paused)
 	{
 		m_Paused = is_paused;
@@ -45,10 +45,13 @@
 #include <boost/signals2/connection.hpp>
 #include <ClanLib/core.h>
 #include <ClanLib/display.h>
+#include <tbb/concurrent_queue.h>
 #include <array>
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <queue>
+#include <thread>
 #include <unordered_map>
 
 namespace Gwen
@@ -255,6 +258,11 @@ namespace FusionEngine
 
 		bool m_RebuildScripts;
 		bool m_CompileMap;
+		// Compiles the map in the background, so progress can be shown (editing is paused and the map loader is stopped until it's done)
+		std::thread m_CompileThread;
+		std::atomic<bool> m_CompileFinished;
+		// Progress messages from the compile thread and its workers (they're sent to the console by Update)
+		tbb::concurrent_queue<std::string> m_CompileMessages;
 		bool m_SaveMap;
 		bool m_LoadMap;
 
@@ -212,6 +212,7 @@ namespace FusionEngine
 		m_Active(false),
 		m_RebuildScripts(false),
 		m_CompileMap(false),
+		m_CompileFinished(false),
 		m_SaveMap(false),
 		m_LoadMap(false),
 		m_ShiftSelect(false),
@@ -447,6 +448,9 @@ namespace FusionEngine
 
 	void Editor::CleanUp()
 	{
+		if (m_CompileThread.joinable())
+			m_CompileThread.join();
+
 		Deactivate();
 
 		//m_ResourceBrowser.reset();
@@ -970,6 +974,22 @@ namespace FusionEngine
 
 	void Editor::Update(float time, float dt)
 	{
+		if (m_CompileThread.joinable())
+		{
+			std::string message;
+			while (m_CompileMessages.try_pop(message))
+				SendToConsole(message);
+
+			if (!m_CompileFinished)
+				return;
+			// Pick up any message pushed between draining the queue and the compile finishing
+			m_CompileThread.join();
+			while (m_CompileMessages.try_pop(message))
+				SendToConsole(message);
+
+			m_MapLoader->Start();
+			m_StreamingManager->Update(true);
+		}
 		
 		// Bodies have to be forced to create since the simulation isn't running
 		m_Box2DWorld->InitialiseActiveComponents();
@@ -1243,6 +1263,11 @@ namespace FusionEngine
 
 	void Editor::Compile(const std::string& mapName)
 	{
+		if (m_CompileThread.joinable())
+		{
+			SendToConsole("Failed to compile map: the map is already being compiled");
+			return;
+		}
 		try
 			{
 				if (!mapName.empty() && (PHYSFS_isDirectory(mapName.c_str()) || PHYSFS_mkdir(mapName.c_str())))
@@ -1252,11 +1277,29 @@ namespace FusionEngine
 					m_MapLoader->Save(mapName);
 					m_MapLoader->Stop();
 
-					PhysVFS vfs;
-					GameMap::CompileMap(vfs, mapName, m_StreamingManager->GetCellSize(), m_MapLoader.get(), m_NonStreamedEntities, m_EntityInstantiator.get());
-
-					auto messageTitle = std::string("Success");
-					auto messageText = std::string("Compiled ") + mapName;
+					// Update shows the progress messages while this runs, and restarts the map loader when it's done
+					m_CompileFinished = false;
+					m_CompileThread = std::thread([this, mapName]()
+					{
+						try
+						{
+							PhysVFS vfs;
+							GameMap::CompileMap(vfs, mapName, m_StreamingManager->GetCellSize(), m_MapLoader.get(), m_NonStreamedEntities, m_EntityInstantiator.get(), [this](bool, const std::string& message)
+							{
+								m_CompileMessages.push(message);
+							});
+						}
+						catch (FileSystemException& e)
+						{
+							m_CompileMessages.push("Failed to compile map: " + e.GetDescription());
+						}
+						catch (Exception& e)
+						{
+							m_CompileMessages.push("Failed to compile map: " + e.GetDescription());
+						}
+						m_CompileFinished = true;
+					});
+					return;
 				}
 				else
 				{
@@ -1509,7 +1552,7 @@ namespace FusionEngine
 
 	void Editor::OnKeyDown(const clan::InputEvent& ev)
 	{
-		if (!m_Active)
+		if (!m_Active || m_CompileThread.joinable())
 			return;
 
 		if (ev.shift)
@@ -1656,7 +1699,7 @@ namespace FusionEngine
 
 	void Editor::OnKeyUp(const clan::InputEvent& ev)
 	{
-		if (!m_Active)
+		if (!m_Active || m_CompileThread.joinable())
 			return;
 		
 		m_ShiftSelect = false;
@@ -1828,7 +1871,7 @@ namespace FusionEngine
 
 	void Editor::OnMouseDown(const clan::InputEvent& ev)
 	{
-		if (m_Active)
+		if (m_Active && !m_CompileThread.joinable())
 		{
 			//[process global inputs here]
 
@@ -1864,7 +1907,7 @@ namespace FusionEngine
 
 	void Editor::OnMouseUp(const clan::InputEvent& ev)
 	{
-		if (m_Active)
+		if (m_Active && !m_CompileThread.joinable())
 		{
 			if (m_ReceivedMouseDown)
 			{
@@ -1948,7 +1991,7 @@ namespace FusionEngine
 
 	void Editor::OnMouseMove(const clan::InputEvent& ev)
 	{
-		if (m_Active)
+		if (m_Active && !m_CompileThread.joinable())
 		{
 			if (m_Tool != Tool::None)
 			{
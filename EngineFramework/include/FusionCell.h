@@ -55,17 +55,13 @@ namespace FusionEngine
 		bool pendingDeactivation;
 		float pendingDeactivationTime;
 
-		float x, y;
-
 		ObjectID id;
 		std::shared_ptr<RakNet::BitStream> data;
 
 		CellEntry()
 			: active(Inactive),
 			pendingDeactivation(false),
-			pendingDeactivationTime(0.0f),
-			x(0.0f),
-			y(0.0f)
+			pendingDeactivationTime(0.0f)
 		{}
 	};
 
@@ -84,7 +80,7 @@ namespace FusionEngine
 		void Reset()
 		{
 			inRange = false;
-			objects.clear();
+			ClearEntries();
 			loaded = false;
 			active_entries = 0;
 			waiting = Ready;
@@ -93,6 +89,8 @@ namespace FusionEngine
 	private:
 		Cell(const Cell& other)
 			: objects(other.objects),
+			positionsX(other.positionsX),
+			positionsY(other.positionsY),
 			active_entries(other.active_entries),
 			loaded(other.loaded)
 		{
@@ -101,6 +99,8 @@ namespace FusionEngine
 
 		Cell(Cell&& other)
 			: objects(std::move(other.objects)),
+			positionsX(std::move(other.positionsX)),
+			positionsY(std::move(other.positionsY)),
 			active_entries(other.active_entries),
 			loaded(other.loaded)
 		{}
@@ -108,6 +108,8 @@ namespace FusionEngine
 		Cell& operator= (const Cell& other)
 		{
 			objects = other.objects;
+			positionsX = other.positionsX;
+			positionsY = other.positionsY;
 			active_entries = other.active_entries;
 			loaded = other.loaded;
 			return *this;
@@ -116,6 +118,8 @@ namespace FusionEngine
 		Cell& operator= (Cell&& other)
 		{
 			objects = std::move(other.objects);
+			positionsX = std::move(other.positionsX);
+			positionsY = std::move(other.positionsY);
 			active_entries = other.active_entries;
 			loaded = other.loaded;
 			return *this;
@@ -128,7 +132,89 @@ namespace FusionEngine
 		typedef std::pair<EntityPtr, CellEntry> EntityEntryPair;
 		typedef std::vector<EntityEntryPair> CellEntryMap;
 		CellEntryMap objects;
+
+		//! Adds an entry for the given entity, recording its slot on the entity
+		CellEntry& AddEntry(EntityPtr entity, const Vector2& position, const CellEntry& entry = CellEntry())
+		{
+			entity->SetStreamingCellSlot(objects.size());
+			objects.push_back(std::make_pair(std::move(entity), entry));
+			positionsX.push_back(position.x);
+			positionsY.push_back(position.y);
+			return objects.back().second;
+		}
+
+		//! Returns the stored position of the entry at the given slot
+		Vector2 GetEntryPosition(size_t slot) const
+		{
+			FSN_ASSERT(slot < positionsX.size());
+			return Vector2(positionsX[slot], positionsY[slot]);
+		}
+
+		//! Updates the stored position of the entry at the given slot
+		void SetEntryPosition(size_t slot, const Vector2& position)
+		{
+			FSN_ASSERT(slot < positionsX.size());
+			positionsX[slot] = position.x;
+			positionsY[slot] = position.y;
+		}
+
+		//! Returns the entry for the given entity, or objects.end() if it isn't in this cell
+		/*!
+		* Constant time: the slot recorded on the entity is checked rather than searching the list.
+		*/
+		CellEntryMap::iterator FindEntry(const EntityPtr& entity)
+		{
+			const size_t slot = entity->GetStreamingCellSlot();
+			if (slot < objects.size() && objects[slot].first == entity)
+				return objects.begin() + slot;
+			return objects.end();
+		}
+
+		//! Removes the entry at the given slot (the last entry is moved into its place)
+		void RemoveEntry(size_t slot)
+		{
+			FSN_ASSERT(slot < objects.size());
+			if (slot + 1 != objects.size())
+			{
+				objects[slot] = std::move(objects.back());
+				objects[slot].first->SetStreamingCellSlot(slot);
+				positionsX[slot] = positionsX.back();
+				positionsY[slot] = positionsY.back();
+			}
+			objects.pop_back();
+			positionsX.pop_back();
+			positionsY.pop_back();
+		}
+
+		//! Removes the given entry, returning an iterator to the entry that replaced it
+		CellEntryMap::iterator RemoveEntry(CellEntryMap::iterator where)
+		{
+			const size_t slot = size_t(where - objects.begin());
+			RemoveEntry(slot);
+			return objects.begin() + slot;
+		}
+
+		//! Removes the entry for the given entity, if present
+		bool RemoveEntry(const EntityPtr& entity)
+		{
+			auto where = FindEntry(entity);
+			if (where == objects.end())
+				return false;
+			RemoveEntry(where);
+			return true;
+		}
+
+		//! Removes all entries
+		void ClearEntries()
+		{
+			objects.clear();
+			positionsX.clear();
+			positionsY.clear();
+		}
 #endif
+		//! Entry positions, indexed by slot (kept apart from the entries so they can be range-tested in bulk)
+		std::vector<float> positionsX, positionsY;
+
 		tbb::atomic<unsigned int> active_entries;
 		void EntryUnreferenced() { FSN_ASSERT(active_entries > 0); --active_entries; AddHist("EntryUnreferenced", active_entries); }
 		void EntryReferenced() { ++active_entries; AddHist("EntryReferenced", active_entries); }
@@ -30,6 +30,8 @@
 
 #include "FusionPrerequisites.h"
 
+#include "FusionCellCodec.h"
+
 #include <boost/iostreams/filtering_stream.hpp>
 
 #include <memory>
@@ -53,7 +55,10 @@ namespace FusionEngine
 		virtual void GetCellStreamForReading(const GotCellForReadingCallback& callback, int32_t cell_x, int32_t cell_y) = 0;
 		virtual std::unique_ptr<ArchiveOStream> GetCellStreamForWriting(int32_t cell_x, int32_t cell_y) = 0;
 
-		virtual void GetRawCellStreamForReading(const GotCellForReadingCallback& callback, int32_t cell_x, int32_t cell_y) = 0;
+		//! Passes the stored data for a cell, and the codec it was compressed with
+		typedef std::function<void (std::shared_ptr<ArchiveIStream>, CellCodec)> GotRawCellForReadingCallback;
+
+		virtual void GetRawCellStreamForReading(const GotRawCellForReadingCallback& callback, int32_t cell_x, int32_t cell_y) = 0;
 	};
 
 }
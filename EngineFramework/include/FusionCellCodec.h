@@ -0,0 +1,136 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author:
+*    Elliot Hayward
+*/
+
+#ifndef H_FusionCellCodec
+#define H_FusionCellCodec
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "FusionPrerequisites.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace FusionEngine
+{
+
+	//! Compression applied to stored cell data (the value is written in each cell header)
+	/*!
+	* LZ4 and zstd support is compiled in when FSN_USE_LZ4 / FSN_USE_ZSTD are
+	* defined (set FusionUseLZ4 / FusionUseZstd in CommonProperties.props). zlib
+	* is always available, and is what data written before codecs were tagged is
+	* read as.
+	*/
+	enum class CellCodec : uint8_t
+	{
+		Zlib = 0,
+		//! Fastest to decompress: for caches that are written and read while the game runs
+		LZ4 = 1,
+		//! Best ratio (especially with a dictionary): for compiled / shipped maps
+		Zstd = 2
+	};
+
+	//! Returns the name of the given codec (for logs / config)
+	std::string CellCodecToString(CellCodec codec);
+	//! Parses a codec name ("zlib", "lz4", "zstd"); returns zlib for unrecognised names
+	CellCodec CellCodecFromString(const std::string& name);
+
+	//! Returns true if the given codec was compiled in
+	bool IsCellCodecAvailable(CellCodec codec);
+
+	//! Returns the given codec, or zlib if the given codec isn't available
+	CellCodec GetAvailableCellCodec(CellCodec preferred);
+
+	//! Compression dictionary, trained on a set of sample cells (zstd only)
+	/*!
+	* Cells are small, so most of what a general-purpose compressor would learn
+	* from a cell (component type names, common property values) has to be
+	* relearned for each one. A dictionary trained on a map's cells primes the
+	* compressor with that, which greatly improves the ratio for small cells.
+	* The same dictionary must be used to decompress.
+	*/
+	class CellCodecDictionary
+	{
+	public:
+		//! Creates a dictionary from trained data (e.g. previously saved with GetData())
+		explicit CellCodecDictionary(std::vector<char> data);
+		//! Destructor
+		~CellCodecDictionary();
+
+		//! Trains a dictionary on the given samples
+		/*!
+		* \return null if there weren't enough samples (or zstd isn't available)
+		*/
+		static std::shared_ptr<CellCodecDictionary> Train(const std::vector<std::vector<char>>& samples, size_t max_size = 64 * 1024);
+
+		//! Returns the dictionary data (to be saved alongside the data it was trained on)
+		const std::vector<char>& GetData() const { return m_Data; }
+
+		//! Returns the ID zstd stores in frames compressed with this dictionary
+		uint32_t GetID() const { return m_ID; }
+
+	private:
+		friend class CellCodecs;
+
+		std::vector<char> m_Data;
+		uint32_t m_ID;
+
+		// Digested versions of the dictionary, created on first use
+		struct impl;
+		std::unique_ptr<impl> m_Impl;
+
+		CellCodecDictionary(const CellCodecDictionary&);
+		CellCodecDictionary& operator=(const CellCodecDictionary&);
+	};
+
+	//! Compresses / decompresses cell data
+	/*!
+	* Working state (compression contexts and the like) is kept per-thread and
+	* reused, so these can be called concurrently.
+	*/
+	class CellCodecs
+	{
+	public:
+		//! Compresses the given data, replacing the contents of out
+		/*!
+		* \param dictionary
+		* Optional; only used by zstd
+		*/
+		static void Compress(CellCodec codec, const char* data, size_t length, std::vector<char>& out, const CellCodecDictionary* dictionary = nullptr);
+
+		//! Decompresses the given data, replacing the contents of out
+		/*!
+		* \return False if the data is corrupt, or needs a dictionary that wasn't given
+		*/
+		static bool Decompress(CellCodec codec, const char* data, size_t length, std::vector<char>& out, const CellCodecDictionary* dictionary = nullptr);
+	};
+
+}
+
+#endif
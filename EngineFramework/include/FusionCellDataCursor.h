@@ -0,0 +1,211 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author:
+*    Elliot Hayward
+*/
+
+#ifndef H_FusionCellDataCursor
+#define H_FusionCellDataCursor
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "FusionPrerequisites.h"
+
+#include "FusionCellCodec.h"
+
+#include <ClanLib/core.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace FusionEngine
+{
+
+	//! Reads serialised values straight out of a contiguous buffer
+	/*!
+	* The in-memory counterpart of IO::Streams::CellStreamReader (same interface and
+	* encoding), for when the whole cell is already in memory: reads are a bounds
+	* check and a memcpy rather than a chain of virtual stream calls, and
+	* ReadBytes() returns a pointer into the buffer instead of copying.
+	*
+	* The cursor doesn't own the data.
+	*/
+	class CellDataCursor
+	{
+	public:
+		//! Empty cursor
+		CellDataCursor()
+			: m_Begin(nullptr),
+			m_Position(nullptr),
+			m_End(nullptr),
+			m_LittleEndian(!clan::Endian::is_system_big())
+		{}
+
+		//! Cursor over the given data
+		CellDataCursor(const char* data, size_t length)
+			: m_Begin(data),
+			m_Position(data),
+			m_End(data + length),
+			m_LittleEndian(!clan::Endian::is_system_big())
+		{}
+
+		template <typename T>
+		bool Read(T& out)
+		{
+			if (GetRemaining() >= sizeof(out))
+			{
+				std::memcpy(&out, m_Position, sizeof(out));
+				m_Position += sizeof(out);
+				if (m_LittleEndian == clan::Endian::is_system_big())
+				{
+					clan::Endian::swap(&out, sizeof(out));
+				}
+				return true;
+			}
+			else
+				return false;
+		}
+
+		template <typename T>
+		T ReadValue()
+		{
+			static_assert(std::is_fundamental<T>::value, "Must actually be a basic type");
+			T value;
+			if (Read(value))
+				return value;
+			else
+				return T(0);
+		}
+
+		std::string ReadString()
+		{
+			std::string::size_type length = 0;
+			Read(length);
+			if (length > 0)
+			{
+				if (auto data = ReadBytes(length))
+					return std::string(data, length);
+			}
+			return std::string();
+		}
+
+		//! Returns a pointer to the next length bytes and skips past them
+		/*!
+		* \return nullptr if there are fewer than length bytes remaining
+		*/
+		const char* ReadBytes(size_t length)
+		{
+			if (GetRemaining() >= length)
+			{
+				const char* data = m_Position;
+				m_Position += length;
+				return data;
+			}
+			else
+				return nullptr;
+		}
+
+		//! Skips the given number of bytes (returns false if there aren't that many remaining)
+		bool Skip(size_t length) { return ReadBytes(length) != nullptr; }
+
+		//! Moves the cursor to the given offset from the beginning of the data
+		/*!
+		* \return False if the offset is past the end of the data (the cursor isn't moved)
+		*/
+		bool Seek(size_t offset)
+		{
+			if (offset <= (size_t)(m_End - m_Begin))
+			{
+				m_Position = m_Begin + offset;
+				return true;
+			}
+			else
+				return false;
+		}
+
+		//! Returns the offset of the cursor from the beginning of the data
+		size_t Tell() const { return (size_t)(m_Position - m_Begin); }
+		//! Returns the number of bytes after the cursor
+		size_t GetRemaining() const { return (size_t)(m_End - m_Position); }
+		//! Returns true if the cursor has reached the end of the data
+		bool AtEnd() const { return m_Position == m_End; }
+
+	protected:
+		//! Points the cursor at the beginning of the given data
+		void reset(const char* data, size_t length)
+		{
+			m_Begin = m_Position = data;
+			m_End = data + length;
+		}
+
+	private:
+		const char* m_Begin;
+		const char* m_Position;
+		const char* m_End;
+		bool m_LittleEndian;
+	};
+
+	//! Decompressed cell data, with a cursor over it
+	/*!
+	* The buffer is borrowed from a per-thread pool and handed back when this is
+	* destroyed, so loading a stream of cells doesn't allocate once the pool has
+	* warmed up.
+	*/
+	class CellData : public CellDataCursor
+	{
+	public:
+		//! Constructor
+		CellData();
+		//! Destructor
+		~CellData();
+
+		//! Returns the buffer for the data to be written to (call Rewind() when done)
+		std::vector<char>& GetBuffer() { return m_Buffer; }
+
+		//! Points the cursor at the beginning of the buffer
+		void Rewind() { reset(m_Buffer.data(), m_Buffer.size()); }
+
+		//! Decompresses data into this buffer (and rewinds)
+		/*!
+		* \return False if the data is corrupt / truncated
+		*/
+		bool Decompress(CellCodec codec, const char* data, size_t length, const CellCodecDictionary* dictionary = nullptr);
+		//! Decompresses zlib data into this buffer (and rewinds)
+		bool Inflate(const char* data, size_t length) { return Decompress(CellCodec::Zlib, data, length); }
+
+		//! Copies uncompressed data into this buffer (and rewinds)
+		void Assign(const char* data, size_t length);
+
+	private:
+		std::vector<char> m_Buffer;
+
+		CellData(const CellData&);
+		CellData& operator=(const CellData&);
+	};
+
+}
+
+#endif
@@ -30,6 +30,8 @@
 
 #include "FusionPrerequisites.h"
 
+#include <boost/signals2.hpp>
+
 namespace FusionEngine
 {
 
@@ -44,6 +46,21 @@ namespace FusionEngine
 
 		virtual void Store(int32_t x, int32_t y, std::shared_ptr<Cell> cell) = 0;
 		virtual std::shared_ptr<Cell> Retrieve(int32_t x, int32_t y) = 0;
+		//! Retrieves the given cell ahead of time, at low priority
+		/*!
+		* Prefetched cells are loaded after outstanding Retrieve requests, sooner
+		* time_of_need first. Calling Prefetch again for a cell that hasn't started
+		* loading re-prioritises it, calling Retrieve promotes it to a normal request,
+		* and calling Store or CancelPrefetch cancels it.
+		*/
+		virtual std::shared_ptr<Cell> Prefetch(int32_t x, int32_t y, float time_of_need) { return Retrieve(x, y); }
+		//! Cancels a prefetch request that hasn't started loading
+		/*!
+		* Unlike Store, nothing is written.
+		*
+		* \return False if the cell has started loading (or wasn't prefetched), in which case it is left to finish
+		*/
+		virtual bool CancelPrefetch(int32_t x, int32_t y) { return false; }
 
 		//! Update location and data (inactive cells)
 		virtual void Update(ObjectID id, int32_t new_x, int32_t new_y, unsigned char* continuous, size_t con_length, unsigned char* occasional_begin, size_t occ_length) = 0;
@@ -58,6 +75,12 @@ namespace FusionEngine
 		virtual void UpdateActiveEntityLocation(ObjectID id, const Vector2T<int32_t>& location) = 0;
 		//! Get the cell coord of an active entity
 		virtual bool GetActiveEntityLocation(ObjectID id, Vector2T<int32_t>& location) = 0;
+
+		//! Fired when a retrieved cell has finished loading (or failed to load)
+		/*!
+		* This may be fired from the archiver's worker thread.
+		*/
+		boost::signals2::signal<void (int32_t, int32_t)> SignalCellLoaded;
 	};
 
 }
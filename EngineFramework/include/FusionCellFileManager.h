@@ -30,6 +30,7 @@
 
 #include "FusionPrerequisites.h"
 
+#include <functional>
 #include <string>
 
 namespace FusionEngine
@@ -43,7 +44,13 @@ namespace FusionEngine
 		//! Copies the entity database to the given path
 		virtual void CopyDatabase(const std::string& dest_path) = 0;
 		//! Copies cell data files to the given path
-		virtual void CopyCellFiles(const std::string& dest_path) = 0;
+		/*!
+		* \param progress
+		* Called with the number of files copied so far and the total (may be called
+		* from worker threads, if the files are processed in parallel, but not
+		* concurrently: the counts are in order)
+		*/
+		virtual void CopyCellFiles(const std::string& dest_path, const std::function<void (size_t, size_t)>& progress) = 0;
 	};
 
 }
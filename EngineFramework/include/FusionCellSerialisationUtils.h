@@ -36,6 +36,7 @@
 
 #include "FusionEntitySerialisationUtils.h"
 #include "FusionCell.h"
+#include "FusionCellDataCursor.h"
 #include "FusionCellStreamTypes.h"
 #include "FusionTypes.h"
 
@@ -48,9 +49,103 @@ namespace FusionEngine
 
 	namespace CellSerialisationUtils
 	{
+		//! Synched-entity data that is found through a table of slots
+		/*!
+		* Each entity's data is found through its slot, so an entity can grow, shrink or be
+		* removed without moving the data of the other entities in the cell: their slot
+		* indices (which are what the entity location DB records) stay the same. The space
+		* this leaves unused is reclaimed by Compact(), which also keeps slot indices.
+		*
+		* Serialised as: [size_t marker][uint32 slot count][slots: ObjectID id, uint32 offset, uint32 length]
+		*  [uint32 payload length][payload]. Slots with id 0 are free. The marker can't be
+		*  mistaken for the entity count that the un-slotted format starts with.
+		*/
+		class EntitySlotTable
+		{
+		public:
+			struct Slot
+			{
+				ObjectID id;
+				uint32_t offset; // Relative to the start of the payload
+				uint32_t length;
+
+				Slot() : id(0), offset(0), length(0) {}
+				Slot(ObjectID id_, uint32_t offset_, uint32_t length_) : id(id_), offset(offset_), length(length_) {}
+			};
+
+			static const size_t s_Marker = ~size_t(0);
+			static const size_t s_NoSlot = ~size_t(0);
+
+			EntitySlotTable();
+
+			//! Reads a slot table & payload from the given data
+			/*!
+			* \return False if the data isn't a valid slot table
+			*/
+			bool Read(CellDataCursor& data);
+			//! Writes the slot table & payload
+			void Write(std::ostream& out) const;
+
+			//! Returns true if the data at the cursor is a slot table (the cursor isn't moved)
+			static bool IsSlotTable(const CellDataCursor& data);
+
+			//! Replaces the contents with the given slots & payload
+			void Assign(std::vector<Slot> slots, std::vector<char> payload);
+
+			//! Returns the slot holding the given entity, or s_NoSlot
+			/*!
+			* \param hint
+			* The slot that the entity is expected to be in (e.g. from the entity location DB)
+			*/
+			size_t Find(ObjectID id, size_t hint = s_NoSlot) const;
+			//! Stores data for the given entity, returning its slot
+			/*!
+			* The data is overwritten in place if it fits in the entity's current slot,
+			* otherwise it is appended to the payload. New entities reuse free slots.
+			*/
+			size_t Put(ObjectID id, const char* data, size_t length, size_t hint = s_NoSlot);
+			//! Frees the slot holding the given entity (returns false if it wasn't found)
+			bool Remove(ObjectID id, size_t hint = s_NoSlot);
+
+			const Slot& GetSlot(size_t slot) const { return m_Slots[slot]; }
+			const char* GetData(size_t slot) const { return m_Payload.data() + m_Slots[slot].offset; }
+
+			size_t GetNumSlots() const { return m_Slots.size(); }
+			size_t GetNumEntities() const { return m_NumEntities; }
+
+			size_t GetPayloadLength() const { return m_Payload.size(); }
+			//! Returns the number of payload bytes that aren't referenced by any slot
+			size_t GetUnusedLength() const { return m_Payload.size() - m_UsedLength; }
+
+			//! Returns true if enough of the payload is unused that it is worth compacting
+			bool NeedsCompaction() const;
+			//! Packs the payload (slots keep their indices; free slots at the end are dropped)
+			void Compact();
+
+		private:
+			std::vector<Slot> m_Slots;
+			std::vector<char> m_Payload;
+			size_t m_NumEntities;
+			size_t m_UsedLength;
+		};
+
+		//! Writes the given entities
+		/*!
+		* Synched entities are written as an EntitySlotTable.
+		*
+		* \return The ID, slot index and data length of each synched entity written
+		*/
 		std::vector<std::tuple<ObjectID, std::streamoff, std::streamsize>> WriteCellData(std::ostream& file_param, const Cell::CellEntryMap& entities, const bool synched, const EntitySerialisationUtils::SerialisedDataStyle data_style);
 
 		std::pair<size_t, std::vector<ObjectID>> ReadCellIntro(const CellCoord_t& coord, ICellStream& file, const bool data_includes_ids, const EntitySerialisationUtils::SerialisedDataStyle data_style);
+		//! Reads the number of entities and (optionally) their IDs
+		/*!
+		* \param entity_offsets
+		* Set to the offset of each entity's data if the entities were written as an
+		* EntitySlotTable (the cursor has to be moved to each offset before reading the
+		* entity), otherwise cleared (the entity data follows the intro in order).
+		*/
+		std::pair<size_t, std::vector<ObjectID>> ReadCellIntro(const CellCoord_t& coord, CellDataCursor& data, const bool data_includes_ids, const EntitySerialisationUtils::SerialisedDataStyle data_style, std::vector<size_t>* entity_offsets = nullptr);
 	}
 
 }
@@ -0,0 +1,172 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author(s):
+*
+*    Elliot Hayward
+*/
+
+#ifndef H_FusionEntityLocationIndex
+#define H_FusionEntityLocationIndex
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "FusionPrerequisites.h"
+
+#include "FusionTypes.h"
+#include "FusionVector2.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <tbb/spin_rw_mutex.h>
+
+namespace FusionEngine
+{
+
+	//! Stores the locations of inactive (stored) entities
+	/*!
+	* Lookups and updates are done on an in-memory open-addressed table. Every
+	* change is also appended to a log next to the snapshot file, and the log is
+	* folded into a new snapshot by Checkpoint() (when it gets long, and on
+	* Close()), so each change costs a buffered write rather than a database
+	* round trip.
+	*
+	* Snapshots are Kyoto Cabinet hash DBs in the same layout that the entity
+	* location DB has always used, so saves and compiled maps are unchanged.
+	*/
+	class EntityLocationIndex
+	{
+	public:
+		typedef Vector2T<int32_t> CellCoord_t;
+
+		//! Where an entity's data is stored
+		struct Location
+		{
+			CellCoord_t cell;
+			std::streamoff offset; // Slot index within the cell (see CellSerialisationUtils::EntitySlotTable)
+			std::streamsize length;
+
+			Location() : offset(0), length(0) {}
+			Location(const CellCoord_t& cell_, std::streamoff offset_, std::streamsize length_)
+				: cell(cell_), offset(offset_), length(length_)
+			{}
+		};
+
+		//! CTOR
+		EntityLocationIndex();
+		//! DTOR (closes the index)
+		~EntityLocationIndex();
+
+		//! Loads the given snapshot, replaying any log left next to it
+		/*!
+		* Changes made after this are logged next to the snapshot.
+		*
+		* \param truncate
+		* Start empty (deletes any existing snapshot & log at the path)
+		*/
+		void Open(const std::string& snapshot_path, bool truncate = false);
+		//! Writes a snapshot and stops logging
+		/*!
+		* \param checkpoint
+		* Pass false to discard the changes made since the last checkpoint (along
+		* with the log) instead, e.g. when the snapshot is about to be replaced.
+		*/
+		void Close(bool checkpoint = true);
+
+		bool IsOpen() const { return !m_Path.empty(); }
+		const std::string& GetPath() const { return m_Path; }
+
+		//! Gets the location of the given entity (returns false if it isn't stored)
+		bool Get(ObjectID id, Location& location) const;
+		//! Sets the location of the given entity
+		void Store(ObjectID id, const Location& location);
+		//! Removes the given entity (returns false if it wasn't stored)
+		bool Remove(ObjectID id);
+
+		//! Returns the number of stored entities
+		size_t GetSize() const;
+
+		//! Writes all the stored locations to the given file (in the snapshot format)
+		void SaveSnapshot(const std::string& path) const;
+
+		typedef std::vector<std::pair<ObjectID, Location>> Entries_t;
+		//! Returns a copy of all the stored locations
+		/*!
+		* This is quick (it's all in memory), so it can be taken while other threads
+		* wait, and written with WriteSnapshot afterwards.
+		*/
+		Entries_t GetEntries() const;
+		//! Writes the given locations to the given file (in the snapshot format)
+		static void WriteSnapshot(const std::string& path, const Entries_t& entries);
+
+		//! Returns true if the log has grown long enough that Checkpoint() should be called
+		bool NeedsCheckpoint() const;
+		//! Folds the log into a new snapshot
+		void Checkpoint();
+
+		//! Writes buffered log entries to disk
+		void FlushLog();
+
+	private:
+		enum SlotState : uint8_t { Empty, Occupied, Removed };
+		struct Slot
+		{
+			ObjectID id;
+			SlotState state;
+			Location location;
+
+			Slot() : id(0), state(Empty) {}
+		};
+
+		typedef tbb::spin_rw_mutex Mutex_t;
+		mutable Mutex_t m_Mutex;
+
+		std::vector<Slot> m_Slots; // Size is always a power of two
+		size_t m_Count;
+		size_t m_RemovedCount;
+
+		std::string m_Path;
+		std::ofstream m_Log;
+		size_t m_LogRecords;
+
+		size_t findSlot(ObjectID id) const;
+		void set(ObjectID id, const Location& location);
+		bool erase(ObjectID id);
+		void rehash(size_t min_capacity);
+
+		void appendToLog(uint8_t op, ObjectID id, const Location& location);
+		void replayLog(const std::string& path);
+		void loadSnapshot(const std::string& path);
+
+		Entries_t getEntries() const;
+
+		EntityLocationIndex(const EntityLocationIndex&);
+		EntityLocationIndex& operator=(const EntityLocationIndex&);
+	};
+
+}
+
+#endif
@@ -44,18 +44,23 @@
 #include "FusionInputHandler.h"
 #include "FusionPacketHandler.h"
 #include "FusionPlayerInput.h"
+#include "FusionSpatialIndex.h"
 #include "FusionStreamingManager.h"
 #include "FusionTypes.h"
 #include "FusionViewport.h"
 
 #include <tbb/spin_rw_mutex.h>
 #include <tbb/recursive_mutex.h>
+#include <tbb/tick_count.h>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index/member.hpp>
 
+#include <deque>
+#include <unordered_set>
+
 namespace FusionEngine
 {
 
@@ -178,6 +183,10 @@ namespace FusionEngine
 
 		void QueryRect(const std::function<bool (const EntityPtr&)>& fn, const Vector2& lb, const Vector2& ub) const;
 
+		//! Returns the index of active entity positions (for radius, nearest and segment queries)
+		SpatialIndex& GetSpatialIndex() { return m_SpatialIndex; }
+		const SpatialIndex& GetSpatialIndex() const { return m_SpatialIndex; }
+
 		std::vector<EntityPtr> GetNonStreamedEntities() const;
 		// Hack for loading maps in the editor
 		std::vector<EntityPtr> GetLastLoadedNonStreamedEntities() const;
@@ -210,8 +219,40 @@ namespace FusionEngine
 		//! Removes all entities in the given domain
 		void ClearDomain(EntityDomain domain_index);
 
+		//! Activates / deactivates queued entities, nearest-to-a-camera first
+		/*!
+		* Stops once the activation budget or the given time limit (in seconds),
+		* whichever is smaller, has been used.
+		*/
 		void ProcessActivationQueues(float time_limit = std::numeric_limits<float>::infinity());
 
+		//! Sets the time (in microseconds) ProcessActivationQueues may spend per frame activating and deactivating entities
+		void SetActivationBudget(unsigned int microseconds) { m_ActivationBudget = microseconds; }
+		unsigned int GetActivationBudget() const { return m_ActivationBudget; }
+
+		//! Activation queue counters, updated by ProcessActivationQueues
+		struct ActivationQueueStats
+		{
+			//! Entities waiting to be activated
+			size_t activationBacklog;
+			//! Entities waiting to be deactivated / dropped
+			size_t deactivationBacklog;
+			//! Entities activated / deactivated during the last call
+			size_t activated;
+			size_t deactivated;
+			//! Time (in seconds) the entities activated during the last call spent in the queue
+			float meanWaitTime;
+			float maxWaitTime;
+			//! Time (in seconds) the oldest entity still in the queue has been waiting
+			float oldestWaitTime;
+
+			ActivationQueueStats()
+				: activationBacklog(0), deactivationBacklog(0), activated(0), deactivated(0),
+				meanWaitTime(0.0f), maxWaitTime(0.0f), oldestWaitTime(0.0f)
+			{}
+		};
+		const ActivationQueueStats& GetActivationQueueStats() const { return m_ActivationQueueStats; }
+
 		void ProcessActiveEntities(float split);
 
 		void UpdateActiveRegions();
@@ -330,11 +371,37 @@ namespace FusionEngine
 
 		std::vector<std::pair<EntityPtr, ComponentPtr>> m_ComponentsToActivate;
 		std::vector<ComponentPtr> m_ComponentsToDeactivate;
-		std::vector<EntityPtr> m_EntitiesToActivate;
-		std::vector<EntityPtr> m_EntitiesUnreferenced;
-		std::vector<EntityPtr> m_EntitiesToDeactivate;
+		//! An entity waiting to be activated
+		struct PendingActivation
+		{
+			EntityPtr entity;
+			//! Squared distance to the nearest streaming camera (lower is activated sooner)
+			float priority;
+			//! Queue order, so entities at the same distance are activated first-come-first-served
+			uint64_t sequence;
+			tbb::tick_count timeQueued;
+
+			//! Heap ordering: true if this should be activated after the other
+			bool operator< (const PendingActivation& other) const
+			{
+				return priority > other.priority || (priority == other.priority && sequence > other.sequence);
+			}
+		};
+		//! Binary heap (re-prioritised every time the queues are processed)
+		std::vector<PendingActivation> m_EntitiesToActivate;
+		uint64_t m_NextActivationSequence;
+		//! Entities to drop (and deactivate, if they are active), in the order they became unreferenced
+		std::deque<EntityPtr> m_EntitiesUnreferenced;
+		//! The entities in m_EntitiesUnreferenced that are still to be dropped (removed if they are re-activated first)
+		std::unordered_set<Entity*> m_PendingUnreferenced;
+
+		unsigned int m_ActivationBudget;
+		ActivationQueueStats m_ActivationQueueStats;
+		std::vector<Vector2> m_StreamPositions;
 		tbb::concurrent_queue<EntityPtr> m_EntitiesToRemove;
 		EntityArray m_ActiveEntities;
+		//! Positions of m_ActiveEntities (updated along with them)
+		SpatialIndex m_SpatialIndex;
 
 		std::vector<EntityPtr> m_LoadedNonStreamedEntities;
 
@@ -38,6 +38,7 @@
 #include <ClanLib/core.h>
 
 #include "FusionEntityComponent.h"
+#include "FusionCellDataCursor.h"
 #include "FusionCellStreamTypes.h"
 
 namespace RakNet
@@ -82,6 +83,7 @@ namespace FusionEngine
 
 		void WriteComponent(OCellStream& outstr, EntityComponent* component, SerialisedDataStyle data_style);
 		void ReadComponent(ICellStream& instr, EntityComponent* component, SerialisedDataStyle data_style);
+		void ReadComponent(CellDataCursor& in, EntityComponent* component, SerialisedDataStyle data_style);
 
 		//! Merge inactive entity data
 		std::streamsize MergeEntityData(ICellStream& in, OCellStream& out, RakNet::BitStream& incomming, RakNet::BitStream& incomming_occasional);
@@ -98,6 +100,7 @@ namespace FusionEngine
 			//! Waits for the value to be available, then returns it
 			virtual EntityPtr get_entity() = 0;
 
+			//! Returns the stream the entity was loaded from (null if it was loaded from a CellDataCursor)
 			virtual std::shared_ptr<ICellStream> get_file() = 0;
 
 			virtual std::pair<EntityPtr, std::shared_ptr<ICellStream>> get() = 0;
@@ -110,6 +113,8 @@ namespace FusionEngine
 		void SaveEntity(OCellStream& out, EntityPtr entity, bool id_included, SerialisedDataStyle data_style);
 		//! Load an entity... eventually (checks for archetypes)
 		std::shared_ptr<EntityFuture> LoadEntity(std::shared_ptr<ICellStream>&& in, bool id_included, ObjectID override_id, SerialisedDataStyle data_style, ComponentFactory* factory, EntityManager* manager, EntityInstantiator* synchroniser);
+		//! Load an entity from in-memory cell data (the cursor is left at the end of the entity, or kept by the future until the archetype is loaded)
+		std::shared_ptr<EntityFuture> LoadEntity(const std::shared_ptr<CellDataCursor>& in, bool id_included, ObjectID override_id, SerialisedDataStyle data_style, ComponentFactory* factory, EntityManager* manager, EntityInstantiator* synchroniser);
 		//! Load an entity RIGHT NOW
 		std::pair<EntityPtr, std::shared_ptr<ICellStream>> LoadEntityImmeadiate(std::shared_ptr<ICellStream>&& in, bool id_included, ObjectID override_id, SerialisedDataStyle data_style, ComponentFactory* factory, EntityManager* manager, EntityInstantiator* synchroniser);
 		
@@ -73,7 +73,14 @@ namespace FusionEngine
 		//! Loads entities that aren't managed by the cell archiver
 		void LoadNonStreamingEntities(bool include_synched, EntityManager* entityManager, ComponentFactory* factory, ArchetypeFactory* archetype_factory, EntityInstantiator* instantiator);
 
-		static void CompileMap(const VirtualFilesystem& vfs, const std::string& map_name, float cell_size, CellFileManager* cache, const std::vector<EntityPtr>& nonStreamingEntities, EntityInstantiator* instantiator);
+		//! Writes the map files (region files are recompressed in parallel)
+		/*!
+		* \param progress_notification
+		* Called with (done, message) as the compilation progresses, possibly from worker threads
+		* (one at a time). Messages should be passed to the main thread to be shown, e.g. by
+		* wrapping a ProgressDisplay generator, which queues them.
+		*/
+		static void CompileMap(const VirtualFilesystem& vfs, const std::string& map_name, float cell_size, CellFileManager* cache, const std::vector<EntityPtr>& nonStreamingEntities, EntityInstantiator* instantiator, const std::function<void (bool, const std::string&)>& progress_notification);
 
 		std::string GetName() const { return m_Name; }
 
@@ -87,6 +94,11 @@ namespace FusionEngine
 
 		std::string GetEntityDatabasePath() const { return GetPath() + "/" + entityDatabaseFilename; }
 
+		//! Returns the path of the dictionary the map's cells were compressed with (may not exist)
+		std::string GetCellDictionaryPath() const { return GetPath() + "/" + cellDictionaryFilename; }
+
+		static const std::string cellDictionaryFilename;
+
 		float GetCellSize() const;
 
 	private:
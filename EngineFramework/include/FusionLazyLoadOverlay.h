@@ -0,0 +1,110 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author(s):
+*
+*    Elliot Hayward
+*/
+
+#ifndef H_FusionLazyLoadOverlay
+#define H_FusionLazyLoadOverlay
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "FusionPrerequisites.h"
+
+#include "FusionRegionCellCache.h"
+
+#include <atomic>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <tbb/concurrent_hash_map.h>
+
+namespace FusionEngine
+{
+
+	//! Provides the region files from a chain of saves that are being loaded lazily
+	/*!
+	* Each region file is copied into the cache the first time it is faulted in:
+	* the saves are applied in order (starting with the one the others are
+	* based on), each either replacing the file or writing a delta over it.
+	*
+	* \see RegionCellArchivist::SetLazyLoading
+	*/
+	class LazyLoadOverlay : public RegionCacheOverlay
+	{
+	public:
+		//! Opens the given file (relative to the save's root) in the save with the given index, or returns null if it isn't in that save
+		typedef std::function<std::unique_ptr<std::istream> (size_t save_index, const std::string& relative_path)> OpenSaveFileFn_t;
+
+		//! CTOR
+		/*!
+		* \param num_saves
+		* The number of saves in the chain (open_file is called with indices below this)
+		*
+		* \param open_file
+		* Used to read files from the saves
+		*
+		* \param filenames
+		* The region files that are in any of the saves (see GetRegionFilename)
+		*
+		* \param sub_path
+		* The folder in each save that the region files are in
+		*
+		* \param cache_path
+		* The folder to copy the region files to
+		*/
+		LazyLoadOverlay(size_t num_saves, const OpenSaveFileFn_t& open_file, const std::vector<std::string>& filenames, const std::string& sub_path, const std::string& cache_path);
+
+		//! Returns the name of the region file that the given file in a save is for ("0.0.celldelta" gives "0.0.celldata"), or an empty string if it isn't one
+		static std::string GetRegionFilename(const std::string& filename);
+
+		bool Provides(const std::string& filename) const;
+
+		void FaultIn(const std::string& filename);
+
+		std::vector<std::string> GetFilenames() const;
+
+		//! Copies every region file that hasn't been copied yet (unless cancel is set)
+		void FaultInAll(const std::atomic<bool>& cancel);
+
+	private:
+		size_t m_NumSaves;
+		OpenSaveFileFn_t m_OpenSaveFile;
+		std::string m_SubPath;
+		std::string m_CachePath;
+
+		std::vector<std::string> m_Filenames;
+		// Whether each region file has been copied into the cache
+		typedef tbb::concurrent_hash_map<std::string, bool> Copied_t;
+		Copied_t m_Copied;
+	};
+
+}
+
+#endif
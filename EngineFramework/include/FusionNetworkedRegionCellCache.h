@@ -68,7 +68,7 @@ namespace FusionEngine
 
 		virtual void HandlePacket(RakNet::Packet* packet);
 
-		void OnGotCellStreamForSending(std::shared_ptr<std::istream> cellDataStream, RakNet::RakNetGUID send_to, CellCoord_t coord);
+		void OnGotCellStreamForSending(std::shared_ptr<std::istream> cellDataStream, CellCodec codec, RakNet::RakNetGUID send_to, CellCoord_t coord);
 
 	private:
 		std::shared_ptr<PacketHandler> m_MapCellPacketHandler;
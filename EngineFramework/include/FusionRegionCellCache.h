@@ -44,13 +44,17 @@
 #include <array>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <ClanLib/Core/Math/rect.h>
 
 #include <boost/dynamic_bitset.hpp>
 
+#include <tbb/atomic.h>
 #include <tbb/recursive_mutex.h>
+#include <tbb/spin_mutex.h>
 #include "tbb/concurrent_hash_map.h"
 #include "tbb/concurrent_unordered_map.h"
 
@@ -58,6 +62,28 @@ namespace FusionEngine
 {
 
 	class RegionFileLoadedCallbackHandle;
+	class RegionSnapshot;
+
+	//! Source of region files that haven't been copied into a cache yet
+	/*!
+	* \see RegionCellCache::SetOverlay
+	*/
+	class RegionCacheOverlay
+	{
+	public:
+		virtual ~RegionCacheOverlay() {}
+
+		//! Returns true if the given region file (e.g. "0.0.celldata") comes from this overlay
+		virtual bool Provides(const std::string& filename) const = 0;
+		//! Copies the given region file into the cache, if it comes from this overlay and hasn't been copied already
+		/*!
+		* Called from any thread: returns once the file is in the cache, even if it
+		* was being copied on another thread.
+		*/
+		virtual void FaultIn(const std::string& filename) = 0;
+		//! Returns the names of all the region files that come from this overlay
+		virtual std::vector<std::string> GetFilenames() const = 0;
+	};
 
 	//! Region-file based cell data source
 	class RegionCellCache : public CellDataSource
@@ -72,8 +98,11 @@ namespace FusionEngine
 		*
 		* \param cells_per_region_square
 		* Width & height in number of cells per region file, i.e. 16 makes 16x16 region files.
+		*
+		* \param memory_mapped
+		* Memory-map writable region files (see RegionFile) rather than loading them fully.
 		*/
-		RegionCellCache(const std::string& cache_path, int32_t cells_per_region_square = 16, bool readonly = false);
+		RegionCellCache(const std::string& cache_path, int32_t cells_per_region_square = 16, bool readonly = false, bool memory_mapped = true);
 
 		//! Set the path from which the cache files should be loaded
 		void SetPath(const std::string& new_path);
@@ -84,6 +113,44 @@ namespace FusionEngine
 		//! Write cache data from loaded regions to disk (unlike DropCache, keeps them loaded)
 		void FlushCache();
 
+		//! Takes a copy-on-write snapshot of the region files in this cache
+		/*!
+		* The cache is flushed, then the returned snapshot can be written to dest_path
+		* (by RegionSnapshot::WriteNext, on any thread) while the cache keeps being
+		* used. Call EndSnapshot once it has been written.
+		*
+		* If incremental is set, only the region files that have changed since the
+		* last save (the last snapshot, or MarkSaved) are written: as deltas, unless
+		* they didn't exist at the time of the last save. Either way, changes are
+		* tracked from when this snapshot is taken.
+		*
+		* Region files that are still to come from the overlay are part of the
+		* snapshot: for full snapshots, they have to be faulted in before it is
+		* written (see RegionCacheOverlay::FaultIn).
+		*/
+		std::shared_ptr<RegionSnapshot> BeginSnapshot(const std::string& dest_path, bool incremental = false);
+		//! Stops preserving region files for the current snapshot
+		void EndSnapshot();
+
+		//! Marks the region files as they are now as saved, e.g. after a save has been loaded (see BeginSnapshot)
+		/*!
+		* Region files that are still to come from the overlay count as saved.
+		*/
+		void MarkSaved();
+		//! Returns the number of region files that have changed since the last save
+		size_t GetNumChangedRegions() const;
+		//! Returns the number of cells that have been written since the last save
+		size_t GetNumChangedCells() const;
+
+		//! Sets a source for region files that haven't been copied into the cache yet (null to remove it)
+		/*!
+		* Region files that aren't in the cache are faulted in from the overlay
+		* the first time they're needed, so a save can be played before it is
+		* fully copied. Writes and snapshots only see the region files that have
+		* been faulted in.
+		*/
+		void SetOverlay(const std::shared_ptr<RegionCacheOverlay>& overlay);
+
 		//! Set properties for editable cache
 		void SetupEditMode(bool enabled);
 
@@ -94,8 +161,97 @@ namespace FusionEngine
 		//! Calls defragment on all cached regions
 		void DefragNow();
 
+		//! Decides which regions DefragmentStep should be used on, and how much it does
+		struct DefragmentationPolicy
+		{
+			//! Regions are defragmented once at least this proportion of their sectors are holes (see RegionFile::FragmentationStats)
+			float minHoleRatio;
+			//! ... and there are at least this many hole sectors
+			size_t minHoleSectors;
+			//! The most sectors that each call to DefragmentStep will move (roughly: whole cells are moved)
+			size_t sectorsPerStep;
+
+			DefragmentationPolicy() : minHoleRatio(0.2f), minHoleSectors(16), sectorsPerStep(32) {}
+		};
+		void SetDefragmentationPolicy(const DefragmentationPolicy& policy) { m_DefragPolicy = policy; }
+		const DefragmentationPolicy& GetDefragmentationPolicy() const { return m_DefragPolicy; }
+
+		//! Returns the loaded regions that are fragmented enough to defragment (according to the policy), most fragmented first
+		/*!
+		* Uses the stats recorded when each region was last loaded / written, so this
+		* is cheap enough to call whenever the caller is idle.
+		*/
+		std::vector<RegionCoord_t> GetFragmentedRegions() const;
+		//! Defragments part of the given region (if it is loaded)
+		/*!
+		* Must not be called concurrently with writes to the same region.
+		* \return The number of sectors moved
+		*/
+		size_t DefragmentStep(const RegionCoord_t& coord);
+
+		//! Fragmentation of the loaded regions
+		struct FragmentationMetrics
+		{
+			size_t regions;
+			uint64_t totalSectors;
+			uint64_t freeSectors;
+			uint64_t holeSectors;
+			//! The largest run of free sectors in any region
+			size_t largestFreeRun;
+			//! The smallest largest-free-run of any region
+			size_t smallestLargestFreeRun;
+			//! The highest hole ratio of any region
+			float worstHoleRatio;
+			//! Sectors moved by DefragmentStep since the cache was created
+			uint64_t sectorsDefragmented;
+			uint64_t defragmentSteps;
+
+			FragmentationMetrics()
+				: regions(0), totalSectors(0), freeSectors(0), holeSectors(0),
+				largestFreeRun(0), smallestLargestFreeRun(0), worstHoleRatio(0.f),
+				sectorsDefragmented(0), defragmentSteps(0)
+			{}
+
+			float freeRatio() const { return totalSectors > 0 ? float(freeSectors) / totalSectors : 0.f; }
+		};
+		FragmentationMetrics GetFragmentationMetrics() const;
+		//! Gets the recorded stats for the given region (returns false if it isn't loaded)
+		bool GetRegionFragmentation(const RegionCoord_t& coord, RegionFile::FragmentationStats& stats) const;
+
+		//! Sets the codec that cells written through this cache are compressed with
+		/*!
+		* Falls back to zlib if the given codec isn't available. Data already
+		* written stays as it is (the codec is recorded per-cell), so this can be
+		* changed at any time.
+		*/
+		void SetCodec(CellCodec codec);
+		CellCodec GetCodec() const { return m_Codec; }
+
+		//! Sets the dictionary used to compress / decompress cells (zstd only)
+		/*!
+		* Must be set before reading cells that were compressed with a dictionary.
+		*/
+		void SetDictionary(const std::shared_ptr<CellCodecDictionary>& dictionary);
+		const std::shared_ptr<CellCodecDictionary>& GetDictionary() const { return m_Dictionary; }
+
 		typedef std::function<void (RegionFile*)> RegionLoadedCallback;
 
+		//! Runs the given function on behalf of the given region
+		typedef std::function<void (const RegionCoord_t&, const std::function<void ()>&)> CallbackDispatcher_t;
+		//! Sets the dispatcher for callbacks that were waiting for a region file to load
+		/*!
+		* Without a dispatcher these are called on the ResourceManager thread that
+		* loaded the file. Set this so they run in order with other work for that
+		* region (e.g. on the region's strand). Changes to regions that are dropped
+		* from the cache are also recorded via the dispatcher, so they include
+		* writes that are still in progress.
+		*
+		* Callbacks for regions that are already cached are called immediately,
+		* on the calling thread: region files aren't locked, so reads and writes
+		* of a region must be requested from that region's strand as well.
+		*/
+		void SetLoadedCallbackDispatcher(const CallbackDispatcher_t& dispatcher);
+
 		//! Clear the cache for the given file and reload it
 		void ReloadRegionFile(const RegionLoadedCallback& loadedCallback, const RegionCoord_t& coord);
 		//! Returns a RegionFile for the given coord
@@ -112,17 +268,78 @@ namespace FusionEngine
 
 		//! Returns the given cell data
 		void GetCellStreamForReading(const GotCellForReadingCallback& callback, int32_t cell_x, int32_t cell_y);
+
+		typedef std::function<void (std::shared_ptr<CellData>)> GotCellDataForReadingCallback;
+		//! Returns the given cell data, decompressed straight into a (pooled) buffer
+		/*!
+		* Cheaper than GetCellStreamForReading when the data is going to be read
+		* front to back: no stream objects are created and nothing is copied
+		* besides the decompressed data. The callback gets null if there is no
+		* data for the cell.
+		*/
+		void GetCellDataForReading(const GotCellDataForReadingCallback& callback, int32_t cell_x, int32_t cell_y);
+
+		typedef std::function<void (int32_t, int32_t, std::shared_ptr<CellData>)> GotCellDataBatchCallback;
+		//! Reads the cells within the given rectangle (right / bottom exclusive)
+		/*!
+		* The cells are grouped by region: each region file is requested once, and
+		* all the requested cells within it are read in one sweep (in the order
+		* they are stored) once it is available. The callback is called with the
+		* world-relative coords of each cell, and null data if there is none.
+		*
+		* \param prefetch_margin
+		* Region files within this many cells of the requested cells are also
+		* loaded, so requests for the surrounding cells will find them cached.
+		* Skipped if there are more of these than the cache can hold.
+		*/
+		void GetCellDataBatchForReading(const GotCellDataBatchCallback& callback, const clan::Rect& cells, int32_t prefetch_margin = 0);
+		//! Reads the given cells (see the rectangle overload)
+		void GetCellDataBatchForReading(const GotCellDataBatchCallback& callback, const std::vector<RegionCoord_t>& cells, int32_t prefetch_margin = 0);
 		std::unique_ptr<ArchiveOStream> GetCellStreamForWriting(int32_t cell_x, int32_t cell_y);
 
-		//! Writes data produced by BureaucraticCellBuffer
+		//! Compresses & writes data produced by BureaucraticCellBuffer
 		void WriteCellData(std::pair<int32_t, int32_t> cellIndex, std::shared_ptr<SmartArrayDevice::DataArray_t> data);
 
-		//! Returns the compressed cell data
-		void GetRawCellStreamForReading(const GotCellForReadingCallback& callback, int32_t cell_x, int32_t cell_y);
+		//! Cell data compressed by CompressCellData, ready to be written
+		struct CompressedCellData
+		{
+			std::shared_ptr<SmartArrayDevice::DataArray_t> data;
+			CellCodec codec;
+
+			CompressedCellData() : codec(CellCodec::Zlib) {}
+		};
+		//! Compresses the given cell data with the current codec
+		/*!
+		* This doesn't touch the region files, so cells can be compressed on any
+		* number of threads at once. The result is written by WriteCompressedCellData.
+		*/
+		CompressedCellData CompressCellData(const SmartArrayDevice::DataArray_t& data);
+		//! Writes cell data returned by CompressCellData (cellIndex is world-relative)
+		void WriteCompressedCellData(std::pair<int32_t, int32_t> cellIndex, const CompressedCellData& data);
+
+		//! Returns the compressed cell data, along with the codec it was compressed with
+		void GetRawCellStreamForReading(const GotRawCellForReadingCallback& callback, int32_t cell_x, int32_t cell_y);
 
 		void Sustain();
 		void EndSustain();
 
+		//! Cell data transfer counters
+		struct IOStats
+		{
+			//! Compressed cell data read from regions (in whole sectors)
+			uint64_t bytesRead;
+			//! Compressed cell data written to regions
+			uint64_t bytesWritten;
+			uint64_t cellsRead;
+			uint64_t cellsWritten;
+
+			IOStats() : bytesRead(0), bytesWritten(0), cellsRead(0), cellsWritten(0) {}
+		};
+		//! Returns the amount of cell data that has passed through this cache since it was created (or ResetIOStats was called)
+		IOStats GetIOStats() const;
+		//! Zeros the IO counters
+		void ResetIOStats();
+
 	protected:
 		bool IsCached(const RegionCoord_t& coord) const;
 
@@ -134,6 +351,30 @@ namespace FusionEngine
 		RegionCoord_t cellToRegionCoord(int32_t x, int32_t y) const;
 
 	private:
+		//! Adds the given cell's data to the read counters
+		void recordRead(RegionFile* region_file, int32_t x, int32_t y);
+
+		//! Updates the fragmentation stats for the given region
+		void recordFragmentation(const RegionCoord_t& coord, const RegionFile& region_file);
+		void forgetFragmentation(const RegionCoord_t& coord);
+
+		//! Called before a region file is modified, in case it needs to be kept for the current snapshot
+		void preserveForSnapshot(const RegionFile& region_file);
+		//! Called after a region file is modified, to add the modified sectors (and cell, if given) to the changes since the last save
+		void recordChanges(RegionFile& region_file, const std::pair<int32_t, int32_t>* cell_index = nullptr);
+		//! Calls recordChanges for a region that is being dropped from the cache (via the dispatcher, if there is one)
+		void recordChangesInOrder(const ResourcePointer<RegionFile>& region_file, const RegionCoord_t& coord);
+
+		std::shared_ptr<RegionCacheOverlay> getOverlay() const;
+
+		//! Reads the given (region-relative) cells from the given region
+		void readCellBatch(RegionFile* region_file, const RegionCoord_t& region_coord, std::vector<std::pair<int32_t, int32_t>>& cells, const GotCellDataBatchCallback& callback);
+
+		tbb::atomic<uint64_t> m_BytesRead;
+		tbb::atomic<uint64_t> m_BytesWritten;
+		tbb::atomic<uint64_t> m_CellsRead;
+		tbb::atomic<uint64_t> m_CellsWritten;
+
 		typedef tbb::concurrent_hash_map<RegionCoord_t, RegionFileLoadedCallbackHandle> CallbackHandles_t;
 		CallbackHandles_t m_CallbackHandles;
 
@@ -144,6 +385,9 @@ namespace FusionEngine
 		typedef tbb::spin_mutex CacheMutex_t;
 		CacheMutex_t m_CacheMutex;
 
+		CallbackDispatcher_t m_LoadedCallbackDispatcher;
+		std::mutex m_DispatcherMutex;
+
 		std::string m_CachePath;
 
 		int32_t m_RegionSize;
@@ -153,7 +397,35 @@ namespace FusionEngine
 
 		bool m_FragmentationAllowed;
 
+		DefragmentationPolicy m_DefragPolicy;
+		typedef std::unordered_map<RegionCoord_t, RegionFile::FragmentationStats, boost::hash<RegionCoord_t>> FragmentationStatsMap_t;
+		FragmentationStatsMap_t m_FragmentationStats;
+		mutable tbb::spin_mutex m_FragmentationStatsMutex;
+		tbb::atomic<uint64_t> m_SectorsDefragmented;
+		tbb::atomic<uint64_t> m_DefragmentSteps;
+
+		std::shared_ptr<RegionSnapshot> m_Snapshot;
+		tbb::spin_mutex m_SnapshotMutex;
+
+		struct RegionChanges
+		{
+			boost::dynamic_bitset<> sectors;
+			boost::dynamic_bitset<> cells;
+		};
+		// Changes since the last save, by region file name
+		typedef std::unordered_map<std::string, RegionChanges> ChangesMap_t;
+		ChangesMap_t m_Changes;
+		// The region files that existed at the time of the last save
+		std::unordered_set<std::string> m_SavedFiles;
+		mutable tbb::spin_mutex m_ChangesMutex;
+
+		std::shared_ptr<RegionCacheOverlay> m_Overlay;
+		mutable tbb::spin_mutex m_OverlayMutex;
+
 		bool m_ReadOnly;
+
+		CellCodec m_Codec;
+		std::shared_ptr<CellCodecDictionary> m_Dictionary;
 	};
 
 }
@@ -39,15 +39,18 @@
 #include "FusionResourcePointer.h"
 
 #include "FusionCellCache.h"
+#include "FusionCellDataCursor.h"
 
 #include <array>
 #include <functional>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include <ClanLib/Core/Math/rect.h>
 
 #include <boost/dynamic_bitset.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 
 namespace FusionEngine
 {
@@ -93,17 +96,46 @@ namespace FusionEngine
 		//std::shared_ptr<impl> pimpl;
 	};
 
+	//! Seekable device for a memory-mapped file
+	/*!
+	* Writing past the end grows the file (and remaps it) to the next whole sector.
+	*/
+	struct MappedFileDevice
+	{
+		std::shared_ptr<boost::iostreams::mapped_file> mapping;
+		std::streamsize position;
+
+		explicit MappedFileDevice(std::shared_ptr<boost::iostreams::mapped_file> mapping)
+			: mapping(std::move(mapping)),
+			position(0)
+		{}
+
+		typedef char char_type;
+		typedef boost::iostreams::seekable_device_tag category;
+
+		std::streamsize read(char_type* s, std::streamsize n);
+		std::streamsize write(const char_type* s, std::streamsize n);
+		boost::iostreams::stream_offset seek(boost::iostreams::stream_offset off, std::ios_base::seekdir way);
+	};
+
 	//! Region file (contains compressed cell data in a mini filesystem)
 	class RegionFile
 	{
 	public:
 		//! Default CTOR
 		RegionFile()
-			: region_width(0)
+			: region_width(0),
+			index_sectors(0)
 		{}
 
 		//! File path CTOR
-		explicit RegionFile(const std::string& filename, size_t width);
+		/*!
+		* \param memory_mapped
+		* Map the file into memory rather than reading all of it up front: only the
+		* pages that are accessed become resident. Falls back to reading the file
+		* if it can't be mapped.
+		*/
+		explicit RegionFile(const std::string& filename, size_t width, bool memory_mapped = false);
 		//! Custom read-only file buffer CTOR
 		explicit RegionFile(std::unique_ptr<std::istream>&& read_only_file, size_t width);
 
@@ -114,16 +146,33 @@ namespace FusionEngine
 		void init();
 
 		//! Write to disk
+		/*!
+		* Only the sectors that have been modified since the last flush are written.
+		*/
 		void flush() const;
 
+		//! Returns true if the file is memory-mapped (rather than loaded into regionData)
+		bool isMemoryMapped() const { return mappedFile != nullptr; }
+
+		//! Returns the whole file as it currently is (in regionData or the mapping)
+		/*!
+		* Only valid until the region is next written.
+		*/
+		std::pair<const char*, size_t> getRegionData() const;
+
 		//! Move CTOR
 		RegionFile(RegionFile&& other)
 			: filename(std::move(other.filename)),
 			file(std::move(other.file)),
 			regionData(std::move(other.regionData)),
+			mappedFile(std::move(other.mappedFile)),
 			cellDataLocations(std::move(other.cellDataLocations)),
 			free_sectors(std::move(other.free_sectors)),
-			region_width(other.region_width)
+			dirty_sectors(std::move(other.dirty_sectors)),
+			modified_sectors(std::move(other.modified_sectors)),
+			region_width(other.region_width),
+			index_sectors(other.index_sectors),
+			fragmentationAllowed(other.fragmentationAllowed)
 		{
 		}
 
@@ -133,19 +182,30 @@ namespace FusionEngine
 			filename = std::move(other.filename);
 			file = std::move(other.file);
 			regionData = std::move(other.regionData);
+			mappedFile = std::move(other.mappedFile);
 			cellDataLocations = std::move(other.cellDataLocations);
 			free_sectors = std::move(other.free_sectors);
+			dirty_sectors = std::move(other.dirty_sectors);
+			modified_sectors = std::move(other.modified_sectors);
 			region_width = other.region_width;
+			index_sectors = other.index_sectors;
+			fragmentationAllowed = other.fragmentationAllowed;
 			return *this;
 		}
 
 		//! Data location struct (represents a piece of the filesystem index)
+		/*!
+		* Stored as a 64-bit starting sector and 32-bit sector count (see
+		* s_IndexEntrySize). Version 1 region files packed these into 24 / 8 bits,
+		* which limited cells to 255 sectors: those files are upgraded on load.
+		*/
 		struct DataLocation
 		{
-			uint32_t startingSector : 24;
-			uint32_t sectorsAllocated : 8;
+			uint64_t startingSector;
+			uint32_t sectorsAllocated;
 
-			static const size_t s_MaxSectorsPerCell = 255; // i.e. the 8 bits in sectorAllocated allow a max value of 255
+			//! Sanity limit (256MB): the field allows more, but a cell this big is certainly a bug
+			static const size_t s_MaxSectorsPerCell = 0x10000;
 
 			DataLocation()
 				: startingSector(0),
@@ -153,25 +213,71 @@ namespace FusionEngine
 			{}
 
 			bool is_valid() const { return end() != 0; }
-			uint32_t end() const { return startingSector + sectorsAllocated; }
+			uint64_t end() const { return startingSector + sectorsAllocated; }
 		};
 
-		static const size_t s_CellHeaderSize = sizeof(size_t) + sizeof(uint8_t); // length & version number
-		static const size_t s_MaxSectors = 1024;
+		static const size_t s_CellHeaderSize = sizeof(size_t) + sizeof(uint8_t) + sizeof(uint8_t) + sizeof(size_t); // length, version number, codec & cell index
 		static const size_t s_SectorSize = 4096;
 
+		//! The region file format written by this version
+		static const uint32_t s_FormatVersion = 2;
+		//! Magic number, format version & region width
+		static const size_t s_IndexHeaderSize = 8 + sizeof(uint32_t) + sizeof(uint32_t);
+		//! Starting sector & sectors allocated
+		static const size_t s_IndexEntrySize = sizeof(uint64_t) + sizeof(uint32_t);
+		//! Largest supported region width (the index for this takes 193 sectors)
+		static const size_t s_MaxRegionWidth = 256;
+
+		//! Returns the number of sectors used by the index of a region file with the given width
+		static size_t indexSectorsFor(size_t region_width);
+
 		std::string filename;
 		std::shared_ptr<SmartArrayDevice::DataArray_t> regionData; // The data is fully loaded out of the file on construction, writes are fed back in periodically
+		std::shared_ptr<boost::iostreams::mapped_file> mappedFile; // Used instead of regionData when the file is memory-mapped
 		std::unique_ptr<std::iostream> file;
-		std::array<DataLocation, s_MaxSectors> cellDataLocations;
+		std::vector<DataLocation> cellDataLocations; // region_width * region_width entries
 		boost::dynamic_bitset<> free_sectors;
+		mutable boost::dynamic_bitset<> dirty_sectors; // Sectors modified since the last flush
+		boost::dynamic_bitset<> modified_sectors; // Sectors modified since the last call to takeModifiedSectors (unlike dirty_sectors, not reset by flush)
 
 		size_t region_width; // Number of cells in each direction that comprise this region
+		size_t index_sectors; // Sectors at the start of the file used by the index (the data comes after these)
 
 		bool fragmentationAllowed;
 
+		//! The stored (compressed) data for a cell
+		struct CellDataView
+		{
+			const char* data;
+			size_t length;
+			CellCodec codec;
+
+			CellDataView() : data(nullptr), length(0), codec(CellCodec::Zlib) {}
+		};
+
 		//! Gets a stream for reading data for the given cell (co-ords relative to the region)
-		std::unique_ptr<ArchiveIStream> getInputCellData(int32_t x, int32_t y, bool inflate = true);
+		/*!
+		* \param dictionary
+		* Required to decompress data that was compressed using a dictionary
+		*/
+		std::unique_ptr<ArchiveIStream> getInputCellData(int32_t x, int32_t y, bool decompress = true, const CellCodecDictionary* dictionary = nullptr);
+		//! Reads data for the given cell straight out of the region buffer / mapping into out
+		/*!
+		* \return False if there is no data for the cell
+		*/
+		bool readCellData(int32_t x, int32_t y, CellData& out, bool decompress = true, const CellCodecDictionary* dictionary = nullptr);
+		//! Gets a stream for reading the stored (compressed) data for the given cell
+		/*!
+		* \param[out] codec
+		* Set to the codec the data was compressed with
+		*/
+		std::unique_ptr<ArchiveIStream> getRawCellData(int32_t x, int32_t y, CellCodec& codec);
+		//! Returns the stored (compressed) data for the given cell, in place
+		/*!
+		* The returned pointer is into the region buffer / mapping, so it is only valid
+		* until the region is next written. data is null if there is no data.
+		*/
+		CellDataView getCellDataView(int32_t x, int32_t y);
 		//! Gets a stream for writing data to the given cell (co-ords relative to the region)
 		/*!
 		* Not used at the moment: see 
@@ -179,14 +285,55 @@ namespace FusionEngine
 		std::unique_ptr<ArchiveOStream> getOutputCellData(int32_t x, int32_t y);
 
 		//! Writes data for the given cell (co-ords relative to the region)
-		void write(const std::pair<int32_t, int32_t>& cell_index, std::vector<char>& data);
+		/*!
+		* \param codec
+		* The codec that data was compressed with (recorded in the cell header)
+		*/
+		void write(const std::pair<int32_t, int32_t>& cell_index, std::vector<char>& data, CellCodec codec = CellCodec::Zlib);
 		//! Writes data to the given sector
-		void write(size_t first_sector, size_t scalar_cell_index, const std::vector<char>& data);
+		void write(size_t first_sector, size_t scalar_cell_index, const std::vector<char>& data, CellCodec codec = CellCodec::Zlib);
+
+		//! Writes every cell in this region to dest, recompressed with the given codec
+		/*!
+		* Only reads this region, so different regions can be recompressed in parallel
+		* (e.g. when compiling a map).
+		*
+		* \param dictionary
+		* Used to compress the data written to dest (not to read this region)
+		*/
+		void recompressTo(RegionFile& dest, CellCodec codec, const CellCodecDictionary* dictionary = nullptr);
 
 		//! Defragment the entire region file
 		void defragment();
 		//! Defragment the given sectors
 		void defragment(size_t begin, size_t end);
+		//! Move data into the first gap(s) in the file, stopping once the given number of sectors have been moved
+		/*!
+		* Cells are moved whole, so this can exceed max_sectors by up to one cell.
+		* \return The number of sectors moved (zero when there are no gaps left)
+		*/
+		size_t defragmentStep(size_t max_sectors);
+
+		//! Free space in a region file
+		struct FragmentationStats
+		{
+			//! Length of the file (including the index sector)
+			size_t totalSectors;
+			size_t freeSectors;
+			//! Free sectors followed by used ones (i.e. the space that defragmenting would consolidate)
+			size_t holeSectors;
+			//! The largest run of free sectors (the largest cell that can be written without growing the file)
+			size_t largestFreeRun;
+			//! Number of separate runs of free sectors
+			size_t freeRuns;
+
+			FragmentationStats() : totalSectors(0), freeSectors(0), holeSectors(0), largestFreeRun(0), freeRuns(0) {}
+
+			float freeRatio() const { return totalSectors > 0 ? float(freeSectors) / totalSectors : 0.f; }
+			float holeRatio() const { return totalSectors > 0 ? float(holeSectors) / totalSectors : 0.f; }
+		};
+		//! Scans the free-sector map
+		FragmentationStats getFragmentationStats() const;
 
 		//! Move from the given run of sectors to the given new location
 		size_t moveData(size_t first_sector, size_t dest_sector);
@@ -203,15 +350,30 @@ namespace FusionEngine
 		size_t toScalarIndex(const std::pair<int32_t, int32_t>& cell_index) const;
 
 		//! Writes the given information to the region index
-		void setCellDataLocation(const std::pair<int32_t, int32_t>& cell_index, uint32_t startSector, uint32_t sectorsUsed);
+		void setCellDataLocation(const std::pair<int32_t, int32_t>& cell_index, uint64_t startSector, uint32_t sectorsUsed);
 		//! Writes the given information to the region index
-		void setCellDataLocation(const size_t scalar_cell_index, uint32_t startSector, uint32_t sectorsUsed);
+		void setCellDataLocation(const size_t scalar_cell_index, uint64_t startSector, uint32_t sectorsUsed);
 		//! Get the information about the given cell from the region index
 		const DataLocation& getCellDataLocation(const std::pair<int32_t, int32_t>& cell_index);
+
+		//! Returns the sectors that have been modified since this was last called, and resets them
+		boost::dynamic_bitset<> takeModifiedSectors();
 		
 	private:
 		//! Load region data from provided source into memory
 		void loadRegionData(std::unique_ptr<std::istream> source);
+		//! Map the region file into memory
+		void mapRegionData();
+
+		//! Records that the given sectors need to be written by the next flush
+		void markDirty(size_t first_sector, size_t num_sectors);
+
+		//! Writes the index header and all the entries in cellDataLocations
+		void writeIndex();
+		//! Reads the index (returns false if the file doesn't start with a version 2+ index)
+		bool readIndex();
+		//! Rewrites a version 1 region file in the current format
+		void upgradeFromV1();
 
 		// non-copyableness
 		//! Private copy constructor (class is non-copyable)
@@ -222,6 +384,18 @@ namespace FusionEngine
 
 	namespace RegionMap
 	{
+		//! User data for LoadMapRegionResource
+		struct RegionFileSettings
+		{
+			int32_t regionSize;
+			bool memoryMapped;
+
+			RegionFileSettings(int32_t region_size, bool memory_mapped)
+				: regionSize(region_size),
+				memoryMapped(memory_mapped)
+			{}
+		};
+
 		//! Region resource loader callback
 		void LoadMapRegionResource(ResourceContainer* resource, clan::FileSystem fs, boost::any user_data);
 		//! Region resource unloader callback - writes data
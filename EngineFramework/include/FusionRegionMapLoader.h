@@ -44,6 +44,7 @@
 #include <unordered_set>
 #include <tuple>
 #include <tbb/concurrent_queue.h>
+#include <tbb/concurrent_priority_queue.h>
 #include <tbb/concurrent_hash_map.h>
 #include <atomic>
 #include <chrono>
@@ -56,6 +57,7 @@
 #include "FusionGameMapLoader.h"
 #include "FusionPhysFSIOStream.h"
 #include "FusionSaveDataArchive.h"
+#include "FusionStrandedWorkerPool.h"
 #include "FusionCellStreamTypes.h"
 #include "FusionEntitySerialisationUtils.h"
 #include "FusionCellSerialisationUtils.h"
@@ -72,7 +74,10 @@ namespace FusionEngine
 
 	class ArchetypeFactory;
 	class RegionCellCache;
+	class RegionCacheOverlay;
+	class LazyLoadOverlay;
 	class ActiveEntityDirectory;
+	class EntityLocationIndex;
 
 	//! CellArchiver implementation
 	class RegionCellArchivist : public CellArchiver, public SaveDataArchive, public CellFileManager
@@ -82,8 +87,11 @@ namespace FusionEngine
 		/*
 		* The map provides a static entity source, whilst the CellArchiver (cache) provides methods for 
 		* storing and retrieving entity states.
+		*
+		* \param cells_per_region
+		* Width & height of the cache's region files, in cells (edit-mode caches always use 24)
 		*/
-		RegionCellArchivist(bool edit_mode, const std::string& cache_path = "/cache");
+		RegionCellArchivist(bool edit_mode, const std::string& cache_path = "/cache", int32_t cells_per_region = 16);
 		~RegionCellArchivist();
 
 		void SetInstantiator(EntityInstantiator* instantiator, ComponentFactory* component_factory, EntityManager* manager, ArchetypeFactory* arc_factory);
@@ -119,6 +127,10 @@ namespace FusionEngine
 		void Store(int32_t x, int32_t y, std::shared_ptr<Cell> cell);
 		//! Retrieves the given cell
 		std::shared_ptr<Cell> Retrieve(int32_t x, int32_t y);
+		//! Retrieves the given cell at low priority
+		std::shared_ptr<Cell> Prefetch(int32_t x, int32_t y, float time_of_need);
+		//! Cancels the prefetch request for the given cell, if it hasn't started loading
+		bool CancelPrefetch(int32_t x, int32_t y);
 
 		typedef std::recursive_mutex TransactionMutex_t;
 
@@ -143,6 +155,12 @@ namespace FusionEngine
 
 		std::thread m_Thread;
 
+		//! Sets the number of threads that process cell jobs (takes effect when the archivist is next started)
+		/*!
+		* Zero (the default) uses a thread for each core besides the current one.
+		*/
+		void SetNumWorkerThreads(size_t num_threads) { m_NumWorkerThreads = num_threads; }
+
 		void Start();
 
 		void Stop();
@@ -154,21 +172,58 @@ namespace FusionEngine
 		RegionCellCache* GetEditableCellCache() const { return m_EditableCache; }
 
 		//! Implements CellFileManager
-		virtual void CopyCellFiles(const std::string& dest_path);
+		virtual void CopyCellFiles(const std::string& dest_path, const std::function<void (size_t, size_t)>& progress);
 		//! Implements CellFileManager
 		virtual void CopyDatabase(const std::string& dest_path);
 
 		//! Copy the cache files at the given path. Relative to the base-path for this archiver - so the main cache is "" (an empty string)
-		void CopyCellFiles(const std::string& cache_path, const std::string& dest_path);
+		/*!
+		* When compiling with zstd, region files are recompressed in parallel, so progress
+		* is called from the worker threads (one at a time, with the counts in order).
+		*/
+		void CopyCellFiles(const std::string& cache_path, const std::string& dest_path, const std::function<void (size_t, size_t)>& progress);
 		//! Save a copy of the current entity location DB
 		void SaveEntityLocationDB(const std::string& filename);
 
 		void EnqueueQuickSave(const std::string& save_name);
 		void Save(const std::string& save_name);
 
+		//! Sets whether quick-saves are written from a snapshot in the background (the default)
+		/*!
+		* Otherwise the archivist copies the cache itself, so streaming waits until the save is done.
+		*/
+		void SetSnapshotSaves(bool enabled) { m_SnapshotSaves = enabled; }
+		//! Blocks until the snapshot taken by the last quick-save (if any) has been written
+		void WaitForSnapshotSave();
+
+		//! Sets whether snapshot quick-saves only store the regions that have changed since the last save (the default)
+		/*!
+		* Incremental saves refer to the save that they're based on, and Load applies
+		* them over it. A full save is written instead if the chain of saves (the
+		* new save, the saves it would be based on, and the full save at the base)
+		* would be longer than max_chain_length, or if the save being written is
+		* one that the last save is based on. Saves that others are based on
+		* shouldn't be deleted or overwritten: use CollapseSave on the later saves
+		* first.
+		*/
+		void SetIncrementalSaves(bool enabled, size_t max_chain_length = 8) { m_IncrementalSaves = enabled; m_MaxSaveChainLength = max_chain_length; }
+		//! Rewrites the given incremental save as a full save (so it no longer depends on the saves it was based on)
+		void CollapseSave(const std::string& save_name);
+
 		void EnqueueQuickLoad(const std::string& save_name);
 		void Load(const std::string& save_name);
 
+		//! Sets whether Load lets the game start before the region files have been copied out of the save
+		/*!
+		* The save stays mounted, region files are copied into the cache the first
+		* time a cell in them is needed, and a background thread copies the rest.
+		* Full saves (and compiling the map) wait for the copying to finish first,
+		* except for snapshot saves, which finish it on the snapshot thread.
+		*/
+		void SetLazyLoading(bool enabled) { m_LazyLoading = enabled; }
+		//! Blocks until the region files from the last (lazy) load have all been copied into the cache
+		void WaitForLazyLoad();
+
 		//! Create a file for storing custom data
 		std::unique_ptr<std::ostream> CreateDataFile(const std::string& filename);
 		//! Load a custom data file
@@ -211,8 +266,9 @@ namespace FusionEngine
 			std::weak_ptr<Cell> cell;
 			CellCoord_t coord;
 			EntitySerialisationUtils::SerialisedDataStyle dataStyle;
-			std::shared_ptr<std::istream> cellDataStream;
+			std::shared_ptr<CellData> cellData;
 			std::vector<ObjectID> ids;
+			std::vector<size_t> entityOffsets; // Where each entity's data is (if the entities are in slots)
 			size_t entitiesExpected;
 			size_t entitiesReadSoFar; // The count in cell.objects isn't used because some entities may (hope not) fail to instantiate
 			bool thereIsSyncedDataToReadNext;
@@ -242,8 +298,9 @@ namespace FusionEngine
 				: cell(std::move(other.cell)),
 				coord(other.coord),
 				dataStyle(other.dataStyle),
-				cellDataStream(std::move(other.cellDataStream)),
+				cellData(std::move(other.cellData)),
 				ids(std::move(other.ids)),
+				entityOffsets(std::move(other.entityOffsets)),
 				entitiesExpected(other.entitiesExpected),
 				entitiesReadSoFar(other.entitiesReadSoFar),
 				thereIsSyncedDataToReadNext(other.thereIsSyncedDataToReadNext),
@@ -257,34 +314,121 @@ namespace FusionEngine
 		//	{}
 		};
 
-		void OnGotCellStreamForReading(std::shared_ptr<std::istream> cellDataStream, std::shared_ptr<ReadJob> job);
+		void OnGotCellDataForReading(std::shared_ptr<CellData> cellData, std::shared_ptr<ReadJob> job);
 
-		std::shared_ptr<EntitySerialisationUtils::EntityFuture> LoadEntity(std::shared_ptr<ICellStream> file, bool includes_id, ObjectID id, const EntitySerialisationUtils::SerialisedDataStyle data_style);
+		std::shared_ptr<EntitySerialisationUtils::EntityFuture> LoadEntity(const std::shared_ptr<CellDataCursor>& data, bool includes_id, ObjectID id, const EntitySerialisationUtils::SerialisedDataStyle data_style);
 
 		void Run();
 
 	private:
+		//! Implements Retrieve / Prefetch
+		std::shared_ptr<Cell> RequestCell(const CellCoord_t& coord, const bool prefetch, const float time_of_need);
+		//! Requests the cell data stream for the given read job (if the cell still needs loading)
+		void RequestCellData(const std::shared_ptr<ReadJob>& job);
+		//! Requests the cell data for the given read jobs in one batch (so jobs in the same region are read together)
+		void RequestCellData(const std::vector<std::shared_ptr<ReadJob>>& jobs);
+
 		void StartJob(const std::shared_ptr<ReadJob>& job, const std::shared_ptr<Cell>& a_cell_that_is_locked);
 		bool ContinueJob(const std::shared_ptr<ReadJob>& job, const std::shared_ptr<Cell>& the_cell_that_locks);
 
+		//! Returns the worker strand for jobs on the given cell (cells in the same region share a strand)
+		StrandedWorkerPool::StrandKey_t GetRegionStrand(const CellCoord_t& coord) const;
+		//! Returns the worker strand for serialising the given cell (so writes of the same cell finish in order)
+		StrandedWorkerPool::StrandKey_t GetCellStrand(const CellCoord_t& coord) const;
+
+		//! Posts a defragment step for each of the given cache's fragmented regions (to their strands, so they don't overlap writes)
+		void PostDefragmentJobs(RegionCellCache* cache);
+
+		//! Makes the given cache run callbacks for newly loaded regions on the region's strand (or stop doing so, if enable is false)
+		void DispatchLoadedCallbacksToStrands(RegionCellCache* cache, bool enable);
+
+		//! Queues a write for the given cell, replacing the write that is already queued for it (if it hasn't started)
+		void EnqueueWrite(const WriteJob& job);
+		//! Ends a write that was posted to the workers: the cell is marked ready once no more writes are queued or running for it
+		/*!
+		* \param unload
+		* Clear the cell's entries if this was the last write for it (and it hasn't been requested again
+		* since it was stored). The cell must be locked by the caller.
+		*/
+		void FinishWrite(const std::shared_ptr<Cell>& cell, const CellCoord_t& coord, bool unload = false);
+
+		struct UpdateJob;
+		struct SerialisedCell;
+
+		// Worker jobs (posted by Run)
+		void ProcessReadJob(const std::shared_ptr<ReadJob>& job);
+		void ProcessIncommingJob(const std::shared_ptr<ReadJob>& job);
+		//! Serialises and compresses the cell, then posts CommitWriteJob (runs on the cell strand)
+		void ProcessWriteJob(const std::weak_ptr<Cell>& cell, const CellCoord_t& coord, bool unload_when_done);
+		//! Writes the compressed cell data to the region file(s) (runs on the region strand)
+		void CommitWriteJob(const std::shared_ptr<SerialisedCell>& serialised);
+		void ProcessUpdateJob(const std::shared_ptr<UpdateJob>& job);
+
+		typedef std::vector<std::tuple<ObjectID, std::streamoff, std::streamsize>> EntityDataPositions_t;
+
 		void WriteCellIntro(std::ostream& file, const CellCoord_t& coord, const Cell* cell, size_t expectedNumEntries, const bool synched, const EntitySerialisationUtils::SerialisedDataStyle data_style);
-		void WriteCellData(std::ostream& file, const CellCoord_t& coord, const Cell* cell, size_t expectedNumEntries, const bool synched, const EntitySerialisationUtils::SerialisedDataStyle data_style);
+		//! Returns the position of each entity's data (see StoreEntityLocations)
+		EntityDataPositions_t WriteCellData(std::ostream& file, const CellCoord_t& coord, const Cell* cell, size_t expectedNumEntries, const bool synched, const EntitySerialisationUtils::SerialisedDataStyle data_style);
+
+		//! Returns the positions of the synched entities' data
+		EntityDataPositions_t WriteCellDataForEditMode(std::ostream& file, const CellCoord_t& cell_coord, const std::shared_ptr<Cell>& cell, size_t numPseudo, size_t numSynched, const EntitySerialisationUtils::SerialisedDataStyle data_style);
 
-		void WriteCellDataForEditMode(const std::unique_ptr<std::ostream>& filePtr, const CellCoord_t& cell_coord, const std::shared_ptr<Cell>& cell, size_t numPseudo, size_t numSynched, const EntitySerialisationUtils::SerialisedDataStyle data_style);
+		//! Updates the entity location DB once the given cell data has been written
+		void StoreEntityLocations(const CellCoord_t& coord, const EntityDataPositions_t& positions);
 
 		// Reads the number of entities, and optional IDs from the cell data
 		//std::pair<size_t, std::vector<ObjectID>> ReadCellIntro(const CellCoord_t& coord, ICellStream& file, const bool data_includes_ids, const EntitySerialisationUtils::SerialisedDataStyle data_style);
-		std::tuple<bool, size_t, std::shared_ptr<ICellStream>> ContinueReadingCell(const CellCoord_t& coord, const std::shared_ptr<Cell>& conveniently_locked_cell, size_t num_entities, size_t progress, std::shared_ptr<EntitySerialisationUtils::EntityFuture>& incomming_entity, const std::vector<ObjectID>& ids, std::shared_ptr<ICellStream> file, const EntitySerialisationUtils::SerialisedDataStyle data_style);
-
-		std::streamsize MergeEntityData(std::vector<ObjectID>& objects_displaced, std::vector<ObjectID>& objects_displaced_backward, ObjectID id, std::streamoff data_offset, std::streamsize data_length, ICellStream& source_in, OCellStream& source_out, ICellStream& dest_in, OCellStream& dest, RakNet::BitStream& mergeCon, RakNet::BitStream& mergeOcc) const;
-		void MoveEntityData(std::vector<ObjectID>& objects_displaced_backward, ObjectID id, std::streamoff data_offset, std::streamsize data_length, ICellStream& source_in, OCellStream& source_out, ICellStream& dest_in, OCellStream& dest) const;
-		void DeleteEntityData(std::vector<ObjectID>& objects_displaced_backward, ObjectID id, std::streamoff data_offset, std::streamsize data_length, ICellStream& in, OCellStream& out) const;
+		std::pair<bool, size_t> ContinueReadingCell(const CellCoord_t& coord, const std::shared_ptr<Cell>& conveniently_locked_cell, size_t num_entities, size_t progress, std::shared_ptr<EntitySerialisationUtils::EntityFuture>& incomming_entity, const std::vector<ObjectID>& ids, const std::vector<size_t>& entity_offsets, const std::shared_ptr<CellDataCursor>& data, const EntitySerialisationUtils::SerialisedDataStyle data_style);
 
+		//! Creates the folder for the given save (or empties it, if it exists) and returns its full path
+		std::string CreateSaveFolder(const std::string& save_name);
 		bool PerformSave(const std::string& save_name, const std::function<void (bool, const std::string&)> progress_notification);
+		//! Takes a snapshot of the cache and starts writing it on m_SnapshotThread
+		bool PerformSnapshotSave(const std::string& save_name, const std::function<void (bool, const std::string&)> progress_notification);
 
 		void PrepareLoad(const std::string& save_name);
 		void PerformLoad(const std::string& save_name);
 
+		//! A save that has been found (and mounted, if it's archived) by openSave
+		struct SaveLocation
+		{
+			std::string name;
+			std::string physPath; // Within the PhysFS search path
+			std::string nativePath;
+			std::string archivePath;
+			bool archived;
+		};
+		//! (name, ID) of each save in a chain, starting with the last (incremental) save
+		typedef std::vector<std::pair<std::string, std::string>> SaveChain_t;
+
+		//! Finds the given save, mounting it if it's archived (returns false if it doesn't exist)
+		bool openSave(const std::string& save_name, SaveLocation& location);
+		//! Unmounts the given save, if it's archived
+		void closeSave(const SaveLocation& location);
+		//! Opens the given file in the given save (returns null if it doesn't exist)
+		std::unique_ptr<std::istream> openSaveFile(const SaveLocation& location, const std::string& relative_path);
+		//! Copies the region and data files from the given save (applied over the saves it's based on) to the target path
+		/*!
+		* \param chain
+		* Filled with the saves that were copied, starting with this one (pass an empty chain and a depth of zero)
+		*
+		* \param lazy_saves
+		* If this is set, region files aren't copied: the saves that this one is based on
+		* are left mounted and added to this list instead (the save they're based on first)
+		*/
+		void copySaveFiles(const SaveLocation& location, const std::string& target_path, const std::string& phys_target_path, size_t depth, SaveChain_t& chain, std::vector<SaveLocation>* lazy_saves = nullptr);
+
+		//! Creates an overlay that provides the region files in the given sub-folder of the given saves (the save they're based on first)
+		std::shared_ptr<LazyLoadOverlay> createLazyLoadOverlay(const std::vector<SaveLocation>& saves, const std::string& sub_path, const std::string& cache_path);
+
+		//! Stops the background copying for the last lazy load (without finishing it) and unmounts its saves
+		/*!
+		* \returns True if there was a lazy load to cancel
+		*/
+		bool cancelLazyLoad();
+		//! Removes the overlays from the caches and unmounts the saves that were being loaded lazily (m_LazyLoadMutex must be locked)
+		void endLazyLoad();
+
 		void CompressSave(const std::string& save_name);
 
 		bool m_EditMode;
@@ -302,7 +446,7 @@ namespace FusionEngine
 		RegionCellCache* m_MapCache;
 
 		std::string m_FullBasePath;
-		std::unique_ptr<kyotocabinet::HashDB> m_EntityLocationDB;
+		std::unique_ptr<EntityLocationIndex> m_EntityLocations;
 
 		std::unique_ptr<kyotocabinet::HashDB> m_SynchLoadedDB;
 
@@ -312,6 +456,24 @@ namespace FusionEngine
 		// Cells who's ownership has been passed to this archiver via Store or created by Retrieve
 		CellsBeingProcessedMap_t m_CellsBeingProcessed;
 
+		struct PendingWrite
+		{
+			// The latest write requested for the cell (valid while queued is set)
+			WriteJob job;
+			// Set while the cell is in m_WriteQueue (cleared when the write is posted to the workers)
+			bool queued;
+			// Writes that have been posted to the workers and haven't finished
+			unsigned int inFlight;
+
+			PendingWrite()
+				: queued(false),
+				inFlight(0)
+			{}
+		};
+		typedef tbb::concurrent_hash_map<CellCoord_t, PendingWrite> PendingWriteMap_t;
+		// Cells with writes queued or running (removed when the last one finishes)
+		PendingWriteMap_t m_PendingWrites;
+
 		//TransactionMutex_t m_TransactionMutex;
 
 		std::unique_ptr<ActiveEntityDirectory> m_ActiveEntityDirectory;
@@ -333,12 +495,70 @@ namespace FusionEngine
 		typedef std::queue<std::tuple<WriteJob> WriteQueue_t;
 		typedef std::queue<std::tuple<ReadJob> ReadQueue_t;
 #endif
-		WriteQueue_t m_WriteQueue;
+		// Cells with a write pending (each cell is queued once, however many times it is stored: see m_PendingWrites)
+		tbb::concurrent_queue<CellCoord_t> m_WriteQueue;
 		ReadQueue_t m_ReadQueueGetCellData;
 		ReadQueue_t m_ReadQueueLoadEntities;
 
+		struct PrefetchJob
+		{
+			std::weak_ptr<Cell> cell;
+			CellCoord_t coord;
+			float timeOfNeed;
+
+			PrefetchJob()
+				: timeOfNeed(0.f)
+			{}
+
+			PrefetchJob(const std::weak_ptr<Cell>& cell_, const CellCoord_t& coord_, float time_of_need)
+				: cell(cell_),
+				coord(coord_),
+				timeOfNeed(time_of_need)
+			{}
+
+			//! Cells that are needed sooner have higher priority
+			bool operator<(const PrefetchJob& other) const { return timeOfNeed > other.timeOfNeed; }
+		};
+		// Low priority read requests (only processed when there are no normal read requests queued)
+		tbb::concurrent_priority_queue<PrefetchJob> m_PrefetchQueue;
+		typedef tbb::concurrent_hash_map<CellCoord_t, float> PendingPrefetchMap_t;
+		// Current time-of-need of each prefetch that hasn't started loading (queued jobs that don't match are stale)
+		PendingPrefetchMap_t m_PendingPrefetches;
+
 		// Cells waiting on archetypes to finish loading (put aside to not hold up the other cells)
-		std::list<std::shared_ptr<ReadJob>> m_IncommingCells;
+		ReadQueue_t m_IncommingCells;
+
+		// Runs the jobs from the queues above (jobs for the same region are run in order)
+		std::unique_ptr<StrandedWorkerPool> m_Workers;
+		size_t m_NumWorkerThreads;
+
+		bool m_SnapshotSaves;
+		// Writes the snapshot taken by the last quick-save
+		std::thread m_SnapshotThread;
+
+		bool m_IncrementalSaves;
+		size_t m_MaxSaveChainLength;
+		// The last save written or loaded and the saves it's based on (empty if there isn't one that the cache matches)
+		SaveChain_t m_SaveChain;
+		// CollapseSave can be called while the archivist thread is saving
+		std::mutex m_SaveChainMutex;
+
+		bool m_LazyLoading;
+		// The saves being loaded lazily (the save they're based on first), and the overlays that read from them
+		std::vector<SaveLocation> m_LazyLoadSaves;
+		std::vector<std::shared_ptr<LazyLoadOverlay>> m_LazyLoadOverlays;
+		// Copies the region files that haven't been needed yet into the cache
+		std::thread m_LazyLoadThread;
+		std::atomic<bool> m_CancelLazyLoad;
+		// Guards the above: the lazy load can be finished from the archivist thread (saving) or the caller's (e.g. CollapseSave)
+		std::mutex m_LazyLoadMutex;
+		// Width of the area each strand covers, in cells (a multiple of the region size of each cache)
+		size_t m_StrandRegionSize;
+
+		// Results passed back from the workers to the archivist thread
+		tbb::concurrent_queue<CellCoord_t> m_ReadyCells;
+		WriteQueue_t m_WritesToRetry;
+		ReadQueue_t m_ReadsToRetry;
 
 		//! TODO un-caps these when vc++ supports enum class
 		enum UpdateOperation { UPDATE, REMOVE };
@@ -0,0 +1,141 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author(s):
+*
+*    Elliot Hayward
+*/
+
+#ifndef H_FusionRegionSnapshot
+#define H_FusionRegionSnapshot
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "FusionPrerequisites.h"
+
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/dynamic_bitset.hpp>
+#include <boost/filesystem/path.hpp>
+
+namespace FusionEngine
+{
+
+	class RegionFile;
+
+	//! Copy-on-write snapshot of a set of region files
+	/*!
+	* The files are copied to the destination one at a time by WriteNext (e.g.
+	* on a background thread) while they keep being used. Preserve must be
+	* called before a region file is modified: if that file hasn't been copied
+	* yet, its current content is kept in memory and written in its place, so
+	* the destination ends up with every file as it was when the snapshot was
+	* taken.
+	*
+	* Files added with AddDelta are written as deltas: only the given sectors,
+	* which ApplyDelta writes over the copy of the file in an earlier snapshot.
+	*
+	* \see RegionCellCache::BeginSnapshot
+	*/
+	class RegionSnapshot
+	{
+	public:
+		//! CTOR
+		/*!
+		* \param files
+		* The region files to copy (these should be flushed before the snapshot is taken)
+		*
+		* \param destination
+		* The folder to copy the files to
+		*/
+		RegionSnapshot(const std::vector<boost::filesystem::path>& files, const boost::filesystem::path& destination);
+
+		//! Extension of delta files, which are written in place of the region file (e.g. "0.0.celldelta")
+		static const char* const s_DeltaExtension;
+
+		//! Adds a file that will be written as a delta containing the given sectors
+		/*!
+		* Must be called before the first call to WriteNext.
+		*/
+		void AddDelta(const boost::filesystem::path& file, const boost::dynamic_bitset<>& sectors);
+
+		//! Writes a delta containing the given sectors of the region file data read from region_data
+		static void WriteDelta(std::ostream& delta, std::istream& region_data, uint64_t length, const boost::dynamic_bitset<>& sectors);
+		//! Writes the sectors in the given delta over the region file at the given path (creating it if necessary)
+		static void ApplyDelta(std::istream& delta, const boost::filesystem::path& region_file);
+
+		//! Keeps the current content of the given region file, if it is in this snapshot and hasn't been written yet
+		void Preserve(const RegionFile& region_file);
+
+		//! Writes the next file to the destination
+		/*!
+		* \return False if there were no files left to write
+		*/
+		bool WriteNext();
+
+		size_t GetNumFiles() const { return m_Files.size(); }
+		//! Returns the number of files that are written as deltas
+		size_t GetNumDeltas() const { return m_NumDeltas; }
+		//! Returns the number of files that were modified before they were written (so were copied from memory)
+		size_t GetNumPreserved() const;
+
+	private:
+		struct File
+		{
+			boost::filesystem::path source;
+			boost::filesystem::path dest;
+			bool written;
+			std::shared_ptr<std::vector<char>> preserved;
+			// Sectors to write, for files written as deltas (empty otherwise)
+			boost::dynamic_bitset<> deltaSectors;
+
+			File() : written(false) {}
+		};
+		std::vector<File> m_Files;
+		boost::filesystem::path m_Destination;
+		// Indexed by file name (the files are all in one folder)
+		std::unordered_map<std::string, size_t> m_FileIndices;
+
+		size_t m_NextFile;
+		size_t m_NumPreserved;
+		size_t m_NumDeltas;
+
+		// Held while a file is copied, so Preserve waits for the copy rather than letting the file change half way through
+		mutable std::mutex m_Mutex;
+
+		//! Writes the given file to its destination (from the preserved content, if it isn't null)
+		static void writeFile(const File& file, const std::vector<char>* preserved);
+
+		RegionSnapshot(const RegionSnapshot&);
+		RegionSnapshot& operator=(const RegionSnapshot&);
+	};
+
+}
+
+#endif
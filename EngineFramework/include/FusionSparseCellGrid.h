@@ -0,0 +1,370 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author:
+*    Elliot Hayward
+*/
+
+#ifndef H_FusionSparseCellGrid
+#define H_FusionSparseCellGrid
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "FusionPrerequisites.h"
+
+#include "FusionVectorTypes.h"
+
+#include <array>
+#include <bitset>
+#include <memory>
+#include <vector>
+
+#include <ClanLib/Core/Math/rect.h>
+
+namespace FusionEngine
+{
+
+	//! Sparse, unbounded 2D grid of values indexed by cell location
+	/*!
+	* Cells are grouped into square chunks (s_ChunkSize cells across); chunks are
+	* stored in an open-addressed (linear probing) hash table keyed on the chunk
+	* location. This gives constant-time point lookups, and allows rectangular
+	* ranges to be iterated without visiting cells outside the range (which a
+	* std::map sorted by y then x can't do.)
+	*
+	* Structural changes (insert / erase) must not be made while iterating.
+	*/
+	template <typename T>
+	class SparseCellGrid
+	{
+	public:
+		static const int32_t s_ChunkShift = 4;
+		static const int32_t s_ChunkSize = 1 << s_ChunkShift;
+		static const int32_t s_ChunkMask = s_ChunkSize - 1;
+		static const size_t s_CellsPerChunk = s_ChunkSize * s_ChunkSize;
+
+		SparseCellGrid()
+			: m_NumCells(0),
+			m_NumChunks(0)
+		{
+			m_Slots.resize(s_InitialCapacity);
+		}
+
+		//! Returns the value at the given location, or nullptr if there is none
+		T* find(const CellHandle& location)
+		{
+			if (Chunk* chunk = findChunk(toChunkLocation(location)))
+			{
+				const size_t i = toLocalIndex(location);
+				if (chunk->occupied.test(i))
+					return &chunk->values[i];
+			}
+			return nullptr;
+		}
+
+		//! Returns the value at the given location, or nullptr if there is none
+		const T* find(const CellHandle& location) const
+		{
+			return const_cast<SparseCellGrid*>(this)->find(location);
+		}
+
+		//! Returns true if there is a value at the given location
+		bool contains(const CellHandle& location) const
+		{
+			return find(location) != nullptr;
+		}
+
+		//! Returns the value at the given location, default-constructing it if necessary
+		T& operator[](const CellHandle& location)
+		{
+			Chunk& chunk = getOrCreateChunk(toChunkLocation(location));
+			const size_t i = toLocalIndex(location);
+			if (!chunk.occupied.test(i))
+			{
+				chunk.occupied.set(i);
+				++m_NumCells;
+			}
+			return chunk.values[i];
+		}
+
+		//! Sets the value at the given location, returning a reference to the stored value
+		T& insert(const CellHandle& location, T value)
+		{
+			T& stored = (*this)[location];
+			stored = std::move(value);
+			return stored;
+		}
+
+		//! Removes the value at the given location
+		/*!
+		* \return true if there was a value to remove
+		*/
+		bool erase(const CellHandle& location)
+		{
+			const CellHandle chunkLocation = toChunkLocation(location);
+			const size_t slot = findSlot(chunkLocation);
+			if (slot == s_NoSlot)
+				return false;
+
+			Chunk& chunk = *m_Slots[slot];
+			const size_t i = toLocalIndex(location);
+			if (!chunk.occupied.test(i))
+				return false;
+
+			chunk.occupied.reset(i);
+			chunk.values[i] = T();
+			--m_NumCells;
+
+			// Release the chunk once it is empty
+			if (chunk.occupied.none())
+				eraseSlot(slot);
+
+			return true;
+		}
+
+		//! Removes all values
+		void clear()
+		{
+			m_Slots.clear();
+			m_Slots.resize(s_InitialCapacity);
+			m_NumCells = 0;
+			m_NumChunks = 0;
+		}
+
+		//! Number of values stored
+		size_t size() const { return m_NumCells; }
+		//! True if no values are stored
+		bool empty() const { return m_NumCells == 0; }
+
+		//! Calls fn(const CellHandle&, T&) for every value in the grid
+		template <typename Fn>
+		void for_each(Fn&& fn)
+		{
+			for (auto it = m_Slots.begin(), end = m_Slots.end(); it != end; ++it)
+			{
+				if (Chunk* chunk = it->get())
+					forEachInChunk(*chunk, 0, s_ChunkMask, 0, s_ChunkMask, fn);
+			}
+		}
+
+		//! Calls fn(const CellHandle&, const T&) for every value in the grid
+		template <typename Fn>
+		void for_each(Fn&& fn) const
+		{
+			for (auto it = m_Slots.begin(), end = m_Slots.end(); it != end; ++it)
+			{
+				if (const Chunk* chunk = it->get())
+					forEachInChunk(*chunk, 0, s_ChunkMask, 0, s_ChunkMask, fn);
+			}
+		}
+
+		//! Calls fn(const CellHandle&, T&) for each value within the given (inclusive) range
+		/*!
+		* Only cells that actually hold values within the range are visited; the
+		* order is row-major within each chunk.
+		*/
+		template <typename Fn>
+		void for_each_in_range(const clan::Rect& range, Fn&& fn)
+		{
+			forEachInRange(*this, range, fn);
+		}
+
+		//! Calls fn(const CellHandle&, const T&) for each value within the given (inclusive) range
+		template <typename Fn>
+		void for_each_in_range(const clan::Rect& range, Fn&& fn) const
+		{
+			forEachInRange(*this, range, fn);
+		}
+
+	private:
+		static const size_t s_InitialCapacity = 64; // must be a power of two
+		static const size_t s_NoSlot = ~size_t(0);
+
+		struct Chunk
+		{
+			CellHandle location;
+			std::bitset<s_CellsPerChunk> occupied;
+			std::array<T, s_CellsPerChunk> values;
+
+			explicit Chunk(const CellHandle& location_)
+				: location(location_)
+			{}
+		};
+
+		std::vector<std::unique_ptr<Chunk>> m_Slots;
+		size_t m_NumCells;
+		size_t m_NumChunks;
+
+		// Arithmetic shift rounds towards negative infinity, which is what's wanted for negative cell locations
+		static int32_t toChunkCoord(int32_t cell_coord) { return cell_coord >> s_ChunkShift; }
+
+		static CellHandle toChunkLocation(const CellHandle& location)
+		{
+			return CellHandle(toChunkCoord(location.x), toChunkCoord(location.y));
+		}
+
+		static size_t toLocalIndex(const CellHandle& location)
+		{
+			return size_t(location.x & s_ChunkMask) + size_t(location.y & s_ChunkMask) * s_ChunkSize;
+		}
+
+		static size_t hashChunkLocation(const CellHandle& chunk_location)
+		{
+			// Spread both coords over the word before mixing (so neighbouring chunks don't cluster)
+			uint32_t h = uint32_t(chunk_location.x) * 0x9E3779B1u;
+			h ^= uint32_t(chunk_location.y) * 0x85EBCA77u;
+			h ^= h >> 15;
+			h *= 0xC2B2AE3Du;
+			h ^= h >> 13;
+			return size_t(h);
+		}
+
+		size_t findSlot(const CellHandle& chunk_location) const
+		{
+			const size_t mask = m_Slots.size() - 1;
+			for (size_t i = hashChunkLocation(chunk_location) & mask;; i = (i + 1) & mask)
+			{
+				const Chunk* chunk = m_Slots[i].get();
+				if (!chunk)
+					return s_NoSlot;
+				if (chunk->location == chunk_location)
+					return i;
+			}
+		}
+
+		Chunk* findChunk(const CellHandle& chunk_location) const
+		{
+			const size_t slot = findSlot(chunk_location);
+			return slot != s_NoSlot ? m_Slots[slot].get() : nullptr;
+		}
+
+		Chunk& getOrCreateChunk(const CellHandle& chunk_location)
+		{
+			if (Chunk* existing = findChunk(chunk_location))
+				return *existing;
+
+			// Keep the load factor under 1/2 so probe sequences stay short
+			if ((m_NumChunks + 1) * 2 > m_Slots.size())
+				rehash(m_Slots.size() * 2);
+
+			std::unique_ptr<Chunk> chunk(new Chunk(chunk_location));
+			Chunk& result = *chunk;
+			placeChunk(std::move(chunk));
+			++m_NumChunks;
+			return result;
+		}
+
+		void placeChunk(std::unique_ptr<Chunk> chunk)
+		{
+			const size_t mask = m_Slots.size() - 1;
+			size_t i = hashChunkLocation(chunk->location) & mask;
+			while (m_Slots[i])
+				i = (i + 1) & mask;
+			m_Slots[i] = std::move(chunk);
+		}
+
+		void rehash(size_t new_capacity)
+		{
+			std::vector<std::unique_ptr<Chunk>> oldSlots(new_capacity);
+			oldSlots.swap(m_Slots);
+			for (auto it = oldSlots.begin(), end = oldSlots.end(); it != end; ++it)
+			{
+				if (*it)
+					placeChunk(std::move(*it));
+			}
+		}
+
+		//! Removes the chunk in the given slot, shifting back any entries in the same probe sequence
+		void eraseSlot(size_t slot)
+		{
+			const size_t mask = m_Slots.size() - 1;
+			m_Slots[slot].reset();
+			--m_NumChunks;
+
+			size_t hole = slot;
+			for (size_t i = (slot + 1) & mask; m_Slots[i]; i = (i + 1) & mask)
+			{
+				const size_t ideal = hashChunkLocation(m_Slots[i]->location) & mask;
+				// Move the entry into the hole if the hole lies (cyclically) between its ideal slot and its current slot
+				const bool canMove = (hole <= i) ? (ideal <= hole || ideal > i) : (ideal <= hole && ideal > i);
+				if (canMove)
+				{
+					m_Slots[hole] = std::move(m_Slots[i]);
+					hole = i;
+				}
+			}
+		}
+
+		template <typename ChunkT, typename Fn>
+		static void forEachInChunk(ChunkT& chunk, int32_t left, int32_t right, int32_t top, int32_t bottom, Fn& fn)
+		{
+			if (chunk.occupied.none())
+				return;
+			const int32_t baseX = chunk.location.x << s_ChunkShift;
+			const int32_t baseY = chunk.location.y << s_ChunkShift;
+			for (int32_t ly = top; ly <= bottom; ++ly)
+			{
+				for (int32_t lx = left; lx <= right; ++lx)
+				{
+					const size_t i = size_t(lx) + size_t(ly) * s_ChunkSize;
+					if (chunk.occupied.test(i))
+						fn(CellHandle(baseX + lx, baseY + ly), chunk.values[i]);
+				}
+			}
+		}
+
+		template <typename GridT, typename Fn>
+		static void forEachInRange(GridT& grid, const clan::Rect& range, Fn& fn)
+		{
+			if (range.right < range.left || range.bottom < range.top || grid.empty())
+				return;
+
+			const int32_t chunkLeft = toChunkCoord(range.left), chunkRight = toChunkCoord(range.right);
+			const int32_t chunkTop = toChunkCoord(range.top), chunkBottom = toChunkCoord(range.bottom);
+
+			for (int32_t cy = chunkTop; cy <= chunkBottom; ++cy)
+			{
+				// Clip the range to this row of chunks
+				const int32_t localTop = (cy == chunkTop) ? (range.top & s_ChunkMask) : 0;
+				const int32_t localBottom = (cy == chunkBottom) ? (range.bottom & s_ChunkMask) : s_ChunkMask;
+				for (int32_t cx = chunkLeft; cx <= chunkRight; ++cx)
+				{
+					if (auto chunk = grid.findChunk(CellHandle(cx, cy)))
+					{
+						const int32_t localLeft = (cx == chunkLeft) ? (range.left & s_ChunkMask) : 0;
+						const int32_t localRight = (cx == chunkRight) ? (range.right & s_ChunkMask) : s_ChunkMask;
+						forEachInChunk(*chunk, localLeft, localRight, localTop, localBottom, fn);
+					}
+				}
+			}
+		}
+
+		// Non-copyable
+		SparseCellGrid(const SparseCellGrid&);
+		SparseCellGrid& operator=(const SparseCellGrid&);
+	};
+
+}
+
+#endif
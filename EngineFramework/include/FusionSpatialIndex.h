@@ -0,0 +1,150 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author:
+*    Elliot Hayward
+*/
+
+#ifndef H_FusionSpatialIndex
+#define H_FusionSpatialIndex
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "FusionPrerequisites.h"
+
+#include "FusionSparseCellGrid.h"
+#include "FusionTypes.h"
+#include "FusionVectorTypes.h"
+
+#include <tbb/spin_rw_mutex.h>
+
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class asIScriptEngine;
+
+namespace FusionEngine
+{
+
+	//! Grid of active entity positions, for proximity queries
+	/*!
+	* Entities are bucketed by position into square cells; each bucket stores
+	* positions apart from the entities (SoA) so they can be tested in bulk.
+	* EntityManager keeps the index in step with the active entity list:
+	* entities are inserted when activated, moved as they are updated and
+	* removed when deactivated.
+	*
+	* Queries append to the given results vector (it isn't cleared), so callers
+	* can reuse a buffer between queries. All methods are thread-safe; queries
+	* can run concurrently with each other.
+	*
+	* Entries are plain pointers (so the index doesn't count as a reference when
+	* EntityManager checks whether an entity can be dropped): entities must be
+	* removed before they are destroyed.
+	*/
+	class SpatialIndex
+	{
+	public:
+		//! Constructor
+		explicit SpatialIndex(float cell_size = 10.f);
+
+		//! Sets the width / height of the grid cells (re-buckets all entries)
+		/*!
+		* The best size is about the radius of typical queries: smaller cells
+		* mean more buckets to visit, larger cells mean more entries to test.
+		*/
+		void SetCellSize(float cell_size);
+		float GetCellSize() const { return m_CellSize; }
+
+		//! Adds the given entity, or updates its position if it is already indexed
+		void Update(const EntityPtr& entity, const Vector2& position);
+		//! Removes the given entity (no-op if it isn't indexed)
+		void Remove(const EntityPtr& entity);
+		//! Removes all entities
+		void Clear();
+
+		//! Returns the number of indexed entities
+		size_t GetNumEntities() const;
+
+		//! Finds entities within the given distance of centre
+		/*!
+		* \return The number of entities appended to results
+		*/
+		size_t QueryRadius(const Vector2& centre, float radius, std::vector<EntityPtr>& results) const;
+
+		//! Finds the (up to) k entities closest to point, nearest first
+		/*!
+		* \param max_distance
+		* Entities further away than this are ignored
+		*
+		* \return The number of entities appended to results
+		*/
+		size_t QueryNearest(const Vector2& point, size_t k, std::vector<EntityPtr>& results, float max_distance = std::numeric_limits<float>::infinity()) const;
+
+		//! Finds entities within radius of the segment from start to end, ordered by distance along the segment
+		/*!
+		* Useful for line of fire / path sweeps: the first result is the first
+		* entity a circle of the given radius would touch moving from start to end.
+		*
+		* \return The number of entities appended to results
+		*/
+		size_t QuerySegment(const Vector2& start, const Vector2& end, float radius, std::vector<EntityPtr>& results) const;
+
+		//! Registers the script interface
+		static void Register(asIScriptEngine* engine);
+
+	private:
+		struct Bucket
+		{
+			std::vector<Entity*> entities;
+			std::vector<float> positionsX, positionsY;
+		};
+
+		struct Location
+		{
+			CellHandle cell;
+			size_t slot;
+		};
+
+		float m_CellSize;
+		float m_InverseCellSize;
+
+		SparseCellGrid<Bucket> m_Grid;
+		std::unordered_map<const Entity*, Location> m_Locations;
+
+		typedef tbb::spin_rw_mutex Mutex_t;
+		mutable Mutex_t m_Mutex;
+
+		CellHandle toCellLocation(float x, float y) const;
+		clan::Rect toCellRange(const Vector2& lb, const Vector2& ub) const;
+
+		void addToBucket(const CellHandle& cell, Entity* entity, const Vector2& position);
+		void removeFromBucket(const Location& location);
+	};
+
+}
+
+#endif
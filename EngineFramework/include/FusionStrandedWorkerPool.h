@@ -0,0 +1,146 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author:
+*    Elliot Hayward
+*/
+
+#ifndef H_FusionStrandedWorkerPool
+#define H_FusionStrandedWorkerPool
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "FusionPrerequisites.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace FusionEngine
+{
+
+	//! Pool of threads that run jobs grouped into strands
+	/*!
+	* Jobs posted to the same strand run one at a time, in the order they were
+	* posted; jobs on different strands run concurrently. When choosing the next
+	* strand to run, strands with high-priority jobs queued go first.
+	*
+	* The threads are dedicated to this pool (rather than using the TBB
+	* scheduler) because jobs are expected to block on IO.
+	*/
+	class StrandedWorkerPool
+	{
+	public:
+		typedef uint64_t StrandKey_t;
+		typedef std::function<void ()> Job_t;
+		typedef std::function<void ()> ThreadCallback_t;
+
+		enum Priority { Normal, High };
+
+		//! CTOR
+		/*!
+		* \param num_threads
+		* Zero to use a thread for each core besides the one the caller is on
+		*
+		* \param on_thread_start
+		* Called on each worker thread before it runs any jobs (e.g. to set the thread priority)
+		*
+		* \param on_thread_exit
+		* Called on each worker thread before it exits (e.g. to clean up thread-local state)
+		*/
+		explicit StrandedWorkerPool(size_t num_threads = 0, const ThreadCallback_t& on_thread_start = ThreadCallback_t(), const ThreadCallback_t& on_thread_exit = ThreadCallback_t());
+		//! DTOR - runs any jobs that are still queued, then joins the threads
+		~StrandedWorkerPool();
+
+		//! Queues the given job to run after any jobs already posted to the same strand
+		void Post(StrandKey_t strand, const Job_t& job, Priority priority = Normal);
+
+		//! Blocks until all posted jobs have finished (including jobs posted while waiting)
+		void WaitForIdle();
+
+		//! Returns the number of jobs that have been posted but haven't finished
+		size_t GetNumPendingJobs() const;
+
+		size_t GetNumThreads() const { return m_Threads.size(); }
+
+	private:
+		struct QueuedJob
+		{
+			Job_t fn;
+			Priority priority;
+
+			QueuedJob(const Job_t& fn_, Priority priority_)
+				: fn(fn_),
+				priority(priority_)
+			{}
+		};
+
+		struct Strand
+		{
+			std::deque<QueuedJob> jobs;
+			size_t numHighPriorityJobs;
+			bool running; // Claimed by a worker (so it isn't in either ready list)
+
+			Strand()
+				: numHighPriorityJobs(0),
+				running(false)
+			{}
+		};
+
+		typedef std::unordered_map<StrandKey_t, Strand> StrandMap_t;
+		StrandMap_t m_Strands;
+
+		// Strands that have jobs queued and aren't running
+		std::deque<StrandKey_t> m_ReadyHighPriority;
+		std::deque<StrandKey_t> m_ReadyNormalPriority;
+
+		size_t m_NumPendingJobs;
+		bool m_Quit;
+
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_JobsReady;
+		std::condition_variable m_Idle;
+
+		std::vector<std::thread> m_Threads;
+
+		ThreadCallback_t m_OnThreadStart;
+		ThreadCallback_t m_OnThreadExit;
+
+		void Run();
+
+		//! Adds the given (non-running) strand to the ready list matching its highest priority job
+		void MakeReady(StrandKey_t key, const Strand& strand);
+
+		// Non-copyable
+		StrandedWorkerPool(const StrandedWorkerPool&);
+		StrandedWorkerPool& operator=(const StrandedWorkerPool&);
+	};
+
+}
+
+#endif
@@ -44,10 +44,12 @@
 #include "FusionCameraManager.h"
 #include "FusionCell.h"
 #include "FusionIDStack.h"
+#include "FusionSparseCellGrid.h"
 
 #include "FusionHashable.h"
 
 //#include <tbb/concurrent_unordered_map.h>
+#include <tbb/concurrent_queue.h>
 #include <tbb/spin_mutex.h>
 #include <boost/thread/recursive_mutex.hpp>
 
@@ -111,6 +113,41 @@ namespace FusionEngine
 		void SetPollArchiveInterval(const float interval);
 		float GetPollArchiveInterval() const { return m_PollArchiveInterval; }
 
+		//! Sets how far ahead (in seconds) camera movement is projected to prefetch cells (0 disables prefetching)
+		void SetPrefetchHorizon(const float seconds);
+		float GetPrefetchHorizon() const { return m_PrefetchHorizon; }
+
+		//! Sets the maximum number of cells that can be prefetched at once
+		void SetMaxPrefetchedCells(const size_t max_cells) { m_MaxPrefetchedCells = max_cells; }
+		size_t GetMaxPrefetchedCells() const { return m_MaxPrefetchedCells; }
+
+		//! Sets the memory (in bytes) that can be used to keep recently deactivated cells loaded
+		/*!
+		* Cells that leave the active range are kept (least-recently-used first out)
+		* until this is exceeded, so moving back and forth across a cell boundary
+		* doesn't cause them to be written and reloaded. 0 disables the cache (cells
+		* are passed to the archivist as soon as they are deactivated.)
+		*/
+		void SetHotCellCacheSize(const size_t bytes);
+		size_t GetHotCellCacheSize() const { return m_MaxHotCellBytes; }
+
+		//! Hot-cell cache counters
+		struct HotCellCacheStats
+		{
+			//! Cells that were taken from the cache rather than the archivist
+			uint64_t hits;
+			//! Cells that had to be requested from the archivist
+			uint64_t misses;
+			//! Cells passed to the archivist to make room
+			uint64_t evictions;
+			//! Current contents
+			size_t numCells;
+			size_t bytes;
+
+			HotCellCacheStats() : hits(0), misses(0), evictions(0), numCells(0), bytes(0) {}
+		};
+		const HotCellCacheStats& GetHotCellCacheStats() const { return m_HotCellStats; }
+
 		//! Adds the given camera
 		void AddCamera(const CameraPtr &cam, float range = -1.f);
 		//! Removes the given camera
@@ -127,6 +164,9 @@ namespace FusionEngine
 		//! Returns the default range
 		float GetRange() const;
 
+		//! Appends the current stream position of every camera (local and remote) to the given list
+		void GetStreamPositions(std::vector<Vector2>& positions_out);
+
 		//clan::Rectf CalculateActiveArea(PlayerID net_idx) const;
 
 		//unsigned int GetNumCellsAcross() const { return m_XCellCount; }
@@ -311,33 +351,135 @@ namespace FusionEngine
 		float m_InverseCellSize;
 
 		typedef std::map<CellHandle, std::shared_ptr<Cell>, CellHandleGreater> CellMap_t;
-
-		// Cells are sorted by y then x, so they can be iterated over linearly when processing
-		CellMap_t m_Cells;
-		// Where entities are stored until the correct cell is loaded for them
-		Cell m_TheVoid;
+		typedef SparseCellGrid<std::shared_ptr<Cell>> CellGrid_t;
+
+		// Cells are indexed by location, so lookups are constant-time and ranges can be iterated without touching cells outside them
+		CellGrid_t m_Cells;
+		// Where entities are stored until the correct cell is loaded for them: there is a list for each cell being
+		//  waited for, so the entities can be moved as soon as it loads, and rect. queries only visit the relevant lists
+		CellGrid_t m_TheVoid;
+		size_t m_NumEntitiesInTheVoid;
+		// Locks The Void and m_CellsBeingLoaded
+		Cell::mutex_t m_VoidMutex;
 		CellMap_t m_CellsBeingLoaded;
 		// Entities that have been requested useing the public method ActivateEntity(ObjectID)
 		std::map<CellHandle, std::set<ObjectID>, CellHandleGreater> m_RequestedEntities;
 
 		float m_PollArchiveInterval;
-		float m_TimeUntilVoidRefresh;
+
+		// Cells that the archivist has finished loading (pushed from the archivist's thread)
+		tbb::concurrent_queue<CellHandle> m_LoadedCells;
+		boost::signals2::connection m_CellLoadedConnection;
+		// Void lists that couldn't be moved into their cells last time they were checked
+		std::vector<CellHandle> m_VoidCellsToRehome;
+		// Counts down to the next time every Void list is checked (see s_VoidPollInterval)
+		unsigned int m_UpdatesUntilVoidPoll;
+
+		//! Adds an entry for the given entity to The Void, to wait for the cell at the given location
+		CellEntry& addToTheVoid(const CellHandle& target, const EntityPtr& entity, const Vector2& position, const CellEntry& entry = CellEntry());
+		//! Returns the Void list containing the given entity
+		Cell* findVoidCell(const EntityPtr& entity);
+		//! Removes an entry from the Void list for the given target (the list is dropped once it's empty)
+		void removeFromTheVoid(const CellHandle& target, size_t slot);
+		//! Moves the entities waiting in The Void for the given cell into it
+		/*!
+		* \return False if the cell couldn't be locked (so this should be tried again later)
+		*/
+		bool rehomeVoidEntities(const CellHandle& location);
 
 		CellMap_t m_CellsToStore;
 
 		CellArchiver* m_Archivist;
 
+		struct PrefetchedCell
+		{
+			std::shared_ptr<Cell> cell;
+			//! Predicted time (on m_PrefetchClock) at which the cell will enter an active range
+			float timeOfNeed;
+		};
+		typedef std::map<CellHandle, PrefetchedCell, CellHandleGreater> PrefetchedCellMap_t;
+		// Cells requested ahead of the cameras (moved into m_Cells when they come into range)
+		PrefetchedCellMap_t m_PrefetchedCells;
+		float m_PrefetchHorizon;
+		size_t m_MaxPrefetchedCells;
+		float m_PrefetchClock;
+
+		//! Projects moving cameras ahead and prefetches the cells they are expected to need
+		void updatePrefetch();
+		//! Cancels all prefetch requests
+		void cancelPrefetches();
+		//! Returns the cached / prefetched cell at the given location if there is one, otherwise retrieves the cell
+		std::shared_ptr<Cell> claimOrRetrieveCell(const CellHandle& location);
+
+		struct HotCell
+		{
+			CellHandle location;
+			std::shared_ptr<Cell> cell;
+			//! Estimated memory used by the cell when it was added
+			size_t bytes;
+		};
+		typedef std::list<HotCell> HotCellList_t;
+		// Recently deactivated cells, most recently deactivated first
+		HotCellList_t m_HotCells;
+		std::map<CellHandle, HotCellList_t::iterator, CellHandleGreater> m_HotCellIndex;
+		size_t m_MaxHotCellBytes;
+		HotCellCacheStats m_HotCellStats;
+
+		//! Adds a deactivated cell to the hot-cell cache (or passes it to the archivist if the cache is disabled)
+		void cacheOrStoreCell(const CellHandle& location, std::shared_ptr<Cell> cell);
+		//! Removes and returns the cached cell at the given location (null if it isn't cached)
+		std::shared_ptr<Cell> claimHotCell(const CellHandle& location);
+		//! Returns the cached cell at the given location without claiming it (null if it isn't cached)
+		Cell* findHotCell(const CellHandle& location) const;
+		//! Passes least-recently deactivated cells to the archivist until the cache is within the given size
+		void evictHotCells(const size_t max_bytes);
+		//! Passes all cached cells to the archivist
+		void flushHotCells();
+
+		//! Events generated while processing a cell (published after all cells in the step have been processed)
+		struct CellEvents
+		{
+			std::vector<ActivationEvent> activationEvents;
+			std::vector<RemoteActivationEvent> remoteActivationEvents;
+			//! Whether each event, in the order they were generated, is a remote one (so local and remote events stay interleaved)
+			std::vector<bool> isRemote;
+
+			void push_back(const ActivationEvent& ev)
+			{
+				activationEvents.push_back(ev);
+				isRemote.push_back(false);
+			}
+
+			void push_back(const RemoteActivationEvent& ev)
+			{
+				remoteActivationEvents.push_back(ev);
+				isRemote.push_back(true);
+			}
+
+			void clear()
+			{
+				activationEvents.clear();
+				remoteActivationEvents.clear();
+				isRemote.clear();
+			}
+		};
+		//! Event buffers for the cells processed in parallel by Update(), one per cell (kept between updates so their storage is reused)
+		std::vector<CellEvents> m_CellEvents;
+
+		//! Fires the buffered events, in the order they were generated
+		void publishEvents(CellEvents& events);
+
 		void StoreWhenDereferenced(const CellHandle& location);
 		void StoreWhenDereferenced(const CellHandle& location, const std::shared_ptr<Cell>& cell);
-		void StoreWhenDereferenced(const CellMap_t::iterator& location);
 
 		std::shared_ptr<Cell>& RetrieveCell(const CellHandle &location);
 		void StoreCell(const CellHandle& location);
-		void StoreCell(const CellMap_t::iterator& location);
 		//! Makes sure that the given cell is in either Ready or Retrieve state
 		bool ConfirmRetrieval(const CellHandle &location, Cell* cell);
 
 		void ActivateEntity(const CellHandle& cell_location, Cell &cell, const EntityPtr &entity, CellEntry &entry);
+		//! Updates the entry / cell state for activation without generating an event
+		void activateEntry(const CellHandle& cell_location, Cell &cell, const EntityPtr &entity, CellEntry &entry);
 		void DeactivateEntity(Cell &cell, const EntityPtr &entity, CellEntry &entry);
 
 		void RemoteActivateEntity(CellEntry& entry, ObjectID entity, PlayerID viewer, std::shared_ptr<RakNet::BitStream> state);
@@ -361,10 +503,24 @@ namespace FusionEngine
 
 		void deactivateCells(const clan::Rect& inactiveRange);
 
-		// TODO: replace the pair here with a struct CamToProcess { Vec2, float }
-		void processCell(const CellHandle& cell_location, Cell& cell, const std::list<std::pair<Vector2, float>>& cam_position, const std::list<std::pair<std::pair<Vector2, float>, PlayerID>>& remote_positions);
+		//! Stream positions laid out for StreamingRangeKernel (local positions first, then remote)
+		struct StreamCircles
+		{
+			std::vector<float> x, y, rangeSquared;
+			std::vector<PlayerID> remoteOwners;
+			size_t numLocal;
+
+			StreamCircles(const LocalStreamPositionsList_t& local_positions, const RemoteStreamPositionsList_t& remote_positions);
+		};
+
+		//! Activates / deactivates entries in the given cell according to the given stream positions
+		/*!
+		* Safe to call concurrently for different cells: events are written to events_out
+		* rather than being signalled.
+		*/
+		void processCell(const CellHandle& cell_location, Cell& cell, const StreamCircles& circles, CellEvents& events_out);
 
-		void activateInView(const CellHandle& cell_location, Cell *cell, CellEntry *cell_entry, const EntityPtr &entity, bool warp);
+		void activateInView(const CellHandle& cell_location, Cell *cell, CellEntry *cell_entry, const EntityPtr &entity, const Vector2& position, bool warp);
 
 		bool updateStreamingCamera(StreamingCamera &cam, CameraPtr camera);
 	};
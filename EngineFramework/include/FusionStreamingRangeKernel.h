@@ -0,0 +1,120 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author:
+*    Elliot Hayward
+*/
+
+#ifndef H_FusionStreamingRangeKernel
+#define H_FusionStreamingRangeKernel
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "FusionPrerequisites.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define FSN_STREAMING_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace FusionEngine
+{
+
+	//! Bulk range tests for streaming
+	namespace StreamingRangeKernel
+	{
+
+		//! Value written by ClassifyPositions for positions that aren't within any circle
+		static const int32_t s_OutOfRange = -1;
+
+		//! Finds the first circle (if any) that contains each position
+		/*!
+		* For each i in [0, count), out_circle[i] is set to the index of the first
+		* circle such that the squared distance from (xs[i], ys[i]) to (cx[c], cy[c])
+		* is no greater than radius_sq[c], or s_OutOfRange if there is no such circle.
+		* Callers can order the circles by priority (e.g. local cameras before remote
+		* ones) to classify every position in a single pass.
+		*/
+		inline void ClassifyPositionsScalar(const float* xs, const float* ys, size_t count,
+			const float* cx, const float* cy, const float* radius_sq, size_t num_circles,
+			int32_t* out_circle)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				int32_t result = s_OutOfRange;
+				for (size_t c = 0; c < num_circles; ++c)
+				{
+					const float dx = xs[i] - cx[c], dy = ys[i] - cy[c];
+					if (dx * dx + dy * dy <= radius_sq[c])
+					{
+						result = int32_t(c);
+						break;
+					}
+				}
+				out_circle[i] = result;
+			}
+		}
+
+		//! Finds the first circle (if any) that contains each position (see ClassifyPositionsScalar)
+		/*!
+		* Processes four positions at a time where SSE2 is available.
+		*/
+		inline void ClassifyPositions(const float* xs, const float* ys, size_t count,
+			const float* cx, const float* cy, const float* radius_sq, size_t num_circles,
+			int32_t* out_circle)
+		{
+			size_t i = 0;
+#ifdef FSN_STREAMING_SSE2
+			const __m128i outOfRange = _mm_set1_epi32(s_OutOfRange);
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128 px = _mm_loadu_ps(xs + i);
+				const __m128 py = _mm_loadu_ps(ys + i);
+				__m128i result = outOfRange;
+				// Lanes that haven't found a circle yet
+				__m128i unresolved = _mm_set1_epi32(-1);
+				for (size_t c = 0; c < num_circles; ++c)
+				{
+					const __m128 dx = _mm_sub_ps(px, _mm_set1_ps(cx[c]));
+					const __m128 dy = _mm_sub_ps(py, _mm_set1_ps(cy[c]));
+					const __m128 distSq = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+					const __m128i inside = _mm_castps_si128(_mm_cmple_ps(distSq, _mm_set1_ps(radius_sq[c])));
+					const __m128i hit = _mm_and_si128(inside, unresolved);
+					result = _mm_or_si128(_mm_andnot_si128(hit, result), _mm_and_si128(hit, _mm_set1_epi32(int32_t(c))));
+					unresolved = _mm_andnot_si128(hit, unresolved);
+					if (_mm_movemask_epi8(unresolved) == 0)
+						break;
+				}
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out_circle + i), result);
+			}
+#endif
+			// Remainder (or everything, if SSE2 isn't available)
+			ClassifyPositionsScalar(xs + i, ys + i, count - i, cx, cy, radius_sq, num_circles, out_circle + i);
+		}
+
+	}
+
+}
+
+#endif
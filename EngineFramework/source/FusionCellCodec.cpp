@@ -0,0 +1,380 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author:
+*    Elliot Hayward
+*/
+
+#include "PrecompiledHeaders.h"
+
+#include "FusionCellCodec.h"
+
+#include "FusionExceptionFactory.h"
+
+#include <tbb/enumerable_thread_specific.h>
+
+#include <zlib.h>
+
+#ifdef FSN_USE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef FSN_USE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+namespace FusionEngine
+{
+
+	namespace
+	{
+		//! zlib state that is reset rather than reallocated for each cell
+		struct ZlibStreams
+		{
+			z_stream deflater;
+			z_stream inflater;
+			bool deflaterOk;
+			bool inflaterOk;
+
+			ZlibStreams()
+			{
+				std::memset(&deflater, 0, sizeof(deflater));
+				std::memset(&inflater, 0, sizeof(inflater));
+				deflaterOk = deflateInit(&deflater, Z_DEFAULT_COMPRESSION) == Z_OK;
+				inflaterOk = inflateInit(&inflater) == Z_OK;
+			}
+
+			~ZlibStreams()
+			{
+				if (deflaterOk)
+					deflateEnd(&deflater);
+				if (inflaterOk)
+					inflateEnd(&inflater);
+			}
+		};
+		tbb::enumerable_thread_specific<ZlibStreams> s_ZlibStreams;
+
+		void zlibCompress(const char* data, size_t length, std::vector<char>& out)
+		{
+			auto& streams = s_ZlibStreams.local();
+			if (!streams.deflaterOk)
+				FSN_EXCEPT(InvalidArgumentException, "Failed to initialise zlib");
+
+			z_stream& stream = streams.deflater;
+			deflateReset(&stream);
+
+			out.resize(deflateBound(&stream, (uLong)length));
+
+			stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+			stream.avail_in = (uInt)length;
+			stream.next_out = reinterpret_cast<Bytef*>(out.data());
+			stream.avail_out = (uInt)out.size();
+
+			// The output buffer is big enough for the whole lot, so this finishes in one call
+			const int result = deflate(&stream, Z_FINISH);
+			FSN_ASSERT(result == Z_STREAM_END);
+
+			out.resize(out.size() - stream.avail_out);
+		}
+
+		bool zlibDecompress(const char* data, size_t length, std::vector<char>& out)
+		{
+			auto& streams = s_ZlibStreams.local();
+			if (!streams.inflaterOk)
+				return false;
+
+			z_stream& stream = streams.inflater;
+			inflateReset(&stream);
+
+			stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+			stream.avail_in = (uInt)length;
+
+			// Use whatever capacity the buffer already has (cell data usually compresses about 4:1)
+			out.resize(std::max(out.capacity(), length * 4 + 64));
+
+			size_t produced = 0;
+			int result = Z_OK;
+			while (result == Z_OK)
+			{
+				if (produced == out.size())
+					out.resize(out.size() * 2);
+
+				stream.next_out = reinterpret_cast<Bytef*>(out.data() + produced);
+				stream.avail_out = (uInt)(out.size() - produced);
+
+				result = inflate(&stream, Z_NO_FLUSH);
+
+				produced = out.size() - stream.avail_out;
+
+				// No progress with output space available means the input was truncated
+				if (result == Z_BUF_ERROR && stream.avail_out > 0)
+					break;
+				if (result == Z_BUF_ERROR)
+					result = Z_OK;
+			}
+
+			out.resize(produced);
+
+			return result == Z_STREAM_END;
+		}
+
+#ifdef FSN_USE_LZ4
+		// LZ4 blocks don't record their decompressed size, so it is written in front
+		typedef uint32_t LZ4Header_t;
+
+		void lz4Compress(const char* data, size_t length, std::vector<char>& out)
+		{
+			if (length > (size_t)LZ4_MAX_INPUT_SIZE)
+				FSN_EXCEPT(InvalidArgumentException, "Too much data to compress with LZ4");
+
+			out.resize(sizeof(LZ4Header_t) + LZ4_compressBound((int)length));
+
+			const LZ4Header_t decompressedLength = (LZ4Header_t)length;
+			std::memcpy(out.data(), &decompressedLength, sizeof(LZ4Header_t));
+
+			const int compressedLength = LZ4_compress_default(data, out.data() + sizeof(LZ4Header_t), (int)length, (int)(out.size() - sizeof(LZ4Header_t)));
+			FSN_ASSERT(compressedLength > 0 || length == 0);
+
+			out.resize(sizeof(LZ4Header_t) + compressedLength);
+		}
+
+		bool lz4Decompress(const char* data, size_t length, std::vector<char>& out)
+		{
+			if (length < sizeof(LZ4Header_t))
+				return false;
+
+			LZ4Header_t decompressedLength;
+			std::memcpy(&decompressedLength, data, sizeof(LZ4Header_t));
+
+			out.resize(decompressedLength);
+			const int result = LZ4_decompress_safe(data + sizeof(LZ4Header_t), out.data(), (int)(length - sizeof(LZ4Header_t)), (int)decompressedLength);
+			return result == (int)decompressedLength;
+		}
+#endif
+
+#ifdef FSN_USE_ZSTD
+		// Compiled maps are compressed once and read many times, so this is well up the scale
+		const int s_ZstdLevel = 15;
+
+		struct ZstdContexts
+		{
+			ZSTD_CCtx* compression;
+			ZSTD_DCtx* decompression;
+
+			ZstdContexts()
+				: compression(ZSTD_createCCtx()),
+				decompression(ZSTD_createDCtx())
+			{}
+
+			~ZstdContexts()
+			{
+				ZSTD_freeCCtx(compression);
+				ZSTD_freeDCtx(decompression);
+			}
+		};
+		tbb::enumerable_thread_specific<ZstdContexts> s_ZstdContexts;
+#endif
+	}
+
+	std::string CellCodecToString(CellCodec codec)
+	{
+		switch (codec)
+		{
+		case CellCodec::Zlib: return "zlib";
+		case CellCodec::LZ4: return "lz4";
+		case CellCodec::Zstd: return "zstd";
+		default: return "unknown";
+		}
+	}
+
+	CellCodec CellCodecFromString(const std::string& name)
+	{
+		if (name == "lz4")
+			return CellCodec::LZ4;
+		else if (name == "zstd")
+			return CellCodec::Zstd;
+		else
+			return CellCodec::Zlib;
+	}
+
+	bool IsCellCodecAvailable(CellCodec codec)
+	{
+		switch (codec)
+		{
+		case CellCodec::Zlib:
+			return true;
+#ifdef FSN_USE_LZ4
+		case CellCodec::LZ4:
+			return true;
+#endif
+#ifdef FSN_USE_ZSTD
+		case CellCodec::Zstd:
+			return true;
+#endif
+		default:
+			return false;
+		}
+	}
+
+	CellCodec GetAvailableCellCodec(CellCodec preferred)
+	{
+		return IsCellCodecAvailable(preferred) ? preferred : CellCodec::Zlib;
+	}
+
+	struct CellCodecDictionary::impl
+	{
+#ifdef FSN_USE_ZSTD
+		ZSTD_CDict* compressionDict;
+		ZSTD_DDict* decompressionDict;
+
+		impl(const std::vector<char>& data)
+			: compressionDict(ZSTD_createCDict(data.data(), data.size(), s_ZstdLevel)),
+			decompressionDict(ZSTD_createDDict(data.data(), data.size()))
+		{}
+
+		~impl()
+		{
+			ZSTD_freeCDict(compressionDict);
+			ZSTD_freeDDict(decompressionDict);
+		}
+#endif
+	};
+
+	CellCodecDictionary::CellCodecDictionary(std::vector<char> data)
+		: m_Data(std::move(data)),
+		m_ID(0)
+	{
+#ifdef FSN_USE_ZSTD
+		m_ID = ZDICT_getDictID(m_Data.data(), m_Data.size());
+		m_Impl.reset(new impl(m_Data));
+#endif
+	}
+
+	CellCodecDictionary::~CellCodecDictionary()
+	{
+	}
+
+	std::shared_ptr<CellCodecDictionary> CellCodecDictionary::Train(const std::vector<std::vector<char>>& samples, size_t max_size)
+	{
+#ifdef FSN_USE_ZSTD
+		// The trainer takes the samples concatenated
+		std::vector<char> concatenated;
+		std::vector<size_t> sampleSizes;
+		sampleSizes.reserve(samples.size());
+		for (auto it = samples.begin(), end = samples.end(); it != end; ++it)
+		{
+			if (!it->empty())
+			{
+				concatenated.insert(concatenated.end(), it->begin(), it->end());
+				sampleSizes.push_back(it->size());
+			}
+		}
+
+		std::vector<char> dictionary(max_size);
+		const size_t result = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), concatenated.data(), sampleSizes.data(), (unsigned)sampleSizes.size());
+		if (ZDICT_isError(result))
+		{
+			AddLogEntry(std::string("Failed to train cell compression dictionary: ") + ZDICT_getErrorName(result), LOG_NORMAL);
+			return std::shared_ptr<CellCodecDictionary>();
+		}
+		dictionary.resize(result);
+
+		return std::make_shared<CellCodecDictionary>(std::move(dictionary));
+#else
+		return std::shared_ptr<CellCodecDictionary>();
+#endif
+	}
+
+	void CellCodecs::Compress(CellCodec codec, const char* data, size_t length, std::vector<char>& out, const CellCodecDictionary* dictionary)
+	{
+		switch (codec)
+		{
+		case CellCodec::Zlib:
+			zlibCompress(data, length, out);
+			break;
+#ifdef FSN_USE_LZ4
+		case CellCodec::LZ4:
+			lz4Compress(data, length, out);
+			break;
+#endif
+#ifdef FSN_USE_ZSTD
+		case CellCodec::Zstd:
+			{
+				auto& contexts = s_ZstdContexts.local();
+				out.resize(ZSTD_compressBound(length));
+				const size_t result = (dictionary && dictionary->m_Impl)
+					? ZSTD_compress_usingCDict(contexts.compression, out.data(), out.size(), data, length, dictionary->m_Impl->compressionDict)
+					: ZSTD_compressCCtx(contexts.compression, out.data(), out.size(), data, length, s_ZstdLevel);
+				if (ZSTD_isError(result))
+					FSN_EXCEPT(InvalidArgumentException, std::string("Failed to compress cell data: ") + ZSTD_getErrorName(result));
+				out.resize(result);
+			}
+			break;
+#endif
+		default:
+			FSN_EXCEPT(NotImplementedException, "The " + CellCodecToString(codec) + " cell codec isn't available in this build");
+		}
+	}
+
+	bool CellCodecs::Decompress(CellCodec codec, const char* data, size_t length, std::vector<char>& out, const CellCodecDictionary* dictionary)
+	{
+		switch (codec)
+		{
+		case CellCodec::Zlib:
+			return zlibDecompress(data, length, out);
+#ifdef FSN_USE_LZ4
+		case CellCodec::LZ4:
+			return lz4Decompress(data, length, out);
+#endif
+#ifdef FSN_USE_ZSTD
+		case CellCodec::Zstd:
+			{
+				const auto decompressedLength = ZSTD_getFrameContentSize(data, length);
+				if (decompressedLength == ZSTD_CONTENTSIZE_UNKNOWN || decompressedLength == ZSTD_CONTENTSIZE_ERROR)
+					return false;
+
+				const auto dictionaryID = ZSTD_getDictID_fromFrame(data, length);
+				if (dictionaryID != 0 && (!dictionary || dictionary->GetID() != dictionaryID))
+				{
+					AddLogEntry("Cell data was compressed with a dictionary that isn't loaded", LOG_NORMAL);
+					return false;
+				}
+
+				auto& contexts = s_ZstdContexts.local();
+				out.resize((size_t)decompressedLength);
+				const size_t result = (dictionaryID != 0)
+					? ZSTD_decompress_usingDDict(contexts.decompression, out.data(), out.size(), data, length, dictionary->m_Impl->decompressionDict)
+					: ZSTD_decompressDCtx(contexts.decompression, out.data(), out.size(), data, length);
+				return !ZSTD_isError(result) && result == out.size();
+			}
+#endif
+		default:
+			AddLogEntry("Cell data is compressed with the " + CellCodecToString(codec) + " codec, which isn't available in this build", LOG_NORMAL);
+			return false;
+		}
+	}
+
+}
@@ -0,0 +1,82 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author:
+*    Elliot Hayward
+*/
+
+#include "PrecompiledHeaders.h"
+
+#include "FusionCellDataCursor.h"
+
+#include <tbb/enumerable_thread_specific.h>
+
+namespace FusionEngine
+{
+
+	namespace
+	{
+		// Buffers bigger than this aren't kept, so one huge cell doesn't pin memory
+		const size_t s_MaxPooledCapacity = 1024 * 1024;
+		const size_t s_MaxPooledBuffers = 8;
+
+		typedef std::vector<std::vector<char>> BufferPool_t;
+		tbb::enumerable_thread_specific<BufferPool_t> s_BufferPools;
+	}
+
+	CellData::CellData()
+	{
+		auto& pool = s_BufferPools.local();
+		if (!pool.empty())
+		{
+			m_Buffer.swap(pool.back());
+			pool.pop_back();
+		}
+	}
+
+	CellData::~CellData()
+	{
+		if (m_Buffer.capacity() <= s_MaxPooledCapacity)
+		{
+			auto& pool = s_BufferPools.local();
+			if (pool.size() < s_MaxPooledBuffers)
+			{
+				m_Buffer.clear();
+				pool.push_back(std::move(m_Buffer));
+			}
+		}
+	}
+
+	bool CellData::Decompress(CellCodec codec, const char* data, size_t length, const CellCodecDictionary* dictionary)
+	{
+		const bool ok = CellCodecs::Decompress(codec, data, length, m_Buffer, dictionary);
+		Rewind();
+		return ok;
+	}
+
+	void CellData::Assign(const char* data, size_t length)
+	{
+		m_Buffer.assign(data, data + length);
+		Rewind();
+	}
+
+}
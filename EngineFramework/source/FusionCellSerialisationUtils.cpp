@@ -33,7 +33,9 @@
 #include "FusionCharCounter.h"
 #include "FusionEntitySerialisationUtils.h"
 
+#include <boost/iostreams/device/back_inserter.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/stream.hpp>
 
 namespace bio = boost::iostreams;
 
@@ -42,6 +44,187 @@ namespace FusionEngine
 	namespace CellSerialisationUtils
 	{
 
+		// Compaction is worthwhile once this fraction of the payload is unused...
+		static const float s_CompactionThreshold = 0.25f;
+		// ... and there is at least this much of it
+		static const size_t s_MinUnusedLengthToCompact = 1024;
+
+		EntitySlotTable::EntitySlotTable()
+			: m_NumEntities(0),
+			m_UsedLength(0)
+		{
+		}
+
+		bool EntitySlotTable::IsSlotTable(const CellDataCursor& data)
+		{
+			CellDataCursor peek(data);
+			size_t marker = 0;
+			return peek.Read(marker) && marker == s_Marker;
+		}
+
+		bool EntitySlotTable::Read(CellDataCursor& data)
+		{
+			size_t marker = 0;
+			if (!data.Read(marker) || marker != s_Marker)
+				return false;
+
+			uint32_t numSlots = 0;
+			if (!data.Read(numSlots) || numSlots > data.GetRemaining() / (sizeof(ObjectID) + sizeof(uint32_t) * 2))
+				return false;
+
+			std::vector<Slot> slots(numSlots);
+			for (auto it = slots.begin(); it != slots.end(); ++it)
+			{
+				data.Read(it->id);
+				data.Read(it->offset);
+				data.Read(it->length);
+			}
+
+			uint32_t payloadLength = 0;
+			data.Read(payloadLength);
+			const char* payload = data.ReadBytes(payloadLength);
+			if (!payload)
+				return false;
+
+			for (auto it = slots.begin(); it != slots.end(); ++it)
+			{
+				if (it->id != 0 && (size_t)it->offset + it->length > payloadLength)
+					return false;
+			}
+
+			Assign(std::move(slots), std::vector<char>(payload, payload + payloadLength));
+			return true;
+		}
+
+		void EntitySlotTable::Write(std::ostream& out) const
+		{
+			IO::Streams::CellStreamWriter writer(&out);
+
+			writer.Write(size_t(s_Marker));
+			writer.Write((uint32_t)m_Slots.size());
+			for (auto it = m_Slots.begin(); it != m_Slots.end(); ++it)
+			{
+				writer.Write(it->id);
+				writer.Write(it->offset);
+				writer.Write(it->length);
+			}
+			writer.Write((uint32_t)m_Payload.size());
+			out.write(m_Payload.data(), m_Payload.size());
+		}
+
+		void EntitySlotTable::Assign(std::vector<Slot> slots, std::vector<char> payload)
+		{
+			m_Slots = std::move(slots);
+			m_Payload = std::move(payload);
+
+			m_NumEntities = 0;
+			m_UsedLength = 0;
+			for (auto it = m_Slots.begin(); it != m_Slots.end(); ++it)
+			{
+				if (it->id != 0)
+				{
+					++m_NumEntities;
+					m_UsedLength += it->length;
+				}
+			}
+		}
+
+		size_t EntitySlotTable::Find(ObjectID id, size_t hint) const
+		{
+			if (id == 0)
+				return s_NoSlot;
+			if (hint < m_Slots.size() && m_Slots[hint].id == id)
+				return hint;
+			for (size_t i = 0; i < m_Slots.size(); ++i)
+			{
+				if (m_Slots[i].id == id)
+					return i;
+			}
+			return s_NoSlot;
+		}
+
+		size_t EntitySlotTable::Put(ObjectID id, const char* data, size_t length, size_t hint)
+		{
+			FSN_ASSERT(id != 0);
+
+			size_t slotIndex = Find(id, hint);
+			if (slotIndex == s_NoSlot)
+			{
+				// Reuse a free slot if there is one
+				for (slotIndex = 0; slotIndex < m_Slots.size(); ++slotIndex)
+				{
+					if (m_Slots[slotIndex].id == 0)
+						break;
+				}
+				if (slotIndex == m_Slots.size())
+					m_Slots.push_back(Slot());
+				m_Slots[slotIndex] = Slot(id, (uint32_t)m_Payload.size(), 0);
+				++m_NumEntities;
+			}
+
+			auto& slot = m_Slots[slotIndex];
+			m_UsedLength -= slot.length;
+			if (length > slot.length)
+			{
+				// Doesn't fit: append
+				slot.offset = (uint32_t)m_Payload.size();
+				m_Payload.insert(m_Payload.end(), data, data + length);
+			}
+			else
+				std::copy(data, data + length, m_Payload.begin() + slot.offset);
+			slot.length = (uint32_t)length;
+			m_UsedLength += length;
+
+			return slotIndex;
+		}
+
+		bool EntitySlotTable::Remove(ObjectID id, size_t hint)
+		{
+			const size_t slotIndex = Find(id, hint);
+			if (slotIndex != s_NoSlot)
+			{
+				m_UsedLength -= m_Slots[slotIndex].length;
+				--m_NumEntities;
+				m_Slots[slotIndex] = Slot();
+				return true;
+			}
+			else
+				return false;
+		}
+
+		bool EntitySlotTable::NeedsCompaction() const
+		{
+			const size_t unused = GetUnusedLength();
+			return unused >= s_MinUnusedLengthToCompact && unused >= size_t(m_Payload.size() * s_CompactionThreshold);
+		}
+
+		void EntitySlotTable::Compact()
+		{
+			// Copy in the order the data is stored, so the entities keep their relative order
+			std::vector<size_t> order;
+			order.reserve(m_NumEntities);
+			for (size_t i = 0; i < m_Slots.size(); ++i)
+			{
+				if (m_Slots[i].id != 0)
+					order.push_back(i);
+			}
+			std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return m_Slots[a].offset < m_Slots[b].offset; });
+
+			std::vector<char> payload;
+			payload.reserve(m_UsedLength);
+			for (auto it = order.begin(); it != order.end(); ++it)
+			{
+				auto& slot = m_Slots[*it];
+				const auto data = m_Payload.begin() + slot.offset;
+				slot.offset = (uint32_t)payload.size();
+				payload.insert(payload.end(), data, data + slot.length);
+			}
+			m_Payload.swap(payload);
+
+			while (!m_Slots.empty() && m_Slots.back().id == 0)
+				m_Slots.pop_back();
+		}
+
 		std::vector<std::tuple<ObjectID, std::streamoff, std::streamsize>> WriteCellData(std::ostream& file_param, const Cell::CellEntryMap& entities, const bool synched, const EntitySerialisationUtils::SerialisedDataStyle data_style)
 		{
 			using namespace EntitySerialisationUtils;
@@ -53,55 +236,60 @@ namespace FusionEngine
 					++expectedNumEntries;
 			});
 
-			CharCounter counter;
-			bio::filtering_ostream file;
-			file.push(counter, 0);
-			file.push(file_param);
-
-			IO::Streams::CellStreamWriter writer(&file);
-
-			writer.Write(expectedNumEntries);
-
 			std::vector<std::tuple<ObjectID, std::streamoff, std::streamsize>> dataPositions;
 
-			//std::streamoff headerPos = sizeof(expectedNumEntries);
 			if (synched)
 			{
-				// Leave some space for the header data
-				//const std::vector<char> headerSpace(expectedNumEntries * (sizeof(ObjectID) /*+ sizeof(std::streamoff)*/));
-				//file.write(headerSpace.data(), headerSpace.size());
+				// Write the entities one after another into the payload, then put the slot table in front of them
+				std::vector<EntitySlotTable::Slot> slots;
+				slots.reserve(expectedNumEntries);
+				dataPositions.reserve(expectedNumEntries);
 
-				for (auto it = entities.cbegin(), end = entities.cend(); it != end; ++it)
+				std::vector<char> payload;
 				{
-					const bool entSynched = it->first->IsSyncedEntity();
-					if (entSynched)
-						writer.Write(it->first->GetID());
+					bio::stream<bio::back_insert_device<std::vector<char>>> payloadStream(payload);
+					for (auto it = entities.cbegin(), end = entities.cend(); it != end; ++it)
+					{
+						if (it->first->IsSyncedEntity())
+						{
+							payloadStream.flush();
+							const size_t beginPos = payload.size();
+
+							SaveEntity(payloadStream, it->first, false, data_style);
+
+							payloadStream.flush();
+							const size_t length = payload.size() - beginPos;
+
+							dataPositions.push_back(std::make_tuple(it->first->GetID(), std::streamoff(slots.size()), std::streamsize(length)));
+							slots.push_back(EntitySlotTable::Slot(it->first->GetID(), (uint32_t)beginPos, (uint32_t)length));
+						}
+					}
 				}
+				FSN_ASSERT(slots.size() == expectedNumEntries); // Confirm the number of synched entities expected
 
-				dataPositions.reserve(expectedNumEntries);
+				EntitySlotTable table;
+				table.Assign(std::move(slots), std::move(payload));
+				table.Write(file_param);
+
+				return dataPositions;
 			}
 
-			std::streamoff beginPos;
+			CharCounter counter;
+			bio::filtering_ostream file;
+			file.push(counter, 0);
+			file.push(file_param);
+
+			IO::Streams::CellStreamWriter writer(&file);
+
+			writer.Write(expectedNumEntries);
+
 			for (auto it = entities.cbegin(), end = entities.cend(); it != end; ++it)
 			{
-				const bool entSynched = it->first->IsSyncedEntity();
-				if (entSynched == synched)
+				if (!it->first->IsSyncedEntity())
 				{
-					if (entSynched)
-					{
-						beginPos = counter.count();
-					}
-
 					SaveEntity(file, it->first, false, data_style);
 
-					if (entSynched)
-					{
-						auto endPos = counter.count();
-						std::streamsize length = endPos - beginPos;
-						dataPositions.push_back(std::make_tuple(it->first->GetID(), beginPos, length));
-					}
-
-					FSN_ASSERT(expectedNumEntries-- > 0); // Confirm the number of synched / unsynched entities expected
+					FSN_ASSERT(expectedNumEntries-- > 0); // Confirm the number of unsynched entities expected
 				}
 			}
 
@@ -113,6 +301,9 @@ namespace FusionEngine
 			size_t numEntries;
 			file.read(reinterpret_cast<char*>(&numEntries), sizeof(size_t));
 
+			if (numEntries == EntitySlotTable::s_Marker)
+				FSN_EXCEPT(FileSystemException, "Slotted cell data can only be read from memory (see the CellDataCursor overload)");
+
 			FSN_ASSERT_MSG(numEntries < 65535, "Probably invalid data: entry count is implausible");
 
 			std::vector<ObjectID> ids;
@@ -131,5 +322,74 @@ namespace FusionEngine
 			return std::make_pair(numEntries, ids);
 		}
 
+		std::pair<size_t, std::vector<ObjectID>> ReadCellIntro(const CellCoord_t& coord, CellDataCursor& data, bool data_includes_ids, const EntitySerialisationUtils::SerialisedDataStyle, std::vector<size_t>* entity_offsets)
+		{
+			if (entity_offsets)
+				entity_offsets->clear();
+
+			if (EntitySlotTable::IsSlotTable(data))
+			{
+				if (!entity_offsets)
+					FSN_EXCEPT(FileSystemException, "Slotted cell data was found where it isn't supported");
+
+				size_t marker = 0;
+				uint32_t numSlots = 0;
+				data.Read(marker);
+				data.Read(numSlots);
+
+				std::vector<EntitySlotTable::Slot> slots;
+				slots.reserve(numSlots);
+				for (uint32_t i = 0; i < numSlots; ++i)
+				{
+					EntitySlotTable::Slot slot;
+					data.Read(slot.id);
+					data.Read(slot.offset);
+					data.Read(slot.length);
+					if (slot.id != 0)
+						slots.push_back(slot);
+				}
+
+				uint32_t payloadLength = 0;
+				data.Read(payloadLength);
+				const size_t payloadBegin = data.Tell();
+				if (!data.Skip(payloadLength))
+					FSN_EXCEPT(FileSystemException, "Slotted cell data is truncated");
+
+				// Read the entities in the order they are stored
+				std::sort(slots.begin(), slots.end(), [](const EntitySlotTable::Slot& a, const EntitySlotTable::Slot& b) { return a.offset < b.offset; });
+
+				std::vector<ObjectID> ids;
+				ids.reserve(slots.size());
+				entity_offsets->reserve(slots.size());
+				for (auto it = slots.begin(); it != slots.end(); ++it)
+				{
+					ids.push_back(it->id);
+					entity_offsets->push_back(payloadBegin + it->offset);
+				}
+
+				return std::make_pair(ids.size(), std::move(ids));
+			}
+
+			size_t numEntries = 0;
+			data.Read(numEntries);
+
+			FSN_ASSERT_MSG(numEntries < 65535, "Probably invalid data: entry count is implausible");
+
+			std::vector<ObjectID> ids;
+
+			if (data_includes_ids)
+			{
+				ids.reserve(numEntries);
+				for (size_t i = 0; i < numEntries; ++i)
+				{
+					ObjectID id;
+					data.Read(id);
+					ids.push_back(id);
+				}
+			}
+
+			return std::make_pair(numEntries, ids);
+		}
+
 	}
 }
@@ -61,6 +61,7 @@
 #include "FusionScriptInputEvent.h"
 #include "FusionScriptManager.h"
 #include "FusionScriptSound.h"
+#include "FusionSpatialIndex.h"
 #include "FusionStreamingManager.h"
 #include "FusionSpriteDefinition.h"
 #include "FusionSystemType.h"
@@ -238,6 +239,8 @@ namespace FusionEngine
 			m_EntityManager.reset(new EntityManager(m_InputManager.get(), m_EntitySynchroniser.get(), m_StreamingManager.get(), m_ComponentUniverse.get(), m_CellArchivist.get()));
 			m_EntityInstantiator.reset(new P2PEntityInstantiator(m_ComponentUniverse.get(), m_EntityManager.get()));
 
+			m_ScriptManager->RegisterGlobalObject("SpatialIndex spatial_index", &m_EntityManager->GetSpatialIndex());
+
 			m_ArchetypeFactoryManager.reset(new ArchetypeFactoryManager(m_ComponentUniverse.get(), m_EntityManager.get(), m_EntityInstantiator.get()));
 
 			m_MapLoader.reset(new GameMapLoader());
@@ -573,6 +576,7 @@ namespace FusionEngine
 		engine->RegisterObjectMethod("Viewport", "Vector ScreenToWorld(Vector position)", asFUNCTION(Viewport_ScreenToWorld), asCALL_CDECL_OBJLAST);
 
 		StreamingManager::Register(engine);
+		SpatialIndex::Register(engine);
 	}
 
 	void EngineManager::AddResourceLoaders()
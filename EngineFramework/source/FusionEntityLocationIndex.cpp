@@ -0,0 +1,495 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author(s):
+*
+*    Elliot Hayward
+*/
+
+#include "PrecompiledHeaders.h"
+
+#include "FusionEntityLocationIndex.h"
+
+#include "FusionLogger.h"
+
+#include <array>
+
+#include <boost/filesystem.hpp>
+
+#if _MSC_VER > 1000
+#pragma warning( push )
+#pragma warning( disable: 4244 4351; )
+#endif
+#include <kchashdb.h>
+#if _MSC_VER > 1000
+#pragma warning( pop )
+#endif
+
+namespace FusionEngine
+{
+
+	// The log is folded into the snapshot once it has this many records
+	static const size_t s_CheckpointLogRecords = 1 << 16;
+
+	static const size_t s_MinCapacity = 1024;
+
+	static const size_t s_NoSlot = ~size_t(0);
+
+	namespace
+	{
+		enum LogOp : uint8_t { StoreOp = 1, RemoveOp = 2 };
+
+		// [op][id][x][y][offset][length]
+		const size_t s_LogRecordSize = sizeof(uint8_t) + sizeof(ObjectID) + sizeof(int32_t) * 2 + sizeof(int64_t) * 2;
+
+		// Snapshot records are laid out as the entity location DB has always stored them
+		const size_t s_SnapshotRecordSize = sizeof(int32_t) * 2 + sizeof(std::streamoff) + sizeof(std::streamsize);
+
+		template <typename T>
+		char* put(char* out, const T& value)
+		{
+			std::memcpy(out, &value, sizeof(T));
+			return out + sizeof(T);
+		}
+
+		template <typename T>
+		const char* get(const char* in, T& value)
+		{
+			std::memcpy(&value, in, sizeof(T));
+			return in + sizeof(T);
+		}
+
+		size_t hashID(ObjectID id)
+		{
+			// IDs tend to be sequential: multiplying by an odd constant spreads them across the table
+			return (size_t)(id * 2654435761u);
+		}
+
+		std::string logPath(const std::string& snapshot_path)
+		{
+			return snapshot_path + ".log";
+		}
+
+		std::string oldLogPath(const std::string& snapshot_path)
+		{
+			return snapshot_path + ".log.old";
+		}
+	}
+
+	EntityLocationIndex::EntityLocationIndex()
+		: m_Count(0),
+		m_RemovedCount(0),
+		m_LogRecords(0)
+	{
+		m_Slots.resize(s_MinCapacity);
+	}
+
+	EntityLocationIndex::~EntityLocationIndex()
+	{
+		try
+		{
+			Close();
+		}
+		catch (std::exception& e)
+		{
+			AddLogEntry(std::string("Failed to save entity locations: ") + e.what(), LOG_CRITICAL);
+		}
+	}
+
+	void EntityLocationIndex::Open(const std::string& snapshot_path, bool truncate)
+	{
+		namespace bfs = boost::filesystem;
+
+		if (IsOpen())
+			Close();
+
+		{
+			Mutex_t::scoped_lock lock(m_Mutex);
+
+			m_Slots.assign(s_MinCapacity, Slot());
+			m_Count = 0;
+			m_RemovedCount = 0;
+			m_LogRecords = 0;
+
+			m_Path = snapshot_path;
+		}
+
+		bool replayed = false;
+		if (truncate)
+		{
+			bfs::remove(snapshot_path);
+			bfs::remove(oldLogPath(snapshot_path));
+			bfs::remove(logPath(snapshot_path));
+		}
+		else
+		{
+			if (bfs::exists(snapshot_path))
+				loadSnapshot(snapshot_path);
+
+			// Recover changes that didn't make it into the snapshot
+			if (bfs::exists(oldLogPath(snapshot_path)))
+			{
+				replayLog(oldLogPath(snapshot_path));
+				replayed = true;
+			}
+			if (bfs::exists(logPath(snapshot_path)))
+			{
+				replayLog(logPath(snapshot_path));
+				replayed = true;
+			}
+		}
+
+		{
+			Mutex_t::scoped_lock lock(m_Mutex);
+			m_Log.open(logPath(snapshot_path), std::ios::out | std::ios::binary | std::ios::app);
+			if (!m_Log)
+				AddLogEntry("Failed to open entity location log: " + logPath(snapshot_path), LOG_CRITICAL);
+		}
+
+		if (replayed)
+			Checkpoint();
+	}
+
+	void EntityLocationIndex::Close(bool checkpoint)
+	{
+		if (!IsOpen())
+			return;
+
+		if (checkpoint)
+			Checkpoint();
+
+		Mutex_t::scoped_lock lock(m_Mutex);
+		m_Log.close();
+		if (!checkpoint)
+		{
+			boost::filesystem::remove(logPath(m_Path));
+			boost::filesystem::remove(oldLogPath(m_Path));
+		}
+		m_Path.clear();
+	}
+
+	bool EntityLocationIndex::Get(ObjectID id, Location& location) const
+	{
+		Mutex_t::scoped_lock lock(m_Mutex, false);
+		const size_t index = findSlot(id);
+		if (index != s_NoSlot)
+		{
+			location = m_Slots[index].location;
+			return true;
+		}
+		else
+			return false;
+	}
+
+	void EntityLocationIndex::Store(ObjectID id, const Location& location)
+	{
+		Mutex_t::scoped_lock lock(m_Mutex);
+		set(id, location);
+		appendToLog(StoreOp, id, location);
+	}
+
+	bool EntityLocationIndex::Remove(ObjectID id)
+	{
+		Mutex_t::scoped_lock lock(m_Mutex);
+		if (erase(id))
+		{
+			appendToLog(RemoveOp, id, Location());
+			return true;
+		}
+		else
+			return false;
+	}
+
+	size_t EntityLocationIndex::GetSize() const
+	{
+		Mutex_t::scoped_lock lock(m_Mutex, false);
+		return m_Count;
+	}
+
+	void EntityLocationIndex::SaveSnapshot(const std::string& path) const
+	{
+		WriteSnapshot(path, GetEntries());
+	}
+
+	EntityLocationIndex::Entries_t EntityLocationIndex::GetEntries() const
+	{
+		Mutex_t::scoped_lock lock(m_Mutex, false);
+		return getEntries();
+	}
+
+	bool EntityLocationIndex::NeedsCheckpoint() const
+	{
+		Mutex_t::scoped_lock lock(m_Mutex, false);
+		return m_LogRecords >= s_CheckpointLogRecords;
+	}
+
+	void EntityLocationIndex::Checkpoint()
+	{
+		namespace bfs = boost::filesystem;
+
+		Entries_t entries;
+		std::string path;
+		{
+			Mutex_t::scoped_lock lock(m_Mutex);
+			if (m_Path.empty())
+				return;
+			path = m_Path;
+
+			entries = getEntries();
+
+			// Start a new log for changes made while the snapshot is written (the old one
+			//  is kept until the snapshot is complete, so nothing is lost if this fails)
+			m_Log.close();
+			const auto currentLog = logPath(path), oldLog = oldLogPath(path);
+			if (bfs::exists(oldLog))
+			{
+				// A previous checkpoint didn't finish: keep its log, followed by this one
+				std::ofstream old(oldLog, std::ios::out | std::ios::binary | std::ios::app);
+				std::ifstream current(currentLog, std::ios::in | std::ios::binary);
+				old << current.rdbuf();
+				current.close();
+				bfs::remove(currentLog);
+			}
+			else if (bfs::exists(currentLog))
+				bfs::rename(currentLog, oldLog);
+
+			m_Log.open(currentLog, std::ios::out | std::ios::binary | std::ios::trunc);
+			m_LogRecords = 0;
+		}
+
+		WriteSnapshot(path, entries);
+
+		bfs::remove(oldLogPath(path));
+	}
+
+	void EntityLocationIndex::FlushLog()
+	{
+		Mutex_t::scoped_lock lock(m_Mutex);
+		if (m_Log.is_open())
+			m_Log.flush();
+	}
+
+	size_t EntityLocationIndex::findSlot(ObjectID id) const
+	{
+		const size_t mask = m_Slots.size() - 1;
+		for (size_t i = hashID(id) & mask;; i = (i + 1) & mask)
+		{
+			const auto& slot = m_Slots[i];
+			if (slot.state == Empty)
+				return s_NoSlot;
+			if (slot.state == Occupied && slot.id == id)
+				return i;
+		}
+	}
+
+	void EntityLocationIndex::set(ObjectID id, const Location& location)
+	{
+		const size_t existing = findSlot(id);
+		if (existing != s_NoSlot)
+		{
+			m_Slots[existing].location = location;
+			return;
+		}
+
+		// Keep the load (including removed slots, which lengthen probes just the same) under 70%
+		if ((m_Count + m_RemovedCount + 1) * 10 > m_Slots.size() * 7)
+			rehash((m_Count + 1) * 2);
+
+		const size_t mask = m_Slots.size() - 1;
+		size_t i = hashID(id) & mask;
+		while (m_Slots[i].state == Occupied)
+			i = (i + 1) & mask;
+
+		auto& slot = m_Slots[i];
+		if (slot.state == Removed)
+			--m_RemovedCount;
+		slot.id = id;
+		slot.state = Occupied;
+		slot.location = location;
+		++m_Count;
+	}
+
+	bool EntityLocationIndex::erase(ObjectID id)
+	{
+		const size_t index = findSlot(id);
+		if (index != s_NoSlot)
+		{
+			m_Slots[index].state = Removed;
+			--m_Count;
+			++m_RemovedCount;
+			return true;
+		}
+		else
+			return false;
+	}
+
+	void EntityLocationIndex::rehash(size_t min_capacity)
+	{
+		size_t capacity = s_MinCapacity;
+		while (capacity < min_capacity)
+			capacity *= 2;
+
+		std::vector<Slot> oldSlots(capacity);
+		oldSlots.swap(m_Slots);
+		m_Count = 0;
+		m_RemovedCount = 0;
+
+		for (auto it = oldSlots.begin(); it != oldSlots.end(); ++it)
+		{
+			if (it->state == Occupied)
+				set(it->id, it->location);
+		}
+	}
+
+	void EntityLocationIndex::appendToLog(uint8_t op, ObjectID id, const Location& location)
+	{
+		std::array<char, s_LogRecordSize> record;
+		char* out = record.data();
+		out = put(out, op);
+		out = put(out, id);
+		out = put(out, location.cell.x);
+		out = put(out, location.cell.y);
+		out = put(out, (int64_t)location.offset);
+		out = put(out, (int64_t)location.length);
+
+		m_Log.write(record.data(), record.size());
+		++m_LogRecords;
+	}
+
+	void EntityLocationIndex::replayLog(const std::string& path)
+	{
+		std::ifstream log(path, std::ios::in | std::ios::binary);
+
+		Mutex_t::scoped_lock lock(m_Mutex);
+		std::array<char, s_LogRecordSize> record;
+		// A truncated record at the end means the process stopped while it was being written: it is ignored
+		while (log.read(record.data(), record.size()))
+		{
+			uint8_t op;
+			ObjectID id;
+			Location location;
+			int64_t offset, length;
+
+			const char* in = record.data();
+			in = get(in, op);
+			in = get(in, id);
+			in = get(in, location.cell.x);
+			in = get(in, location.cell.y);
+			in = get(in, offset);
+			in = get(in, length);
+			location.offset = (std::streamoff)offset;
+			location.length = (std::streamsize)length;
+
+			if (op == StoreOp)
+				set(id, location);
+			else if (op == RemoveOp)
+				erase(id);
+		}
+	}
+
+	void EntityLocationIndex::loadSnapshot(const std::string& path)
+	{
+		kyotocabinet::HashDB db;
+		if (!db.open(path, kyotocabinet::HashDB::OREADER | kyotocabinet::HashDB::ONOLOCK))
+		{
+			AddLogEntry("Failed to open entity location snapshot (" + path + "): " + db.error().message(), LOG_CRITICAL);
+			return;
+		}
+
+		Mutex_t::scoped_lock lock(m_Mutex);
+		rehash((size_t)db.count() * 2);
+
+		std::unique_ptr<kyotocabinet::HashDB::Cursor> cursor(db.cursor());
+		cursor->jump();
+		std::string key, value;
+		while (cursor->get(&key, &value, true))
+		{
+			if (key.size() != sizeof(ObjectID) || value.size() != s_SnapshotRecordSize)
+				continue;
+
+			ObjectID id;
+			get(key.data(), id);
+
+			Location location;
+			const char* in = value.data();
+			in = get(in, location.cell.x);
+			in = get(in, location.cell.y);
+			in = get(in, location.offset);
+			in = get(in, location.length);
+
+			set(id, location);
+		}
+		cursor.reset();
+
+		db.close();
+	}
+
+	EntityLocationIndex::Entries_t EntityLocationIndex::getEntries() const
+	{
+		Entries_t entries;
+		entries.reserve(m_Count);
+		for (auto it = m_Slots.begin(); it != m_Slots.end(); ++it)
+		{
+			if (it->state == Occupied)
+				entries.push_back(std::make_pair(it->id, it->location));
+		}
+		return entries;
+	}
+
+	void EntityLocationIndex::WriteSnapshot(const std::string& path, const Entries_t& entries)
+	{
+		namespace bfs = boost::filesystem;
+
+		// Write to a temp. file first, so the existing snapshot is intact if this fails
+		const std::string tempPath = path + ".tmp";
+
+		kyotocabinet::HashDB db;
+		db.tune_buckets(std::max<int64_t>((int64_t)entries.size() * 2, 1024));
+		if (!db.open(tempPath, kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OCREATE | kyotocabinet::HashDB::OTRUNCATE))
+			FSN_EXCEPT(FileSystemException, "Failed to create entity location snapshot (" + tempPath + "): " + db.error().message());
+
+		std::array<char, s_SnapshotRecordSize> record;
+		for (auto it = entries.begin(); it != entries.end(); ++it)
+		{
+			char* out = record.data();
+			out = put(out, it->second.cell.x);
+			out = put(out, it->second.cell.y);
+			out = put(out, it->second.offset);
+			out = put(out, it->second.length);
+
+			db.set((const char*)&it->first, sizeof(ObjectID), record.data(), record.size());
+		}
+
+		if (!db.close())
+			FSN_EXCEPT(FileSystemException, "Failed to write entity location snapshot (" + tempPath + "): " + db.error().message());
+
+		try
+		{
+			bfs::rename(tempPath, path);
+		}
+		catch (bfs::filesystem_error& e)
+		{
+			FSN_EXCEPT(FileSystemException, std::string("Failed to replace entity location snapshot: ") + e.what());
+		}
+	}
+
+}
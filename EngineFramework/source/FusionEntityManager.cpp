@@ -1006,6 +1006,13 @@ namespace FusionEngine
 
 	// TODO: set domain modes (and / or replace domains with mode flags in entities?)
 
+	//! Default time ProcessActivationQueues may spend activating / deactivating entities per frame (microseconds)
+	const unsigned int s_DefaultActivationBudget = 4000;
+	//! Minimum number of newly added entities that are passed on each frame, regardless of the budget
+	const size_t s_MinNewEntitiesPerFrame = 5;
+	//! Fraction of the budget that deactivation can use while there are entities waiting to be activated
+	const float s_DeactivationBudgetShare = 0.25f;
+
 	EntityManager::EntityManager(InputManager *input_manager, EntitySynchroniser *entity_synchroniser, StreamingManager *streaming, ComponentUniverse* universe, SaveDataArchive* data_archive)
 		: m_InputManager(input_manager),
 		m_EntitySynchroniser(entity_synchroniser),
@@ -1015,7 +1022,9 @@ namespace FusionEngine
 		m_UpdateBlockedFlags(0),
 		m_DrawBlockedFlags(0),
 		m_ClearWhenAble(false),
-		m_ReferenceTokens(1)
+		m_ReferenceTokens(1),
+		m_NextActivationSequence(0),
+		m_ActivationBudget(s_DefaultActivationBudget)
 	{
 		for (size_t i = 0; i < s_EntityDomainCount; ++i)
 			m_DomainState[i] = DS_ALL;
@@ -1408,7 +1417,8 @@ namespace FusionEngine
 		m_ComponentsToDeactivate.clear();
 		m_EntitiesToActivate.clear();
 		m_EntitiesUnreferenced.clear();
-		m_EntitiesToDeactivate.clear();
+		m_PendingUnreferenced.clear();
+		m_ActivationQueueStats = ActivationQueueStats();
 		m_EntitiesToRemove.clear();
 
 		std::for_each(m_ActiveEntities.begin(), m_ActiveEntities.end(), [](const EntityPtr &entity){ entity->m_ReferencedEntities.clear(); });
@@ -1424,6 +1434,7 @@ namespace FusionEngine
 		m_LoadedReferenceRange.first = m_LoadedReferenceRange.second = 0;
 
 		m_ActiveEntities.clear();
+		m_SpatialIndex.Clear();
 
 		m_EntitiesByName.clear();
 		m_Entities.clear();
@@ -1464,7 +1475,7 @@ namespace FusionEngine
 			}
 			for (auto it = m_EntitiesToActivate.begin(), end = m_EntitiesToActivate.end(); it != end; ++it)
 			{
-				auto& entity = *it;
+				auto& entity = it->entity;
 				entity->m_ReferencedEntities.clear();
 				// TODO: note that this might have to be done when activating entities normally (i.e. check m_EntitiesToActivate as well when calling deactivateEntity)
 				for (auto it = entity->GetComponents().begin(), end = entity->GetComponents().end(); it != end; ++it)
@@ -1487,7 +1498,10 @@ namespace FusionEngine
 		{
 			auto& entity = *it;
 			if (entity->GetDomain() == idx)
+			{
+				m_SpatialIndex.Remove(entity);
 				m_ActiveEntities.erase(it++);
+			}
 			else
 				++it;
 		}
@@ -1581,10 +1595,10 @@ namespace FusionEngine
 				// Keep entities active until they are no longer referenced
 				if (hasNoActiveReferences(entity))
 				{
-					if (entity->IsActive())
-						m_EntitiesToDeactivate.push_back(*it);
-
+					// Deactivated (if active) and dropped by ProcessActivationQueues
+					m_SpatialIndex.Remove(entity);
 					m_EntitiesUnreferenced.push_back(*it);
+					m_PendingUnreferenced.insert(entity.get());
 
 					entity->RemoveDeactivateMark();
 
@@ -1601,6 +1615,8 @@ namespace FusionEngine
 					if (CheckState(domainIndex, DS_STREAMING))
 						m_StreamingManager->OnUpdated(entity, split);
 
+					m_SpatialIndex.Update(entity, entity->GetPosition());
+
 					if (CheckState(domainIndex, DS_SYNCH))
 						m_EntitySynchroniser->Enqueue(entity);
 				}
@@ -1645,34 +1661,51 @@ namespace FusionEngine
 			}
 		}
 
+		const double budget = std::min<double>(time_limit, m_ActivationBudget * 1e-6);
+		auto timeUsed = [startTime]() { return (tbb::tick_count::now() - startTime).seconds(); };
+
 		// Process newly added entities
 		{
 			FSN_PROFILE("Add New Entities To Activate");
 			EntityPtr entityToActivate;
-			for (int i = 0; i < 5 && m_NewEntitiesToActivate.try_pop(entityToActivate); ++i)
+			for (size_t i = 0; (i < s_MinNewEntitiesPerFrame || timeUsed() < budget) && m_NewEntitiesToActivate.try_pop(entityToActivate); ++i)
 			{
 				if (CheckState(entityToActivate->GetDomain(), DS_STREAMING))
 					m_StreamingManager->AddEntity(entityToActivate);
 				else
-					m_EntitiesToActivate.push_back(entityToActivate);
+					queueEntityToActivate(entityToActivate);
 			}
 		}
 
-		// Deactivate entities
-		for (auto it = m_EntitiesToDeactivate.begin(), end = m_EntitiesToDeactivate.end(); it != end; ++it)
-		{
-			deactivateEntity(*it);
-		}
-		m_EntitiesToDeactivate.clear();
-		// Drop local references
-		for (auto it = m_EntitiesUnreferenced.begin(), end = m_EntitiesUnreferenced.end(); it != end; ++it)
+		m_ActivationQueueStats.activated = 0;
+		m_ActivationQueueStats.deactivated = 0;
+
+		// Deactivate & drop unreferenced entities (oldest first). While there are entities waiting
+		//  to be activated this only gets a share of the budget, so pop-in near cameras isn't held
+		//  up by a large cell being unloaded elsewhere
+		if (!m_EntitiesUnreferenced.empty())
 		{
-			if (!(*it)->IsMarkedToRemove()) // Mark-to-remove supersedes mark-to-deactivate
-				dropEntity(*it);
-			else
-				removeEntity(*it);
+			FSN_PROFILE("Deactivate Unreferenced Entities");
+			const double deactivationBudget = m_EntitiesToActivate.empty() ? budget : budget * s_DeactivationBudgetShare;
+			do
+			{
+				EntityPtr entity = std::move(m_EntitiesUnreferenced.front());
+				m_EntitiesUnreferenced.pop_front();
+
+				// Skip entities that were re-activated while they were waiting (see queueEntityToActivate)
+				if (m_PendingUnreferenced.erase(entity.get()) == 0)
+					continue;
+
+				if (entity->IsActive())
+					deactivateEntity(entity);
+				if (!entity->IsMarkedToRemove()) // Mark-to-remove supersedes mark-to-deactivate
+					dropEntity(entity);
+				else
+					removeEntity(entity);
+
+				++m_ActivationQueueStats.deactivated;
+			} while (!m_EntitiesUnreferenced.empty() && timeUsed() < deactivationBudget);
 		}
-		m_EntitiesUnreferenced.clear();
 
 		// Process removed entities
 		{
@@ -1690,21 +1723,40 @@ namespace FusionEngine
 #if FSN_PROFILING_ENABLED
 		Profiling::getSingleton().AddTime("~Entities to Activate", (double)m_EntitiesToActivate.size());
 #endif
-			auto it = m_EntitiesToActivate.begin(), end = m_EntitiesToActivate.end();
-#ifdef _DEBUG
+			// Cameras move between frames, so re-prioritise the whole queue (linear time)
+			m_StreamPositions.clear();
+			m_StreamingManager->GetStreamPositions(m_StreamPositions);
+			for (auto it = m_EntitiesToActivate.begin(), end = m_EntitiesToActivate.end(); it != end; ++it)
+			{
+				const Vector2& position = it->entity->GetPosition();
+				float nearest = std::numeric_limits<float>::max();
+				for (auto pit = m_StreamPositions.cbegin(), pend = m_StreamPositions.cend(); pit != pend; ++pit)
+					nearest = std::min(nearest, (position - *pit).squared_length());
+				it->priority = nearest;
+			}
+			std::make_heap(m_EntitiesToActivate.begin(), m_EntitiesToActivate.end());
+
+			const auto now = tbb::tick_count::now();
+			double totalWaitTime = 0.0;
+			m_ActivationQueueStats.maxWaitTime = 0.0f;
+
+			// Entities that weren't ready are put back after the loop, so they aren't retried this frame
+			size_t heapSize = m_EntitiesToActivate.size();
+			// Always attempt at least one entity, so the queue can't stall if the frame is already over budget
 			bool first = true;
-			while ((first || (tbb::tick_count::now() - startTime).seconds() < time_limit) && it != end)
+			while (heapSize > 0 && (first || timeUsed() < budget))
 			{
 				first = false;
-#else
-			while ((tbb::tick_count::now() - startTime).seconds() < time_limit && it != end)
-			{
-#endif
-				if (attemptToActivateEntity(*it))
+
+				std::pop_heap(m_EntitiesToActivate.begin(), m_EntitiesToActivate.begin() + heapSize);
+				--heapSize;
+				PendingActivation& pending = m_EntitiesToActivate[heapSize];
+
+				if (attemptToActivateEntity(pending.entity))
 				{
 					FSN_PROFILE("PostActivationInitialisation");
 					//FSN_ASSERT(std::find(m_ActiveEntities.begin(), m_ActiveEntities.end(), *it) == m_ActiveEntities.end());
-					auto& entity = (*it);
+					auto& entity = pending.entity;
 
 					entity->StreamIn();
 					{
@@ -1712,6 +1764,7 @@ namespace FusionEngine
 						ActiveEntitiesMutex_t::scoped_lock lock(m_ActiveEntitiesMutex);
 						m_ActiveEntities.push_back(entity);
 					}
+					m_SpatialIndex.Update(entity, entity->GetPosition());
 
 					m_EntitySynchroniser->OnEntityActivated(entity);
 
@@ -1726,13 +1779,38 @@ namespace FusionEngine
 					if (!entity->GetName().empty())
 						m_EntitiesByName[entity->GetName()] = entity;
 
-					it = m_EntitiesToActivate.erase(it);
-					end = m_EntitiesToActivate.end();
+					const float waitTime = float((now - pending.timeQueued).seconds());
+					totalWaitTime += waitTime;
+					m_ActivationQueueStats.maxWaitTime = std::max(m_ActivationQueueStats.maxWaitTime, waitTime);
+					++m_ActivationQueueStats.activated;
+
+					// Remove the activated entry from the tail (the tail is unordered)
+					if (heapSize + 1 != m_EntitiesToActivate.size())
+						pending = std::move(m_EntitiesToActivate.back());
+					m_EntitiesToActivate.pop_back();
 				}
-				else
-					++it;
 			}
+			// Restore the heap property for entries that weren't ready (they are re-prioritised next time anyway)
+			std::make_heap(m_EntitiesToActivate.begin(), m_EntitiesToActivate.end());
+
+			m_ActivationQueueStats.meanWaitTime = m_ActivationQueueStats.activated > 0 ? float(totalWaitTime / m_ActivationQueueStats.activated) : 0.0f;
 		}
+
+		m_ActivationQueueStats.activationBacklog = m_EntitiesToActivate.size();
+		m_ActivationQueueStats.deactivationBacklog = m_EntitiesUnreferenced.size();
+		{
+			float oldest = 0.0f;
+			const auto now = tbb::tick_count::now();
+			for (auto it = m_EntitiesToActivate.cbegin(), end = m_EntitiesToActivate.cend(); it != end; ++it)
+				oldest = std::max(oldest, float((now - it->timeQueued).seconds()));
+			m_ActivationQueueStats.oldestWaitTime = oldest;
+		}
+#if FSN_PROFILING_ENABLED
+		Profiling::getSingleton().AddTime("~Activation Backlog", (double)m_ActivationQueueStats.activationBacklog);
+		Profiling::getSingleton().AddTime("~Deactivation Backlog", (double)m_ActivationQueueStats.deactivationBacklog);
+		Profiling::getSingleton().AddTime("~Activation Wait (max)", (double)m_ActivationQueueStats.maxWaitTime);
+#endif
+
 		// Activate components
 		{
 			FSN_PROFILE("ActivateNewComponents");
@@ -1791,12 +1869,25 @@ namespace FusionEngine
 			//  so that mark must be removed
 			if (entity->IsMarkedToDeactivate())
 				entity->RemoveDeactivateMark();
-			if (!entity->IsActive())
+			// Entities waiting to be deactivated are still active, but have already been taken off the
+			//  active list, so they are put back rather than being activated again
+			const bool wasPendingDeactivation = m_PendingUnreferenced.erase(entity.get()) != 0;
+			if (wasPendingDeactivation && entity->IsActive())
+			{
+				{
+					ActiveEntitiesMutex_t::scoped_lock lock(m_ActiveEntitiesMutex);
+					m_ActiveEntities.push_back(entity);
+				}
+				m_SpatialIndex.Update(entity, entity->GetPosition());
+			}
+			else if (!entity->IsActive())
 			{
-//#ifdef _DEBUG
-//				FSN_ASSERT(std::find(m_EntitiesToActivate.begin(), m_EntitiesToActivate.end(), entity) == m_EntitiesToActivate.end());
-//#endif
-				m_EntitiesToActivate.push_back(entity);
+				PendingActivation pending;
+				pending.entity = entity;
+				pending.priority = 0.0f; // Set when the queue is processed
+				pending.sequence = m_NextActivationSequence++;
+				pending.timeQueued = tbb::tick_count::now();
+				m_EntitiesToActivate.push_back(std::move(pending));
 			}
 		}
 		else
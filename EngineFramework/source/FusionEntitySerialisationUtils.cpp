@@ -866,60 +866,115 @@ namespace FusionEngine
 			}
 		}
 
-		void ReadComponent(ICellStream& instr, EntityComponent* component, SerialisedDataStyle data_style)
+		namespace
 		{
-			FSN_ASSERT(component);
-
-			CellStreamReader in(&instr);
-
-			if (data_style == FastBinary)
+			//! Gives a stream the reading interface of CellDataCursor (so the loading functions below can be shared)
+			/*!
+			* ReadBytes copies into a scratch buffer that is reused for each read.
+			*/
+			class StreamSource
 			{
-				const auto conDataLen = in.ReadValue<RakNet::BitSize_t>();
-				std::vector<char> data(conDataLen);
-				if (conDataLen > 0)
-				{
-					instr.read(data.data(), conDataLen);
+			public:
+				explicit StreamSource(ICellStream& stream)
+					: m_Stream(stream),
+					m_Reader(&stream)
+				{}
 
-					RakNet::BitStream stream(reinterpret_cast<unsigned char*>(data.data()), data.size(), false);
+				template <typename T>
+				bool Read(T& out) { return m_Reader.Read(out); }
 
-					component->DeserialiseContinuous(stream);
+				template <typename T>
+				T ReadValue() { return m_Reader.ReadValue<T>(); }
 
-					if (stream.GetNumberOfUnreadBits() >= 8)
-						SendToConsole("Not all serialised data was used when reading a " + component->GetType());
-				}
+				std::string ReadString() { return m_Reader.ReadString(); }
 
-				const auto occDataLen = in.ReadValue<RakNet::BitSize_t>();
-				if (occDataLen > 0)
+				const char* ReadBytes(size_t length)
 				{
-					data.resize(occDataLen);
-					instr.read(data.data(), occDataLen);
+					m_Buffer.resize(length);
+					if (m_Stream.read(m_Buffer.data(), length))
+						return m_Buffer.data();
+					else
+					{
+						m_Stream.clear();
+						return nullptr;
+					}
+				}
 
-					RakNet::BitStream stream(reinterpret_cast<unsigned char*>(data.data()), data.size(), false);
+			private:
+				ICellStream& m_Stream;
+				CellStreamReader m_Reader;
+				std::vector<char> m_Buffer;
 
-					component->DeserialiseOccasional(stream);
+				StreamSource& operator=(const StreamSource&);
+			};
 
-					if (stream.GetNumberOfUnreadBits() >= 8)
-						SendToConsole("Not all serialised data was used when reading a " + component->GetType());
-				}
+			//! Reads a block of the given length (for a non-copying bitstream to be created over)
+			template <class Source>
+			unsigned char* ReadBlock(Source& in, RakNet::BitSize_t length)
+			{
+				auto data = in.ReadBytes(length);
+				if (!data)
+					FSN_EXCEPT(FileSystemException, "Entity data is truncated");
+				// BitStream wants a non-const pointer, but it doesn't write to data it doesn't own
+				return reinterpret_cast<unsigned char*>(const_cast<char*>(data));
 			}
-			else
+
+			template <class Source>
+			void ReadComponentImpl(Source& in, EntityComponent* component, SerialisedDataStyle data_style)
 			{
-				const auto dataLen = in.ReadValue<RakNet::BitSize_t>();
-				std::vector<char> data(dataLen);
-				if (dataLen > 0)
+				FSN_ASSERT(component);
+
+				if (data_style == FastBinary)
 				{
-					instr.read(data.data(), dataLen);
+					const auto conDataLen = in.ReadValue<RakNet::BitSize_t>();
+					if (conDataLen > 0)
+					{
+						RakNet::BitStream stream(ReadBlock(in, conDataLen), conDataLen, false);
 
-					RakNet::BitStream stream(reinterpret_cast<unsigned char*>(data.data()), data.size(), false);
+						component->DeserialiseContinuous(stream);
 
-					component->DeserialiseEditable(stream);
+						if (stream.GetNumberOfUnreadBits() >= 8)
+							SendToConsole("Not all serialised data was used when reading a " + component->GetType());
+					}
 
-					if (stream.GetNumberOfUnreadBits() >= 8)
-						SendToConsole("Not all serialised data was used when reading a " + component->GetType() + " (editable mode)");
+					const auto occDataLen = in.ReadValue<RakNet::BitSize_t>();
+					if (occDataLen > 0)
+					{
+						RakNet::BitStream stream(ReadBlock(in, occDataLen), occDataLen, false);
+
+						component->DeserialiseOccasional(stream);
+
+						if (stream.GetNumberOfUnreadBits() >= 8)
+							SendToConsole("Not all serialised data was used when reading a " + component->GetType());
+					}
 				}
+				else
+				{
+					const auto dataLen = in.ReadValue<RakNet::BitSize_t>();
+					if (dataLen > 0)
+					{
+						RakNet::BitStream stream(ReadBlock(in, dataLen), dataLen, false);
+
+						component->DeserialiseEditable(stream);
+
+						if (stream.GetNumberOfUnreadBits() >= 8)
+							SendToConsole("Not all serialised data was used when reading a " + component->GetType() + " (editable mode)");
+					}
+				}
+
+				component->SynchronisePropertiesNow();
 			}
+		}
 
-			component->SynchronisePropertiesNow();
+		void ReadComponent(ICellStream& instr, EntityComponent* component, SerialisedDataStyle data_style)
+		{
+			StreamSource in(instr);
+			ReadComponentImpl(in, component, data_style);
+		}
+
+		void ReadComponent(CellDataCursor& in, EntityComponent* component, SerialisedDataStyle data_style)
+		{
+			ReadComponentImpl(in, component, data_style);
 		}
 
 		//{
@@ -1038,7 +1093,7 @@ namespace FusionEngine
 		class ArchetypalEntityFuture : public EntityFuture
 		{
 		public:
-			ArchetypalEntityFuture(std::shared_ptr<ICellStream>&& cell_data_stream, const std::string& archetype_id, const std::function<EntityPtr (const std::shared_ptr<ICellStream>&, const ResourceDataPtr&)>& finalise);
+			ArchetypalEntityFuture(std::shared_ptr<ICellStream>&& cell_data_stream, const std::string& archetype_id, const std::function<EntityPtr (const ResourceDataPtr&)>& finalise);
 
 			void OnArchetypeLoaded(ResourceDataPtr resource);
 
@@ -1053,14 +1108,14 @@ namespace FusionEngine
 		private:
 			ResourceDataPtr m_Resource;
 			std::shared_ptr<ICellStream> m_Stream;
-			std::function<EntityPtr (const std::shared_ptr<ICellStream>&, const ResourceDataPtr&)> m_FinaliseFn;
+			std::function<EntityPtr (const ResourceDataPtr&)> m_FinaliseFn;
 
 			std::shared_ptr<boost::signals2::scoped_connection> m_ResourceLoaderCnx;
 
 			clan::Event m_GotResult;
 		};
 
-		ArchetypalEntityFuture::ArchetypalEntityFuture(std::shared_ptr<ICellStream>&& cell_data_stream, const std::string& archetype_id, const std::function<EntityPtr (const std::shared_ptr<ICellStream>&, const ResourceDataPtr&)>& finalise)
+		ArchetypalEntityFuture::ArchetypalEntityFuture(std::shared_ptr<ICellStream>&& cell_data_stream, const std::string& archetype_id, const std::function<EntityPtr (const ResourceDataPtr&)>& finalise)
 			: m_Stream(std::move(cell_data_stream)),
 			m_FinaliseFn(finalise),
 			m_GotResult(true, false)
@@ -1080,7 +1135,7 @@ namespace FusionEngine
 			clan::Event::wait(m_GotResult);
 
 			if (m_Resource)
-				return m_FinaliseFn(m_Stream, m_Resource);
+				return m_FinaliseFn(m_Resource);
 			else
 				return EntityPtr();
 		}
@@ -1101,7 +1156,7 @@ namespace FusionEngine
 
 			if (m_Resource)
 			{
-				auto entity = m_FinaliseFn(m_Stream, m_Resource);
+				auto entity = m_FinaliseFn(m_Resource);
 				return std::make_pair(std::move(entity), std::move(m_Stream));
 			}
 			else
@@ -1113,182 +1168,231 @@ namespace FusionEngine
 			return (bool)m_Resource;
 		}
 
-		std::pair<EntityPtr, std::shared_ptr<ICellStream>> LoadEntityImmeadiate(std::shared_ptr<ICellStream>&& in, bool id_included, ObjectID override_id, SerialisedDataStyle data_style, ComponentFactory* factory, EntityManager* manager, EntityInstantiator* synchroniser)
+		namespace
 		{
-			return LoadEntity(std::move(in), id_included, override_id, data_style, factory, manager, synchroniser)->get();
-		}
+			//! The info that precedes each entity's data
+			struct EntityInfo
+			{
+				ObjectID id;
+				PlayerID owner;
+				std::string name;
+				bool terrain;
+				std::string archetypeId;
+			};
+
+			template <class Source>
+			EntityInfo ReadEntityInfo(Source& in, bool id_included, ObjectID override_id, EntityInstantiator* instantiator)
+			{
+				EntityInfo info;
 
-		std::shared_ptr<EntityFuture> LoadEntity(std::shared_ptr<ICellStream>&& instr, bool id_included, ObjectID override_id, SerialisedDataStyle data_style, ComponentFactory* factory, EntityManager* manager, EntityInstantiator* instantiator)
-		{
-			FSN_ASSERT(factory);
-			FSN_ASSERT(manager);
-			FSN_ASSERT(instantiator);
+				// Load entity info
+				info.id = 0;
+				if (id_included)
+				{
+					in.Read(info.id);
+					instantiator->TakeID(info.id);
+				}
+				else if (override_id != 0)
+				{
+					info.id = override_id;
+					instantiator->TakeID(info.id);
+				}
 
-			CellStreamReader in(instr.get());
+				info.owner = 0;
+				in.Read(info.owner);
 
-			// Load entity info
-			ObjectID id = 0;
-			if (id_included)
-			{
-				in.Read(id);
-				instantiator->TakeID(id);
+				info.name = in.ReadString();
+
+				info.terrain = false;
+				in.Read(info.terrain);
+
+				// Check for an archetype
+				info.archetypeId = in.ReadString();
+
+				return info;
 			}
-			else if (override_id != 0)
+
+			template <class Source>
+			EntityPtr LoadUniqueEntityImpl(Source& in, ObjectID id, PlayerID owner, const std::string& name, bool terrain, SerialisedDataStyle data_style, ComponentFactory* factory, EntityManager* manager)
 			{
-				id = override_id;
-				instantiator->TakeID(id);
-			}
+				FSN_ASSERT(factory);
+				FSN_ASSERT(manager);
 
-			PlayerID owner = 0;
-			in.Read(owner);
+				ComponentPtr transform;
+				//const auto dataLen = in.read_uint32();
+				//std::vector<unsigned char> referencedEntitiesData(dataLen);
+				//in.read(referencedEntitiesData.data(), referencedEntitiesData.size());
+				{
+					std::string transformType = in.ReadString();
+					transform = factory->InstantiateComponent(transformType);
 
-			auto name = in.ReadString();
+					auto tf = dynamic_cast<ITransform*>(transform.get()); FSN_ASSERT(tf);
+					auto len = in.ReadValue<RakNet::BitSize_t>();
+					if (len > 0)
+					{
+						RakNet::BitStream stream(ReadBlock(in, len), len, false);
+						auto result = StdDeserialisePosition(stream, Vector2(), 0);
+						tf->SetPosition(result);
+					}
+				}
 
-			bool terrain = false;
-			in.Read(terrain);
+				auto entity = std::make_shared<Entity>(manager, transform);
 
-			// Check for an archetype
-			std::string archetypeId = in.ReadString();
-			const bool isArchetypal = !archetypeId.empty();
+				entity->SetID(id);
+				entity->SetOwnerID(owner);
 
-			if (isArchetypal)
-			{
-				return std::make_shared<ArchetypalEntityFuture>(std::move(instr), archetypeId,
-					[id, owner, name, terrain, data_style, factory, manager, instantiator](const std::shared_ptr<ICellStream>& stream, const ResourceDataPtr& resource)->EntityPtr
-				{
-					auto archetypeFactory = static_cast<ArchetypeFactory*>(resource->GetDataPtr());
-					return LoadArchetypalEntity(*stream, archetypeFactory, id, owner, name, terrain, data_style, factory, manager, instantiator);
-				});
-			}
-			else
-			{
-				return std::make_shared<DoNothingEntityFuture>(std::move(instr), LoadUniqueEntity(*instr, id, owner, name, terrain, data_style, factory, manager, instantiator));
-			}
-		}
+				if (!name.empty())
+					entity->SetName(name);
 
-		EntityPtr LoadUniqueEntity(ICellStream& instr, ObjectID id, PlayerID owner, const std::string& name, bool terrain, SerialisedDataStyle data_style, ComponentFactory* factory, EntityManager* manager, EntityInstantiator* instantiator)
-		{
-			FSN_ASSERT(factory);
-			FSN_ASSERT(manager);
+				entity->SetTerrain(terrain);
 
-			CellStreamReader in(&instr);
+				// Read the rest of the transform data, now that the component has been initialised (by adding it to the entity)
+				ReadComponentImpl(in, transform.get(), data_style);
 
-			ComponentPtr transform;
-			//const auto dataLen = in.read_uint32();
-			//std::vector<unsigned char> referencedEntitiesData(dataLen);
-			//in.read(referencedEntitiesData.data(), referencedEntitiesData.size());
-			{
-				std::string transformType = in.ReadString();
-				transform = factory->InstantiateComponent(transformType);
+				//transform->SynchronisePropertiesNow();
 
-				if (transformType != "StaticTransform")
-				{
-					auto i = transformType.length();
-				}
+				//{
+				//	RakNet::BitStream stream(referencedEntitiesData.data(), referencedEntitiesData.size(), false);
+				//	entity->DeserialiseReferencedEntitiesList(stream, EntityDeserialiser(manager));
+				//}
 
-				auto tf = dynamic_cast<ITransform*>(transform.get()); FSN_ASSERT(tf);
-				auto len = in.ReadValue<RakNet::BitSize_t>();
-				if (len > 0)
+				size_t numComponents = 0;
+				in.Read(numComponents);
+				for (size_t i = 0; i < numComponents; ++i)
 				{
-					std::vector<char> buffer(len);
-					instr.read(buffer.data(), len);
-					RakNet::BitStream stream(reinterpret_cast<unsigned char*>(buffer.data()), buffer.size(), false);
-					auto result = StdDeserialisePosition(stream, Vector2(), 0);
-					tf->SetPosition(result);
+					std::string type = in.ReadString();
+					std::string ident = in.ReadString();
+					auto component = factory->InstantiateComponent(type);
+					entity->AddComponent(component, ident);
 				}
-			}
+				if (numComponents != 0)
+				{
+					auto& components = entity->GetComponents();
+					auto it = components.begin(), end = components.end();
+					for (++it; it != end; ++it)
+					{
+						auto& component = *it;
+						FSN_ASSERT(component != transform);
 
-			auto entity = std::make_shared<Entity>(manager, transform);
+						ReadComponentImpl(in, component.get(), data_style);
+					}
+				}
 
-			entity->SetID(id);
-			entity->SetOwnerID(owner);
+				return entity;
+			}
 
-			if (!name.empty())
-				entity->SetName(name);
+			template <class Source>
+			EntityPtr LoadArchetypalEntityImpl(Source& in, ArchetypeFactory* archetype_factory, SerialisedDataStyle data_style, ComponentFactory* factory, EntityManager* manager)
+			{
+				FSN_ASSERT(archetype_factory);
+				FSN_ASSERT(factory);
+				FSN_ASSERT(manager);
 
-			entity->SetTerrain(terrain);
+				Vector2 position;
+				const float angle = 0.0f;
 
-			// Read the rest of the transform data, now that the component has been initialised (by adding it to the entity)
-			ReadComponent(instr, transform.get(), data_style);
+				auto len = in.ReadValue<RakNet::BitSize_t>();
+				if (len > 0)
+				{
+					RakNet::BitStream stream(ReadBlock(in, len), len, false);
 
-			//transform->SynchronisePropertiesNow();
+					position = StdDeserialisePosition(stream, Vector2(), 0);
+				}
+				else
+				{
+					FSN_EXCEPT(FileSystemException, "Failed to load archetype: missing position data");
+				}
 
-			//{
-			//	RakNet::BitStream stream(referencedEntitiesData.data(), referencedEntitiesData.size(), false);
-			//	entity->DeserialiseReferencedEntitiesList(stream, EntityDeserialiser(manager));
-			//}
+				EntityPtr entity = ArchetypeFactoryManager::IsInstanceLinkingEnabled()
+					? archetype_factory->MakeInstance(factory, position, angle)
+					: archetype_factory->MakeUnlinkedInstance(factory, position, angle);
 
-			size_t numComponents;
-			in.Read(numComponents);
-			for (size_t i = 0; i < numComponents; ++i)
-			{
-				std::string type = in.ReadString();
-				std::string ident = in.ReadString();
-				auto component = factory->InstantiateComponent(type);
-				entity->AddComponent(component, ident);
-			}
-			if (numComponents != 0)
-			{
-				auto& components = entity->GetComponents();
-				auto it = components.begin(), end = components.end();
-				for (++it; it != end; ++it)
+				// Deserialise the archetype agent
 				{
-					auto& component = *it;
-					FSN_ASSERT(component != transform);
+					auto agent = entity->GetArchetypeAgent();
 
-					ReadComponent(instr, component.get(), data_style);
+					// Read the property overrides
+					auto len = in.ReadValue<RakNet::BitSize_t>();
+					if (len > 0)
+					{
+						RakNet::BitStream stream(ReadBlock(in, len), len, false);
+
+						agent->Deserialise(stream);
+					}
 				}
+
+				return entity;
 			}
+		}
 
-			return entity;
+		std::pair<EntityPtr, std::shared_ptr<ICellStream>> LoadEntityImmeadiate(std::shared_ptr<ICellStream>&& in, bool id_included, ObjectID override_id, SerialisedDataStyle data_style, ComponentFactory* factory, EntityManager* manager, EntityInstantiator* synchroniser)
+		{
+			return LoadEntity(std::move(in), id_included, override_id, data_style, factory, manager, synchroniser)->get();
 		}
 
-		EntityPtr LoadArchetypalEntity(ICellStream& instr, ArchetypeFactory* archetype_factory, ObjectID id, PlayerID owner, const std::string& name, bool terrain, SerialisedDataStyle data_style, ComponentFactory* factory, EntityManager* manager, EntityInstantiator* instantiator)
+		std::shared_ptr<EntityFuture> LoadEntity(std::shared_ptr<ICellStream>&& instr, bool id_included, ObjectID override_id, SerialisedDataStyle data_style, ComponentFactory* factory, EntityManager* manager, EntityInstantiator* instantiator)
 		{
-			FSN_ASSERT(archetype_factory);
 			FSN_ASSERT(factory);
 			FSN_ASSERT(manager);
+			FSN_ASSERT(instantiator);
 
-			CellStreamReader in(&instr);
+			StreamSource in(*instr);
 
-			Vector2 position;
-			const float angle = 0.0f;
+			const auto info = ReadEntityInfo(in, id_included, override_id, instantiator);
 
-			auto len = in.ReadValue<RakNet::BitSize_t>();
-			if (len > 0)
+			if (!info.archetypeId.empty())
 			{
-				std::vector<char> buffer(len);
-				instr.read(buffer.data(), len);
-				RakNet::BitStream stream(reinterpret_cast<unsigned char*>(buffer.data()), buffer.size(), false);
-
-				position = StdDeserialisePosition(stream, Vector2(), 0);
+				// The future keeps the stream alive until the entity is finished
+				ICellStream* stream = instr.get();
+				return std::make_shared<ArchetypalEntityFuture>(std::move(instr), info.archetypeId,
+					[stream, info, data_style, factory, manager, instantiator](const ResourceDataPtr& resource)->EntityPtr
+				{
+					auto archetypeFactory = static_cast<ArchetypeFactory*>(resource->GetDataPtr());
+					return LoadArchetypalEntity(*stream, archetypeFactory, info.id, info.owner, info.name, info.terrain, data_style, factory, manager, instantiator);
+				});
 			}
 			else
 			{
-				FSN_EXCEPT(FileSystemException, "Failed to load archetype: missing position data");
+				auto entity = LoadUniqueEntityImpl(in, info.id, info.owner, info.name, info.terrain, data_style, factory, manager);
+				return std::make_shared<DoNothingEntityFuture>(std::move(instr), entity);
 			}
+		}
 
-			EntityPtr entity = ArchetypeFactoryManager::IsInstanceLinkingEnabled()
-				? archetype_factory->MakeInstance(factory, position, angle)
-				: archetype_factory->MakeUnlinkedInstance(factory, position, angle);
+		std::shared_ptr<EntityFuture> LoadEntity(const std::shared_ptr<CellDataCursor>& in, bool id_included, ObjectID override_id, SerialisedDataStyle data_style, ComponentFactory* factory, EntityManager* manager, EntityInstantiator* instantiator)
+		{
+			FSN_ASSERT(in);
+			FSN_ASSERT(factory);
+			FSN_ASSERT(manager);
+			FSN_ASSERT(instantiator);
 
-			// Deserialise the archetype agent
-			{
-				auto agent = entity->GetArchetypeAgent();
+			const auto info = ReadEntityInfo(*in, id_included, override_id, instantiator);
 
-				// Read the property overrides
-				auto len = in.ReadValue<RakNet::BitSize_t>();
-				if (len > 0)
+			if (!info.archetypeId.empty())
+			{
+				return std::make_shared<ArchetypalEntityFuture>(std::shared_ptr<ICellStream>(), info.archetypeId,
+					[in, data_style, factory, manager](const ResourceDataPtr& resource)->EntityPtr
 				{
-					std::vector<char> buffer(len);
-					instr.read(buffer.data(), len);
-					RakNet::BitStream stream(reinterpret_cast<unsigned char*>(buffer.data()), buffer.size(), false);
-
-					agent->Deserialise(stream);
-				}
+					auto archetypeFactory = static_cast<ArchetypeFactory*>(resource->GetDataPtr());
+					return LoadArchetypalEntityImpl(*in, archetypeFactory, data_style, factory, manager);
+				});
 			}
+			else
+			{
+				auto entity = LoadUniqueEntityImpl(*in, info.id, info.owner, info.name, info.terrain, data_style, factory, manager);
+				return std::make_shared<DoNothingEntityFuture>(std::shared_ptr<ICellStream>(), entity);
+			}
+		}
 
-			return entity;
+		EntityPtr LoadUniqueEntity(ICellStream& instr, ObjectID id, PlayerID owner, const std::string& name, bool terrain, SerialisedDataStyle data_style, ComponentFactory* factory, EntityManager* manager, EntityInstantiator* instantiator)
+		{
+			StreamSource in(instr);
+			return LoadUniqueEntityImpl(in, id, owner, name, terrain, data_style, factory, manager);
+		}
+
+		EntityPtr LoadArchetypalEntity(ICellStream& instr, ArchetypeFactory* archetype_factory, ObjectID id, PlayerID owner, const std::string& name, bool terrain, SerialisedDataStyle data_style, ComponentFactory* factory, EntityManager* manager, EntityInstantiator* instantiator)
+		{
+			StreamSource in(instr);
+			return LoadArchetypalEntityImpl(in, archetype_factory, data_style, factory, manager);
 		}
 
 	}
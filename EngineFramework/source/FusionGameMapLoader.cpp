@@ -55,6 +55,7 @@
 #include <yaml-cpp/yaml.h>
 
 #include <boost/filesystem.hpp>
+#include <limits>
 
 #include "FusionPhysFS.h"
 
@@ -67,6 +68,7 @@ namespace FusionEngine
 	const std::string GameMap::instantiatorStateFilename = "instantiator_state";
 	const std::string GameMap::tentDataFilename = "transcendental.entitydata";
 	const std::string GameMap::entityDatabaseFilename = "entitylocations.kc";
+	const std::string GameMap::cellDictionaryFilename = "cells.dict";
 
 	GameMap::GameMap(const std::string& path)
 		: m_Path(path)
@@ -166,7 +168,7 @@ namespace FusionEngine
 		}
 	}
 
-	void GameMap::CompileMap(const VirtualFilesystem& vfs, const std::string& map_name, float cell_size, CellFileManager* cell_archiver, const std::vector<EntityPtr>& nsentities, EntityInstantiator* instantiator)
+	void GameMap::CompileMap(const VirtualFilesystem& vfs, const std::string& map_name, float cell_size, CellFileManager* cell_archiver, const std::vector<EntityPtr>& nsentities, EntityInstantiator* instantiator, const std::function<void (bool, const std::string&)>& progress_notification)
 	{
 		using namespace EntitySerialisationUtils;
 		using namespace IO::Streams;
@@ -181,8 +183,19 @@ namespace FusionEngine
 		const std::string entityDatabasePath = path + "/" + entityDatabaseFilename;
 
 		// Entity locations database
+		progress_notification(false, "Copying entity locations");
 		cell_archiver->CopyDatabase(entityDatabasePath);
-		cell_archiver->CopyCellFiles(path);
+		// Progress is only reported when the percentage changes (there can be thousands of region files)
+		auto lastPercent = std::make_shared<size_t>(std::numeric_limits<size_t>::max());
+		cell_archiver->CopyCellFiles(path, [progress_notification, lastPercent](size_t filesDone, size_t numFiles)
+		{
+			const size_t percent = numFiles > 0 ? filesDone * 100 / numFiles : 100;
+			if (percent == *lastPercent)
+				return;
+			*lastPercent = percent;
+			progress_notification(false, "Compiling regions: " + boost::lexical_cast<std::string>(percent) + "% (" +
+				boost::lexical_cast<std::string>(filesDone) + " / " + boost::lexical_cast<std::string>(numFiles) + ")");
+		});
 
 		// Metadata
 		//  cell size
@@ -213,6 +226,8 @@ namespace FusionEngine
 		{
 			auto tentsFile = vfs.OpenFileForWriting(tentDataPath);
 
+			progress_notification(false, "Writing non-streaming entities");
+
 			// Filter the pseudo / synced entities into separate lists
 			std::vector<EntityPtr> nonStreamingEntities = nsentities;
 			std::vector<EntityPtr> nonStreamingEntitiesSynched;
@@ -254,6 +269,8 @@ namespace FusionEngine
 				SaveEntity(compressingStream, entity, true, FastBinary);
 			}
 		}
+
+		progress_notification(true, "Compiled " + map_name);
 	}
 
 	GameMapLoader::GameMapLoader(/*ClientOptions *options*/)
@@ -0,0 +1,109 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author(s):
+*
+*    Elliot Hayward
+*/
+
+#include "PrecompiledHeaders.h"
+
+#include "FusionLazyLoadOverlay.h"
+
+#include "FusionRegionSnapshot.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+namespace FusionEngine
+{
+
+	LazyLoadOverlay::LazyLoadOverlay(size_t num_saves, const OpenSaveFileFn_t& open_file, const std::vector<std::string>& filenames, const std::string& sub_path, const std::string& cache_path)
+		: m_NumSaves(num_saves),
+		m_OpenSaveFile(open_file),
+		m_Filenames(filenames),
+		m_SubPath(sub_path),
+		m_CachePath(cache_path)
+	{
+		for (auto it = m_Filenames.begin(); it != m_Filenames.end(); ++it)
+			m_Copied.insert(std::make_pair(*it, false));
+	}
+
+	std::string LazyLoadOverlay::GetRegionFilename(const std::string& filename)
+	{
+		boost::filesystem::path file(filename);
+		if (file.extension() == RegionSnapshot::s_DeltaExtension)
+			file.replace_extension(".celldata");
+		if (file.extension() == ".celldata")
+			return file.filename().string();
+		return std::string();
+	}
+
+	bool LazyLoadOverlay::Provides(const std::string& filename) const
+	{
+		Copied_t::const_accessor accessor;
+		return m_Copied.find(accessor, filename);
+	}
+
+	void LazyLoadOverlay::FaultIn(const std::string& filename)
+	{
+		namespace bfs = boost::filesystem;
+
+		// Other threads that need this file wait on the accessor until it has been copied
+		Copied_t::accessor accessor;
+		if (!m_Copied.find(accessor, filename) || accessor->second)
+			return;
+
+		const auto regionFile = bfs::path(m_CachePath) / filename;
+		const auto relativePath = bfs::path(m_SubPath) / filename;
+		auto deltaPath = relativePath;
+		deltaPath.replace_extension(RegionSnapshot::s_DeltaExtension);
+
+		// Each save (starting with the one the others are based on) either replaces the file or has changes to apply to it
+		for (size_t i = 0; i < m_NumSaves; ++i)
+		{
+			if (auto data = m_OpenSaveFile(i, relativePath.generic_string()))
+			{
+				bfs::ofstream file(regionFile, std::ios::out | std::ios::binary | std::ios::trunc);
+				file << data->rdbuf();
+				if (!file)
+					FSN_EXCEPT(FileSystemException, "Failed to copy " + relativePath.generic_string());
+			}
+			if (auto delta = m_OpenSaveFile(i, deltaPath.generic_string()))
+				RegionSnapshot::ApplyDelta(*delta, regionFile);
+		}
+
+		accessor->second = true;
+	}
+
+	std::vector<std::string> LazyLoadOverlay::GetFilenames() const
+	{
+		return m_Filenames;
+	}
+
+	void LazyLoadOverlay::FaultInAll(const std::atomic<bool>& cancel)
+	{
+		for (auto it = m_Filenames.begin(); it != m_Filenames.end() && !cancel; ++it)
+			FaultIn(*it);
+	}
+
+}
@@ -178,15 +178,20 @@ namespace FusionEngine
 
 		auto guidCopy = guid;
 		auto coordCopy = coord;
-		this->GetRawCellStreamForReading(std::bind(&NetworkedRegionCellCache::OnGotCellStreamForSending, this, _1, guidCopy, coordCopy), coord.x, coord.y);
+		this->GetRawCellStreamForReading(std::bind(&NetworkedRegionCellCache::OnGotCellStreamForSending, this, _1, _2, guidCopy, coordCopy), coord.x, coord.y);
 	}
 
-	void NetworkedRegionCellCache::OnGotCellStreamForSending(std::shared_ptr<std::istream> cellDataStream, RakNet::RakNetGUID send_to, CellCoord_t coord)
+	void NetworkedRegionCellCache::OnGotCellStreamForSending(std::shared_ptr<std::istream> cellDataStream, CellCodec codec, RakNet::RakNetGUID send_to, CellCoord_t coord)
 	{
+		if (!cellDataStream)
+			return;
+
 		auto network = NetworkManager::getSingleton().GetNetwork();
 
 		RakNet::BitStream toSend;
 		toSend.Write(coord);
+		// The receiver needs to know how the data was compressed (it may not match the codec it would use itself)
+		toSend.Write(static_cast<uint8_t>(codec));
 		
 		{
 			RakNet::BitStream data;
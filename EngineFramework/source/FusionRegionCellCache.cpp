@@ -35,6 +35,7 @@
 #include "FusionPhysFSIOStream.h"
 #include "FusionResourceManager.h"
 #include "FusionRegionFileLoadedCallbackHandle.h"
+#include "FusionRegionSnapshot.h"
 
 #include "FusionResource.h"
 
@@ -46,11 +47,65 @@
 #include <boost/iostreams/device/file.hpp>
 #include <boost/iostreams/device/file_descriptor.hpp>
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
 namespace io = boost::iostreams;
 
 namespace FusionEngine
 {
-	const uint8_t s_CellDataVersion = 2;
+	const uint8_t s_CellDataVersion = 3;
+
+	//! The header written in front of each cell's data
+	struct CellHeader
+	{
+		size_t length; // Length of the data after the header
+		uint8_t version;
+		CellCodec codec;
+		size_t scalarCellIndex;
+	};
+
+	//! Reads a cell header (returns false if there is no data at the reader's position)
+	template <class Reader>
+	static bool readCellHeader(Reader& reader, CellHeader& header)
+	{
+		// The length written includes the version number and (from version 3) the codec
+		const auto lengthField = reader.template ReadValue<size_t>();
+		if (lengthField == 0)
+			return false;
+
+		header.version = reader.template ReadValue<uint8_t>();
+		if (header.version == 1)
+			FSN_EXCEPT(FileTypeException, "Version 1 cell data is no longer supported");
+		if (header.version > s_CellDataVersion)
+			FSN_EXCEPT(FileTypeException, "Cell data version unsupported");
+
+		size_t headerFieldsInLength = sizeof(uint8_t);
+		// * Added in s_CellDataVersion 3 (data before that is all zlib)
+		header.codec = CellCodec::Zlib;
+		if (header.version >= 3)
+		{
+			header.codec = (CellCodec)reader.template ReadValue<uint8_t>();
+			headerFieldsInLength += sizeof(uint8_t);
+		}
+
+		if (lengthField < headerFieldsInLength)
+			FSN_EXCEPT(FileTypeException, "Cell data length is invalid - the region file is probably corrupt");
+		header.length = lengthField - headerFieldsInLength;
+
+		header.scalarCellIndex = reader.template ReadValue<size_t>();
+
+		return true;
+	}
+
+	//! Returns the number of sectors needed to store a cell's header followed by the given length of data
+	static size_t sectorsForCellData(size_t length, uint8_t version = s_CellDataVersion)
+	{
+		// Headers before version 3 have no codec byte
+		const size_t headerSize = version >= 3 ? RegionFile::s_CellHeaderSize : RegionFile::s_CellHeaderSize - sizeof(uint8_t);
+		return (headerSize + length + RegionFile::s_SectorSize - 1) / RegionFile::s_SectorSize;
+	}
 
 	std::array<char, RegionFile::s_SectorSize> EmptySectorData;
 
@@ -151,7 +206,7 @@ namespace FusionEngine
 		}
 		if (result < n)
 		{
-			data->insert(data->end(), s, s + n);
+			data->insert(data->end(), s + result, s + n);
 			position = data->size();
 		}
 		return n;
@@ -179,6 +234,56 @@ namespace FusionEngine
 		return position;
 	}
 
+	std::streamsize MappedFileDevice::read(char_type* s, std::streamsize n)
+	{
+		const std::streamsize amt = static_cast<std::streamsize>(mapping->size()) - position;
+		const std::streamsize result = std::min(n, amt);
+		if (result > 0)
+		{
+			std::memcpy(s, mapping->const_data() + position, (size_t)result);
+			position += result;
+			return result;
+		}
+		else
+		{
+			return -1; // EOF
+		}
+	}
+	std::streamsize MappedFileDevice::write(const char_type* s, std::streamsize n)
+	{
+		const std::streamsize end = position + n;
+		if (end > static_cast<std::streamsize>(mapping->size()))
+		{
+			// Grow to the next whole sector (remapping the file)
+			const std::streamsize sectorSize = RegionFile::s_SectorSize;
+			mapping->resize((end + sectorSize - 1) / sectorSize * sectorSize);
+		}
+		std::memcpy(mapping->data() + position, s, (size_t)n);
+		position = end;
+		return n;
+	}
+	boost::iostreams::stream_offset MappedFileDevice::seek(boost::iostreams::stream_offset off, std::ios_base::seekdir way)
+	{
+		using namespace std;
+		using namespace boost::iostreams;
+		const stream_offset size = static_cast<stream_offset>(mapping->size());
+		stream_offset next;
+		if (way == ios_base::beg)
+			next = off;
+		else if (way == ios_base::cur)
+			next = position + off;
+		else if (way == ios_base::end)
+			next = size + off;
+		else
+			throw ios_base::failure("bad seek direction");
+
+		if (next < 0 || next > size)
+			throw ios_base::failure("bad seek offset");
+
+		position = next;
+		return position;
+	}
+
 	CellBuffer::impl::~impl()
 	{
 		FSN_ASSERT(parent);
@@ -210,25 +315,42 @@ namespace FusionEngine
 			return 0;
 	}
 
-	RegionFile::RegionFile(const std::string& filename, size_t width)
+	RegionFile::RegionFile(const std::string& filename, size_t width, bool memory_mapped)
 		: filename(filename),
 		region_width(width),
 		fragmentationAllowed(true)
 	{
-		std::unique_ptr<boost::iostreams::file_descriptor> filedesc;
+		if (memory_mapped)
+		{
+			try
+			{
+				mapRegionData();
+			}
+			catch (std::exception& ex)
+			{
+				AddLogEntry("Failed to map region file " + filename + " into memory, loading it instead: " + ex.what(), LOG_NORMAL);
+				mappedFile.reset();
+				file.reset();
+			}
+		}
 
-		if (!boost::filesystem::exists(filename))
+		if (!mappedFile)
 		{
-			// Create the file (creating an in | out stream for a file that doesn't exist will fail)
-			filedesc.reset(new io::file_descriptor(filename, std::ios::out | std::ios::binary));
+			std::unique_ptr<boost::iostreams::file_descriptor> filedesc;
+
+			if (!boost::filesystem::exists(filename))
+			{
+				// Create the file (creating an in | out stream for a file that doesn't exist will fail)
+				filedesc.reset(new io::file_descriptor(filename, std::ios::out | std::ios::binary));
+				file.reset(new io::stream<io::file_descriptor>(*filedesc, 0));
+				file.reset();
+				filedesc.reset();
+			}
+			filedesc.reset(new io::file_descriptor(filename, std::ios::in | std::ios::out | std::ios::binary));
 			file.reset(new io::stream<io::file_descriptor>(*filedesc, 0));
-			file.reset();
-			filedesc.reset();
-		}
-		filedesc.reset(new io::file_descriptor(filename, std::ios::in | std::ios::out | std::ios::binary));
-		file.reset(new io::stream<io::file_descriptor>(*filedesc, 0));
 
-		loadRegionData(std::move(file));
+			loadRegionData(std::move(file));
+		}
 
 		init();
 	}
@@ -247,27 +369,117 @@ namespace FusionEngine
 		flush();
 	}
 
+	//! Calls fn(first_sector, num_sectors) for each run of set bits
+	template <typename Fn>
+	static void forEachRun(const boost::dynamic_bitset<>& sectors, Fn&& fn)
+	{
+		auto first = sectors.find_first();
+		while (first != boost::dynamic_bitset<>::npos)
+		{
+			auto end = first + 1;
+			while (end < sectors.size() && sectors.test(end))
+				++end;
+			fn((size_t)first, (size_t)(end - first));
+			first = end < sectors.size() ? sectors.find_next(end) : boost::dynamic_bitset<>::npos;
+		}
+	}
+
+	static void flushMappedRange(char* address, size_t length)
+	{
+#ifdef _WIN32
+		if (!::FlushViewOfFile(address, length))
+			AddLogEntry("Failed to write back region file data", LOG_CRITICAL);
+#else
+		if (::msync(address, length, MS_ASYNC) != 0)
+			AddLogEntry("Failed to write back region file data", LOG_CRITICAL);
+#endif
+	}
+
 	void RegionFile::flush() const
 	{
 		// Write the region to disk (if it wasn't loaded read-only)
-		if (!filename.empty())
+		if (!filename.empty() && dirty_sectors.any())
 		{
-			std::unique_ptr<boost::iostreams::file_descriptor> filedesc(new io::file_descriptor(filename, std::ios::out | std::ios::binary));
-			std::unique_ptr<std::iostream> outFile;
-			outFile.reset(new io::stream<io::file_descriptor>(*filedesc, 0));
-			outFile->write(regionData->data(), regionData->size());
-			outFile.reset();
-			filedesc.reset();
+			// Make sure buffered writes have reached the region data
+			if (file)
+				file->flush();
+
+			if (mappedFile)
+			{
+				char* const data = mappedFile->data();
+				const size_t size = mappedFile->size();
+				forEachRun(dirty_sectors, [&](size_t first_sector, size_t num_sectors)
+				{
+					const size_t begin = first_sector * s_SectorSize;
+					if (begin < size)
+						flushMappedRange(data + begin, std::min(num_sectors * s_SectorSize, size - begin));
+				});
+			}
+			else
+			{
+				// Opened in | out so the file isn't truncated: only the dirty sectors are written
+				io::file_descriptor outFile(filename, std::ios::in | std::ios::out | std::ios::binary);
+				const size_t size = regionData->size();
+				forEachRun(dirty_sectors, [&](size_t first_sector, size_t num_sectors)
+				{
+					const size_t begin = first_sector * s_SectorSize;
+					if (begin < size)
+					{
+						outFile.seek(begin, std::ios::beg);
+						outFile.write(regionData->data() + begin, std::min(num_sectors * s_SectorSize, size - begin));
+					}
+				});
+			}
+
+			dirty_sectors.reset();
 		}
 	}
 
+	void RegionFile::mapRegionData()
+	{
+		io::mapped_file_params params(filename);
+		params.flags = io::mapped_file::readwrite;
+		// Empty files can't be mapped, so new files are created with a (zeroed, i.e. empty) index sector
+		if (!boost::filesystem::exists(filename) || boost::filesystem::file_size(filename) == 0)
+			params.new_file_size = s_SectorSize;
+
+		mappedFile = std::make_shared<io::mapped_file>(params);
+
+		auto stream = new io::filtering_stream<MappedFileDevice::category>();
+		stream->push(MappedFileDevice(mappedFile));
+
+		file = std::unique_ptr<std::iostream>(std::move(stream));
+	}
+
+	void RegionFile::markDirty(size_t first_sector, size_t num_sectors)
+	{
+		if (filename.empty())
+			return;
+		if (dirty_sectors.size() < first_sector + num_sectors)
+			dirty_sectors.resize(first_sector + num_sectors, false);
+		for (size_t i = first_sector; i < first_sector + num_sectors; ++i)
+			dirty_sectors.set(i);
+
+		if (modified_sectors.size() < first_sector + num_sectors)
+			modified_sectors.resize(first_sector + num_sectors, false);
+		for (size_t i = first_sector; i < first_sector + num_sectors; ++i)
+			modified_sectors.set(i);
+	}
+
+	boost::dynamic_bitset<> RegionFile::takeModifiedSectors()
+	{
+		boost::dynamic_bitset<> modified;
+		modified.swap(modified_sectors);
+		return modified;
+	}
+
 	void RegionFile::loadRegionData(std::unique_ptr<std::istream> source)
 	{
 		const auto length = fileLength(*source);
 
 		// Generate the container into which the region file will be loaded
 		regionData = std::make_shared<SmartArrayDevice::DataArray_t>(length);
-		regionData->reserve(RegionFile::s_SectorSize * RegionFile::s_MaxSectors);
+		regionData->reserve(length + RegionFile::s_SectorSize * 1024);
 
 		// Create the device to access the container as if it is a file
 		SmartArrayDevice device(regionData);
@@ -285,6 +497,15 @@ namespace FusionEngine
 		file = std::unique_ptr<std::iostream>(std::move(stream));
 	}
 
+	//! Identifies version 2+ region files (version 1 files start with the index)
+	static const char s_RegionFileMagic[8] = { 'F', 'S', 'N', 'R', 'G', 'N', '\0', '\0' };
+
+	size_t RegionFile::indexSectorsFor(size_t region_width)
+	{
+		const size_t indexLength = s_IndexHeaderSize + region_width * region_width * s_IndexEntrySize;
+		return (indexLength + s_SectorSize - 1) / s_SectorSize;
+	}
+
 	void RegionFile::init()
 	{
 		try
@@ -292,7 +513,11 @@ namespace FusionEngine
 			if (!(*file))
 				FSN_EXCEPT(FileSystemException, "Failed to open region file: " + filename);
 
-			IO::Streams::CellStreamWriter writer(file.get());
+			if (region_width == 0 || region_width > s_MaxRegionWidth)
+				FSN_EXCEPT(InvalidArgumentException, "Unsupported region width for region file: " + filename);
+
+			index_sectors = indexSectorsFor(region_width);
+			cellDataLocations.assign(region_width * region_width, DataLocation());
 
 			bool new_file = false;
 			auto length = fileLength(*file);
@@ -302,24 +527,21 @@ namespace FusionEngine
 
 			if (length < s_SectorSize)
 			{
-				// New file: write the chunk offset table
-				DataLocation nothing; nothing.startingSector = 0; nothing.sectorsAllocated = 0;
-				for (int i = 0; i < s_MaxSectors; ++i)
-					writer.Write(nothing);
-
+				// New file: write the (empty) index
+				writeIndex();
 				file->flush();
 
-				//sizeDelta += s_SectorSize;
-
 				length = fileLength(*file);
 
 				new_file = true;
 			}
 
-			if ((length & 0xFFF) != 0)
+			const bool padded = (length & 0xFFF) != 0;
+			if (padded)
 			{
 				// The file size is not a multiple of 4KB, grow it
-				for (size_t i = 0; i < (length & 0xfff); ++i)
+				file->seekp(0, std::ios::end);
+				for (size_t i = (length & 0xFFF); i < s_SectorSize; ++i)
 					file->put(0);
 
 				length = fileLength(*file);
@@ -327,35 +549,32 @@ namespace FusionEngine
 			}
 
 			// Set up the available-sector map
-			auto numSectors = std::max<size_t>(length / s_SectorSize, 1);
+			auto numSectors = std::max<size_t>(length / s_SectorSize, index_sectors);
+
+			if (new_file || padded)
+				markDirty(0, numSectors);
 			free_sectors.resize(numSectors, true);
 
-			free_sectors.set(0, false); // sector zero is the chunk offset table (thus not free from the beginning)
+			// The first sectors are the index (thus not free from the beginning)
+			for (size_t i = 0; i < index_sectors; ++i)
+				free_sectors.set(i, false);
 
 			if (!new_file)
 			{
-				IO::Streams::CellStreamReader reader(file.get());
+				if (!readIndex())
+					upgradeFromV1();
 
-				file->seekg(0);
-				for (size_t i = 0; i < s_MaxSectors; ++i)
+				for (size_t i = 0; i < cellDataLocations.size(); ++i)
 				{
-					DataLocation location;
-					if (reader.Read(location))
+					const auto& location = cellDataLocations[i];
+					if (location.is_valid() && location.startingSector >= index_sectors && location.end() <= free_sectors.size())
 					{
-						cellDataLocations[i] = location;
-						if (location.is_valid() && location.end() <= free_sectors.size())
+						const auto endSector = (size_t)location.end();
+						for (size_t sectorNum = (size_t)location.startingSector; sectorNum < endSector; ++sectorNum)
 						{
-							const auto endSector = location.end();
-							for (size_t sectorNum = location.startingSector; sectorNum < endSector; ++sectorNum)
-							{
-								free_sectors.set(sectorNum, false);
-							}
+							free_sectors.set(sectorNum, false);
 						}
 					}
-					else
-					{
-						FSN_EXCEPT(FileTypeException, "Failed to read sector data from region file header");
-					}
 				}
 			}
 		}
@@ -366,9 +585,145 @@ namespace FusionEngine
 		}
 	}
 
-	std::unique_ptr<ArchiveIStream> RegionFile::getInputCellData(int32_t x, int32_t y, bool inflate)
+	void RegionFile::writeIndex()
+	{
+		IO::Streams::CellStreamWriter writer(file.get());
+
+		file->seekp(0);
+		file->write(s_RegionFileMagic, sizeof(s_RegionFileMagic));
+		writer.WriteAs<uint32_t>(s_FormatVersion);
+		writer.WriteAs<uint32_t>(region_width);
+		for (auto it = cellDataLocations.begin(); it != cellDataLocations.end(); ++it)
+		{
+			writer.WriteAs<uint64_t>(it->startingSector);
+			writer.WriteAs<uint32_t>(it->sectorsAllocated);
+		}
+
+		// Pad the index out to a whole number of sectors
+		const size_t indexLength = s_IndexHeaderSize + cellDataLocations.size() * s_IndexEntrySize;
+		file->write(EmptySectorData.data(), index_sectors * s_SectorSize - indexLength);
+
+		markDirty(0, index_sectors);
+	}
+
+	bool RegionFile::readIndex()
+	{
+		IO::Streams::CellStreamReader reader(file.get());
+
+		file->seekg(0);
+		std::array<char, sizeof(s_RegionFileMagic)> magic;
+		file->read(magic.data(), magic.size());
+		if (!std::equal(magic.begin(), magic.end(), s_RegionFileMagic))
+			return false;
+
+		const auto version = reader.ReadValue<uint32_t>();
+		if (version > s_FormatVersion)
+			FSN_EXCEPT(FileTypeException, "Region file version unsupported: " + filename);
+		const auto width = reader.ReadValue<uint32_t>();
+		if (width != region_width)
+		{
+			std::stringstream str; str << "Region file " << filename << " is " << width << " cells wide (expected " << region_width << ")";
+			FSN_EXCEPT(FileTypeException, str.str());
+		}
+
+		for (auto it = cellDataLocations.begin(); it != cellDataLocations.end(); ++it)
+		{
+			it->startingSector = reader.ReadValue<uint64_t>();
+			it->sectorsAllocated = reader.ReadValue<uint32_t>();
+		}
+
+		return true;
+	}
+
+	//! Version 1 index entry
+	struct DataLocationV1
+	{
+		uint32_t startingSector : 24;
+		uint32_t sectorsAllocated : 8;
+	};
+	//! Version 1 region files have exactly this many index entries (filling sector 0)
+	static const size_t s_V1IndexEntries = 1024;
+
+	void RegionFile::upgradeFromV1()
+	{
+		const size_t numSectors = free_sectors.size();
+
+		// Read all the cell data, since the new index needs more room than the old one
+		std::vector<std::pair<size_t, std::vector<char>>> cells;
+		{
+			IO::Streams::CellStreamReader reader(file.get());
+
+			std::vector<DataLocationV1> oldIndex(s_V1IndexEntries);
+			file->seekg(0);
+			for (size_t i = 0; i < s_V1IndexEntries; ++i)
+			{
+				if (!reader.Read(oldIndex[i]))
+					FSN_EXCEPT(FileTypeException, "Failed to read sector data from region file header");
+			}
+
+			for (size_t i = 0; i < s_V1IndexEntries; ++i)
+			{
+				const auto& location = oldIndex[i];
+				if (location.sectorsAllocated == 0 || location.startingSector == 0)
+					continue;
+				if (i >= cellDataLocations.size() || location.startingSector + location.sectorsAllocated > numSectors)
+				{
+					AddLogEntry("Dropping invalid index entry while upgrading region file " + filename, LOG_NORMAL);
+					continue;
+				}
+
+				std::vector<char> data(location.sectorsAllocated * s_SectorSize);
+				file->seekg(std::streampos(location.startingSector * s_SectorSize));
+				file->read(data.data(), data.size());
+				cells.push_back(std::make_pair(i, std::move(data)));
+			}
+		}
+
+		// Write the new index then put the cells after it (this also defragments the file)
+		size_t nextSector = index_sectors;
+		for (auto it = cells.begin(); it != cells.end(); ++it)
+		{
+			auto& location = cellDataLocations[it->first];
+			location.startingSector = nextSector;
+			location.sectorsAllocated = (uint32_t)(it->second.size() / s_SectorSize);
+			nextSector += location.sectorsAllocated;
+		}
+		writeIndex();
+
+		for (auto it = cells.begin(); it != cells.end(); ++it)
+		{
+			file->seekp(std::streampos(cellDataLocations[it->first].startingSector * s_SectorSize));
+			file->write(it->second.data(), it->second.size());
+		}
+
+		// Clear what's left of the old data
+		for (size_t sector = nextSector; sector < numSectors; ++sector)
+			file->write(EmptySectorData.data(), s_SectorSize);
+
+		if (nextSector > numSectors)
+			free_sectors.resize(nextSector, true);
+		markDirty(0, free_sectors.size());
+
+		if (!cells.empty())
+			AddLogEntry("Upgraded region file " + filename + " to version 2", LOG_INFO);
+	}
+
+	std::pair<const char*, size_t> RegionFile::getRegionData() const
+	{
+		// Make sure buffered writes have reached the region data
+		if (file)
+			file->flush();
+
+		if (mappedFile)
+			return std::make_pair(mappedFile->const_data(), mappedFile->size());
+		else if (regionData)
+			return std::make_pair((const char*)regionData->data(), regionData->size());
+		else
+			return std::make_pair((const char*)nullptr, size_t(0));
+	}
+
+	RegionFile::CellDataView RegionFile::getCellDataView(int32_t x, int32_t y)
 	{
-		namespace io = boost::iostreams;
 		// TODO: sanity checks
 
 		auto location = std::make_pair(x, y);
@@ -382,46 +737,110 @@ namespace FusionEngine
 		{
 			//std::stringstream str; str << location.first << ", " << location.second;
 			//AddLogEntry("There was no cell data for [" + str.str() + "] in the cache", LOG_INFO);
-			return std::unique_ptr<ArchiveIStream>();
+			return CellDataView();
 		}
 
 		FSN_ASSERT(locationData.is_valid());
 
-		const auto dataBegin = firstSector * s_SectorSize;
+		const auto region = getRegionData();
+		const char* regionBegin = region.first;
+		const size_t regionLength = region.second;
 
-		file->seekg(dataBegin);
+		const size_t dataBegin = firstSector * s_SectorSize;
+		if (dataBegin >= regionLength)
+		{
+			Log(LOG_CRITICAL) << "Data for cell [" << location.first << ", " << location.second << "] is past the end of the region file (meaning region file is corrupt)";
+			return CellDataView();
+		}
 
 		// Read the header
-		IO::Streams::CellStreamReader reader(file.get());
-		const auto dataLength = reader.ReadValue<size_t>() - sizeof(uint8_t); // - sizeof(version number)
+		CellDataCursor reader(regionBegin + dataBegin, std::min<size_t>(numSectors * s_SectorSize, regionLength - dataBegin));
+		CellHeader header;
+		if (!readCellHeader(reader, header))
+			return CellDataView();
+
+		// When there is a changes to the cell data, conversions for old data can be added here
 
-		if (dataLength > s_SectorSize * numSectors)
+		if (header.length > s_SectorSize * numSectors)
 		{
 			Log(LOG_CRITICAL) << "Data length for cell [" << location.first << ", " << location.second << "] is inconsistent with sectors used (meaning region file is corrupt)";
-			return std::unique_ptr<ArchiveIStream>();
+			return CellDataView();
 		}
 
-		const auto dataVersion = reader.ReadValue<uint8_t>();
+		if (header.scalarCellIndex != toScalarIndex(location))
+		{
+			FSN_EXCEPT(FileTypeException, "Cell data retrieved is not for the expected cell index - the region file is probably corrupt");
+		}
 
-		// When there is a changes to the cell data, conversions for old data can be added here
+		CellDataView view;
+		view.data = reader.ReadBytes(header.length);
+		if (!view.data)
+		{
+			Log(LOG_CRITICAL) << "Data for cell [" << location.first << ", " << location.second << "] is truncated (meaning region file is corrupt)";
+			return CellDataView();
+		}
+		view.length = header.length;
+		view.codec = header.codec;
 
-		if (dataVersion != s_CellDataVersion)
-			FSN_EXCEPT(FileTypeException, "Cell data version unsupported");
+		return view;
+	}
 
-		const auto scalarCellIndex = reader.ReadValue<size_t>();
-		if (scalarCellIndex != toScalarIndex(location))
+	bool RegionFile::readCellData(int32_t x, int32_t y, CellData& out, bool decompress, const CellCodecDictionary* dictionary)
+	{
+		const auto view = getCellDataView(x, y);
+		if (!view.data)
+			return false;
+
+		if (decompress)
 		{
-			FSN_EXCEPT(FileTypeException, "Cell data retrieved is not for the expected cell index - the region file is probably corrupt");
+			if (!out.Decompress(view.codec, view.data, view.length, dictionary))
+			{
+				Log(LOG_CRITICAL) << "Failed to decompress data for cell [" << x << ", " << y << "] (" << CellCodecToString(view.codec) << ")";
+				return false;
+			}
 		}
+		else
+			out.Assign(view.data, view.length);
 
-		SmartArrayDevice device;
+		return true;
+	}
 
-		device.data->resize(dataLength);
-		file->read(device.data->data(), dataLength);
+	std::unique_ptr<ArchiveIStream> RegionFile::getInputCellData(int32_t x, int32_t y, bool decompress, const CellCodecDictionary* dictionary)
+	{
+		namespace io = boost::iostreams;
+
+		const auto view = getCellDataView(x, y);
+		if (!view.data)
+			return std::unique_ptr<ArchiveIStream>();
+
+		SmartArrayDevice device;
+		if (decompress)
+		{
+			if (!CellCodecs::Decompress(view.codec, view.data, view.length, *device.data, dictionary))
+			{
+				Log(LOG_CRITICAL) << "Failed to decompress data for cell [" << x << ", " << y << "] (" << CellCodecToString(view.codec) << ")";
+				return std::unique_ptr<ArchiveIStream>();
+			}
+		}
+		else
+			device.data->assign(view.data, view.data + view.length);
 
 		auto stream = std::unique_ptr<ArchiveIStream>(new io::filtering_istream());
-		if (inflate)
-			stream->push(io::zlib_decompressor());
+		stream->push(device);
+		return stream;
+	}
+
+	std::unique_ptr<ArchiveIStream> RegionFile::getRawCellData(int32_t x, int32_t y, CellCodec& codec)
+	{
+		const auto view = getCellDataView(x, y);
+		codec = view.codec;
+		if (!view.data)
+			return std::unique_ptr<ArchiveIStream>();
+
+		SmartArrayDevice device;
+		device.data->assign(view.data, view.data + view.length);
+
+		auto stream = std::unique_ptr<ArchiveIStream>(new boost::iostreams::filtering_istream());
 		stream->push(device);
 		return stream;
 	}
@@ -449,14 +868,14 @@ namespace FusionEngine
 		return stream;
 	}
 
-	void RegionFile::write(const std::pair<int32_t, int32_t>& cell_index, std::vector<char>& data)
+	void RegionFile::write(const std::pair<int32_t, int32_t>& cell_index, std::vector<char>& data, CellCodec codec)
 	{
 		const auto length = data.size();
 
 		const auto& dataLocation = getCellDataLocation(cell_index);
-		auto startingSector = dataLocation.startingSector;
-		const auto sectorsAllocated = dataLocation.sectorsAllocated;
-		const auto sectorsNeeded = (length + s_CellHeaderSize) / s_SectorSize + 1;
+		auto startingSector = (size_t)dataLocation.startingSector;
+		const size_t sectorsAllocated = dataLocation.sectorsAllocated;
+		const size_t sectorsNeeded = sectorsForCellData(length);
 
 		if (sectorsNeeded > DataLocation::s_MaxSectorsPerCell)
 		{
@@ -466,7 +885,7 @@ namespace FusionEngine
 
 		if (startingSector != 0 && sectorsAllocated == sectorsNeeded) // Must be exact match to just write, because even if the data is smaller that needs to be recorded
 		{
-			write(startingSector, toScalarIndex(cell_index), data);
+			write(startingSector, toScalarIndex(cell_index), data, codec);
 		}
 		else // Allocate & assign new sectors (or mark sectors unused if data has shrunk)
 		{
@@ -500,12 +919,12 @@ namespace FusionEngine
 			if (runLength >= sectorsNeeded) // Free space found
 			{
 				const auto newStartingSector = runStart;
-				setCellDataLocation(cell_index, newStartingSector, sectorsNeeded);
+				setCellDataLocation(cell_index, newStartingSector, (uint32_t)sectorsNeeded);
 				// Mark these sectors used
-				for (size_t i = 0; i < sectorsAllocated; ++i)
+				for (size_t i = 0; i < sectorsNeeded; ++i)
 					free_sectors.set(newStartingSector + i, false);
 				
-				write(newStartingSector, toScalarIndex(cell_index), data);
+				write(newStartingSector, toScalarIndex(cell_index), data, codec);
 
 				// Defrag if fragmentation is not allowed
 				if (!fragmentationAllowed)
@@ -524,14 +943,15 @@ namespace FusionEngine
 				{
 					file->write(EmptySectorData.data(), s_SectorSize);
 				}
+				markDirty(startingSector, sectorsNeeded);
 				
-				write(startingSector, toScalarIndex(cell_index), data);
-				setCellDataLocation(cell_index, startingSector, sectorsNeeded);
+				write(startingSector, toScalarIndex(cell_index), data, codec);
+				setCellDataLocation(cell_index, startingSector, (uint32_t)sectorsNeeded);
 			}
 		}
 	}
 
-	void RegionFile::write(size_t first_sector, size_t scalar_cell_index, const std::vector<char>& data)
+	void RegionFile::write(size_t first_sector, size_t scalar_cell_index, const std::vector<char>& data, CellCodec codec)
 	{
 		IO::Streams::CellStreamWriter writer(file.get());
 
@@ -539,24 +959,51 @@ namespace FusionEngine
 		file->seekp(streamPos);
 
 		// Write the basic cell header, consisting of length of data then version number
-		writer.WriteAs<size_t>(data.size() + sizeof(uint8_t)); // The length written includes the version number (written below)
+		writer.WriteAs<size_t>(data.size() + sizeof(uint8_t) + sizeof(uint8_t)); // The length written includes the version number and codec (written below)
 		writer.WriteAs<uint8_t>(s_CellDataVersion);
+
+		// * Added in s_CellDataVersion 3
+		writer.WriteAs<uint8_t>((uint8_t)codec);
 		
 		// * Added in s_CellDataVersion 2
 		// Write the cell index for backwards lookup (used to update the index in sector0 when defraging)
 		writer.WriteAs<size_t>(scalar_cell_index);
 
 		file->write(data.data(), data.size());
+
+		const size_t bytesWritten = s_CellHeaderSize + data.size();
+		markDirty(first_sector, (bytesWritten + s_SectorSize - 1) / s_SectorSize);
+	}
+
+	void RegionFile::recompressTo(RegionFile& dest, CellCodec codec, const CellCodecDictionary* dictionary)
+	{
+		std::vector<char> cellData, compressedData;
+		for (size_t y = 0; y < region_width; ++y)
+		{
+			for (size_t x = 0; x < region_width; ++x)
+			{
+				const auto view = getCellDataView((int32_t)x, (int32_t)y);
+				if (!view.data)
+					continue;
+				if (!CellCodecs::Decompress(view.codec, view.data, view.length, cellData))
+				{
+					std::stringstream str; str << x << ", " << y;
+					FSN_EXCEPT(FileSystemException, "Failed to decompress cell [" + str.str() + "] in " + filename);
+				}
+				CellCodecs::Compress(codec, cellData.data(), cellData.size(), compressedData, dictionary);
+				dest.write(std::make_pair((int32_t)x, (int32_t)y), compressedData, codec);
+			}
+		}
 	}
 
 	void RegionFile::defragment()
 	{
-		defragment(1, free_sectors.size());
+		defragment(index_sectors, free_sectors.size());
 	}
 
 	void RegionFile::defragment(size_t begin, size_t end)
 	{
-		FSN_ASSERT(begin > 0); // don't defrag the index!
+		FSN_ASSERT(begin >= index_sectors); // don't defrag the index!
 		FSN_ASSERT(end <= free_sectors.size());
 
 		// Find the first gap
@@ -584,9 +1031,63 @@ namespace FusionEngine
 		}
 	}
 
+	size_t RegionFile::defragmentStep(size_t max_sectors)
+	{
+		size_t sectorsMoved = 0;
+
+		auto gapStart = free_sectors.find_first();
+		while (gapStart != boost::dynamic_bitset<>::npos && sectorsMoved < max_sectors)
+		{
+			// Find the data after the gap
+			auto dataStart = gapStart;
+			while (dataStart < free_sectors.size() && free_sectors.test(dataStart))
+				++dataStart;
+			if (dataStart == free_sectors.size())
+				break; // Only free space left at the end of the file
+
+			const auto length = moveData(dataStart, gapStart);
+			if (length == 0)
+			{
+				AddLogEntry("Failed to read cell header while defragmenting region file " + filename, LOG_NORMAL);
+				break;
+			}
+			sectorsMoved += length;
+
+			gapStart = free_sectors.find_next(gapStart + length - 1);
+		}
+
+		return sectorsMoved;
+	}
+
+	RegionFile::FragmentationStats RegionFile::getFragmentationStats() const
+	{
+		FragmentationStats stats;
+		stats.totalSectors = free_sectors.size();
+
+		size_t runLength = 0;
+		for (size_t i = index_sectors; i < free_sectors.size(); ++i)
+		{
+			if (free_sectors.test(i))
+			{
+				if (runLength++ == 0)
+					++stats.freeRuns;
+				++stats.freeSectors;
+				stats.largestFreeRun = std::max(stats.largestFreeRun, runLength);
+			}
+			else
+			{
+				// Everything free up to here is a hole (the free space after the last used sector isn't)
+				stats.holeSectors = stats.freeSectors;
+				runLength = 0;
+			}
+		}
+
+		return stats;
+	}
+
 	size_t RegionFile::moveData(size_t first_sector, size_t dest_sector)
 	{
-		if (first_sector > 0) // sector zero is the cell index, which doesn't have length data
+		if (first_sector >= index_sectors) // the first sectors are the cell index, which doesn't have length data
 		{
 			// Read the data length from the given sector
 			IO::Streams::CellStreamReader reader(file.get());
@@ -594,22 +1095,21 @@ namespace FusionEngine
 			std::streampos streamPos(first_sector * s_SectorSize);
 			file->seekg(streamPos);
 
-			auto length = reader.ReadValue<size_t>();
-			if (length > 0)
+			CellHeader header;
+			if (readCellHeader(reader, header))
 			{
-				const auto dataVersion = reader.ReadValue<uint8_t>();
-				if (dataVersion == 1)
-					FSN_EXCEPT(FileTypeException, "Can't defrag version 1 region files");
-
-				const auto cellIndex = reader.ReadValue<size_t>();
-				const auto lengthInSectors = (size_t)(length / s_SectorSize + 1u);
+				const auto cellIndex = header.scalarCellIndex;
+				if (cellIndex >= cellDataLocations.size())
+					return 0;
+				// The index records the sectors that were allocated, which is what needs to be moved (and marked free)
+				const auto& location = cellDataLocations[cellIndex];
+				const auto lengthInSectors = location.startingSector == first_sector ?
+					(size_t)location.sectorsAllocated :
+					sectorsForCellData(header.length, header.version);
+				FSN_ASSERT(location.startingSector == first_sector);
 				moveData(first_sector, lengthInSectors, dest_sector);
 
-#ifdef _DEBUG
-				auto indexEntry = std::find_if(cellDataLocations.cbegin(), cellDataLocations.cend(), [first_sector](const DataLocation& location) { return location.startingSector == first_sector; });
-				FSN_ASSERT(indexEntry != cellDataLocations.cend() && std::distance(cellDataLocations.cbegin(), indexEntry) == cellIndex);
-#endif
-				setCellDataLocation(cellIndex, first_sector, lengthInSectors);
+				setCellDataLocation(cellIndex, dest_sector, (uint32_t)lengthInSectors);
 
 				return lengthInSectors;
 			}
@@ -617,7 +1117,7 @@ namespace FusionEngine
 			return 0;
 		}
 		else
-			FSN_EXCEPT(InvalidArgumentException, "Failed to move data with region: can't move sector 0");
+			FSN_EXCEPT(InvalidArgumentException, "Failed to move data with region: can't move the index");
 	}
 
 	void RegionFile::moveData(size_t first_sector, size_t length_in_sectors, size_t dest_sector)
@@ -631,6 +1131,7 @@ namespace FusionEngine
 
 		file->seekp(dest_sector * s_SectorSize);
 		file->write(buffer.data(), buffer.size());
+		markDirty(dest_sector, length_in_sectors);
 
 		// Update free_sectors
 		// TODO: copy the flags from the original to new new
@@ -645,22 +1146,20 @@ namespace FusionEngine
 	{
 		const auto lengthOfFile = fileLength(*file);
 		const auto numSectorsInFile = lengthOfFile / s_SectorSize;
-		for (size_t sectorIndex = 1; sectorIndex < numSectorsInFile; ++sectorIndex)
+		for (size_t sectorIndex = index_sectors; sectorIndex < numSectorsInFile; ++sectorIndex)
 		{
 			IO::Streams::CellStreamReader reader(file.get());
 
 			std::streampos streamPos(sectorIndex * s_SectorSize);
 			file->seekg(streamPos);
 
-			auto cellDataLength = reader.ReadValue<size_t>();
-			if (cellDataLength > 0)
+			CellHeader header;
+			if (readCellHeader(reader, header))
 			{
-				const auto dataVersion = reader.ReadValue<uint8_t>();
-
-				const auto cellIndex = reader.ReadValue<size_t>();
-				const auto cellDataLengthInSectors = (size_t)(cellDataLength / s_SectorSize + 1u);
+				const auto cellDataLengthInSectors = sectorsForCellData(header.length, header.version);
 
-				setCellDataLocation(cellIndex, sectorIndex, cellDataLengthInSectors);
+				if (header.scalarCellIndex < cellDataLocations.size())
+					setCellDataLocation(header.scalarCellIndex, sectorIndex, (uint32_t)cellDataLengthInSectors);
 			}
 		}
 	}
@@ -670,11 +1169,10 @@ namespace FusionEngine
 		return cell_index.first + cell_index.second * region_width;
 	}
 
-	void RegionFile::setCellDataLocation(const std::pair<int32_t, int32_t>& cell_index, uint32_t startSector, uint32_t sectorsUsed)
+	void RegionFile::setCellDataLocation(const std::pair<int32_t, int32_t>& cell_index, uint64_t startSector, uint32_t sectorsUsed)
 	{
-		// Make sure the values given fit within the space available to them in the bitfield
-		FSN_ASSERT(startSector < (1 << 24));
-		FSN_ASSERT(sectorsUsed < DataLocation::s_MaxSectorsPerCell);
+		FSN_ASSERT(startSector == 0 || startSector >= index_sectors);
+		FSN_ASSERT(sectorsUsed <= DataLocation::s_MaxSectorsPerCell);
 
 		const auto x = cell_index.first;
 		const auto y = cell_index.second;
@@ -688,7 +1186,7 @@ namespace FusionEngine
 		setCellDataLocation(x + y * region_width, startSector, sectorsUsed);
 	}
 
-	void RegionFile::setCellDataLocation(const size_t cell_index, uint32_t startSector, uint32_t sectorsUsed)
+	void RegionFile::setCellDataLocation(const size_t cell_index, uint64_t startSector, uint32_t sectorsUsed)
 	{
 		auto& data = cellDataLocations[cell_index];
 		data.startingSector = startSector;
@@ -696,14 +1194,16 @@ namespace FusionEngine
 
 		IO::Streams::CellStreamWriter writer(file.get());
 
-		std::streampos pos(cell_index * sizeof(DataLocation));
+		const size_t offset = s_IndexHeaderSize + cell_index * s_IndexEntrySize;
+		std::streampos pos(offset);
 		if (file->seekp(pos))
-			writer.Write(data);
-#ifdef _DEBUG
-		const auto p = file->tellp();
-		const auto expectedp = pos + std::streamoff(sizeof(data));
-#endif
-		FSN_ASSERT(file->tellp() == (pos + std::streamoff(sizeof(data))));
+		{
+			writer.WriteAs<uint64_t>(data.startingSector);
+			writer.WriteAs<uint32_t>(data.sectorsAllocated);
+		}
+		// The entry can straddle two sectors
+		markDirty(offset / s_SectorSize, (offset + s_IndexEntrySize - 1) / s_SectorSize - offset / s_SectorSize + 1);
+		FSN_ASSERT(file->tellp() == (pos + std::streamoff(s_IndexEntrySize)));
 	}
 
 	const RegionFile::DataLocation& RegionFile::getCellDataLocation(const std::pair<int32_t, int32_t>& cell_coords)
@@ -718,16 +1218,21 @@ namespace FusionEngine
 		return cellDataLocations[x + y * region_width];
 	}
 
-	RegionCellCache::RegionCellCache(const std::string& cache_path, int32_t region_size, bool readonly)
+	RegionCellCache::RegionCellCache(const std::string& cache_path, int32_t region_size, bool readonly, bool memory_mapped)
 		: m_CachePath(cache_path),
 		m_RegionSize(region_size),
 		m_MaxLoadedFiles(10),
 		m_FragmentationAllowed(true),
-		m_ReadOnly(readonly)
+		m_ReadOnly(readonly),
+		m_Codec(GetAvailableCellCodec(CellCodec::LZ4))
 	{
 		FSN_ASSERT(region_size > 0);
 
-		FSN_ASSERT(region_size * region_size < RegionFile::s_MaxSectors);
+		ResetIOStats();
+		m_SectorsDefragmented = 0;
+		m_DefragmentSteps = 0;
+
+		FSN_ASSERT(region_size <= (int32_t)RegionFile::s_MaxRegionWidth);
 
 		if (readonly) // Used for compiled maps (can't be written to, obviously)
 		{
@@ -737,7 +1242,7 @@ namespace FusionEngine
 		else
 		{
 			ResourceManager::getSingleton().AddResourceLoader(
-				ResourceLoader("MapRegion" + m_CachePath, &RegionMap::LoadMapRegionResource, RegionMap::UnloadMapRegionResource, region_size));
+				ResourceLoader("MapRegion" + m_CachePath, &RegionMap::LoadMapRegionResource, RegionMap::UnloadMapRegionResource, RegionMap::RegionFileSettings(region_size, memory_mapped)));
 		}
 	}
 
@@ -750,12 +1255,34 @@ namespace FusionEngine
 		DropCache();
 	}
 
+	void RegionCellCache::SetCodec(CellCodec codec)
+	{
+		if (!IsCellCodecAvailable(codec))
+			AddLogEntry("Cell codec '" + CellCodecToString(codec) + "' isn't available in this build: using zlib instead", LOG_NORMAL);
+		m_Codec = GetAvailableCellCodec(codec);
+	}
+
+	void RegionCellCache::SetDictionary(const std::shared_ptr<CellCodecDictionary>& dictionary)
+	{
+		m_Dictionary = dictionary;
+	}
+
 	void RegionCellCache::DropCache()
 	{
 		//CacheMutex_t::scoped_lock lock(m_CacheMutex);
 
+		// Keep any changes that haven't been recorded yet (so the next incremental save includes them)
+		for (auto it = m_Cache.cbegin(); it != m_Cache.cend(); ++it)
+		{
+			if (!m_ReadOnly && it->second.IsLoaded())
+				recordChanges(*it->second.Get());
+		}
+
 		m_Cache.clear();
 		m_CacheImportance.clear();
+
+		tbb::spin_mutex::scoped_lock lock(m_FragmentationStatsMutex);
+		m_FragmentationStats.clear();
 	}
 
 	void RegionCellCache::FlushCache()
@@ -768,11 +1295,183 @@ namespace FusionEngine
 
 			if (regionFile.IsLoaded())
 			{
+				if (!m_ReadOnly)
+					recordChanges(*regionFile.Get());
 				regionFile->flush();
 			}
 		}
 	}
 
+	std::shared_ptr<RegionSnapshot> RegionCellCache::BeginSnapshot(const std::string& dest_path, bool incremental)
+	{
+		FlushCache();
+
+		std::vector<boost::filesystem::path> regionFiles;
+		std::unordered_set<std::string> listedFiles;
+		for (boost::filesystem::directory_iterator it(m_CachePath), end; it != end; ++it)
+		{
+			if (it->path().extension() == ".celldata")
+			{
+				regionFiles.push_back(it->path());
+				listedFiles.insert(it->path().filename().string());
+			}
+		}
+		// Files that are still to come from the overlay are unchanged, but need to be faulted in before
+		//  the snapshot is written (if they're included)
+		if (auto overlay = getOverlay())
+		{
+			const auto overlayFiles = overlay->GetFilenames();
+			for (auto it = overlayFiles.begin(); it != overlayFiles.end(); ++it)
+			{
+				if (listedFiles.insert(*it).second)
+					regionFiles.push_back(boost::filesystem::path(m_CachePath) / *it);
+			}
+		}
+
+		// This snapshot becomes the last save
+		ChangesMap_t changes;
+		std::unordered_set<std::string> savedFiles;
+		{
+			tbb::spin_mutex::scoped_lock lock(m_ChangesMutex);
+			changes.swap(m_Changes);
+			savedFiles.swap(m_SavedFiles);
+			for (auto it = regionFiles.begin(); it != regionFiles.end(); ++it)
+				m_SavedFiles.insert(it->filename().string());
+		}
+
+		std::vector<boost::filesystem::path> fullFiles;
+		for (auto it = regionFiles.begin(); it != regionFiles.end(); ++it)
+		{
+			if (!incremental || savedFiles.find(it->filename().string()) == savedFiles.end())
+				fullFiles.push_back(*it);
+		}
+		auto snapshot = std::make_shared<RegionSnapshot>(fullFiles, dest_path);
+		if (incremental)
+		{
+			for (auto it = regionFiles.begin(); it != regionFiles.end(); ++it)
+			{
+				const auto name = it->filename().string();
+				auto entry = changes.find(name);
+				if (entry != changes.end() && entry->second.sectors.any() && savedFiles.find(name) != savedFiles.end())
+					snapshot->AddDelta(*it, entry->second.sectors);
+			}
+		}
+		{
+			tbb::spin_mutex::scoped_lock lock(m_SnapshotMutex);
+			FSN_ASSERT_MSG(!m_Snapshot, "The previous snapshot wasn't ended");
+			m_Snapshot = snapshot;
+		}
+		return snapshot;
+	}
+
+	void RegionCellCache::EndSnapshot()
+	{
+		tbb::spin_mutex::scoped_lock lock(m_SnapshotMutex);
+		m_Snapshot.reset();
+	}
+
+	void RegionCellCache::preserveForSnapshot(const RegionFile& region_file)
+	{
+		std::shared_ptr<RegionSnapshot> snapshot;
+		{
+			tbb::spin_mutex::scoped_lock lock(m_SnapshotMutex);
+			snapshot = m_Snapshot;
+		}
+		if (snapshot)
+			snapshot->Preserve(region_file);
+	}
+
+	void RegionCellCache::MarkSaved()
+	{
+		std::unordered_set<std::string> savedFiles;
+		if (boost::filesystem::is_directory(m_CachePath))
+		{
+			for (boost::filesystem::directory_iterator it(m_CachePath), end; it != end; ++it)
+			{
+				if (it->path().extension() == ".celldata")
+					savedFiles.insert(it->path().filename().string());
+			}
+		}
+		if (auto overlay = getOverlay())
+		{
+			const auto overlayFiles = overlay->GetFilenames();
+			savedFiles.insert(overlayFiles.begin(), overlayFiles.end());
+		}
+
+		tbb::spin_mutex::scoped_lock lock(m_ChangesMutex);
+		m_Changes.clear();
+		m_SavedFiles.swap(savedFiles);
+	}
+
+	size_t RegionCellCache::GetNumChangedRegions() const
+	{
+		tbb::spin_mutex::scoped_lock lock(m_ChangesMutex);
+		return m_Changes.size();
+	}
+
+	size_t RegionCellCache::GetNumChangedCells() const
+	{
+		tbb::spin_mutex::scoped_lock lock(m_ChangesMutex);
+		size_t numCells = 0;
+		for (auto it = m_Changes.begin(); it != m_Changes.end(); ++it)
+			numCells += it->second.cells.count();
+		return numCells;
+	}
+
+	void RegionCellCache::recordChanges(RegionFile& region_file, const std::pair<int32_t, int32_t>* cell_index)
+	{
+		if (region_file.filename.empty())
+			return;
+
+		auto sectors = region_file.takeModifiedSectors();
+		if (sectors.none() && !cell_index)
+			return;
+
+		const auto name = boost::filesystem::path(region_file.filename).filename().string();
+
+		tbb::spin_mutex::scoped_lock lock(m_ChangesMutex);
+		auto& changes = m_Changes[name];
+		if (changes.sectors.size() < sectors.size())
+			changes.sectors.resize(sectors.size(), false);
+		else
+			sectors.resize(changes.sectors.size(), false);
+		changes.sectors |= sectors;
+
+		if (cell_index)
+		{
+			if (changes.cells.empty())
+				changes.cells.resize(region_file.region_width * region_file.region_width, false);
+			changes.cells.set(region_file.toScalarIndex(*cell_index));
+		}
+	}
+
+	void RegionCellCache::recordChangesInOrder(const ResourcePointer<RegionFile>& region_file, const RegionCoord_t& coord)
+	{
+		// Writes to the region may still be running, so when there is a dispatcher this is done in order with them
+		std::unique_lock<std::mutex> lock(m_DispatcherMutex);
+		if (m_LoadedCallbackDispatcher)
+		{
+			m_LoadedCallbackDispatcher(coord, [this, region_file]() { recordChanges(*region_file.Get()); });
+		}
+		else
+		{
+			lock.unlock();
+			recordChanges(*region_file.Get());
+		}
+	}
+
+	void RegionCellCache::SetOverlay(const std::shared_ptr<RegionCacheOverlay>& overlay)
+	{
+		tbb::spin_mutex::scoped_lock lock(m_OverlayMutex);
+		m_Overlay = overlay;
+	}
+
+	std::shared_ptr<RegionCacheOverlay> RegionCellCache::getOverlay() const
+	{
+		tbb::spin_mutex::scoped_lock lock(m_OverlayMutex);
+		return m_Overlay;
+	}
+
 	void RegionCellCache::SetFragmentationAllowed(bool allowed)
 	{
 		if (!allowed)
@@ -790,13 +1489,121 @@ namespace FusionEngine
 
 	void RegionCellCache::DefragNow()
 	{
-		for (auto it = m_Cache.cbegin(); it != m_Cache.cend(); ++it)
+		// The loaded regions are collected under the lock, but defragmented (and preserved for any snapshot) after releasing it
+		std::vector<std::pair<RegionCoord_t, ResourcePointer<RegionFile>>> regions;
 		{
-			if (it->second.IsLoaded())
+			CacheMutex_t::scoped_lock lock(m_CacheMutex);
+			for (auto it = m_Cache.cbegin(); it != m_Cache.cend(); ++it)
+			{
+				if (it->second.IsLoaded())
+					regions.push_back(*it);
+			}
+		}
+		for (auto it = regions.begin(); it != regions.end(); ++it)
+		{
+			auto& regionFile = *it->second.Get();
+			preserveForSnapshot(regionFile);
+			regionFile.defragment();
+			recordChanges(regionFile);
+			recordFragmentation(it->first, regionFile);
+		}
+	}
+
+	std::vector<RegionCellCache::RegionCoord_t> RegionCellCache::GetFragmentedRegions() const
+	{
+		std::vector<std::pair<float, RegionCoord_t>> fragmented;
+		if (!m_ReadOnly)
+		{
+			tbb::spin_mutex::scoped_lock lock(m_FragmentationStatsMutex);
+			for (auto it = m_FragmentationStats.begin(); it != m_FragmentationStats.end(); ++it)
+			{
+				const auto& stats = it->second;
+				if (stats.holeSectors >= m_DefragPolicy.minHoleSectors && stats.holeRatio() >= m_DefragPolicy.minHoleRatio)
+					fragmented.push_back(std::make_pair(stats.holeRatio(), it->first));
+			}
+		}
+		std::sort(fragmented.begin(), fragmented.end(), [](const std::pair<float, RegionCoord_t>& a, const std::pair<float, RegionCoord_t>& b) { return a.first > b.first; });
+
+		std::vector<RegionCoord_t> regions;
+		regions.reserve(fragmented.size());
+		for (auto it = fragmented.begin(); it != fragmented.end(); ++it)
+			regions.push_back(it->second);
+		return regions;
+	}
+
+	size_t RegionCellCache::DefragmentStep(const RegionCoord_t& coord)
+	{
+		// Looked up directly (rather than via GetRegionFile) so that defragmenting doesn't keep regions in the cache.
+		//  The pointer is copied so the region stays valid if it's dropped from the cache while this runs
+		ResourcePointer<RegionFile> region;
+		{
+			CacheMutex_t::scoped_lock lock(m_CacheMutex);
+			auto entry = m_Cache.find(coord);
+			if (entry == m_Cache.end() || !entry->second.IsLoaded())
+				return 0;
+			region = entry->second;
+		}
+
+		auto& regionFile = *region.Get();
+		preserveForSnapshot(regionFile);
+		const size_t sectorsMoved = regionFile.defragmentStep(m_DefragPolicy.sectorsPerStep);
+		recordChanges(regionFile);
+		recordFragmentation(coord, regionFile);
+
+		if (sectorsMoved > 0)
+		{
+			m_SectorsDefragmented += sectorsMoved;
+			++m_DefragmentSteps;
+		}
+		return sectorsMoved;
+	}
+
+	RegionCellCache::FragmentationMetrics RegionCellCache::GetFragmentationMetrics() const
+	{
+		FragmentationMetrics metrics;
+		{
+			tbb::spin_mutex::scoped_lock lock(m_FragmentationStatsMutex);
+			for (auto it = m_FragmentationStats.begin(); it != m_FragmentationStats.end(); ++it)
 			{
-				it->second->defragment();
+				const auto& stats = it->second;
+				metrics.totalSectors += stats.totalSectors;
+				metrics.freeSectors += stats.freeSectors;
+				metrics.holeSectors += stats.holeSectors;
+				metrics.largestFreeRun = std::max(metrics.largestFreeRun, stats.largestFreeRun);
+				metrics.smallestLargestFreeRun = metrics.regions == 0 ? stats.largestFreeRun : std::min(metrics.smallestLargestFreeRun, stats.largestFreeRun);
+				metrics.worstHoleRatio = std::max(metrics.worstHoleRatio, stats.holeRatio());
+				++metrics.regions;
 			}
 		}
+		metrics.sectorsDefragmented = m_SectorsDefragmented;
+		metrics.defragmentSteps = m_DefragmentSteps;
+		return metrics;
+	}
+
+	bool RegionCellCache::GetRegionFragmentation(const RegionCoord_t& coord, RegionFile::FragmentationStats& stats) const
+	{
+		tbb::spin_mutex::scoped_lock lock(m_FragmentationStatsMutex);
+		auto entry = m_FragmentationStats.find(coord);
+		if (entry != m_FragmentationStats.end())
+		{
+			stats = entry->second;
+			return true;
+		}
+		return false;
+	}
+
+	void RegionCellCache::recordFragmentation(const RegionCoord_t& coord, const RegionFile& region_file)
+	{
+		const auto stats = region_file.getFragmentationStats();
+
+		tbb::spin_mutex::scoped_lock lock(m_FragmentationStatsMutex);
+		m_FragmentationStats[coord] = stats;
+	}
+
+	void RegionCellCache::forgetFragmentation(const RegionCoord_t& coord)
+	{
+		tbb::spin_mutex::scoped_lock lock(m_FragmentationStatsMutex);
+		m_FragmentationStats.erase(coord);
 	}
 
 	RegionCellCache::RegionCoord_t RegionCellCache::cellToRegionCoord(int32_t* cell_x, int32_t* cell_y) const
@@ -817,7 +1624,15 @@ namespace FusionEngine
 		//CacheMutex_t::scoped_lock lock(m_CacheMutex);
 
 		//m_Cache.erase(coord);
-		m_Cache[coord].Release();
+		ResourcePointer<RegionFile> dropped;
+		{
+			CacheMutex_t::scoped_lock lock(m_CacheMutex);
+			auto& regionFile = m_Cache[coord];
+			dropped = regionFile;
+			regionFile.Release();
+		}
+		if (!m_ReadOnly && dropped.IsLoaded())
+			recordChangesInOrder(dropped, coord);
 		GetRegionFile(loadedCallback, coord, true);
 	}
 
@@ -829,101 +1644,176 @@ namespace FusionEngine
 		return m_CachePath + filename + ".celldata";
 	}
 
+	void RegionCellCache::SetLoadedCallbackDispatcher(const CallbackDispatcher_t& dispatcher)
+	{
+		std::lock_guard<std::mutex> lock(m_DispatcherMutex);
+		m_LoadedCallbackDispatcher = dispatcher;
+	}
+
 	void RegionCellCache::GetRegionFile(const RegionLoadedCallback& loadedCallback, const RegionCellCache::RegionCoord_t& coord, bool load_if_uncached)
 	{
-		auto entry = m_Cache.find(coord);
-		if (entry == m_Cache.end() || !entry->second.IsLoaded())
+		// The callback is called after releasing the lock (holding a reference so the region can't be dropped in the meantime)
+		ResourcePointer<RegionFile> cached;
+		{
+			CacheMutex_t::scoped_lock lock(m_CacheMutex);
+			auto entry = m_Cache.find(coord);
+			if (entry != m_Cache.end() && entry->second.IsLoaded())
+			{
+				cached = entry->second;
+				// Make the existing entry more important
+				m_CacheImportance.remove(coord);
+				m_CacheImportance.push_back(coord);
+			}
+		}
+		if (cached.IsLoaded())
+		{
+			loadedCallback(cached.Get());
+		}
+		else
 		{
 			if (load_if_uncached)
 			{
-				CacheMutex_t::scoped_lock lock(m_CacheMutex);
+				std::string filePath = GetRegionFilePath(coord);
 
-				// Add a new cache entry
+				// Region files from a save that is being loaded lazily are copied in the first time they're needed
+				if (auto overlay = getOverlay())
+					overlay->FaultIn(boost::filesystem::path(filePath).filename().string());
 
-				// Request the region file resource
-				std::string filePath = GetRegionFilePath(coord);
+				bool firstRequest = false;
+				ResourcePointer<RegionFile> dropped;
+				RegionCoord_t droppedCoord;
+				{
+					CacheMutex_t::scoped_lock lock(m_CacheMutex);
 
-				using namespace std::placeholders;
-				CallbackHandles_t::accessor accessor;
-				if (m_CallbackHandles.insert(accessor, coord))
+					// The region may have finished loading since it was checked above
+					auto entry = m_Cache.find(coord);
+					if (entry != m_Cache.end() && entry->second.IsLoaded())
+						cached = entry->second;
+					else
+					{
+						// Add the given callback to the end of the list for this region
+						{
+							CallbackHandles_t::accessor accessor;
+							firstRequest = m_CallbackHandles.insert(accessor, coord);
+							if (!firstRequest)
+								m_CacheImportance.remove(coord);
+							accessor->second.m_OtherCallbacks.push_back(loadedCallback);
+						}
+
+						m_CacheImportance.push_back(coord);
+
+						FSN_ASSERT(m_MaxLoadedFiles > 0);
+						if (m_CallbackHandles.size() > m_MaxLoadedFiles)
+						{
+							AddLogEntry("cells_loaded", "** Dropped " + filePath);
+							// Remove the least recently accessed file
+							//m_Cache.erase(m_CacheImportance.front());
+							droppedCoord = m_CacheImportance.front();
+							auto& droppedFile = m_Cache[droppedCoord];
+							dropped = droppedFile;
+							droppedFile.Release();
+							m_CallbackHandles.erase(m_CacheImportance.front());
+							forgetFragmentation(m_CacheImportance.front());
+							m_CacheImportance.pop_front();
+						}
+					}
+				}
+
+				// Changes that haven't been recorded yet would be lost with the dropped region
+				if (!m_ReadOnly && dropped.IsLoaded())
+					recordChangesInOrder(dropped, droppedCoord);
+
+				if (cached.IsLoaded())
+				{
+					loadedCallback(cached.Get());
+				}
+				// Request the region file resource (after releasing the lock, since OnRegionFileLoaded is called immediately if it's already loaded)
+				else if (firstRequest)
 				{
 					AddLogEntry("cells_loaded", "** Requested " + filePath);
-					FSN_ASSERT_MSG(!accessor->second.m_Connection.connected(), "What??!");
-					accessor->second.m_Connection =
-						ResourceManager::getSingleton().GetResource(m_ReadOnly ? "StaticMapRegion" : "MapRegion" + m_CachePath,
+					using namespace std::placeholders;
+					auto connection = ResourceManager::getSingleton().GetResource(m_ReadOnly ? "StaticMapRegion" : "MapRegion" + m_CachePath,
 						filePath,
 						std::bind(&RegionCellCache::OnRegionFileLoaded, this, _1, coord),
 						-1000);
-				}
-				else
-					m_CacheImportance.remove(coord);
-				// Add the given callback to the end of the list for this region
-				accessor->second.m_OtherCallbacks.push_back(loadedCallback);
-
-				m_CacheImportance.push_back(coord);
 
-				FSN_ASSERT(m_MaxLoadedFiles > 0);
-				if (m_CallbackHandles.size() > m_MaxLoadedFiles)
-				{
-					AddLogEntry("cells_loaded", "** Dropped " + filePath);
-					// Remove the least recently accessed file
-					//m_Cache.erase(m_CacheImportance.front());
-					m_Cache[m_CacheImportance.front()].Release();
-					m_CallbackHandles.erase(m_CacheImportance.front());
-					m_CacheImportance.pop_front();
+					CallbackHandles_t::accessor accessor;
+					if (m_CallbackHandles.find(accessor, coord))
+					{
+						FSN_ASSERT_MSG(!accessor->second.m_Connection.connected(), "What??!");
+						accessor->second.m_Connection = connection;
+					}
+					else // Dropped already
+						connection.disconnect();
 				}
 			}
 			else
 				loadedCallback(nullptr);
 		}
-		else
-		{
-			CacheMutex_t::scoped_lock lock(m_CacheMutex);
-			// Make the existing entry more important
-			m_CacheImportance.remove(coord);
-			m_CacheImportance.push_back(coord);
-
-			return loadedCallback(entry->second.Get());
-		}
 	}
 
 	void RegionCellCache::OnRegionFileLoaded(ResourceDataPtr& resource, const RegionCoord_t& coord)
 	{
-		//CacheMutex_t::scoped_lock lock(m_CacheMutex);
-
-		auto resourcePointer = m_Cache[coord] = ResourcePointer<RegionFile>(resource);
+		const ResourcePointer<RegionFile> resourcePointer(resource);
 		RegionFile* regionFile = resourcePointer.Get();
 		FSN_ASSERT(regionFile);
 
 		regionFile->fragmentationAllowed = m_FragmentationAllowed;
 
+		if (!m_ReadOnly)
+		{
+			recordFragmentation(coord, *regionFile);
+			// Loading may modify the file (e.g. upgrading it): these changes need to be in the next incremental save
+			recordChanges(*regionFile);
+		}
+
+		// Take the requests for this region file: requests made after the entry is set are fulfilled by GetRegionFile directly
+		std::list<RegionLoadedCallback> callbacks;
+		{
+			CacheMutex_t::scoped_lock lock(m_CacheMutex);
+			m_Cache[coord] = resourcePointer;
+
+			CallbackHandles_t::accessor accessor;
+			if (m_CallbackHandles.find(accessor, coord))
+				callbacks.swap(accessor->second.m_OtherCallbacks);
+		}
+
 		Log("cells_loaded") << "RegionFileLoaded [" << coord.x << "," << coord.y << "] {";
 
-		// Fulfill all the requests for this region file
-		CallbackHandles_t::const_accessor accessor;
-		if (m_CallbackHandles.find(accessor, coord))
+		// Fulfill all the requests for this region file (the dispatcher is used under the lock so it can't be cleared mid-way)
+		std::unique_lock<std::mutex> dispatcherLock(m_DispatcherMutex);
+		if (m_LoadedCallbackDispatcher)
 		{
-			auto& callbackProxy = accessor->second;
-			for (auto it = callbackProxy.m_OtherCallbacks.begin(); it != callbackProxy.m_OtherCallbacks.end(); ++it)
+			for (auto it = callbacks.begin(); it != callbacks.end(); ++it)
 			{
-				(*it)(regionFile);
+				const auto callback = *it;
+				m_LoadedCallbackDispatcher(coord, [callback, resourcePointer]() { callback(resourcePointer.Get()); });
 			}
 		}
+		else
+		{
+			dispatcherLock.unlock();
+			for (auto it = callbacks.begin(); it != callbacks.end(); ++it)
+				(*it)(regionFile);
+		}
 
 		Log("cells_loaded") << "} RegionFileLoaded[" << coord.x << "," << coord.y << "]";
 	}
 
-	void RegionCellCache::GetRawCellStreamForReading(const GotCellForReadingCallback& callback, int32_t cell_x, int32_t cell_y)
+	void RegionCellCache::GetRawCellStreamForReading(const GotRawCellForReadingCallback& callback, int32_t cell_x, int32_t cell_y)
 	{
 		//CacheMutex_t::scoped_lock lock(m_CacheMutex);
 
 		const auto regionCoord = cellToRegionCoord(&cell_x, &cell_y);
 
-		GetRegionFile([callback, cell_x, cell_y](RegionFile* regionFile)
+		GetRegionFile([this, callback, cell_x, cell_y](RegionFile* regionFile)
 		{
 			if (regionFile)
 			{
-				callback(regionFile->getInputCellData(cell_x, cell_y, false));
+				recordRead(regionFile, cell_x, cell_y);
+				CellCodec codec;
+				auto stream = regionFile->getRawCellData(cell_x, cell_y, codec);
+				callback(std::move(stream), codec);
 			}
 		}, regionCoord, false);
 	}
@@ -934,15 +1824,131 @@ namespace FusionEngine
 
 		const auto regionCoord = cellToRegionCoord(&cell_x, &cell_y);
 
-		GetRegionFile([callback, cell_x, cell_y](RegionFile* regionFile)
+		GetRegionFile([this, callback, cell_x, cell_y](RegionFile* regionFile)
+		{
+			if (regionFile)
+			{
+				recordRead(regionFile, cell_x, cell_y);
+				callback(regionFile->getInputCellData(cell_x, cell_y, true, m_Dictionary.get()));
+			}
+		}, regionCoord, true);
+	}
+
+	void RegionCellCache::GetCellDataForReading(const GotCellDataForReadingCallback& callback, int32_t cell_x, int32_t cell_y)
+	{
+		const auto regionCoord = cellToRegionCoord(&cell_x, &cell_y);
+
+		GetRegionFile([this, callback, cell_x, cell_y](RegionFile* regionFile)
 		{
 			if (regionFile)
 			{
-				callback(regionFile->getInputCellData(cell_x, cell_y));
+				recordRead(regionFile, cell_x, cell_y);
+				auto data = std::make_shared<CellData>();
+				if (regionFile->readCellData(cell_x, cell_y, *data, true, m_Dictionary.get()))
+					callback(std::move(data));
+				else
+					callback(std::shared_ptr<CellData>());
 			}
 		}, regionCoord, true);
 	}
 
+	void RegionCellCache::GetCellDataBatchForReading(const GotCellDataBatchCallback& callback, const clan::Rect& cells, int32_t prefetch_margin)
+	{
+		std::vector<RegionCoord_t> cellList;
+		if (cells.get_width() > 0 && cells.get_height() > 0)
+			cellList.reserve(cells.get_width() * cells.get_height());
+		for (int32_t y = cells.top; y < cells.bottom; ++y)
+			for (int32_t x = cells.left; x < cells.right; ++x)
+				cellList.push_back(RegionCoord_t(x, y));
+
+		GetCellDataBatchForReading(callback, cellList, prefetch_margin);
+	}
+
+	void RegionCellCache::GetCellDataBatchForReading(const GotCellDataBatchCallback& callback, const std::vector<RegionCoord_t>& cells, int32_t prefetch_margin)
+	{
+		if (cells.empty())
+			return;
+
+		// Group the cells by region
+		typedef std::vector<std::pair<int32_t, int32_t>> RegionCells_t;
+		std::unordered_map<RegionCoord_t, std::shared_ptr<RegionCells_t>, boost::hash<RegionCoord_t>> cellsByRegion;
+		clan::Rect bounds(cells.front().x, cells.front().y, cells.front().x + 1, cells.front().y + 1);
+		for (auto it = cells.begin(); it != cells.end(); ++it)
+		{
+			int32_t x = it->x, y = it->y;
+			const auto regionCoord = cellToRegionCoord(&x, &y);
+
+			auto& regionCells = cellsByRegion[regionCoord];
+			if (!regionCells)
+				regionCells = std::make_shared<RegionCells_t>();
+			regionCells->push_back(std::make_pair(x, y));
+
+			bounds.left = std::min(bounds.left, it->x);
+			bounds.top = std::min(bounds.top, it->y);
+			bounds.right = std::max(bounds.right, it->x + 1);
+			bounds.bottom = std::max(bounds.bottom, it->y + 1);
+		}
+
+		for (auto it = cellsByRegion.begin(); it != cellsByRegion.end(); ++it)
+		{
+			const auto regionCoord = it->first;
+			const auto regionCells = it->second;
+			GetRegionFile([this, callback, regionCoord, regionCells](RegionFile* regionFile)
+			{
+				this->readCellBatch(regionFile, regionCoord, *regionCells, callback);
+			}, regionCoord, true);
+		}
+
+		if (prefetch_margin > 0)
+		{
+			const auto firstRegion = cellToRegionCoord(bounds.left - prefetch_margin, bounds.top - prefetch_margin);
+			const auto lastRegion = cellToRegionCoord(bounds.right - 1 + prefetch_margin, bounds.bottom - 1 + prefetch_margin);
+			// Loading more regions than the cache holds would drop the ones that were just requested
+			const size_t numRegions = (size_t)((lastRegion.x - firstRegion.x + 1) * (lastRegion.y - firstRegion.y + 1));
+			if (numRegions <= m_MaxLoadedFiles)
+			{
+				for (int32_t y = firstRegion.y; y <= lastRegion.y; ++y)
+				{
+					for (int32_t x = firstRegion.x; x <= lastRegion.x; ++x)
+					{
+						const RegionCoord_t regionCoord(x, y);
+						// Only load regions that exist (requesting others would create empty files)
+						if (cellsByRegion.find(regionCoord) == cellsByRegion.end() && IsCached(regionCoord))
+							GetRegionFile([](RegionFile*) {}, regionCoord, true);
+					}
+				}
+			}
+		}
+	}
+
+	void RegionCellCache::readCellBatch(RegionFile* region_file, const RegionCoord_t& region_coord, std::vector<std::pair<int32_t, int32_t>>& cells, const GotCellDataBatchCallback& callback)
+	{
+		const int32_t originX = region_coord.x * m_RegionSize, originY = region_coord.y * m_RegionSize;
+
+		if (!region_file)
+		{
+			for (auto it = cells.begin(); it != cells.end(); ++it)
+				callback(originX + it->first, originY + it->second, std::shared_ptr<CellData>());
+			return;
+		}
+
+		// Read in the order the data is stored, so the region data is swept front to back
+		std::sort(cells.begin(), cells.end(), [region_file](const std::pair<int32_t, int32_t>& a, const std::pair<int32_t, int32_t>& b)
+		{
+			return region_file->getCellDataLocation(a).startingSector < region_file->getCellDataLocation(b).startingSector;
+		});
+
+		for (auto it = cells.begin(); it != cells.end(); ++it)
+		{
+			recordRead(region_file, it->first, it->second);
+			auto data = std::make_shared<CellData>();
+			if (region_file->readCellData(it->first, it->second, *data, true, m_Dictionary.get()))
+				callback(originX + it->first, originY + it->second, std::move(data));
+			else
+				callback(originX + it->first, originY + it->second, std::shared_ptr<CellData>());
+		}
+	}
+
 	std::unique_ptr<ArchiveOStream> RegionCellCache::GetCellStreamForWriting(int32_t cell_x, int32_t cell_y)
 	{
 		const size_t predictedDataLength = RegionFile::s_SectorSize;
@@ -955,25 +1961,74 @@ namespace FusionEngine
 		device.pimpl->cellCoords = std::make_pair(cell_x, cell_y);
 		device.data->reserve(predictedDataLength);
 
+		// The data is compressed (with the current codec) by WriteCellData
 		auto stream = std::unique_ptr<ArchiveOStream>(new io::filtering_ostream());
-		stream->push(io::zlib_compressor());
 		stream->push(device);
 		return stream;
 	}
 
 	void RegionCellCache::WriteCellData(std::pair<int32_t, int32_t> cellIndex, std::shared_ptr<SmartArrayDevice::DataArray_t> data)
+	{
+		WriteCompressedCellData(cellIndex, CompressCellData(*data));
+	}
+
+	RegionCellCache::CompressedCellData RegionCellCache::CompressCellData(const SmartArrayDevice::DataArray_t& data)
+	{
+		CompressedCellData compressed;
+		compressed.codec = m_Codec;
+		compressed.data = std::make_shared<SmartArrayDevice::DataArray_t>();
+		CellCodecs::Compress(compressed.codec, data.data(), data.size(), *compressed.data, m_Dictionary.get());
+		return compressed;
+	}
+
+	void RegionCellCache::WriteCompressedCellData(std::pair<int32_t, int32_t> cellIndex, const CompressedCellData& compressed)
 	{
 		//CacheMutex_t::scoped_lock lock(m_CacheMutex);
+		FSN_ASSERT(compressed.data);
 
 		const auto regionCoord = cellToRegionCoord(&cellIndex.first, &cellIndex.second);
 
-		GetRegionFile([cellIndex, data](RegionFile* regionFile)
+		m_BytesWritten += compressed.data->size();
+		++m_CellsWritten;
+
+		GetRegionFile([this, regionCoord, cellIndex, compressed](RegionFile* regionFile)
 		{
 			FSN_ASSERT(regionFile);
-			regionFile->write(cellIndex, *data);
+			preserveForSnapshot(*regionFile);
+			regionFile->write(cellIndex, *compressed.data, compressed.codec);
+			recordChanges(*regionFile, &cellIndex);
+			recordFragmentation(regionCoord, *regionFile);
 		}, regionCoord, true);
 	}
 
+	void RegionCellCache::recordRead(RegionFile* region_file, int32_t x, int32_t y)
+	{
+		const auto& location = region_file->getCellDataLocation(std::make_pair(x, y));
+		if (location.sectorsAllocated > 0)
+		{
+			m_BytesRead += location.sectorsAllocated * RegionFile::s_SectorSize;
+			++m_CellsRead;
+		}
+	}
+
+	RegionCellCache::IOStats RegionCellCache::GetIOStats() const
+	{
+		IOStats stats;
+		stats.bytesRead = m_BytesRead;
+		stats.bytesWritten = m_BytesWritten;
+		stats.cellsRead = m_CellsRead;
+		stats.cellsWritten = m_CellsWritten;
+		return stats;
+	}
+
+	void RegionCellCache::ResetIOStats()
+	{
+		m_BytesRead = 0;
+		m_BytesWritten = 0;
+		m_CellsRead = 0;
+		m_CellsWritten = 0;
+	}
+
 	void RegionCellCache::Sustain()
 	{
 		if (ResourceManager::getSingletonPtr())
@@ -990,9 +2045,17 @@ namespace FusionEngine
 	{
 		if  (m_Cache.find(coord) != m_Cache.end())
 			return true;
+		else if (m_ReadOnly) // Read-only caches are loaded through PhysFS
+		{
+			return PHYSFS_exists(GetRegionFilePath(coord).c_str()) != 0;
+		}
 		else
 		{
-			return boost::filesystem::exists(GetRegionFilePath(coord));
+			const auto filePath = GetRegionFilePath(coord);
+			if (boost::filesystem::exists(filePath))
+				return true;
+			auto overlay = getOverlay();
+			return overlay && overlay->Provides(boost::filesystem::path(filePath).filename().string());
 		}
 	}
 
@@ -1007,10 +2070,10 @@ namespace FusionEngine
 
 			try
 			{
-				auto regionSize = boost::any_cast<int32_t>(&user_data);
-				if (regionSize)
+				auto settings = boost::any_cast<RegionFileSettings>(&user_data);
+				if (settings)
 				{
-					RegionFile* regionFile = new RegionFile(resource->GetPath(), (size_t)(*regionSize));
+					RegionFile* regionFile = new RegionFile(resource->GetPath(), (size_t)settings->regionSize, settings->memoryMapped);
 					resource->SetDataPtr(regionFile);
 					resource->setLoaded(true);
 				}
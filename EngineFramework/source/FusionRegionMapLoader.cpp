@@ -30,15 +30,17 @@
 #include "FusionRegionMapLoader.h"
 
 #include "FusionRegionCellCache.h"
+#include "FusionRegionSnapshot.h"
 
 #include "FusionActiveEntityDirectory.h"
 #include "FusionAnyFS.h"
 #include "FusionArchetypeFactory.h"
 #include "FusionBinaryStream.h"
-#include "FusionCharCounter.h"
 #include "FusionGameMapLoader.h"
+#include "FusionLazyLoadOverlay.h"
 #include "FusionEntitySerialisationUtils.h"
 #include "FusionEntityInstantiator.h"
+#include "FusionEntityLocationIndex.h"
 #include "FusionVirtualFileSource_PhysFS.h"
 #include "FusionPaths.h"
 #include "FusionPhysFS.h"
@@ -47,13 +49,19 @@
 #include "FusionZipArchive.h"
 
 #include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/math/common_factor_rt.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/filter/zlib.hpp>
 #include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
 #include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/stream.hpp>
 
 #include <numeric>
 
+#include <tbb/parallel_for.h>
+
 #if _MSC_VER > 1000
 #pragma warning( push )
 #pragma warning( disable: 4244 4351; )
@@ -72,88 +80,161 @@ namespace FusionEngine
 
 	const size_t s_DefaultRegionSize = 4;
 
+	// Limits how many low-priority reads can be started before checking for normal requests again
+	const size_t s_MaxPrefetchRequestsPerIteration = 4;
+
+	// Region files within this many cells of requested cells are loaded ahead of time
+	const int32_t s_RegionPrefetchMargin = 2;
+
+	// How long the archivist has to be idle before region files are defragmented (one step per region each time)
+	const int s_IdleDefragmentInterval = 250;
+	const size_t s_MaxDefragmentJobsPerIteration = 4;
+
 	extern void AddHist(const CellHandle& loc, const std::string& l, unsigned int n = -1);
 
 	namespace
 	{
 
-		void storeEntityLocation(kyotocabinet::HashDB& db, ObjectID id, CellCoord_t new_loc, std::streamoff offset, std::streamsize length)
+		void storeEntityLocation(EntityLocationIndex& index, ObjectID id, const CellCoord_t& new_loc, std::streamoff offset, std::streamsize length)
 		{
-			std::array<char, sizeof(new_loc) + sizeof(offset) + sizeof(length)> data;
+			index.Store(id, EntityLocationIndex::Location(new_loc, offset, length));
+		}
 
-			// Convert to little-endian
-			if (clan::Endian::is_system_big())
+		bool getEntityLocation(const EntityLocationIndex& index, CellCoord_t& cell_loc, std::streamoff& data_offset, std::streamsize& data_length, ObjectID id)
+		{
+			EntityLocationIndex::Location location;
+			if (index.Get(id, location))
 			{
-				clan::Endian::swap((void*)new_loc.x, sizeof(new_loc.x));
-				clan::Endian::swap((void*)new_loc.y, sizeof(new_loc.y));
-				clan::Endian::swap((void*)offset, sizeof(offset));
-				clan::Endian::swap((void*)length, sizeof(length));
+				cell_loc = location.cell;
+				data_offset = location.offset;
+				data_length = location.length;
+				return true;
 			}
+			else
+				return false;
+		}
 
-			// Copy the values into a buffer
-			std::memcpy(data.data(), (char*)&new_loc, sizeof(new_loc));
-			std::memcpy(&data[sizeof(new_loc)], (char*)&offset, sizeof(offset));
-			std::memcpy(&data[sizeof(new_loc) + sizeof(offset)], (char*)&length, sizeof(length));
+		//! Keeps archetype factory resources loaded while any worker is reading cells
+		/*!
+		* ArchetypeFactoryManager::Sustain isn't reference counted, so this makes
+		* sure one worker finishing doesn't end the sustain while others are reading.
+		*/
+		class ScopedArchetypeSustain
+		{
+		public:
+			ScopedArchetypeSustain()
+			{
+				std::lock_guard<std::mutex> lock(s_Mutex);
+				if (s_Count++ == 0)
+					ArchetypeFactoryManager::Sustain();
+			}
 
-#ifdef _DEBUG
-			// Make sure the cell-location data is stored as expected
-			FSN_ASSERT(sizeof(new_loc) == sizeof(int64_t));
+			~ScopedArchetypeSustain()
 			{
-				FSN_ASSERT(std::memcmp(&new_loc.x, data.data(), sizeof(new_loc.x)) == 0);
+				std::lock_guard<std::mutex> lock(s_Mutex);
+				if (--s_Count == 0)
+					ArchetypeFactoryManager::EndSustain();
 			}
-#endif
 
-			// Write the buffer to the DB
-			db.set((const char*)&id, sizeof(id), data.data(), data.size());
-		}
+		private:
+			static std::mutex s_Mutex;
+			static size_t s_Count;
+		};
 
-		bool getEntityLocation(kyotocabinet::HashDB& db, CellCoord_t& cell_loc, std::streamoff& data_offset, std::streamsize& data_length, ObjectID id)
+		std::mutex ScopedArchetypeSustain::s_Mutex;
+		size_t ScopedArchetypeSustain::s_Count = 0;
+
+		//! Cell data loaded so that the inactive entities within it can be updated
+		struct ModifiableCell
 		{
-			std::array<char, sizeof(cell_loc) + sizeof(data_offset) + sizeof(data_length)> data;
+			std::vector<char> editModeData; // Pseudo-entity data (only present in edit mode), kept as-is
+			EntitySlotTable entities;
+		};
 
-			auto retrieved = db.get((const char*)&id, sizeof(id), data.data(), data.size());
+		//! Reads the given cell's data so that it can be modified
+		/*!
+		* Cells written before entities were stored in slots are converted, using the
+		* entity location DB to find where each entity's data ends (the new slot for
+		* each entity is recorded in the DB - this only happens once for each cell).
+		*/
+		bool readModifiableCell(ModifiableCell& out, ICellStream& in, const CellCoord_t& coord, bool edit_mode, EntityLocationIndex& db)
+		{
+			const std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+			CellDataCursor cursor(data.data(), data.size());
 
-			if (retrieved == data.size())
+			if (edit_mode && !cursor.AtEnd())
 			{
-				std::memcpy((void*)&cell_loc, data.data(), sizeof(cell_loc));
-				std::memcpy((void*)&data_offset, &data[sizeof(cell_loc)], sizeof(data_offset));
-				std::memcpy((void*)&data_length, &data[sizeof(cell_loc) + sizeof(data_offset)], sizeof(data_length));
+				std::streamsize editModeDataLength = 0;
+				cursor.Read(editModeDataLength);
+				const char* editModeData = editModeDataLength >= 0 ? cursor.ReadBytes((size_t)editModeDataLength) : nullptr;
+				if (!editModeData)
+					return false;
+				out.editModeData.assign(editModeData, editModeData + editModeDataLength);
+			}
 
-				if (clan::Endian::is_system_big())
-				{
-					clan::Endian::swap((void*)cell_loc.x, sizeof(cell_loc.x));
-					clan::Endian::swap((void*)cell_loc.y, sizeof(cell_loc.y));
-					clan::Endian::swap((void*)data_offset, sizeof(data_offset));
-					clan::Endian::swap((void*)data_length, sizeof(data_length));
-				}
+			if (cursor.AtEnd())
+				return true; // No synched entities
+			if (EntitySlotTable::IsSlotTable(cursor))
+				return out.entities.Read(cursor);
 
-				return true;
-			}
-			else
+			size_t numEntities = 0;
+			cursor.Read(numEntities);
+			if (numEntities >= 65535)
+				return false;
+			std::vector<ObjectID> ids(numEntities);
+			for (auto it = ids.begin(); it != ids.end(); ++it)
+				cursor.Read(*it);
+
+			const size_t payloadBegin = cursor.Tell();
+			std::vector<EntitySlotTable::Slot> slots;
+			slots.reserve(numEntities);
+			for (auto it = ids.begin(); it != ids.end(); ++it)
 			{
-				switch (db.error().code())
-				{
-				case kyotocabinet::BasicDB::Error::NOREC:
-					AddLogEntry(db.error().message(), LOG_INFO); // Missing record is an expected error, since this method is called for every retrieval
-					break;
-				default:
-					AddLogEntry(db.error().message(), LOG_NORMAL);
-					break;
-				}
+				CellCoord_t storedLoc;
+				std::streamoff offset;
+				std::streamsize length;
+				if (!getEntityLocation(db, storedLoc, offset, length, *it) || storedLoc != coord || length < 0)
+					return false;
+
+				slots.push_back(EntitySlotTable::Slot(*it, (uint32_t)(cursor.Tell() - payloadBegin), (uint32_t)length));
+				if (!cursor.Skip((size_t)length))
+					return false;
+			}
+			out.entities.Assign(std::move(slots), std::vector<char>(data.begin() + payloadBegin, data.begin() + cursor.Tell()));
 
-				return false;
+			for (size_t i = 0; i < out.entities.GetNumSlots(); ++i)
+			{
+				const auto& slot = out.entities.GetSlot(i);
+				storeEntityLocation(db, slot.id, coord, std::streamoff(i), std::streamsize(slot.length));
 			}
+
+			return true;
 		}
 
-		void setupTuning(kyotocabinet::HashDB* db)
+		//! Writes cell data read by readModifiableCell
+		void writeModifiableCell(std::ostream& out, const ModifiableCell& cell, bool edit_mode)
 		{
-			db->tune_defrag(8);
-			db->tune_map(2LL << 20); // 2MB memory-map
+			IO::Streams::CellStreamWriter writer(&out);
+			if (edit_mode)
+			{
+				if (!cell.editModeData.empty())
+				{
+					writer.Write(std::streamsize(cell.editModeData.size()));
+					out.write(cell.editModeData.data(), cell.editModeData.size());
+				}
+				else
+				{
+					// Write an empty pseudo-entity list
+					writer.Write(std::streamsize(sizeof(size_t)));
+					writer.Write(size_t(0));
+				}
+			}
+			cell.entities.Write(out);
 		}
 
 	}
 
-	RegionCellArchivist::RegionCellArchivist(bool edit_mode, const std::string& cache_path)
+	RegionCellArchivist::RegionCellArchivist(bool edit_mode, const std::string& cache_path, int32_t cells_per_region)
 		: m_EditMode(edit_mode),
 		m_Running(false),
 		m_Cache(nullptr),
@@ -162,13 +243,20 @@ namespace FusionEngine
 		m_RegionSize(s_DefaultRegionSize),
 		m_SavePath(s_SavePath),
 		m_CachePath(cache_path),
+		m_EntityLocations(new EntityLocationIndex()),
 		m_ActiveEntityDirectory(new ActiveEntityDirectory()),
 		m_Instantiator(nullptr),
 		m_Factory(nullptr),
 		m_EntityManager(nullptr),
 		m_ArchetypeFactory(nullptr),
 		m_NewData(false),
-		m_TransactionEnded(false)
+		m_TransactionEnded(false),
+		m_NumWorkerThreads(0),
+		m_SnapshotSaves(true),
+		m_IncrementalSaves(true),
+		m_MaxSaveChainLength(8),
+		m_LazyLoading(false),
+		m_CancelLazyLoad(false)
 	{
 		m_FullBasePath = PHYSFS_getWriteDir();
 		m_FullBasePath += m_CachePath + "/";
@@ -177,7 +265,10 @@ namespace FusionEngine
 		
 		if (!m_EditMode)
 		{
-			m_Cache = new RegionCellCache(m_FullBasePath, 16);
+			m_Cache = new RegionCellCache(m_FullBasePath, cells_per_region);
+
+			// Start with an empty entity DB (replaced with the map's DB when one is set) so synced entities can be stored without a map
+			m_EntityLocations->Open(m_FullBasePath + "entitylocations.kc", true);
 
 			m_Cache->SetFragmentationAllowed(true);
 		}
@@ -186,10 +277,7 @@ namespace FusionEngine
 			// These cells will be used as the static map file files (after defragmentation)
 			m_Cache = new RegionCellCache(m_FullBasePath, 24);
 
-			m_EntityLocationDB.reset(new kyotocabinet::HashDB);
-			m_EntityLocationDB->tune_options(kyotocabinet::HashDB::TSMALL);
-			setupTuning(m_EntityLocationDB.get());
-			m_EntityLocationDB->open(m_FullBasePath + "entitylocations.kc", kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OCREATE);
+			m_EntityLocations->Open(m_FullBasePath + "entitylocations.kc");
 
 			m_Cache->SetFragmentationAllowed(true);
 
@@ -204,14 +292,27 @@ namespace FusionEngine
 
 			m_EditableCache = new RegionCellCache(fullEditorCachePath);
 		}
+
+		// Jobs are serialised per-region: cells that share a region file in either cache need to share a strand
+		m_StrandRegionSize = (size_t)m_Cache->GetRegionSize();
+		if (m_EditableCache)
+			m_StrandRegionSize = boost::math::lcm(m_StrandRegionSize, (size_t)m_EditableCache->GetRegionSize());
 	}
 
 	RegionCellArchivist::~RegionCellArchivist()
 	{
 		Stop();
+		WaitForSnapshotSave();
+		cancelLazyLoad();
 
-		if (!m_EntityLocationDB->close())
-			AddLogEntry(m_EntityLocationDB->error().message());
+		try
+		{
+			m_EntityLocations->Close();
+		}
+		catch (FileSystemException& e)
+		{
+			AddLogEntry("Failed to save entity locations: " + e.GetDescription(), LOG_CRITICAL);
+		}
 
 		delete m_Cache;
 		if (m_EditableCache)
@@ -230,23 +331,27 @@ namespace FusionEngine
 	{
 		m_Map = map;
 
-		// Close any existing entity database
-		if (m_EntityLocationDB)
-		{
-			if (!m_EntityLocationDB->close())
-				AddLogEntry(m_EntityLocationDB->error().message());
-		}
-
-		m_EntityLocationDB.reset(new kyotocabinet::HashDB);
+		// Close the existing entity locations (they are replaced by the map's)
+		m_EntityLocations->Close(false);
 
 		// Copy the database from the map's folder
 		PhysFSHelp::copy_file(m_Map->GetEntityDatabasePath(), m_CachePath + "/entitylocations.kc");
 
-		// Init the database using the new file
-		setupTuning(m_EntityLocationDB.get());
-		m_EntityLocationDB->open(m_FullBasePath + "entitylocations.kc", kyotocabinet::HashDB::OWRITER);
+		// Load the locations from the new file
+		m_EntityLocations->Open(m_FullBasePath + "entitylocations.kc");
 
 		m_MapCache = new RegionCellCache(m_Map->GetPath(), 16, true);
+		if (m_Workers)
+			DispatchLoadedCallbacksToStrands(m_MapCache, true);
+
+		// Compiled maps may be compressed using a dictionary (see CopyCellFiles)
+		const std::string dictionaryPath = m_Map->GetCellDictionaryPath();
+		if (PHYSFS_exists(dictionaryPath.c_str()))
+		{
+			IO::PhysFSStream dictionaryFile(dictionaryPath, IO::Read);
+			std::vector<char> dictionaryData((std::istreambuf_iterator<char>(dictionaryFile)), std::istreambuf_iterator<char>());
+			m_MapCache->SetDictionary(std::make_shared<CellCodecDictionary>(std::move(dictionaryData)));
+		}
 	}
 
 	void RegionCellArchivist::Update(ObjectID id, const CellCoord_t& new_location, std::vector<unsigned char>&& continuous, std::vector<unsigned char>&& occasional)
@@ -280,56 +385,176 @@ namespace FusionEngine
 	Vector2T<int32_t> RegionCellArchivist::GetEntityLocation(ObjectID id)
 	{
 		CellCoord_t loc(std::numeric_limits<CellCoord_t::type>::max(), std::numeric_limits<CellCoord_t::type>::max());
-		if (m_EntityLocationDB) // TODO: lock while loading save-game and wait here
+		if (m_EntityLocations->IsOpen()) // TODO: lock while loading save-game and wait here
 		{
 			std::streamoff offset; std::streamsize length;
-			getEntityLocation(*m_EntityLocationDB, loc, offset, length, id);
+			getEntityLocation(*m_EntityLocations, loc, offset, length, id);
 		}
 		return loc;
 	}
 
 	void RegionCellArchivist::Store(int32_t x, int32_t y, std::shared_ptr<Cell> cell)
 	{
-		if (cell->waiting.fetch_and_store(Cell::Store) != Cell::Store)
+		// Cancel the prefetch request for this cell, if there is one
+		m_PendingPrefetches.erase(CellCoord_t(x, y));
+
+		// The last param indicates whether the cell should be cleared (unloaded) when the
+		//  write operation is done: it checks whether this is the only reference to the cell
+		EnqueueWrite(WriteJob(cell, CellCoord_t(x, y), cell.unique()));
+
+		//TransactionMutex_t::scoped_try_lock lock(m_TransactionMutex);
+		//FSN_ASSERT_MSG(lock, "Concurrent Store/Retrieve access isn't allowed");
+		CellsBeingProcessedMap_t::accessor accessor;
+		m_CellsBeingProcessed.insert(accessor, CellCoord_t(x, y));
+		accessor->second = std::move(cell);
+	}
+
+	void RegionCellArchivist::EnqueueWrite(const WriteJob& job)
+	{
+		auto cell = job.cell.lock();
+		if (!cell)
+			return;
+
+		PendingWriteMap_t::accessor pending;
+		m_PendingWrites.insert(pending, job.coord);
+		const bool alreadyQueued = pending->second.queued;
+		// If the cell is stored again before the queued write starts, the write will use the latest state
+		//  anyway, so the only thing to update is whether to unload the cell afterwards
+		pending->second.job = job;
+		pending->second.queued = true;
+		// Set while the entry is locked, so FinishWrite can't mark the cell ready after this
+		cell->waiting = Cell::Store;
+
+		if (alreadyQueued)
+			AddHist(job.coord, "Enqueued Out (coalesced)");
+		else
 		{
-			AddHist(CellCoord_t(x, y), "Enqueued Out");
-			// The last tuple param indicates whether the cell should be cleared (unloaded)
-			//  when the write operation is done: it checks whether this is the only reference
-			//  to the cell
-			m_WriteQueue.push(WriteJob(cell, CellCoord_t(x, y), cell.unique()));
+			AddHist(job.coord, "Enqueued Out");
+			m_WriteQueue.push(job.coord);
 			m_NewData.set();
-			
-			//TransactionMutex_t::scoped_try_lock lock(m_TransactionMutex);
-			//FSN_ASSERT_MSG(lock, "Concurrent Store/Retrieve access isn't allowed");
-			CellsBeingProcessedMap_t::accessor accessor;
-			m_CellsBeingProcessed.insert(accessor, CellCoord_t(x, y));
-			accessor->second = std::move(cell);
 		}
 	}
 
+	void RegionCellArchivist::FinishWrite(const std::shared_ptr<Cell>& cell, const CellCoord_t& coord, bool unload)
+	{
+		PendingWriteMap_t::accessor pending;
+		if (!m_PendingWrites.find(pending, coord))
+		{
+			FSN_ASSERT_FAIL("FinishWrite called for a cell with no writes in flight");
+			return;
+		}
+		FSN_ASSERT(pending->second.inFlight > 0);
+		if (--pending->second.inFlight == 0 && !pending->second.queued)
+		{
+			// No other write is queued or running: the cell is now "ready" for other operations
+			if (cell)
+			{
+				if (unload && cell->waiting == Cell::Store)
+				{
+					if (cell->active_entries != 0)
+						AddLogEntry("Warning: unloading active cell");
+					cell->ClearEntries();
+					cell->loaded = false;
+					AddHist(coord, "Written and cleared");
+				}
+				// Unloaded cells that have been requested again since they were stored are left waiting for that read
+				if (cell->loaded)
+					cell->waiting = Cell::Ready;
+				else
+					cell->waiting.compare_and_swap(Cell::Ready, Cell::Store);
+				m_ReadyCells.push(coord);
+			}
+			m_PendingWrites.erase(pending);
+		}
+		else
+			AddHist(coord, "Write finished (another write is queued or running)");
+	}
+
 	std::shared_ptr<Cell> RegionCellArchivist::Retrieve(int32_t x, int32_t y)
+	{
+		return RequestCell(CellCoord_t(x, y), false, 0.f);
+	}
+
+	std::shared_ptr<Cell> RegionCellArchivist::Prefetch(int32_t x, int32_t y, float time_of_need)
+	{
+		return RequestCell(CellCoord_t(x, y), true, time_of_need);
+	}
+
+	bool RegionCellArchivist::CancelPrefetch(int32_t x, int32_t y)
+	{
+		const CellCoord_t coord(x, y);
+		CellsBeingProcessedMap_t::accessor accessor;
+		if (!m_CellsBeingProcessed.find(accessor, coord))
+			return false;
+		// Cells that are loaded are held here while they're written, so they're left alone
+		auto& cell = accessor->second;
+		if (cell->IsLoaded() || m_PendingWrites.count(coord) != 0)
+			return false;
+		// The request can't be canceled if the archivist has already taken it off the prefetch queue
+		if (!m_PendingPrefetches.erase(coord))
+			return false;
+
+		AddHist(coord, "Prefetch canceled");
+		cell->waiting = Cell::Ready;
+		m_CellsBeingProcessed.erase(accessor);
+		return true;
+	}
+
+	std::shared_ptr<Cell> RegionCellArchivist::RequestCell(const CellCoord_t& coord, const bool prefetch, const float time_of_need)
 	{
 		//TransactionMutex_t::scoped_try_lock lock(m_TransactionMutex);
 		//FSN_ASSERT_MSG(lock, "Concurrent Store/Retrieve access isn't allowed");
 		CellsBeingProcessedMap_t::accessor accessor;
-		m_CellsBeingProcessed.insert(accessor, std::make_pair(CellCoord_t(x, y), std::make_shared<Cell>()));
+		m_CellsBeingProcessed.insert(accessor, std::make_pair(coord, std::make_shared<Cell>()));
 		auto& cell = accessor->second;
 
 		auto state = cell->waiting.fetch_and_store(Cell::Retrieve);
 		if (state != Cell::Retrieve && (state != Cell::Ready || !cell->loaded))
 		{
-			AddHist(CellCoord_t(x, y), "Enqueued In");
-			m_ReadQueueGetCellData.push(std::make_shared<ReadJob>(cell, CellCoord_t(x, y)));
+			if (prefetch)
+			{
+				AddHist(coord, "Enqueued In (prefetch)");
+				{
+					PendingPrefetchMap_t::accessor pending;
+					m_PendingPrefetches.insert(pending, coord);
+					pending->second = time_of_need;
+				}
+				m_PrefetchQueue.push(PrefetchJob(cell, coord, time_of_need));
+			}
+			else
+			{
+				AddHist(coord, "Enqueued In");
+				m_ReadQueueGetCellData.push(std::make_shared<ReadJob>(cell, coord));
+			}
 			m_NewData.set();
 		}
 		else if (cell->loaded)
 		{
-			AddHist(CellCoord_t(x, y), "Already loaded");
+			AddHist(coord, "Already loaded");
 			cell->waiting = Cell::Ready;
 			std::shared_ptr<Cell> retVal = std::move(cell); // move the ptr so the stored one can be erased
 			m_CellsBeingProcessed.erase(accessor);
 			return std::move(retVal);
 		}
+		else // Already requested: if it was prefetched and hasn't started loading yet, the request can be re-prioritised
+		{
+			PendingPrefetchMap_t::accessor pending;
+			if (m_PendingPrefetches.find(pending, coord))
+			{
+				if (prefetch)
+				{
+					pending->second = time_of_need;
+					m_PrefetchQueue.push(PrefetchJob(cell, coord, time_of_need));
+				}
+				else
+				{
+					AddHist(coord, "Prefetch promoted");
+					m_PendingPrefetches.erase(pending);
+					m_ReadQueueGetCellData.push(std::make_shared<ReadJob>(cell, coord));
+				}
+				m_NewData.set();
+			}
+		}
 
 		return cell;
 	}
@@ -365,6 +590,20 @@ namespace FusionEngine
 		m_Running = true;
 
 		m_Quit.reset();
+
+		// The workers do the actual cell IO / (de)serialisation: the archivist thread hands jobs out to them
+		auto setupWorkerThread = []()
+		{
+#ifdef _WIN32
+			SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#endif
+		};
+		m_Workers.reset(new StrandedWorkerPool(m_NumWorkerThreads, setupWorkerThread, []() { asThreadCleanup(); }));
+
+		DispatchLoadedCallbacksToStrands(m_Cache, true);
+		DispatchLoadedCallbacksToStrands(m_EditableCache, true);
+		DispatchLoadedCallbacksToStrands(m_MapCache, true);
+
 		m_Thread = std::thread(&RegionCellArchivist::Run, this);
 #ifdef _WIN32
 		SetThreadPriority(m_Thread.native_handle(), THREAD_PRIORITY_BELOW_NORMAL);
@@ -382,6 +621,12 @@ namespace FusionEngine
 		{
 			Log(LOG_NORMAL) << "Exception captured from region archivist thread: " << ex.what();
 		}
+		// Callbacks for regions that finish loading from here on are run by the ResourceManager thread again
+		DispatchLoadedCallbacksToStrands(m_Cache, false);
+		DispatchLoadedCallbacksToStrands(m_EditableCache, false);
+		DispatchLoadedCallbacksToStrands(m_MapCache, false);
+		// Finishes any jobs that are still running
+		m_Workers.reset();
 		m_Running = false;
 	}
 
@@ -454,11 +699,152 @@ namespace FusionEngine
 				boost::filesystem::copy_file(*it, dest, boost::filesystem::copy_option::overwrite_if_exists);
 			}
 		}
+
+		//! Name of the file that identifies each save (and the save that it's based on, if it's incremental)
+		static const char* const s_SaveInfoFilename = "save.info";
+		//! Limits how many saves are followed back from an incremental save (in case a chain is circular)
+		static const size_t s_MaxSaveChainDepth = 256;
+
+		struct SaveInfo
+		{
+			std::string id;
+			std::string base;
+			std::string baseId;
+		};
+
+		std::string CreateSaveId()
+		{
+			return boost::filesystem::unique_path("%%%%%%%%-%%%%-%%%%-%%%%-%%%%%%%%%%%%").string();
+		}
+
+		void WriteSaveInfo(const boost::filesystem::path& save_path, const SaveInfo& info)
+		{
+			const auto path = save_path / s_SaveInfoFilename;
+			boost::filesystem::ofstream file(path, std::ios::out | std::ios::trunc);
+			file << "id=" << info.id << "\n";
+			if (!info.base.empty())
+				file << "base=" << info.base << "\n" << "baseid=" << info.baseId << "\n";
+			if (!file)
+				FSN_EXCEPT(FileSystemException, "Failed to write " + path.string());
+		}
+
+		SaveInfo ReadSaveInfo(std::istream& file)
+		{
+			SaveInfo info;
+			std::string line;
+			while (std::getline(file, line))
+			{
+				if (!line.empty() && line.back() == '\r')
+					line.pop_back();
+				const auto separator = line.find('=');
+				if (separator == std::string::npos)
+					continue;
+				const auto key = line.substr(0, separator);
+				if (key == "id")
+					info.id = line.substr(separator + 1);
+				else if (key == "base")
+					info.base = line.substr(separator + 1);
+				else if (key == "baseid")
+					info.baseId = line.substr(separator + 1);
+			}
+			return info;
+		}
+
+		//! Returns the name of the folder that the given save is written to (CreateSaveFolder removes extensions)
+		std::string GetSaveFolderName(const std::string& save_name)
+		{
+			return boost::filesystem::path(save_name).replace_extension().generic_string();
+		}
+
+		//! Upper limit on the amount of (decompressed) cell data used to train a dictionary
+		static const size_t s_MaxDictionarySampleBytes = 16 * 1024 * 1024;
+
+		//! Trains a dictionary on the cells in the given region files
+		std::shared_ptr<CellCodecDictionary> TrainCellDictionary(const std::vector<boost::filesystem::path>& sourceFiles, size_t region_size)
+		{
+			std::vector<std::vector<char>> samples;
+			size_t totalSampleBytes = 0;
+			std::vector<char> cellData;
+			for (auto it = sourceFiles.begin(); it != sourceFiles.end() && totalSampleBytes < s_MaxDictionarySampleBytes; ++it)
+			{
+				RegionFile source(it->string(), region_size);
+				for (size_t y = 0; y < region_size; ++y)
+				{
+					for (size_t x = 0; x < region_size; ++x)
+					{
+						const auto view = source.getCellDataView((int32_t)x, (int32_t)y);
+						if (view.data && CellCodecs::Decompress(view.codec, view.data, view.length, cellData))
+						{
+							totalSampleBytes += cellData.size();
+							samples.push_back(cellData);
+						}
+					}
+				}
+			}
+			return CellCodecDictionary::Train(samples);
+		}
+
+		//! Copies the given region files, recompressing each cell with the given codec
+		/*!
+		* Each region file is recompressed on its own task, so perFileCallback is called
+		* from the worker threads (with the number of files finished so far): the calls
+		* are serialised, so the counts it gets are in order.
+		*/
+		void RecompressCacheFiles(const std::string& sourceBasePath, const std::vector<boost::filesystem::path>& sourceFiles, const boost::filesystem::path& destination, size_t region_size, CellCodec codec, const CellCodecDictionary* dictionary, const PerFileCallback_t& perFileCallback = PerFileCallback_t())
+		{
+			std::mutex progressMutex;
+			unsigned int filesDone = 0;
+			tbb::parallel_for(tbb::blocked_range<size_t>(0, sourceFiles.size(), 1), [&](const tbb::blocked_range<size_t>& r)
+			{
+				for (size_t i = r.begin(), end = r.end(); i != end; ++i)
+				{
+					const auto& sourceFile = sourceFiles[i];
+
+					auto dest = destination;
+					dest /= make_relative(sourceBasePath, sourceFile);
+					boost::filesystem::remove(dest);
+
+					RegionFile source(sourceFile.string(), region_size);
+					RegionFile compressed(dest.string(), region_size);
+					source.recompressTo(compressed, codec, dictionary);
+
+					if (perFileCallback)
+					{
+						std::lock_guard<std::mutex> lock(progressMutex);
+						perFileCallback(++filesDone);
+					}
+				}
+			});
+		}
+
+		//! Copies the given files, each on its own task (perFileCallback is called as in RecompressCacheFiles)
+		void CopyCacheFilesInParallel(const std::string& sourceBasePath, const std::vector<boost::filesystem::path>& sourceFiles, const boost::filesystem::path& destination, const PerFileCallback_t& perFileCallback = PerFileCallback_t())
+		{
+			std::mutex progressMutex;
+			unsigned int filesDone = 0;
+			tbb::parallel_for(tbb::blocked_range<size_t>(0, sourceFiles.size(), 1), [&](const tbb::blocked_range<size_t>& r)
+			{
+				for (size_t i = r.begin(), end = r.end(); i != end; ++i)
+				{
+					const auto& sourceFile = sourceFiles[i];
+
+					auto dest = destination;
+					dest /= make_relative(sourceBasePath, sourceFile);
+					boost::filesystem::copy_file(sourceFile, dest, boost::filesystem::copy_option::overwrite_if_exists);
+
+					if (perFileCallback)
+					{
+						std::lock_guard<std::mutex> lock(progressMutex);
+						perFileCallback(++filesDone);
+					}
+				}
+			});
+		}
 	}
 
-	void RegionCellArchivist::CopyCellFiles(const std::string& dest_path)
+	void RegionCellArchivist::CopyCellFiles(const std::string& dest_path, const std::function<void (size_t, size_t)>& progress)
 	{
-		CopyCellFiles("", dest_path);
+		CopyCellFiles("", dest_path, progress);
 	}
 
 	void RegionCellArchivist::CopyDatabase(const std::string& dest_path)
@@ -466,8 +852,10 @@ namespace FusionEngine
 		SaveEntityLocationDB(dest_path);
 	}
 
-	void RegionCellArchivist::CopyCellFiles(const std::string& cache_path, const std::string& dest_path)
+	void RegionCellArchivist::CopyCellFiles(const std::string& cache_path, const std::string& dest_path, const std::function<void (size_t, size_t)>& progress)
 	{
+		WaitForLazyLoad();
+
 		std::vector<boost::filesystem::path> regionFiles;
 		// List the data from the normal cache
 		{
@@ -478,41 +866,41 @@ namespace FusionEngine
 
 		const std::string fullPath = make_absolute(dest_path);
 
-		ArchivistSaveUtils::CopyCacheFiles(m_FullBasePath, regionFiles, fullPath, [](unsigned int fileNum) {});
-	}
+		const size_t numRegionFiles = regionFiles.size();
+		const ArchivistSaveUtils::PerFileCallback_t perFileCallback = [progress, numRegionFiles](unsigned int fileNum)
+		{
+			if (progress)
+				progress(fileNum, numRegionFiles);
+		};
 
-	void RegionCellArchivist::SaveEntityLocationDB(const std::string& filename)
-	{
-		if (m_EntityLocationDB)
+		// Compiled maps are only read, so they get the codec with the best ratio, along with
+		//  a dictionary trained on the map's own cells (cells are too small to compress well alone)
+		if (IsCellCodecAvailable(CellCodec::Zstd))
 		{
-			const std::string fullPath = make_absolute(filename);
+			const size_t regionSize = (size_t)m_Cache->GetRegionSize();
 
-			if (m_Thread.joinable())
+			auto dictionary = ArchivistSaveUtils::TrainCellDictionary(regionFiles, regionSize);
+			const auto dictionaryFile = boost::filesystem::path(fullPath) / GameMap::cellDictionaryFilename;
+			if (dictionary)
 			{
-				// Thread is running, DB may be in use: do hot copy
-				m_EntityLocationDB->copy(fullPath);
+				boost::filesystem::ofstream file(dictionaryFile, std::ios::out | std::ios::binary | std::ios::trunc);
+				file.write(dictionary->GetData().data(), dictionary->GetData().size());
 			}
 			else
-			{
-				// Close the DB to do a clean copy (closed DB can be smaller)
-				std::string dbPath = m_EntityLocationDB->path();
-				if (!m_EntityLocationDB->close())
-					AddLogEntry(m_EntityLocationDB->error().message());
-				m_EntityLocationDB.reset();
+				boost::filesystem::remove(dictionaryFile);
 
-				try
-				{
-					boost::filesystem::copy_file(dbPath, fullPath, boost::filesystem::copy_option::overwrite_if_exists);
-				}
-				catch (boost::filesystem::filesystem_error& e)
-				{
-					FSN_EXCEPT(FileSystemException, std::string("Failed to copy entity location db: ") + e.what());
-				}
+			ArchivistSaveUtils::RecompressCacheFiles(m_FullBasePath, regionFiles, fullPath, regionSize, CellCodec::Zstd, dictionary.get(), perFileCallback);
+		}
+		else
+			ArchivistSaveUtils::CopyCacheFilesInParallel(m_FullBasePath, regionFiles, fullPath, perFileCallback);
+	}
 
-				m_EntityLocationDB.reset(new kyotocabinet::HashDB);
-				setupTuning(m_EntityLocationDB.get());
-				m_EntityLocationDB->open(dbPath, kyotocabinet::HashDB::OWRITER);
-			}
+	void RegionCellArchivist::SaveEntityLocationDB(const std::string& filename)
+	{
+		if (m_EntityLocations->IsOpen())
+		{
+			// The index is in memory, so this is the same whether or not the thread is running
+			m_EntityLocations->SaveSnapshot(make_absolute(filename));
 		}
 		else
 		{
@@ -610,45 +998,47 @@ namespace FusionEngine
 		return std::unique_ptr<io::filtering_istream>();
 	}
 
-	void RegionCellArchivist::OnGotCellStreamForReading(std::shared_ptr<std::istream> cellDataStream, std::shared_ptr<ReadJob> job)
+	void RegionCellArchivist::OnGotCellDataForReading(std::shared_ptr<CellData> cellData, std::shared_ptr<ReadJob> job)
 	{
 		std::stringstream str; str << job->coord.x << "," << job->coord.y;
 		AddLogEntry("cells_loaded", "  Got [" + str.str() + "]");
-		AddHist(job->coord, "Got cell data stream");
-		job->cellDataStream = std::move(cellDataStream);
+		AddHist(job->coord, "Got cell data");
+		job->cellData = std::move(cellData);
 
 		// Enqueue to load entities when a) there is no map data to load, or b) map data is ready to load
-		if (!job->mapSubjob || job->mapSubjob->cellDataStream)
+		if (!job->mapSubjob || job->mapSubjob->cellData)
 			m_ReadQueueLoadEntities.push(job);
 
 		m_NewData.set();
 	}
 
-	std::shared_ptr<EntitySerialisationUtils::EntityFuture> RegionCellArchivist::LoadEntity(std::shared_ptr<ICellStream> file, bool includes_id, ObjectID id, const EntitySerialisationUtils::SerialisedDataStyle data_style)
+	std::shared_ptr<EntitySerialisationUtils::EntityFuture> RegionCellArchivist::LoadEntity(const std::shared_ptr<CellDataCursor>& data, bool includes_id, ObjectID id, const EntitySerialisationUtils::SerialisedDataStyle data_style)
 	{
-		return EntitySerialisationUtils::LoadEntity(std::move(file), includes_id, id, data_style, m_Factory, m_EntityManager, m_Instantiator);
+		return EntitySerialisationUtils::LoadEntity(data, includes_id, id, data_style, m_Factory, m_EntityManager, m_Instantiator);
 	}
 
-	std::tuple<bool, size_t, std::shared_ptr<ICellStream>> RegionCellArchivist::ContinueReadingCell(const CellCoord_t& coord, const std::shared_ptr<Cell>& conveniently_locked_cell, size_t num_entities, size_t progress, std::shared_ptr<EntitySerialisationUtils::EntityFuture>& incomming_entity, const std::vector<ObjectID>& ids, std::shared_ptr<ICellStream> file, const EntitySerialisationUtils::SerialisedDataStyle data_style)
+	std::pair<bool, size_t> RegionCellArchivist::ContinueReadingCell(const CellCoord_t& coord, const std::shared_ptr<Cell>& conveniently_locked_cell, size_t num_entities, size_t progress, std::shared_ptr<EntitySerialisationUtils::EntityFuture>& incomming_entity, const std::vector<ObjectID>& ids, const std::vector<size_t>& entity_offsets, const std::shared_ptr<CellDataCursor>& data, const EntitySerialisationUtils::SerialisedDataStyle data_style)
 	{
 		std::list<EntityPtr> loaded_entities;
 
-		FSN_ASSERT(incomming_entity || file);
+		FSN_ASSERT(data);
 
 		if (!incomming_entity)
 		{
 			// Read as many entities as possible before hitting one that requires other resources (e.g. archetype factories)
 			while (progress < num_entities)
 			{
-				++progress;
+				const size_t index = progress++;
+
+				// Entities stored in slots aren't necessarily contiguous
+				if (!entity_offsets.empty() && !data->Seek(entity_offsets[index]))
+					FSN_EXCEPT(FileSystemException, "Entity data offset is out of range");
 
-				incomming_entity = LoadEntity(std::move(file), false, !ids.empty() ? ids[progress] : 0, data_style);
+				incomming_entity = LoadEntity(data, false, !ids.empty() ? ids[index] : 0, data_style);
 				FSN_ASSERT(incomming_entity);
 				if (incomming_entity->is_ready())
 				{
 					loaded_entities.push_back(incomming_entity->get_entity());
-					file = incomming_entity->get_file();
-					FSN_ASSERT(file);
 
 					incomming_entity.reset();
 				}
@@ -659,8 +1049,6 @@ namespace FusionEngine
 		else if (incomming_entity->is_ready())
 		{
 			loaded_entities.push_back(incomming_entity->get_entity());
-			file = incomming_entity->get_file();
-			FSN_ASSERT(file);
 
 			incomming_entity.reset();
 		}
@@ -674,13 +1062,10 @@ namespace FusionEngine
 			//entity->SynchroniseParallelEdits();
 
 			Vector2 pos = entity->GetPosition();
-			// TODO: Cell::Add(entity, CellEntry = def) rather than this bullshit
-			CellEntry entry;
-			entry.x = pos.x; entry.y = pos.y;
 
 			entity->SetStreamingCellIndex(coord);
 
-			conveniently_locked_cell->objects.push_back(std::make_pair(std::move(entity), std::move(entry)));
+			conveniently_locked_cell->AddEntry(entity, pos);
 		}
 		loaded_entities.clear();
 
@@ -694,11 +1079,10 @@ namespace FusionEngine
 					it->first->ResetArchetypeAgent();
 			}
 
-			FSN_ASSERT(file);
-			return std::make_tuple(true, progress, std::move(file));
+			return std::make_pair(true, progress);
 		}
 
-		return std::make_tuple(false, progress, file ? std::move(file) : std::shared_ptr<ICellStream>());
+		return std::make_pair(false, progress);
 	}
 
 	void RegionCellArchivist::WriteCellIntro(std::ostream& file_param, const CellCoord_t& loc, const Cell* cell, size_t expectedNumEntries, const bool synched, const EntitySerialisationUtils::SerialisedDataStyle data_style)
@@ -706,28 +1090,27 @@ namespace FusionEngine
 		using namespace EntitySerialisationUtils;
 	}
 
-	void RegionCellArchivist::WriteCellData(std::ostream& file_param, const CellCoord_t& loc, const Cell* cell, size_t expectedNumEntries, const bool synched, const EntitySerialisationUtils::SerialisedDataStyle data_style)
+	RegionCellArchivist::EntityDataPositions_t RegionCellArchivist::WriteCellData(std::ostream& file_param, const CellCoord_t& loc, const Cell* cell, size_t expectedNumEntries, const bool synched, const EntitySerialisationUtils::SerialisedDataStyle data_style)
 	{
 		FSN_ASSERT(cell);
 
-		auto dataPositions = CellSerialisationUtils::WriteCellData(file_param, cell->objects, synched, data_style);
+		return CellSerialisationUtils::WriteCellData(file_param, cell->objects, synched, data_style);
+	}
 
-		// Update the entity location DB
-		if (synched && data_style == EntitySerialisationUtils::FastBinary)
+	void RegionCellArchivist::StoreEntityLocations(const CellCoord_t& loc, const EntityDataPositions_t& dataPositions)
+	{
+		for (auto it = dataPositions.cbegin(), end = dataPositions.cend(); it != end; ++it)
 		{
-			for (auto it = dataPositions.cbegin(), end = dataPositions.cend(); it != end; ++it)
-			{
-				storeEntityLocation(*m_EntityLocationDB, std::get<0>(*it), loc, std::get<1>(*it), std::get<2>(*it));
+			storeEntityLocation(*m_EntityLocations, std::get<0>(*it), loc, std::get<1>(*it), std::get<2>(*it));
 
-				// The saved entity location is now up to date: don't need the location in the active db anymore
-				m_ActiveEntityDirectory->DropEntityLocation(std::get<0>(*it));
-			}
+			// The saved entity location is now up to date: don't need the location in the active db anymore
+			m_ActiveEntityDirectory->DropEntityLocation(std::get<0>(*it));
 		}
 	}
 
-	void RegionCellArchivist::WriteCellDataForEditMode(const std::unique_ptr<std::ostream>& file, const CellCoord_t& cell_coord, const std::shared_ptr<Cell>& cell, size_t numPseudo, size_t numSynched, const EntitySerialisationUtils::SerialisedDataStyle data_style)
+	RegionCellArchivist::EntityDataPositions_t RegionCellArchivist::WriteCellDataForEditMode(std::ostream& file, const CellCoord_t& cell_coord, const std::shared_ptr<Cell>& cell, size_t numPseudo, size_t numSynched, const EntitySerialisationUtils::SerialisedDataStyle data_style)
 	{
-		if (file && *file)
+		if (file)
 		{
 			{
 				// Need write the length of the data written up front, so a temp stream is needed
@@ -740,15 +1123,15 @@ namespace FusionEngine
 				std::streamsize dataLength = tempStream.tellp() - start;
 
 				// Write the length of the psuedo-entity data
-				IO::Streams::CellStreamWriter writer(file.get());
+				IO::Streams::CellStreamWriter writer(&file);
 				writer.Write(dataLength);
 
 				// Write the pseudo-entity data from the temp stream to the actual output file
-				(*file) << tempStream.rdbuf();
+				file << tempStream.rdbuf();
 			}
 
 			// Write the non-pseudo-entity data
-			WriteCellData(*file, cell_coord, cell.get(), numSynched, true, data_style);
+			return WriteCellData(file, cell_coord, cell.get(), numSynched, true, data_style);
 		}
 		else
 			FSN_EXCEPT(FileSystemException, "Failed to open file in order to dump edit-mode cache");
@@ -773,35 +1156,35 @@ namespace FusionEngine
 		{
 			try
 			{
-				auto& cellDataStream = job->cellDataStream;
+				auto& cellData = job->cellData;
 
 				if (job->mapSubjob)
 				{
 					// Load synched entities if this cell is un-cached (hasn't been loaded before)
-					const bool uncached = !cellDataStream;//m_SynchLoaded.insert(std::make_pair(cell_coord.x, cell_coord.y)).second;
+					const bool uncached = !cellData;//m_SynchLoaded.insert(std::make_pair(cell_coord.x, cell_coord.y)).second;
 
 					{
-						IO::Streams::CellStreamReader reader(job->mapSubjob->cellDataStream.get());
-						auto pseudoEntityDataLength = reader.ReadValue<std::streamsize>();
+						auto& mapData = *job->mapSubjob->cellData;
+						auto pseudoEntityDataLength = mapData.ReadValue<std::streamsize>();
 
 						// Read pseudo-entities
 						if (pseudoEntityDataLength > 0)
 						{
-							std::tie(job->mapSubjob->entitiesExpected, job->mapSubjob->ids) = ReadCellIntro(cellCoord, *job->mapSubjob->cellDataStream, false, FastBinary);
+							std::tie(job->mapSubjob->entitiesExpected, job->mapSubjob->ids) = ReadCellIntro(cellCoord, mapData, false, FastBinary, &job->mapSubjob->entityOffsets);
 							// Remember that there are synced-entities to read next if this cell is uncached:
 							job->thereIsSyncedDataToReadNext = uncached;
 						}
 						else if (uncached)
-							std::tie(job->mapSubjob->entitiesExpected, job->mapSubjob->ids) = ReadCellIntro(cellCoord, *job->mapSubjob->cellDataStream, true, FastBinary);
+							std::tie(job->mapSubjob->entitiesExpected, job->mapSubjob->ids) = ReadCellIntro(cellCoord, mapData, true, FastBinary, &job->mapSubjob->entityOffsets);
 
 						// Enqueue the map data load job if there is anything to load for this map cell
 						if (job->mapSubjob->entitiesExpected > 0)
-							m_IncommingCells.push_back(std::move(job->mapSubjob));
+							m_IncommingCells.push(std::move(job->mapSubjob));
 					}
 				}
 
 				// Load normal data
-				if (cellDataStream && *cellDataStream && !cellDataStream->eof())
+				if (cellData && !cellData->AtEnd())
 				{
 					// Set the data-style to expect for this job (will be used when the actual entity data is read)
 					job->dataStyle = m_EditMode ? EditableBinary : FastBinary;
@@ -811,8 +1194,7 @@ namespace FusionEngine
 					{
 						// The length of this (edit-mode only) data is written in front of it so that it can be skipped when merging incoming data
 						//  (we don't need to know this length to actually load the data):
-						IO::Streams::CellStreamReader reader(cellDataStream.get());
-						std::streamsize unsynchedDataLength = reader.ReadValue<std::streamsize>();
+						std::streamsize unsynchedDataLength = cellData->ReadValue<std::streamsize>();
 
 						// TODO: (or not) Could create a second buffer for the pseudo data, then load it all at once into a new subjob (like the map file)
 						//std::vector<char> buffer(unsynchedDataLength);
@@ -820,13 +1202,13 @@ namespace FusionEngine
 						//auto pseudoDataStream = std::make_shared<std::stringstream>();
 						//pseudoDataStream->write(buffer.data(), unsynchedDataLength);
 
-						std::tie(job->entitiesExpected, job->ids) = ReadCellIntro(cellCoord, *cellDataStream, false, EditableBinary); // This is edit mode, so editable data
+						std::tie(job->entitiesExpected, job->ids) = ReadCellIntro(cellCoord, *cellData, false, EditableBinary, &job->entityOffsets); // This is edit mode, so editable data
 
 						// Remember to read the synced-entity data, too:
 						job->thereIsSyncedDataToReadNext = true;
 					}
 					else
-						std::tie(job->entitiesExpected, job->ids) = ReadCellIntro(cellCoord, *cellDataStream, true, FastBinary); // FastBinary since this isn't edit mode
+						std::tie(job->entitiesExpected, job->ids) = ReadCellIntro(cellCoord, *cellData, true, FastBinary, &job->entityOffsets); // FastBinary since this isn't edit mode
 
 					//std::stringstream str; str << i;
 					//SendToConsole("Cell " + str.str() + " streamed in");
@@ -840,7 +1222,7 @@ namespace FusionEngine
 					if (!done)
 					{
 						// Enqueue the cell to process again later
-						m_IncommingCells.push_back(job);
+						m_IncommingCells.push(job);
 						return;
 					}
 					else
@@ -878,30 +1260,145 @@ namespace FusionEngine
 	{
 		bool done = false;
 
-		std::tie(done, job->entitiesReadSoFar, job->cellDataStream) = ContinueReadingCell(
+		std::tie(done, job->entitiesReadSoFar) = ContinueReadingCell(
 			job->coord, the_cell_that_locks,
 			job->entitiesExpected, job->entitiesReadSoFar,
 			job->entityInTransit,
-			job->ids, std::move(job->cellDataStream),
+			job->ids, job->entityOffsets, job->cellData,
 			job->dataStyle);
 
-		FSN_ASSERT(job->entityInTransit || job->cellDataStream);
-
 		if (done && job->thereIsSyncedDataToReadNext) // but wait, there's more
 		{
-			if (!job->cellDataStream)
+			if (!job->cellData)
 				FSN_EXCEPT(FileSystemException, "This shit done broke");
 
 			done = false;
 			job->thereIsSyncedDataToReadNext = false;
 
-			std::tie(job->entitiesExpected, job->ids) = ReadCellIntro(job->coord, *job->cellDataStream, true, job->dataStyle);
+			std::tie(job->entitiesExpected, job->ids) = ReadCellIntro(job->coord, *job->cellData, true, job->dataStyle, &job->entityOffsets);
 			job->entitiesReadSoFar = 0;
 		}
 
 		return done;
 	}
 
+	void RegionCellArchivist::RequestCellData(const std::shared_ptr<ReadJob>& toRead)
+	{
+		using namespace EntitySerialisationUtils;
+
+		const CellCoord_t& cell_coord = toRead->coord;
+
+		const auto cell = toRead->cell.lock();
+		if (cell && cell->waiting == Cell::Retrieve && !cell->loaded)
+		{
+			AddHist(cell_coord, "Getting cell data stream");
+
+			// Create the sub-job for loading this map cell (unless there is no map, e.g. in generated worlds)
+			if (!m_EditMode && m_MapCache)
+			{
+				toRead->mapSubjob = std::make_shared<ReadJob>(toRead->cell, cell_coord);
+				toRead->mapSubjob->dataStyle = FastBinary; // Map data is always FastBinary
+			}
+
+			// Use the editable data cache in edit mode (the other cache is informally write-only to in this mode)
+			RegionCellCache* cache = m_EditMode ? m_EditableCache : m_Cache;
+			RegionCellCache* mapCache = toRead->mapSubjob ? m_MapCache : nullptr;
+
+			// The cached cell data (if available) is requested on the region strand, so it can't be read while
+			//  the region is being written to / defragmented (region files are read in place)
+			m_Workers->Post(GetRegionStrand(cell_coord), [this, cache, mapCache, toRead]()
+			{
+				using namespace std::placeholders;
+				const CellCoord_t& coord = toRead->coord;
+				cache->GetCellDataForReading(std::bind(&RegionCellArchivist::OnGotCellDataForReading, this, _1, toRead), coord.x, coord.y);
+				if (mapCache)
+					mapCache->GetCellDataForReading(std::bind(&RegionCellArchivist::OnGotCellDataForReading, this, _1, toRead->mapSubjob), coord.x, coord.y);
+			}, StrandedWorkerPool::High);
+		}
+		else
+			AddHist(cell_coord, "Aborting cell data stream retrieval (request canceled / already loaded)");
+	}
+
+	void RegionCellArchivist::RequestCellData(const std::vector<std::shared_ptr<ReadJob>>& jobs)
+	{
+		using namespace EntitySerialisationUtils;
+
+		typedef std::unordered_map<CellCoord_t, std::shared_ptr<ReadJob>, boost::hash<CellCoord_t>> JobsByCell_t;
+		auto batch = std::make_shared<JobsByCell_t>();
+		auto mapBatch = std::make_shared<JobsByCell_t>();
+		std::vector<CellCoord_t> cells;
+		cells.reserve(jobs.size());
+
+		for (auto it = jobs.begin(); it != jobs.end(); ++it)
+		{
+			const auto& toRead = *it;
+			const CellCoord_t& cell_coord = toRead->coord;
+
+			const auto cell = toRead->cell.lock();
+			if (cell && cell->waiting == Cell::Retrieve && !cell->loaded)
+			{
+				if (batch->find(cell_coord) != batch->end())
+				{
+					// Data can only be given to one job, so duplicate requests are made separately
+					RequestCellData(toRead);
+					continue;
+				}
+
+				AddHist(cell_coord, "Getting cell data stream");
+
+				batch->insert(std::make_pair(cell_coord, toRead));
+				cells.push_back(cell_coord);
+
+				// Create the sub-job for loading this map cell (unless there is no map, e.g. in generated worlds)
+				if (!m_EditMode && m_MapCache)
+				{
+					toRead->mapSubjob = std::make_shared<ReadJob>(toRead->cell, cell_coord);
+					toRead->mapSubjob->dataStyle = FastBinary; // Map data is always FastBinary
+
+					mapBatch->insert(std::make_pair(cell_coord, toRead->mapSubjob));
+				}
+			}
+			else
+				AddHist(cell_coord, "Aborting cell data stream retrieval (request canceled / already loaded)");
+		}
+
+		if (cells.empty())
+			return;
+
+		auto deliverTo = [this](const std::shared_ptr<JobsByCell_t>& jobs_by_cell)
+		{
+			return [this, jobs_by_cell](int32_t x, int32_t y, std::shared_ptr<CellData> cellData)
+			{
+				auto entry = jobs_by_cell->find(CellCoord_t(x, y));
+				if (entry != jobs_by_cell->end())
+					this->OnGotCellDataForReading(std::move(cellData), entry->second);
+			};
+		};
+
+		// Use the editable data cache in edit mode (the other cache is informally write-only to in this mode)
+		RegionCellCache* cache = m_EditMode ? m_EditableCache : m_Cache;
+		RegionCellCache* mapCache = mapBatch->empty() ? nullptr : m_MapCache;
+		const auto gotCellData = deliverTo(batch);
+		const auto gotMapCellData = deliverTo(mapBatch);
+
+		// The cells are requested on their region strands, so regions aren't read while they're being written
+		//  to / defragmented (each strand's cells are still requested together)
+		std::unordered_map<StrandedWorkerPool::StrandKey_t, std::vector<CellCoord_t>> cellsByStrand;
+		for (auto it = cells.begin(); it != cells.end(); ++it)
+			cellsByStrand[GetRegionStrand(*it)].push_back(*it);
+
+		for (auto it = cellsByStrand.begin(); it != cellsByStrand.end(); ++it)
+		{
+			const auto strandCells = std::move(it->second);
+			m_Workers->Post(it->first, [cache, mapCache, gotCellData, gotMapCellData, strandCells]()
+			{
+				cache->GetCellDataBatchForReading(gotCellData, strandCells, s_RegionPrefetchMargin);
+				if (mapCache)
+					mapCache->GetCellDataBatchForReading(gotMapCellData, strandCells, s_RegionPrefetchMargin);
+			}, StrandedWorkerPool::High);
+		}
+	}
+
 	void RegionCellArchivist::Run()
 	{
 		using namespace EntitySerialisationUtils;
@@ -912,7 +1409,14 @@ namespace FusionEngine
 			bool retrying = false;
 			while (true)
 			{
-				const int eventId = clan::Event::wait(m_Quit, m_TransactionEnded, m_NewData, retrying ? 100 : -1);
+				const int eventId = clan::Event::wait(m_Quit, m_TransactionEnded, m_NewData, retrying ? 100 : s_IdleDefragmentInterval);
+
+				// Collect the cells that the workers have finished with
+				{
+					CellCoord_t readyCell;
+					while (m_ReadyCells.try_pop(readyCell))
+						readyCells.push_back(readyCell);
+				}
 
 				if (eventId == 1) // TransactionEnded
 				{
@@ -926,425 +1430,582 @@ namespace FusionEngine
 						std::string saveName;
 						while (m_SaveQueue.try_pop(saveName))
 						{
-							PerformSave(saveName, [](bool, const std::string&){});
+							// Let writes that are in progress finish before the cache is copied
+							m_Workers->WaitForIdle();
+							if (m_SnapshotSaves)
+								PerformSnapshotSave(saveName, [](bool, const std::string&){});
+							else
+								PerformSave(saveName, [](bool, const std::string&){});
 						}
 						//m_Cache->EndSustain();
 						//m_EditableCache->EndSustain();
 					}
 
-					std::list<WriteQueue_t::value_type> writesToRetry;
-					std::list<ReadQueue_t::value_type> readsToRetry;
-
-					// Request cell data
+					// Request cell data (all at once, so requests that hit the same region are read together)
 					{
-						std::shared_ptr<ReadJob> toRead;
-						while (m_ReadQueueGetCellData.try_pop(toRead))
+						std::vector<std::shared_ptr<ReadJob>> toRead;
+						std::shared_ptr<ReadJob> job;
+						while (m_ReadQueueGetCellData.try_pop(job))
 						{
-							const CellCoord_t& cell_coord = toRead->coord;
+							toRead.push_back(job);
+						}
+						RequestCellData(toRead);
+					}
 
-							const auto cell = toRead->cell.lock();
-							if (cell && cell->waiting == Cell::Retrieve && !cell->loaded)
+					// Request prefetched cell data (a few at a time, and only while there are no normal requests waiting)
+					{
+						PrefetchJob toPrefetch;
+						std::vector<std::shared_ptr<ReadJob>> toRead;
+						while (toRead.size() < s_MaxPrefetchRequestsPerIteration && m_ReadQueueGetCellData.empty() && m_PrefetchQueue.try_pop(toPrefetch))
+						{
+							// Skip stale jobs (re-prioritised, promoted to normal requests, or canceled - canceled cells may
+							//  have been requested again since, so the job is also checked against the cell)
+							if (toPrefetch.cell.expired())
+								continue;
 							{
-								AddHist(cell_coord, "Getting cell data stream");
-
-								using namespace std::placeholders;
-								// Request the cached cell data (if available)
-								if (!m_EditMode)
-								{
-									m_Cache->GetCellStreamForReading(
-										std::bind(&RegionCellArchivist::OnGotCellStreamForReading, this, _1, toRead),
-										cell_coord.x, cell_coord.y);
-
-									// Create the sub-job for loading this map cell
-									toRead->mapSubjob = std::make_shared<ReadJob>(toRead->cell, cell_coord);
-									toRead->mapSubjob->dataStyle = FastBinary; // Map data is always FastBinary
-
-									m_MapCache->GetCellStreamForReading(
-										std::bind(&RegionCellArchivist::OnGotCellStreamForReading, this, std::placeholders::_1, toRead->mapSubjob),
-										cell_coord.x, cell_coord.y);
-								}
-								else
-								{
-									// Use the editable data cache in edit mode (the other cache is informally write-only to in this mode)
-									m_EditableCache->GetCellStreamForReading(
-										std::bind(&RegionCellArchivist::OnGotCellStreamForReading, this, _1, toRead),
-										cell_coord.x, cell_coord.y);
-								}
+								PendingPrefetchMap_t::accessor pending;
+								if (!m_PendingPrefetches.find(pending, toPrefetch.coord) || pending->second != toPrefetch.timeOfNeed)
+									continue;
+								m_PendingPrefetches.erase(pending);
 							}
-							else
-								AddHist(cell_coord, "Aborting cell data stream retrieval (request canceled / already loaded)");
+							toRead.push_back(std::make_shared<ReadJob>(toPrefetch.cell, toPrefetch.coord));
 						}
+						RequestCellData(toRead);
+						if (!m_PrefetchQueue.empty())
+							m_NewData.set();
 					}
 
-					// Read cell data
+					// Read cell data (posted at high priority, so the workers run these before any queued writes / updates)
 					{
-						// Keep archetype factory resources loaded during this stage
-						ArchetypeFactoryManager::Sustain();
-
 						std::shared_ptr<ReadJob> toRead;
 						while (m_ReadQueueLoadEntities.try_pop(toRead))
 						{
-							std::weak_ptr<Cell>& cellWpt = toRead->cell;
-							const CellCoord_t& cellCoord = toRead->coord;
-							if (auto cell = cellWpt.lock())
-							{
-								Cell::mutex_t::scoped_lock lock;
-								if (lock.try_acquire(cell->mutex))
-								{
-									StartJob(toRead, cell);
-									if (cell->waiting == Cell::Ready) // Sometimes there isn't much to do, and the job finishes immediately
-										readyCells.push_back(cellCoord);
-									else
-										m_NewData.set();
-								}
-								else
-								{
-#ifdef _DEBUG
-									std::stringstream str; str << cellCoord.x << "," << cellCoord.y;
-									SendToConsole("Retrying read on cell [" + str.str() + "]");
-#endif
-									AddHist(cellCoord, "Cell locked (will retry read later)");
-									readsToRetry.push_back(toRead);
-								}
-							}
+							m_Workers->Post(GetRegionStrand(toRead->coord), std::bind(&RegionCellArchivist::ProcessReadJob, this, toRead), StrandedWorkerPool::High);
+						}
+						while (m_IncommingCells.try_pop(toRead))
+						{
+							m_Workers->Post(GetRegionStrand(toRead->coord), std::bind(&RegionCellArchivist::ProcessIncommingJob, this, toRead), StrandedWorkerPool::High);
 						}
-
-						ArchetypeFactoryManager::EndSustain();
 					}
 
-					for (auto it = m_IncommingCells.begin(); it != m_IncommingCells.end();)
+					// Write cells (each cell is serialised & compressed on its own strand, then
+					//  written on the region strand - see ProcessWriteJob)
 					{
-						auto& job = *it;
-						if (auto lockedCell = job->cell.lock())
+						CellCoord_t coord;
+						while (m_WriteQueue.try_pop(coord))
 						{
-							Cell::mutex_t::scoped_lock lock;
-							if (lock.try_acquire(lockedCell->mutex))
+							std::weak_ptr<Cell> cell;
+							bool unloadWhenDone = false;
 							{
-								if (lockedCell->waiting == Cell::Retrieve)
-								{
-									try
-									{
-										bool done = ContinueJob(job, lockedCell);
-										// The map is a separate file so it can be processed in parallel (while the pseudo-entity / synced entity subsections of each cell must be processed serially)
-										bool mapDone = job->mapSubjob ? ContinueJob(job->mapSubjob, lockedCell) : true;
-
-										// Note that at this point it is possible for job->cellDataStream to be null (if it is still held by an entity-in-transit)
-
-										if (mapDone && done)
-										{
-											AddHist(job->coord, "Loaded", lockedCell->objects.size());
-											lockedCell->loaded = true;
-											lockedCell->waiting = Cell::Ready;
-
-											readyCells.push_back(job->coord);
-
-											it = m_IncommingCells.erase(it);
-										}
-										else
-										{
-											// Not done yet (check again soon)
-											m_NewData.set();
-											++it;
-										}
-									}
-									catch (Exception& ex)
-									{
-										AddHist(job->coord, "Failed to load entity data: " + ex.ToString());
-
-										lockedCell->waiting = Cell::Ready;
-										readyCells.push_back(job->coord);
-
-										it = m_IncommingCells.erase(it);
-									}
-								}
-								else
-								{
-									// The requester asked to store the cell, but it was never loaded so it can simply be marked ready
-									lockedCell->waiting = Cell::Ready;
-									readyCells.push_back(job->coord);
-
-									it = m_IncommingCells.erase(it);
-								}
+								PendingWriteMap_t::accessor pending;
+								if (!m_PendingWrites.find(pending, coord) || !pending->second.queued)
+									continue;
+								cell = pending->second.job.cell;
+								unloadWhenDone = pending->second.job.unloadWhenDone;
+								// Stores from here on queue another write
+								pending->second.queued = false;
+								++pending->second.inFlight;
 							}
+							m_Workers->Post(GetCellStrand(coord), [this, cell, coord, unloadWhenDone]() { this->ProcessWriteJob(cell, coord, unloadWhenDone); });
 						}
 					}
 
+					// Update inactive entities (normal priority, so new read jobs preempt update jobs)
 					{
-						WriteJob toWrite;
-						while (m_WriteQueue.try_pop(toWrite))
-						{
-							const std::weak_ptr<Cell>& cellWpt = toWrite.cell;
-							const auto& cell_coord = toWrite.coord;
-							const bool unload_when_done = toWrite.unloadWhenDone;
-							if (auto cell = cellWpt.lock()) // Make sure the queue item is valid
-							{
-								Cell::mutex_t::scoped_lock lock;
-								if (lock.try_acquire(cell->mutex))
-								{
-									// Check active_entries since the Store request may be stale
-									if (cell->waiting == Cell::Store && cell->loaded)
-									{
-										try
-										{
-											if (cell->active_entries != 0 && !m_EditMode)
-												AddLogEntry("Warning: writing cell with active entries");
-
-											FSN_ASSERT(cell->loaded == true); // Just in case I do something dumb
-
-											size_t numSynched = 0;
-											size_t numPseudo = 0;
-											std::for_each(cell->objects.begin(), cell->objects.end(), [&](const Cell::CellEntryMap::value_type& obj)
-											{
-												if (!obj.first->IsSyncedEntity())
-													++numPseudo;
-												else
-													++numSynched;
-											});
-
-											if (m_EditMode)
-											{
-												// The editable cache is used when saving / loading map data in the editor
-												//  (it contains additional information to make it more robust when dealing
-												//  with component script changes, etc.)
-												WriteCellDataForEditMode(m_EditableCache->GetCellStreamForWriting(cell_coord.x, cell_coord.y), cell_coord, cell, numPseudo, numSynched, EntitySerialisationUtils::EditableBinary);
-												// The normal cache is saved also so that this data can be used when compiling the map
-												WriteCellDataForEditMode(GetCellStreamForWriting(cell_coord.x, cell_coord.y), cell_coord, cell, numPseudo, numSynched, EntitySerialisationUtils::FastBinary);
-											}
-											else // Not EditMode
-											{
-												auto filePtr = GetCellStreamForWriting(cell_coord.x, cell_coord.y);
-												// Need a seekable stream, so write to a temp. one
-												//std::stringstream tempStream(std::ios::in | std::ios::out | std::ios::binary);
-												WriteCellData(*filePtr, cell_coord, cell.get(), numSynched, true, EntitySerialisationUtils::FastBinary);
-												//*filePtr << tempStream.rdbuf();
-											}
-
-											if (unload_when_done)
-											{
-												AddHist(cell_coord, "Written and cleared", m_EditMode ? cell->objects.size() : numSynched);
-
-												if (cell->active_entries != 0)
-													AddLogEntry("Warning: unloading active cell");
-												cell->objects.clear();
-												cell->loaded = false;
-											}
-											else
-												AddHist(cell_coord, "Written (not cleared, cell still active)", m_EditMode ? cell->objects.size() : numSynched);
-										}
-										catch (...)
-										{
-											std::stringstream str; str << cell_coord.x << "," << cell_coord.y;
-											std::string message = "Exception streaming out cell [" + str.str() + "]";
-											SendToConsole(message);
-											AddLogEntry(message);
-										}
-									}
-									else
-									{
-										std::stringstream str; str << cell_coord.x << "," << cell_coord.y;
-										SendToConsole("Cell write canceled: " + str.str());
-										AddHist(cell_coord, "Write canceled");
-										//writesToRetry.push_back(toWrite);
-									}
-									// The cell was written or the write was canceled - the cell is now "ready" for other operations
-									cell->waiting = Cell::Ready;
-									readyCells.push_back(cell_coord);
-								}
-								else
-								{
-#ifdef _DEBUG
-									std::stringstream str; str << cell_coord.x << "," << cell_coord.y;
-									SendToConsole("Retrying write on cell [" + str.str() + "]");
-#endif
-									AddHist(cell_coord, "Cell locked (will retry write later)");
-									writesToRetry.push_back(toWrite);
-								}
-							}
+						std::shared_ptr<UpdateJob> objectUpdateData;
+						while (m_ObjectUpdateQueue.try_pop(objectUpdateData))
+						{
+							CellCoord_t loc;
+							std::streamoff dataOffset;
+							std::streamsize dataLength;
+							if (!getEntityLocation(*m_EntityLocations, loc, dataOffset, dataLength, objectUpdateData->id))
+								continue; // This entity hasn't been stored (may have become active again since the update request was queued)
 
-							// Check for read requests (only write one cell at a time when there are read requests queued)
-							//  eventId 0 is m_Quit (don't let reads preempt writes when quiting / saving)
-							if (eventId != 0 && (!m_ReadQueueGetCellData.empty() || !m_ReadQueueLoadEntities.empty()))
+							const auto& new_loc = objectUpdateData->cellCoord;
+							const bool moving = objectUpdateData->operation == UpdateOperation::UPDATE && new_loc != CellCoord_t(std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max());
+
+							const auto strand = GetRegionStrand(loc);
+							if (moving && GetRegionStrand(new_loc) != strand)
 							{
-								m_NewData.set();
-								break;
+								// Moving an entity to another region modifies cells on two strands, so it is done here
+								//  once the workers are idle (this is rare: most updates are for entities that haven't moved far)
+								m_Workers->WaitForIdle();
+								ProcessUpdateJob(objectUpdateData);
 							}
+							else
+								m_Workers->Post(strand, std::bind(&RegionCellArchivist::ProcessUpdateJob, this, objectUpdateData));
 						}
 					}
 
-					// Re-enqueue blocked writes/reads
+					// Defragment region files a little at a time while there is nothing else to do
+					if (eventId == -1 && m_Workers->GetNumPendingJobs() == 0)
+					{
+						PostDefragmentJobs(m_Cache);
+						if (m_EditableCache)
+							PostDefragmentJobs(m_EditableCache);
+					}
+
+					// Persist entity location changes (the workers can keep storing locations while a checkpoint is written)
+					m_EntityLocations->FlushLog();
+					if (m_EntityLocations->NeedsCheckpoint())
+						m_EntityLocations->Checkpoint();
+
+					// Re-enqueue blocked writes/reads (these will be posted again after a short wait)
 					retrying = false;
-					if (!writesToRetry.empty())
 					{
-						retrying = true;
-						for (auto it = writesToRetry.begin(), end = writesToRetry.end(); it != end; ++it)
-							m_WriteQueue.push(*it);
-						writesToRetry.clear();
+						WriteJob toRetry;
+						while (m_WritesToRetry.try_pop(toRetry))
+						{
+							retrying = true;
+							// Queue the retry before ending the blocked write, so the cell doesn't become ready in between
+							EnqueueWrite(toRetry);
+							FinishWrite(toRetry.cell.lock(), toRetry.coord);
+						}
 					}
-					if (!readsToRetry.empty())
 					{
-						retrying = true;
-						for (auto it = readsToRetry.begin(), end = readsToRetry.end(); it != end; ++it)
-							m_ReadQueueLoadEntities.push(*it);
-						readsToRetry.clear();
+						std::shared_ptr<ReadJob> toRetry;
+						while (m_ReadsToRetry.try_pop(toRetry))
+						{
+							retrying = true;
+							m_ReadQueueLoadEntities.push(toRetry);
+						}
 					}
 
+					if (eventId == 0) // Quit
 					{
-						using namespace IO;
+						m_Workers->WaitForIdle();
 
-						std::shared_ptr<UpdateJob> objectUpdateData;
-						while (m_ObjectUpdateQueue.try_pop(objectUpdateData))
-						{
-							const ObjectID id = objectUpdateData->id;
-							const UpdateOperation operation = objectUpdateData->operation;
-							CellCoord_t new_loc = objectUpdateData->cellCoord;
-							auto& incommingConData = objectUpdateData->incommingConData;
-							auto& incommingOccData = objectUpdateData->incommingOccData;
+						CellCoord_t readyCell;
+						while (m_ReadyCells.try_pop(readyCell))
+							readyCells.push_back(readyCell);
+						ClearReadyCells(readyCells);
+						break;
+					}
+				}
+			}
+		}
+		catch (std::exception& ex)
+		{
+			SendToConsole(std::string() + "Unhandled exception in map loader thread: " + ex.what());
+			FSN_ASSERT_FAIL(std::string() + "Unhandled exception in map loader thread:" + ex.what());
+			// TODO: attempt to restart the thread after it exits here
+		}
+		catch (...)
+		{
+			SendToConsole("Unhandled & unknown exception in map loader thread.");
+			FSN_ASSERT_FAIL("Unhandled & unknown exception in map loader thread.");
+		}
+		asThreadCleanup();
+	}
 
-							CellCoord_t loc;
-							std::streamoff dataOffset;
-							std::streamsize dataLength;
-							if (!getEntityLocation(*m_EntityLocationDB, loc, dataOffset, dataLength, id))
-								continue; // This entity hasn't been stored (may have become active again since the update request was queued)
+	StrandedWorkerPool::StrandKey_t RegionCellArchivist::GetRegionStrand(const CellCoord_t& coord) const
+	{
+		// Round towards negative infinity, so each strand covers a whole region
+		const int32_t size = (int32_t)m_StrandRegionSize;
+		const int32_t x = coord.x >= 0 ? coord.x / size : (coord.x + 1) / size - 1;
+		const int32_t y = coord.y >= 0 ? coord.y / size : (coord.y + 1) / size - 1;
+		return (StrandedWorkerPool::StrandKey_t((uint32_t)x) << 32) | (uint32_t)y;
+	}
 
-							if (operation == UpdateOperation::REMOVE || new_loc == CellCoord_t(std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max()))
-								new_loc = loc;
+	StrandedWorkerPool::StrandKey_t RegionCellArchivist::GetCellStrand(const CellCoord_t& coord) const
+	{
+		// Scrambled so these don't share keys with the region strands (sharing a key would be harmless, but
+		//  would make writes wait for unrelated jobs)
+		const auto key = (StrandedWorkerPool::StrandKey_t((uint32_t)coord.x) << 32) | (uint32_t)coord.y;
+		return key ^ 0x9E3779B97F4A7C15ull;
+	}
 
-							// Skip if nothing has changed
-							if (operation != UpdateOperation::REMOVE && new_loc == loc && incommingConData.empty() && incommingOccData.empty())
-								continue;
+	void RegionCellArchivist::PostDefragmentJobs(RegionCellCache* cache)
+	{
+		const auto regions = cache->GetFragmentedRegions();
+		const size_t numJobs = std::min(regions.size(), s_MaxDefragmentJobsPerIteration);
+		for (size_t i = 0; i < numJobs; ++i)
+		{
+			const auto regionCoord = regions[i];
+			const CellCoord_t firstCell(regionCoord.x * cache->GetRegionSize(), regionCoord.y * cache->GetRegionSize());
+			m_Workers->Post(GetRegionStrand(firstCell), [cache, regionCoord]() { cache->DefragmentStep(regionCoord); });
+		}
+	}
 
-							// Request the existing cell data from the disc, is it isn't already available
-							if (!objectUpdateData->existingSourceCellDataStream)
-							{
-								GetCellStreamForReading([this, objectUpdateData](std::shared_ptr<std::istream> dataStream)
-								{
-									objectUpdateData->existingSourceCellDataStream = std::move(dataStream);
-									this->m_ObjectUpdateQueue.push(objectUpdateData);
-								}, loc.x, loc.y);
-								continue;
-							}
-							auto& inSourceData = objectUpdateData->existingSourceCellDataStream;
-							auto outDestData = GetCellStreamForWriting(new_loc.x, new_loc.y);
+	void RegionCellArchivist::DispatchLoadedCallbacksToStrands(RegionCellCache* cache, bool enable)
+	{
+		if (!cache)
+			return;
 
-							if (!inSourceData || !outDestData)
-								continue;
+		// Callbacks can only be kept in order with the rest of a region's jobs if the whole region is on one strand
+		const int32_t regionSize = cache->GetRegionSize();
+		if (enable && m_StrandRegionSize % (size_t)regionSize == 0)
+		{
+			cache->SetLoadedCallbackDispatcher([this, regionSize](const RegionCellCache::RegionCoord_t& region, const std::function<void ()>& fn)
+			{
+				const CellCoord_t firstCell(region.x * regionSize, region.y * regionSize);
+				m_Workers->Post(GetRegionStrand(firstCell), fn, StrandedWorkerPool::High);
+			});
+		}
+		else
+			cache->SetLoadedCallbackDispatcher(RegionCellCache::CallbackDispatcher_t());
+	}
 
-							// If the data is being moved there are some more streams that need to be prepared:
-							std::shared_ptr<std::istream> inDestData;
-							std::shared_ptr<std::ostream> outSourceData;
-							if (new_loc != loc)
-							{
-								if (!objectUpdateData->existingDestCellDataStream)
-								{
-									GetCellStreamForReading([this, objectUpdateData](std::shared_ptr<std::istream> dataStream)
-									{
-										objectUpdateData->existingDestCellDataStream = std::move(dataStream);
-										this->m_ObjectUpdateQueue.push(objectUpdateData);
-									}, new_loc.x, new_loc.y);
-									continue;
-								}
-								inDestData = std::move(objectUpdateData->existingDestCellDataStream);
-								outSourceData = GetCellStreamForWriting(loc.x, loc.y);
-							}
+	void RegionCellArchivist::ProcessReadJob(const std::shared_ptr<ReadJob>& toRead)
+	{
+		ScopedArchetypeSustain sustainArchetypes;
 
-							auto newDataLength = dataLength;
+		const CellCoord_t& cellCoord = toRead->coord;
+		if (auto cell = toRead->cell.lock())
+		{
+			Cell::mutex_t::scoped_lock lock;
+			if (lock.try_acquire(cell->mutex))
+			{
+				StartJob(toRead, cell);
+				if (cell->waiting == Cell::Ready) // Sometimes there isn't much to do, and the job finishes immediately
+				{
+					m_ReadyCells.push(cellCoord);
+					SignalCellLoaded(cellCoord.x, cellCoord.y);
+				}
+				m_NewData.set();
+			}
+			else
+			{
+#ifdef _DEBUG
+				std::stringstream str; str << cellCoord.x << "," << cellCoord.y;
+				SendToConsole("Retrying read on cell [" + str.str() + "]");
+#endif
+				AddHist(cellCoord, "Cell locked (will retry read later)");
+				m_ReadsToRetry.push(toRead);
+				m_NewData.set();
+			}
+		}
+	}
 
-							std::vector<ObjectID> displacedObjects;
-							std::vector<ObjectID> displacedObjectsBackward;
+	void RegionCellArchivist::ProcessIncommingJob(const std::shared_ptr<ReadJob>& job)
+	{
+		ScopedArchetypeSustain sustainArchetypes;
 
-							if (operation == UpdateOperation::UPDATE)
-							{
-								if (!incommingConData.empty() || !incommingOccData.empty())
-								{
-									RakNet::BitStream iConDataStream(incommingConData.data(), incommingConData.size(), false);
-									RakNet::BitStream iOccDataStream(incommingOccData.data(), incommingOccData.size(), false);
-
-									if (new_loc == loc)
-									{
-										// Note that outDest and inSource are re-used for both sets of in and out streams
-										newDataLength = MergeEntityData(displacedObjects, displacedObjectsBackward, id, dataOffset, dataLength, *inSourceData, *outDestData, *inSourceData, *outDestData, iConDataStream, iOccDataStream);
-									}
-									else
-									{
-										if (!outSourceData || !inDestData)
-											continue;
-										newDataLength = MergeEntityData(displacedObjects, displacedObjectsBackward, id, dataOffset, dataLength, *inSourceData, *outSourceData, *inDestData, *outDestData, iConDataStream, iOccDataStream);
-									}
-								}
-								else
-								{
-									if (!inSourceData || !outDestData || !outSourceData || !inDestData)
-										continue;
-
-									MoveEntityData(displacedObjectsBackward, id, dataOffset, dataLength, *inSourceData, *outSourceData, *inDestData, *outDestData);
-								}
-
-								storeEntityLocation(*m_EntityLocationDB, id, new_loc, dataOffset, dataLength);
-							}
-							else if (operation == UpdateOperation::REMOVE)
-							{
-								DeleteEntityData(displacedObjectsBackward, id, dataOffset, dataLength, *inSourceData, *outDestData);
+		if (auto lockedCell = job->cell.lock())
+		{
+			Cell::mutex_t::scoped_lock lock;
+			if (lock.try_acquire(lockedCell->mutex))
+			{
+				if (lockedCell->waiting == Cell::Retrieve)
+				{
+					try
+					{
+						bool done = ContinueJob(job, lockedCell);
+						// The map is a separate file so it can be processed in parallel (while the pseudo-entity / synced entity subsections of each cell must be processed serially)
+						bool mapDone = job->mapSubjob ? ContinueJob(job->mapSubjob, lockedCell) : true;
 
-								m_EntityLocationDB->remove((const char*)&id, sizeof(id));
-							}
+						if (mapDone && done)
+						{
+							AddHist(job->coord, "Loaded", lockedCell->objects.size());
+							lockedCell->loaded = true;
+							lockedCell->waiting = Cell::Ready;
 
-							// Update the offsets of entities affected by data getting longer / shorter
-							if (newDataLength != dataLength)
-							{
-								auto lengthDiff = newDataLength - dataLength;
-								for (auto it = displacedObjects.begin(), end = displacedObjects.end(); it != end; ++it)
-								{
-									ObjectID displaced_id = *it;
-
-									CellCoord_t displaced_loc;
-									std::streamoff displaced_dataOffset;
-									std::streamsize displaced_dataLength;
-									getEntityLocation(*m_EntityLocationDB, displaced_loc, displaced_dataOffset, displaced_dataLength, displaced_id);
-
-									storeEntityLocation(*m_EntityLocationDB, displaced_id, displaced_loc, displaced_dataOffset + lengthDiff, displaced_dataLength);
-								}
-							}
-							// Update the offsets of entities affected by data getting removed
-							for (auto it = displacedObjectsBackward.begin(), end = displacedObjectsBackward.end(); it != end; ++it)
-							{
-								ObjectID displaced_id = *it;
+							m_ReadyCells.push(job->coord);
+							SignalCellLoaded(job->coord.x, job->coord.y);
+						}
+						else
+						{
+							// Not done yet (check again soon)
+							m_IncommingCells.push(job);
+						}
+					}
+					catch (Exception& ex)
+					{
+						AddHist(job->coord, "Failed to load entity data: " + ex.ToString());
+
+						lockedCell->waiting = Cell::Ready;
+						m_ReadyCells.push(job->coord);
+						SignalCellLoaded(job->coord.x, job->coord.y);
+					}
+				}
+				else
+				{
+					// The requester asked to store the cell, but it was never loaded so it can simply be marked ready
+					lockedCell->waiting = Cell::Ready;
+					m_ReadyCells.push(job->coord);
+				}
+			}
+			else
+				m_IncommingCells.push(job); // Try again next time around
+			m_NewData.set();
+		}
+	}
+
+	struct RegionCellArchivist::SerialisedCell
+	{
+		std::weak_ptr<Cell> cell;
+		CellCoord_t coord;
+		RegionCellCache::CompressedCellData data;
+		// Edit-mode only: data for the editable cache
+		RegionCellCache::CompressedCellData editableData;
+		// Synched entities, to be stored in the entity location DB once the data is written
+		EntityDataPositions_t entityPositions;
+		// Set if the cell is to be unloaded once the data is written
+		bool unloadWhenDone;
+	};
+
+	void RegionCellArchivist::ProcessWriteJob(const std::weak_ptr<Cell>& cellWpt, const CellCoord_t& cell_coord, bool unload_when_done)
+	{
+		if (auto cell = cellWpt.lock()) // Make sure the queue item is valid
+		{
+			Cell::mutex_t::scoped_lock lock;
+			if (lock.try_acquire(cell->mutex))
+			{
+				// Check active_entries since the Store request may be stale
+				if (cell->waiting == Cell::Store && cell->loaded)
+				{
+					try
+					{
+						if (cell->active_entries != 0 && !m_EditMode)
+							AddLogEntry("Warning: writing cell with active entries");
 
-								CellCoord_t displaced_loc;
-								std::streamoff displaced_dataOffset;
-								std::streamsize displaced_dataLength;
-								getEntityLocation(*m_EntityLocationDB, displaced_loc, displaced_dataOffset, displaced_dataLength, displaced_id);
+						FSN_ASSERT(cell->loaded == true); // Just in case I do something dumb
 
-								storeEntityLocation(*m_EntityLocationDB, displaced_id, displaced_loc, displaced_dataOffset - dataLength, displaced_dataLength);
+						size_t numSynched = 0;
+						size_t numPseudo = 0;
+						std::for_each(cell->objects.begin(), cell->objects.end(), [&](const Cell::CellEntryMap::value_type& obj)
+						{
+							if (!obj.first->IsSyncedEntity())
+								++numPseudo;
+							else
+								++numSynched;
+						});
+
+						// The cell is serialised & compressed here (on the cell's strand, so many cells are
+						//  processed at once), and only written to the region file on the region strand
+						auto serialised = std::make_shared<SerialisedCell>();
+						serialised->cell = cellWpt;
+						serialised->coord = cell_coord;
+						serialised->unloadWhenDone = unload_when_done;
+
+						auto data = std::make_shared<SmartArrayDevice::DataArray_t>();
+						data->reserve(RegionFile::s_SectorSize);
+						if (m_EditMode)
+						{
+							// The editable cache is used when saving / loading map data in the editor
+							//  (it contains additional information to make it more robust when dealing
+							//  with component script changes, etc.)
+							{
+								bio::filtering_ostream stream;
+								stream.push(SmartArrayDevice(data));
+								WriteCellDataForEditMode(stream, cell_coord, cell, numPseudo, numSynched, EntitySerialisationUtils::EditableBinary);
 							}
+							serialised->editableData = m_EditableCache->CompressCellData(*data);
+							data->clear();
 
-							// New read jobs preempt update jobs
-							if (!m_ReadQueueLoadEntities.empty())
+							// The normal cache is saved also so that this data can be used when compiling the map
 							{
-								break;
+								bio::filtering_ostream stream;
+								stream.push(SmartArrayDevice(data));
+								serialised->entityPositions = WriteCellDataForEditMode(stream, cell_coord, cell, numPseudo, numSynched, EntitySerialisationUtils::FastBinary);
 							}
 						}
-					}
+						else // Not EditMode
+						{
+							bio::filtering_ostream stream;
+							stream.push(SmartArrayDevice(data));
+							serialised->entityPositions = WriteCellData(stream, cell_coord, cell.get(), numSynched, true, EntitySerialisationUtils::FastBinary);
+						}
+						serialised->data = m_Cache->CompressCellData(*data);
 
-					if (eventId == 0) // Quit
+						m_Workers->Post(GetRegionStrand(cell_coord), std::bind(&RegionCellArchivist::CommitWriteJob, this, serialised));
+
+						// The entries are kept until the data is written (so the cell isn't read back in from the old
+						//  data in the meantime), then the cell is cleared (if requested) and marked ready
+						if (unload_when_done)
+							AddHist(cell_coord, "Serialised (will be cleared once written)", m_EditMode ? cell->objects.size() : numSynched);
+						else
+							AddHist(cell_coord, "Serialised (not cleared, cell still active)", m_EditMode ? cell->objects.size() : numSynched);
+						return;
+					}
+					catch (...)
 					{
-						ClearReadyCells(readyCells);
-						break;
+						std::stringstream str; str << cell_coord.x << "," << cell_coord.y;
+						std::string message = "Exception streaming out cell [" + str.str() + "]";
+						SendToConsole(message);
+						AddLogEntry(message);
 					}
 				}
+				else
+				{
+					std::stringstream str; str << cell_coord.x << "," << cell_coord.y;
+					SendToConsole("Cell write canceled: " + str.str());
+					AddHist(cell_coord, "Write canceled");
+					//writesToRetry.push_back(toWrite);
+				}
+				// The write failed or was canceled
+				FinishWrite(cell, cell_coord);
+			}
+			else
+			{
+#ifdef _DEBUG
+				std::stringstream str; str << cell_coord.x << "," << cell_coord.y;
+				SendToConsole("Retrying write on cell [" + str.str() + "]");
+#endif
+				AddHist(cell_coord, "Cell locked (will retry write later)");
+				m_WritesToRetry.push(WriteJob(cellWpt, cell_coord, unload_when_done));
+				m_NewData.set();
 			}
 		}
-		catch (std::exception& ex)
+		else
+			FinishWrite(std::shared_ptr<Cell>(), cell_coord);
+	}
+
+	void RegionCellArchivist::CommitWriteJob(const std::shared_ptr<SerialisedCell>& serialised)
+	{
+		const auto& cell_coord = serialised->coord;
+		bool written = false;
+		try
 		{
-			SendToConsole(std::string() + "Unhandled exception in map loader thread: " + ex.what());
-			FSN_ASSERT_FAIL(std::string() + "Unhandled exception in map loader thread:" + ex.what());
-			// TODO: attempt to restart the thread after it exits here
+			const auto cellIndex = std::make_pair(cell_coord.x, cell_coord.y);
+			if (serialised->editableData.data)
+				m_EditableCache->WriteCompressedCellData(cellIndex, serialised->editableData);
+			m_Cache->WriteCompressedCellData(cellIndex, serialised->data);
+
+			// Update the entity location DB now that the data is in place (update jobs for these
+			//  entities run on this strand, so they won't see locations in data that isn't written yet)
+			StoreEntityLocations(cell_coord, serialised->entityPositions);
+
+			AddHist(cell_coord, "Written");
+			written = true;
 		}
 		catch (...)
 		{
-			SendToConsole("Unhandled & unknown exception in map loader thread.");
-			FSN_ASSERT_FAIL("Unhandled & unknown exception in map loader thread.");
+			std::stringstream str; str << cell_coord.x << "," << cell_coord.y;
+			std::string message = "Exception writing cell [" + str.str() + "]";
+			SendToConsole(message);
+			AddLogEntry(message);
+		}
+
+		// The cell was written - it is now "ready" for other operations (it is only unloaded if the
+		//  write succeeded, so the entities aren't lost)
+		const auto cell = serialised->cell.lock();
+		if (cell && serialised->unloadWhenDone && written)
+		{
+			Cell::mutex_t::scoped_lock lock(cell->mutex);
+			FinishWrite(cell, cell_coord, true);
+		}
+		else
+			FinishWrite(cell, cell_coord);
+	}
+
+	void RegionCellArchivist::ProcessUpdateJob(const std::shared_ptr<UpdateJob>& objectUpdateData)
+	{
+		using namespace IO;
+
+		const ObjectID id = objectUpdateData->id;
+		const UpdateOperation operation = objectUpdateData->operation;
+		CellCoord_t new_loc = objectUpdateData->cellCoord;
+		auto& incommingConData = objectUpdateData->incommingConData;
+		auto& incommingOccData = objectUpdateData->incommingOccData;
+
+		CellCoord_t loc;
+		std::streamoff dataOffset;
+		std::streamsize dataLength;
+		if (!getEntityLocation(*m_EntityLocations, loc, dataOffset, dataLength, id))
+			return; // This entity hasn't been stored (may have become active again since the update request was queued)
+
+		if (operation == UpdateOperation::REMOVE || new_loc == CellCoord_t(std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max()))
+			new_loc = loc;
+
+		// Skip if nothing has changed
+		if (operation != UpdateOperation::REMOVE && new_loc == loc && incommingConData.empty() && incommingOccData.empty())
+			return;
+
+		// Request the existing cell data from the disc, is it isn't already available
+		if (!objectUpdateData->existingSourceCellDataStream)
+		{
+			GetCellStreamForReading([this, objectUpdateData](std::shared_ptr<std::istream> dataStream)
+			{
+				objectUpdateData->existingSourceCellDataStream = std::move(dataStream);
+				this->m_ObjectUpdateQueue.push(objectUpdateData);
+				this->m_NewData.set();
+			}, loc.x, loc.y);
+			return;
+		}
+		auto& inSourceData = objectUpdateData->existingSourceCellDataStream;
+
+		// If the data is being moved the destination cell needs to be loaded too
+		const bool moving = new_loc != loc;
+		std::shared_ptr<std::istream> inDestData;
+		if (moving)
+		{
+			if (!objectUpdateData->existingDestCellDataStream)
+			{
+				GetCellStreamForReading([this, objectUpdateData](std::shared_ptr<std::istream> dataStream)
+				{
+					objectUpdateData->existingDestCellDataStream = std::move(dataStream);
+					this->m_ObjectUpdateQueue.push(objectUpdateData);
+					this->m_NewData.set();
+				}, new_loc.x, new_loc.y);
+				return;
+			}
+			inDestData = std::move(objectUpdateData->existingDestCellDataStream);
+		}
+
+		if (!inSourceData || (moving && !inDestData))
+			return;
+
+		ModifiableCell sourceCell, destCell;
+		if (!readModifiableCell(sourceCell, *inSourceData, loc, m_EditMode, *m_EntityLocations) ||
+			(moving && !readModifiableCell(destCell, *inDestData, new_loc, m_EditMode, *m_EntityLocations)))
+		{
+			AddLogEntry("Failed to update inactive entity: the cell data is invalid", LOG_NORMAL);
+			return;
+		}
+		auto& source = sourceCell.entities;
+		auto& dest = moving ? destCell.entities : sourceCell.entities;
+
+		const size_t slot = source.Find(id, (size_t)dataOffset);
+		if (slot == EntitySlotTable::s_NoSlot)
+		{
+			AddLogEntry("Failed to update inactive entity: it wasn't found in the cell it was stored in", LOG_NORMAL);
+			return;
+		}
+
+		// Only the updated entity's slot (and location record) change: the other entities in the cell aren't affected
+		if (operation == UpdateOperation::UPDATE)
+		{
+			std::vector<char> entityData;
+			if (!incommingConData.empty() || !incommingOccData.empty())
+			{
+				RakNet::BitStream iConDataStream(incommingConData.data(), incommingConData.size(), false);
+				RakNet::BitStream iOccDataStream(incommingOccData.data(), incommingOccData.size(), false);
+
+				bio::stream<bio::array_source> existingData(source.GetData(slot), source.GetSlot(slot).length);
+				bio::stream<bio::back_insert_device<std::vector<char>>> mergedData(entityData);
+				EntitySerialisationUtils::MergeEntityData(existingData, mergedData, iConDataStream, iOccDataStream);
+				mergedData.flush();
+			}
+			else
+				entityData.assign(source.GetData(slot), source.GetData(slot) + source.GetSlot(slot).length);
+
+			if (moving)
+				source.Remove(id, slot);
+			const size_t newSlot = dest.Put(id, entityData.data(), entityData.size(), moving ? size_t(EntitySlotTable::s_NoSlot) : slot);
+
+			storeEntityLocation(*m_EntityLocations, id, new_loc, std::streamoff(newSlot), std::streamsize(entityData.size()));
+		}
+		else if (operation == UpdateOperation::REMOVE)
+		{
+			source.Remove(id, slot);
+
+			m_EntityLocations->Remove(id);
+		}
+
+		// Every update rewrites the whole cell anyway, so this is the cheapest time to reclaim unused space
+		if (source.NeedsCompaction())
+			source.Compact();
+		if (moving && dest.NeedsCompaction())
+			dest.Compact();
+
+		if (auto outSourceData = GetCellStreamForWriting(loc.x, loc.y))
+			writeModifiableCell(*outSourceData, sourceCell, m_EditMode);
+		if (moving)
+		{
+			if (auto outDestData = GetCellStreamForWriting(new_loc.x, new_loc.y))
+				writeModifiableCell(*outDestData, destCell, m_EditMode);
 		}
-		asThreadCleanup();
 	}
 
 	void RegionCellArchivist::ClearReadyCells(std::list<CellCoord_t>& readyCells)
@@ -1374,56 +2035,71 @@ namespace FusionEngine
 		}
 	}
 
-	bool RegionCellArchivist::PerformSave(const std::string& saveName, const std::function<void (bool, const std::string&)> progress_notification)
+	std::string RegionCellArchivist::CreateSaveFolder(const std::string& saveName)
 	{
 		namespace bfs = boost::filesystem;
 
-		try
-		{
-			progress_notification(false, "Saving...");
+		auto savePath = boost::filesystem::path(PHYSFS_getWriteDir()) / m_SavePath / saveName;
 
-			auto savePath = boost::filesystem::path(PHYSFS_getWriteDir()) / m_SavePath / saveName;
+		auto physFsPath = m_SavePath + saveName;
 
-			auto physFsPath = m_SavePath + saveName;
-
-			// Remove any extraneous extensions
-			if (savePath.has_extension())
-			{
-				AddLogEntry("Save name " + saveName + " has an extension; save names should be folders, not files: the extension will be removed.", LOG_NORMAL);
-				savePath.replace_extension();
+		// Remove any extraneous extensions
+		if (savePath.has_extension())
+		{
+			AddLogEntry("Save name " + saveName + " has an extension; save names should be folders, not files: the extension will be removed.", LOG_NORMAL);
+			savePath.replace_extension();
 
-				physFsPath = m_SavePath + bfs::path(saveName).replace_extension().string();
-			}
+			physFsPath = m_SavePath + bfs::path(saveName).replace_extension().string();
+		}
 
-			SendToConsole("Saving to path: " + savePath.string());
-			AddLogEntry("Saving: " + savePath.string(), LOG_INFO);
+		SendToConsole("Saving to path: " + savePath.string());
+		AddLogEntry("Saving: " + savePath.string(), LOG_INFO);
 
-			if (!bfs::is_directory(savePath))
+		if (!bfs::is_directory(savePath))
+		{
+			if (PHYSFS_mkdir(physFsPath.c_str()) == 0)
 			{
-				if (PHYSFS_mkdir(physFsPath.c_str()) == 0)
-				{
-					FSN_EXCEPT(FileSystemException, "Failed to create save path (" + physFsPath + "): " + std::string(PHYSFS_getLastError()));
-				}
+				FSN_EXCEPT(FileSystemException, "Failed to create save path (" + physFsPath + "): " + std::string(PHYSFS_getLastError()));
 			}
-			else
+		}
+		else
+		{
+			try
 			{
-				try
-				{
-					PhysFSHelp::clear_folder(physFsPath + "/");
-				}
-				catch (FileSystemException& ex)
-				{
-					FSN_EXCEPT(FileSystemException, "Failed to clear save path: " + ex.GetDescription());
-				}
+				PhysFSHelp::clear_folder(physFsPath + "/");
 			}
-			FSN_ASSERT(bfs::is_directory(savePath));
-			FSN_ASSERT(bfs::is_empty(savePath));
-
-			if (m_EditableCache)
+			catch (FileSystemException& ex)
 			{
-				if (PHYSFS_mkdir((physFsPath + "/editable").c_str()) == 0)
-					FSN_EXCEPT(FileSystemException, "Failed to create save path (" + physFsPath + "/editable): " + std::string(PHYSFS_getLastError()));
+				FSN_EXCEPT(FileSystemException, "Failed to clear save path: " + ex.GetDescription());
 			}
+		}
+		FSN_ASSERT(bfs::is_directory(savePath));
+		FSN_ASSERT(bfs::is_empty(savePath));
+
+		if (m_EditableCache)
+		{
+			if (PHYSFS_mkdir((physFsPath + "/editable").c_str()) == 0)
+				FSN_EXCEPT(FileSystemException, "Failed to create save path (" + physFsPath + "/editable): " + std::string(PHYSFS_getLastError()));
+		}
+
+		return savePath.string();
+	}
+
+	bool RegionCellArchivist::PerformSave(const std::string& saveName, const std::function<void (bool, const std::string&)> progress_notification)
+	{
+		namespace bfs = boost::filesystem;
+
+		// The save folder may be the one that the last snapshot is being written to
+		WaitForSnapshotSave();
+
+		try
+		{
+			// Full saves copy the whole cache
+			WaitForLazyLoad();
+
+			progress_notification(false, "Saving...");
+
+			bfs::path savePath = CreateSaveFolder(saveName);
 
 			// Prevent unexpected writes (regions may have been queued to unload recently)
 			m_Cache->Sustain();
@@ -1468,6 +2144,17 @@ namespace FusionEngine
 				progress_notification(false, "Copying " + str.str() + " / " + numDataFilesStr + " data files");
 			});
 
+			// This is a full save, which later (incremental) saves can be based on
+			ArchivistSaveUtils::SaveInfo info;
+			info.id = ArchivistSaveUtils::CreateSaveId();
+			ArchivistSaveUtils::WriteSaveInfo(savePath, info);
+			m_Cache->MarkSaved();
+			if (m_EditableCache) m_EditableCache->MarkSaved();
+			{
+				std::lock_guard<std::mutex> lock(m_SaveChainMutex);
+				m_SaveChain.assign(1, std::make_pair(ArchivistSaveUtils::GetSaveFolderName(saveName), info.id));
+			}
+
 			// Allow regions to be unloaded
 			if (m_EditableCache) m_EditableCache->EndSustain();
 			m_Cache->EndSustain();
@@ -1493,9 +2180,254 @@ namespace FusionEngine
 			AddLogEntry(std::string("Quick-Save failed: ") + e.what(), LOG_CRITICAL);
 		}
 
+		{
+			std::lock_guard<std::mutex> lock(m_SaveChainMutex);
+			m_SaveChain.clear();
+		}
+
 		return false;
 	}
 
+	bool RegionCellArchivist::PerformSnapshotSave(const std::string& saveName, const std::function<void (bool, const std::string&)> progress_notification)
+	{
+		namespace bfs = boost::filesystem;
+
+		// Only one snapshot is written at a time
+		WaitForSnapshotSave();
+
+		try
+		{
+			progress_notification(false, "Saving...");
+
+			// Only the changes since the last save are written, if that save can be the base of this one
+			//  (and the chain, including this save, won't be longer than the max)
+			const std::string name = ArchivistSaveUtils::GetSaveFolderName(saveName);
+			SaveChain_t saveChain;
+			{
+				std::lock_guard<std::mutex> lock(m_SaveChainMutex);
+				saveChain = m_SaveChain;
+			}
+			bool incremental = m_IncrementalSaves && !saveChain.empty() && saveChain.size() < m_MaxSaveChainLength;
+			for (auto it = saveChain.begin(); it != saveChain.end() && incremental; ++it)
+				incremental = it->first != name;
+
+			// Region files that haven't been copied from a lazily loaded save are unchanged, so
+			//  incremental saves can leave them out, but full saves need them: they're copied into
+			//  the cache by the snapshot thread (rather than waiting for them here)
+			std::vector<std::shared_ptr<LazyLoadOverlay>> overlays;
+			if (!incremental)
+			{
+				std::lock_guard<std::mutex> lock(m_LazyLoadMutex);
+				overlays = m_LazyLoadOverlays;
+			}
+
+			const bfs::path savePath = CreateSaveFolder(saveName);
+
+			ArchivistSaveUtils::SaveInfo info;
+			info.id = ArchivistSaveUtils::CreateSaveId();
+			if (incremental)
+			{
+				info.base = saveChain.front().first;
+				info.baseId = saveChain.front().second;
+			}
+			ArchivistSaveUtils::WriteSaveInfo(savePath, info);
+
+			// Custom data files are small, so they are just copied now
+			{
+				std::vector<bfs::path> dataFiles;
+				std::set<std::string> extensions;
+				extensions.insert(".dat");
+				ArchivistSaveUtils::FindWithExtensions(dataFiles, bfs::path(m_FullBasePath), extensions);
+				ArchivistSaveUtils::CopyCacheFiles(m_FullBasePath, dataFiles, savePath, [](unsigned int) {});
+			}
+
+			// The region files and entity locations are frozen as they are now, then written in the
+			//  background while the cache keeps being used (region files are only copied into memory
+			//  if they're modified before they are written)
+			std::vector<std::shared_ptr<RegionSnapshot>> snapshots;
+			snapshots.push_back(m_Cache->BeginSnapshot(savePath.string(), incremental));
+			if (m_EditableCache)
+				snapshots.push_back(m_EditableCache->BeginSnapshot((savePath / "editable").string(), incremental));
+			auto entityLocations = std::make_shared<EntityLocationIndex::Entries_t>(m_EntityLocations->GetEntries());
+			const std::string entityLocationsPath = (savePath / "entitylocations.kc").string();
+
+			if (!incremental)
+				saveChain.clear();
+			saveChain.insert(saveChain.begin(), std::make_pair(name, info.id));
+			{
+				std::lock_guard<std::mutex> lock(m_SaveChainMutex);
+				m_SaveChain = saveChain;
+			}
+
+			m_SnapshotThread = std::thread([this, snapshots, overlays, entityLocations, entityLocationsPath, progress_notification]()
+			{
+				bool written = false;
+				try
+				{
+					if (!overlays.empty())
+					{
+						progress_notification(false, "Copying region files from the loaded save");
+						for (auto it = overlays.begin(); it != overlays.end(); ++it)
+							(*it)->FaultInAll(m_CancelLazyLoad);
+					}
+
+					size_t numPreserved = 0, numDeltas = 0;
+					for (auto it = snapshots.begin(); it != snapshots.end(); ++it)
+					{
+						const auto& snapshot = *it;
+						std::stringstream numStr; numStr << snapshot->GetNumFiles();
+						const std::string numRegionFilesStr = numStr.str();
+
+						unsigned int fileNum = 0;
+						while (snapshot->WriteNext())
+						{
+							std::stringstream str; str << ++fileNum;
+							progress_notification(false, "Writing " + str.str() + " / " + numRegionFilesStr + " regions");
+						}
+						numPreserved += snapshot->GetNumPreserved();
+						numDeltas += snapshot->GetNumDeltas();
+					}
+
+					progress_notification(false, "Writing entitylocations.kc");
+					EntityLocationIndex::WriteSnapshot(entityLocationsPath, *entityLocations);
+
+					std::stringstream str; str << numPreserved << " region files were modified while it was being written, " << numDeltas << " were written as deltas";
+					AddLogEntry("Snapshot written (" + str.str() + ")", LOG_INFO);
+
+					progress_notification(true, "Done Saving");
+					written = true;
+				}
+				catch (std::exception& e)
+				{
+					progress_notification(true, "Save Failed");
+
+					AddLogEntry(std::string("Quick-Save failed: ") + e.what(), LOG_CRITICAL);
+				}
+
+				// The next save can't be based on this one (m_SaveChain is only used for saves after waiting for this thread)
+				if (!written)
+				{
+					std::lock_guard<std::mutex> lock(m_SaveChainMutex);
+					m_SaveChain.clear();
+				}
+
+				m_Cache->EndSnapshot();
+				if (m_EditableCache)
+					m_EditableCache->EndSnapshot();
+			});
+
+			return true;
+		}
+		catch (std::exception& e)
+		{
+			progress_notification(true, "Save Failed");
+
+			AddLogEntry(std::string("Quick-Save failed: ") + e.what(), LOG_CRITICAL);
+		}
+
+		m_Cache->EndSnapshot();
+		if (m_EditableCache)
+			m_EditableCache->EndSnapshot();
+		{
+			std::lock_guard<std::mutex> lock(m_SaveChainMutex);
+			m_SaveChain.clear();
+		}
+
+		return false;
+	}
+
+	void RegionCellArchivist::WaitForSnapshotSave()
+	{
+		if (m_SnapshotThread.joinable())
+			m_SnapshotThread.join();
+	}
+
+	std::shared_ptr<LazyLoadOverlay> RegionCellArchivist::createLazyLoadOverlay(const std::vector<SaveLocation>& saves, const std::string& sub_path, const std::string& cache_path)
+	{
+		namespace bfs = boost::filesystem;
+
+		// List the region files in the given sub-folder of each save
+		std::set<std::string> filenames;
+		auto addFile = [&filenames](const bfs::path& file)
+		{
+			const auto regionFilename = LazyLoadOverlay::GetRegionFilename(file.filename().string());
+			if (!regionFilename.empty())
+				filenames.insert(regionFilename);
+		};
+		for (auto it = saves.begin(); it != saves.end(); ++it)
+		{
+			if (it->archived)
+			{
+				const auto sourcePath = bfs::path(it->physPath) / sub_path;
+				auto fileList = PHYSFS_enumerateFiles(sourcePath.generic_string().c_str());
+				for (auto file = fileList; *file; ++file)
+					addFile(bfs::path(*file));
+				PHYSFS_freeList(fileList);
+			}
+			else
+			{
+				const auto sourcePath = bfs::path(it->nativePath) / sub_path;
+				if (bfs::is_directory(sourcePath))
+				{
+					for (bfs::directory_iterator file(sourcePath); file != bfs::directory_iterator(); ++file)
+						addFile(file->path());
+				}
+			}
+		}
+
+		auto openFile = [this, saves](size_t save_index, const std::string& relative_path)
+		{
+			return openSaveFile(saves[save_index], relative_path);
+		};
+		return std::make_shared<LazyLoadOverlay>(saves.size(), openFile, std::vector<std::string>(filenames.begin(), filenames.end()), sub_path, cache_path);
+	}
+
+	void RegionCellArchivist::WaitForLazyLoad()
+	{
+		// Only one thread finishes the load: any others wait here, then find that there's nothing left to do
+		std::lock_guard<std::mutex> lock(m_LazyLoadMutex);
+
+		if (m_LazyLoadThread.joinable())
+			m_LazyLoadThread.join();
+
+		// Anything the background thread didn't get to (e.g. if it failed) is copied now
+		for (auto it = m_LazyLoadOverlays.begin(); it != m_LazyLoadOverlays.end(); ++it)
+			(*it)->FaultInAll(m_CancelLazyLoad);
+
+		endLazyLoad();
+	}
+
+	bool RegionCellArchivist::cancelLazyLoad()
+	{
+		std::lock_guard<std::mutex> lock(m_LazyLoadMutex);
+
+		const bool loading = !m_LazyLoadSaves.empty();
+
+		m_CancelLazyLoad = true;
+		if (m_LazyLoadThread.joinable())
+			m_LazyLoadThread.join();
+		m_CancelLazyLoad = false;
+
+		endLazyLoad();
+
+		return loading;
+	}
+
+	void RegionCellArchivist::endLazyLoad()
+	{
+		if (m_LazyLoadOverlays.empty() && m_LazyLoadSaves.empty())
+			return;
+
+		m_Cache->SetOverlay(std::shared_ptr<RegionCacheOverlay>());
+		if (m_EditableCache)
+			m_EditableCache->SetOverlay(std::shared_ptr<RegionCacheOverlay>());
+		m_LazyLoadOverlays.clear();
+
+		for (auto it = m_LazyLoadSaves.begin(); it != m_LazyLoadSaves.end(); ++it)
+			closeSave(*it);
+		m_LazyLoadSaves.clear();
+	}
+
 	void getArchiveFileList(std::vector<boost::filesystem::path>& results, const boost::filesystem::path& path, const std::string& ext)
 	{
 		namespace bfs = boost::filesystem;
@@ -1531,58 +2463,198 @@ namespace FusionEngine
 			for (bfs::directory_iterator it(nextPath); it != bfs::directory_iterator(); ++it)
 			{
 				if (bfs::is_directory(*it))
-					results.push_back(it->path());
+					toProcess.push_back(it->path());
 				else if (it->path().extension() == ext)
-					toProcess.push_back(*it);
+					results.push_back(it->path());
 			}
 			toProcess.pop_front();
 		}
 	}
 
-	void copyArchivedFiles(const boost::filesystem::path& source_path, std::vector<boost::filesystem::path>& files, const boost::filesystem::path& target_path)
+	void copyArchivedFiles(const boost::filesystem::path& source_path, std::vector<boost::filesystem::path>& files, const boost::filesystem::path& target_path)
+	{
+		namespace bfs = boost::filesystem;
+
+		std::stringstream numStr; numStr << files.size();
+		std::string numDataFilesStr = numStr.str();
+		unsigned int i = 0;
+		for (auto it = files.begin(); it != files.end(); ++it)
+		{
+			std::stringstream str; str << ++i;
+			SendToConsole("Load Progress: copying " + str.str() + " / " + numDataFilesStr + " data files");
+
+			auto dest = target_path / make_relative(source_path, *it);
+			PhysFSHelp::copy_file(it->generic_string(), dest.generic_string());
+		}
+	}
+
+	void copyNativeFiles(const boost::filesystem::path& source_path, std::vector<boost::filesystem::path>& files, const boost::filesystem::path& target_path, const std::function<void (size_t, size_t)>& callback)
+	{
+		namespace bfs = boost::filesystem;
+
+		std::stringstream numStr; numStr << files.size();
+		std::string numDataFilesStr = numStr.str();
+		unsigned int i = 0;
+		for (auto it = files.begin(); it != files.end(); ++it)
+		{
+			std::stringstream str; str << ++i;
+			SendToConsole("Load Progress: copying " + str.str() + " / " + numDataFilesStr + " data files");
+			if (callback)
+				callback(i, files.size());
+
+			auto dest = target_path / make_relative(source_path, *it);
+			boost::filesystem::copy_file(*it, dest, bfs::copy_option::overwrite_if_exists);
+		}
+	}
+
+	void RegionCellArchivist::PrepareLoad(const std::string& saveName)
+	{
+	}
+
+	bool RegionCellArchivist::openSave(const std::string& saveName, SaveLocation& location)
+	{
+		namespace bfs = boost::filesystem;
+
+		auto physSavePath = bfs::path("/" + m_SavePath) / saveName;
+		auto savePath = bfs::path(PHYSFS_getWriteDir()) / physSavePath;
+
+		auto archivePath = PHYSFS_getWriteDir() / physSavePath;
+		if (!archivePath.has_extension())
+			archivePath.replace_extension(".zip");
+		else
+			physSavePath.replace_extension();
+		auto archiveMountpoint = physSavePath.parent_path();
+		archivePath.make_preferred();
+
+		location.name = ArchivistSaveUtils::GetSaveFolderName(saveName);
+		location.physPath = physSavePath.generic_string();
+		location.nativePath = savePath.string();
+		location.archivePath = archivePath.string();
+
+		// Try to mount a save archive with the given name
+		location.archived = bfs::exists(archivePath) && PHYSFS_mount(archivePath.string().c_str(), archiveMountpoint.generic_string().c_str(), 1);
+
+		return location.archived || (bfs::is_directory(savePath) && !bfs::is_empty(savePath));
+	}
+
+	void RegionCellArchivist::closeSave(const SaveLocation& location)
+	{
+		if (location.archived)
+		{
+			int r = PHYSFS_removeFromSearchPath(location.archivePath.c_str());
+			FSN_ASSERT(r != 0);
+		}
+	}
+
+	std::unique_ptr<std::istream> RegionCellArchivist::openSaveFile(const SaveLocation& location, const std::string& relative_path)
 	{
 		namespace bfs = boost::filesystem;
 
-		std::stringstream numStr; numStr << files.size();
-		std::string numDataFilesStr = numStr.str();
-		unsigned int i = 0;
-		for (auto it = files.begin(); it != files.end(); ++it)
+		if (location.archived)
 		{
-			std::stringstream str; str << ++i;
-			SendToConsole("Load Progress: copying " + str.str() + " / " + numDataFilesStr + " data files");
-
-			auto dest = target_path / make_relative(source_path, *it);
-			PhysFSHelp::copy_file(it->generic_string(), dest.generic_string());
+			const auto path = (bfs::path(location.physPath) / relative_path).generic_string();
+			if (PHYSFS_exists(path.c_str()) == 0)
+				return std::unique_ptr<std::istream>();
+			return std::unique_ptr<std::istream>(new IO::PhysFSStream(path, IO::Read));
+		}
+		else
+		{
+			const auto path = bfs::path(location.nativePath) / relative_path;
+			if (!bfs::exists(path))
+				return std::unique_ptr<std::istream>();
+			return std::unique_ptr<std::istream>(new bfs::ifstream(path, std::ios::in | std::ios::binary));
 		}
 	}
 
-	void copyNativeFiles(const boost::filesystem::path& source_path, std::vector<boost::filesystem::path>& files, const boost::filesystem::path& target_path, const std::function<void (size_t, size_t)>& callback)
+	void RegionCellArchivist::copySaveFiles(const SaveLocation& location, const std::string& target_path, const std::string& phys_target_path, size_t depth, SaveChain_t& chain, std::vector<SaveLocation>* lazy_saves)
 	{
 		namespace bfs = boost::filesystem;
 
-		std::stringstream numStr; numStr << files.size();
-		std::string numDataFilesStr = numStr.str();
-		unsigned int i = 0;
-		for (auto it = files.begin(); it != files.end(); ++it)
+		FSN_ASSERT(chain.size() == depth);
+
+		const bfs::path sourcePath = location.archived ? bfs::path(location.physPath) : bfs::path(location.nativePath);
+
+		ArchivistSaveUtils::SaveInfo info;
+		if (auto infoFile = openSaveFile(location, ArchivistSaveUtils::s_SaveInfoFilename))
+			info = ArchivistSaveUtils::ReadSaveInfo(*infoFile);
+		chain.push_back(std::make_pair(location.name, info.id));
+
+		// Incremental saves are applied over the save that they're based on
+		if (!info.base.empty())
 		{
-			std::stringstream str; str << ++i;
-			SendToConsole("Load Progress: copying " + str.str() + " / " + numDataFilesStr + " data files");
-			if (callback)
-				callback(i, files.size());
+			if (depth >= ArchivistSaveUtils::s_MaxSaveChainDepth)
+				FSN_EXCEPT(FileSystemException, "Too many saves lead up to " + location.name + " (they may refer to each other)");
 
-			auto dest = target_path / make_relative(source_path, *it);
-			boost::filesystem::copy_file(*it, dest, bfs::copy_option::overwrite_if_exists);
+			SaveLocation base;
+			if (!openSave(info.base, base))
+				FSN_EXCEPT(FileSystemException, "The save that " + location.name + " is based on (" + info.base + ") doesn't exist");
+			try
+			{
+				copySaveFiles(base, target_path, phys_target_path, depth + 1, chain, lazy_saves);
+			}
+			catch (...)
+			{
+				closeSave(base);
+				throw;
+			}
+			if (lazy_saves)
+				lazy_saves->push_back(base);
+			else
+				closeSave(base);
+
+			if (chain[depth + 1].second != info.baseId)
+				FSN_EXCEPT(FileSystemException, "The save that " + location.name + " is based on (" + info.base + ") has been overwritten since " + location.name + " was saved");
 		}
-	}
 
-	void RegionCellArchivist::PrepareLoad(const std::string& saveName)
-	{
+		SendToConsole("Loading: copying " + location.name);
+
+		// Copy saved custom-data files and region files
+		std::vector<bfs::path> files;
+		if (location.archived)
+		{
+			getArchiveFileList(files, sourcePath, ".dat");
+			if (!lazy_saves)
+				getArchiveFileList(files, sourcePath, ".celldata");
+			copyArchivedFiles(sourcePath, files, phys_target_path);
+		}
+		else
+		{
+			getNativeFileList(files, sourcePath, ".dat");
+			if (!lazy_saves)
+				getNativeFileList(files, sourcePath, ".celldata");
+			copyNativeFiles(sourcePath, files, target_path, [](size_t, size_t)
+			{
+			});
+		}
+
+		// Region files are copied as they're needed
+		if (lazy_saves)
+			return;
+
+		// Apply the changes to the region files that were in the base save
+		std::vector<bfs::path> deltaFiles;
+		if (location.archived)
+			getArchiveFileList(deltaFiles, sourcePath, RegionSnapshot::s_DeltaExtension);
+		else
+			getNativeFileList(deltaFiles, sourcePath, RegionSnapshot::s_DeltaExtension);
+		for (auto it = deltaFiles.begin(); it != deltaFiles.end(); ++it)
+		{
+			auto regionFile = bfs::path(target_path) / make_relative(sourcePath, *it);
+			regionFile.replace_extension(".celldata");
+
+			auto delta = openSaveFile(location, make_relative(sourcePath, *it).generic_string());
+			FSN_ASSERT(delta);
+			RegionSnapshot::ApplyDelta(*delta, regionFile);
+		}
 	}
 
 	void RegionCellArchivist::PerformLoad(const std::string& saveName)
 	{
 		namespace bfs = boost::filesystem;
 
+		// The save being loaded may still be being written
+		WaitForSnapshotSave();
+
 		// TODO: replace all SendToConsole calls with signals
 		{
 			std::lock_guard<std::mutex> lock(m_SaveToLoadMutex);
@@ -1600,24 +2672,18 @@ namespace FusionEngine
 			m_SaveToLoad = saveName;
 		}
 
-		auto physSavePath = bfs::path("/" + m_SavePath) / saveName;
-		auto savePath = bfs::path(PHYSFS_getWriteDir()) / physSavePath;
-
-		auto archivePath = PHYSFS_getWriteDir() / physSavePath;
-		if (!archivePath.has_extension())
-			archivePath.replace_extension(".zip");
-		else
-			physSavePath.replace_extension();
-		auto archiveMountpoint = physSavePath.parent_path();
-		archivePath.make_preferred();
+		SaveLocation save;
+		const bool exists = openSave(saveName, save);
+		bool lazyLoading = false;
 
-		// Try to mount a save archive with the given name
-		bool archived = bfs::exists(archivePath) && PHYSFS_mount(archivePath.string().c_str(), archiveMountpoint.generic_string().c_str(), 1);
+		const bool archived = save.archived;
+		const bfs::path physSavePath = save.physPath;
+		const bfs::path savePath = save.nativePath;
 
 		if (!archived)
 			SendToConsole("Load Path: " + savePath.string());
 		else
-			SendToConsole("Load Path: " + physSavePath.string() + ", in archive: " + archivePath.string());
+			SendToConsole("Load Path: " + physSavePath.string() + ", in archive: " + save.archivePath);
 
 		//if (archived)
 		//{
@@ -1648,7 +2714,7 @@ namespace FusionEngine
 		//	}
 		//}
 
-		if (!archived && (!bfs::is_directory(savePath) || bfs::is_empty(savePath)))
+		if (!exists)
 		{
 			SendToConsole("Load Failed: save doesn't exist");
 			AddLogEntry("Failed to load save: either " + savePath.string() + " doesn't exist or there was an error"
@@ -1660,11 +2726,24 @@ namespace FusionEngine
 		if (threadRunning)
 			Stop();
 
+		// The region files that haven't been copied from the last save that was loaded lazily are
+		//  about to be replaced anyway (that save may be the one being loaded, so it's opened again
+		//  after being unmounted)
+		if (cancelLazyLoad())
+			openSave(saveName, save);
+
 		// Just to be safe
 		m_CellsBeingProcessed.clear();
 		m_ReadQueueGetCellData.clear();
 		m_ReadQueueLoadEntities.clear();
+		m_PrefetchQueue.clear();
+		m_PendingPrefetches.clear();
 		m_WriteQueue.clear();
+		m_PendingWrites.clear();
+		m_IncommingCells.clear();
+		m_ReadyCells.clear();
+		m_WritesToRetry.clear();
+		m_ReadsToRetry.clear();
 
 		// Everything needs to reload after this
 		m_SynchLoaded.clear();
@@ -1674,11 +2753,17 @@ namespace FusionEngine
 		if (m_EditableCache)
 			m_EditableCache->DropCache();
 
-		// Unload the location DB
-		std::string cacheDbPath = m_EntityLocationDB->path();
+		// Unload the location DB (it's replaced by the saved one)
+		std::string cacheDbPath = m_EntityLocations->GetPath();
 		if (cacheDbPath.empty())
 			cacheDbPath = m_FullBasePath + "entitylocations.kc";
-		m_EntityLocationDB.reset();
+		m_EntityLocations->Close(false);
+
+		// There's no save to base the next one on unless this one loads
+		{
+			std::lock_guard<std::mutex> lock(m_SaveChainMutex);
+			m_SaveChain.clear();
+		}
 
 		// Delete the cache files
 		try
@@ -1720,39 +2805,76 @@ namespace FusionEngine
 			}
 			SendToConsole("Loading: done copying entitylocations.kc");
 
-			// Copy saved custom-data files
-			std::vector<bfs::path> dataFiles;
-			if (archived)
-			{
-				getArchiveFileList(dataFiles, physSavePath, ".dat");
-				copyArchivedFiles(physSavePath, dataFiles, m_CachePath);
-			}
-			else
+			// Reload the location DB
+			m_EntityLocations->Open(cacheDbPath);
+
+			// Copy saved custom-data files and region files (if this is an incremental save, the
+			//  saves that it's based on are copied first)
+			SaveChain_t chain;
+			if (m_LazyLoading)
 			{
-				getNativeFileList(dataFiles, savePath, ".dat");
-				copyNativeFiles(savePath, dataFiles, m_FullBasePath, [](size_t, size_t)
+				// The saves stay mounted, and the caches copy region files from them as they're needed
+				std::vector<SaveLocation> lazySaves;
+				try
 				{
-				});
-			}
+					copySaveFiles(save, m_FullBasePath, m_CachePath, 0, chain, &lazySaves);
+				}
+				catch (...)
+				{
+					for (auto it = lazySaves.begin(); it != lazySaves.end(); ++it)
+						closeSave(*it);
+					throw;
+				}
+				lazySaves.push_back(save);
+				lazyLoading = true;
 
-			// Reload the location DB
-			m_EntityLocationDB.reset(new kyotocabinet::HashDB);
-			setupTuning(m_EntityLocationDB.get());
-			m_EntityLocationDB->open(cacheDbPath, kyotocabinet::HashDB::OWRITER);
+				std::lock_guard<std::mutex> lock(m_LazyLoadMutex);
+				m_LazyLoadSaves = lazySaves;
 
-			std::vector<bfs::path> regionFiles;
-			if (archived)
-			{
-				getArchiveFileList(regionFiles, physSavePath, ".celldata");
-				copyArchivedFiles(physSavePath, regionFiles, m_CachePath);
+				m_LazyLoadOverlays.push_back(createLazyLoadOverlay(m_LazyLoadSaves, "", m_FullBasePath));
+				m_Cache->SetOverlay(m_LazyLoadOverlays.back());
+				if (m_EditableCache)
+				{
+					m_LazyLoadOverlays.push_back(createLazyLoadOverlay(m_LazyLoadSaves, "editable", m_FullBasePath + "editable/"));
+					m_EditableCache->SetOverlay(m_LazyLoadOverlays.back());
+				}
 			}
 			else
+				copySaveFiles(save, m_FullBasePath, m_CachePath, 0, chain);
+
+			// Changes are tracked from here, so the next save can be based on this one
+			m_Cache->MarkSaved();
+			if (m_EditableCache)
+				m_EditableCache->MarkSaved();
+			{
+				std::lock_guard<std::mutex> lock(m_SaveChainMutex);
+				m_SaveChain = chain;
+			}
+
+			// The rest of the region files are copied in the background
+			if (lazyLoading)
 			{
-				getNativeFileList(regionFiles, savePath, ".celldata");
-				copyNativeFiles(savePath, regionFiles, m_FullBasePath, [](size_t, size_t)
+				std::lock_guard<std::mutex> lock(m_LazyLoadMutex);
+				auto overlays = m_LazyLoadOverlays;
+				m_LazyLoadThread = std::thread([this, overlays]()
 				{
-					//SendToConsole("Load Progress: copying " + str.str() + " / " + numDataFilesStr + " region files");
+					try
+					{
+						for (auto it = overlays.begin(); it != overlays.end(); ++it)
+							(*it)->FaultInAll(m_CancelLazyLoad);
+						if (!m_CancelLazyLoad)
+							AddLogEntry("Finished copying the region files from the loaded save", LOG_INFO);
+					}
+					catch (bfs::filesystem_error& e)
+					{
+						AddLogEntry(std::string("Failed to copy region files from the loaded save: ") + e.what(), LOG_CRITICAL);
+					}
+					catch (FileSystemException& e)
+					{
+						AddLogEntry(std::string("Failed to copy region files from the loaded save: ") + e.what(), LOG_CRITICAL);
+					}
 				});
+				SetThreadPriority(m_LazyLoadThread.native_handle(), THREAD_PRIORITY_BELOW_NORMAL);
 			}
 
 			SendToConsole("Done Loading.");
@@ -1770,16 +2892,119 @@ namespace FusionEngine
 			AddLogEntry(std::string("Load failed: ") + e.what(), LOG_CRITICAL);
 		}
 
-		if (archived)
-		{
-			int r = PHYSFS_removeFromSearchPath(archivePath.string().c_str());
-			FSN_ASSERT(r != 0);
-		}
+		// (saves being loaded lazily are unmounted once their region files have all been copied)
+		if (!lazyLoading)
+			closeSave(save);
 
 		if (threadRunning)
 			Start();
 	}
 
+	void RegionCellArchivist::CollapseSave(const std::string& saveName)
+	{
+		namespace bfs = boost::filesystem;
+
+		// The save may be the one that the last snapshot is being written to, or one that is still mounted for a lazy load
+		WaitForSnapshotSave();
+		WaitForLazyLoad();
+
+		SaveLocation save;
+		if (!openSave(saveName, save))
+		{
+			AddLogEntry("Can't collapse " + saveName + ": the save doesn't exist", LOG_NORMAL);
+			return;
+		}
+		bool mounted = save.archived;
+		bool removed = false;
+
+		// The save is resolved into a new folder, which then replaces it
+		const std::string collapsedName = save.name + "-collapsing";
+		const bfs::path collapsedPath = bfs::path(PHYSFS_getWriteDir()) / m_SavePath / collapsedName;
+
+		try
+		{
+			ArchivistSaveUtils::SaveInfo info;
+			if (auto infoFile = openSaveFile(save, ArchivistSaveUtils::s_SaveInfoFilename))
+				info = ArchivistSaveUtils::ReadSaveInfo(*infoFile);
+			if (info.base.empty())
+			{
+				AddLogEntry(save.name + " is a full save: it doesn't need to be collapsed", LOG_INFO);
+				closeSave(save);
+				return;
+			}
+
+			SendToConsole("Collapsing save: " + save.name);
+
+			bfs::remove_all(collapsedPath);
+			bfs::create_directories(collapsedPath);
+			if (m_EditableCache)
+				bfs::create_directories(collapsedPath / "editable");
+
+			SaveChain_t chain;
+			copySaveFiles(save, collapsedPath.string(), m_SavePath + collapsedName, 0, chain);
+
+			// Every save has a complete copy of the location DB
+			if (save.archived)
+				PhysFSHelp::copy_file((bfs::path(save.physPath) / "entitylocations.kc").generic_string(), m_SavePath + collapsedName + "/entitylocations.kc");
+			else
+				bfs::copy_file(bfs::path(save.nativePath) / "entitylocations.kc", collapsedPath / "entitylocations.kc");
+
+			// The ID stays the same, so saves that are based on this one are still valid
+			ArchivistSaveUtils::SaveInfo collapsedInfo;
+			collapsedInfo.id = info.id;
+			ArchivistSaveUtils::WriteSaveInfo(collapsedPath, collapsedInfo);
+
+			closeSave(save);
+			mounted = false;
+
+			const bfs::path savePath = bfs::path(PHYSFS_getWriteDir()) / m_SavePath / save.name;
+			if (save.archived)
+				bfs::remove(save.archivePath);
+			else
+				bfs::remove_all(savePath);
+			removed = true;
+			bfs::rename(collapsedPath, savePath);
+			if (save.archived)
+				CompressSave(save.name);
+
+			// The last save (if it was this one or a later one) is now based on fewer saves
+			{
+				std::lock_guard<std::mutex> lock(m_SaveChainMutex);
+				for (size_t i = 0; i < m_SaveChain.size(); ++i)
+				{
+					if (m_SaveChain[i].first == save.name)
+					{
+						m_SaveChain.resize(i + 1);
+						break;
+					}
+				}
+			}
+
+			std::stringstream str; str << chain.size() - 1;
+			SendToConsole("Done collapsing " + save.name + " (it was based on " + str.str() + " other saves)");
+			return;
+		}
+		catch (bfs::filesystem_error& e)
+		{
+			AddLogEntry(std::string("Failed to collapse save: ") + e.what(), LOG_CRITICAL);
+		}
+		catch (FileSystemException& e)
+		{
+			AddLogEntry(std::string("Failed to collapse save: ") + e.what(), LOG_CRITICAL);
+		}
+
+		SendToConsole("Save collapse failed");
+		if (mounted)
+			closeSave(save);
+		if (!removed)
+		{
+			boost::system::error_code ec;
+			bfs::remove_all(collapsedPath, ec);
+		}
+		else
+			AddLogEntry("The collapsed save was left at " + collapsedPath.string(), LOG_CRITICAL);
+	}
+
 	void RegionCellArchivist::CompressSave(const std::string& saveName)
 	{
 		namespace bfs = boost::filesystem;
@@ -1827,6 +3052,11 @@ namespace FusionEngine
 
 			{
 				IO::FileType::ZipArchive archive(archiveFilePath);
+				// Cell data is already compressed
+				std::set<std::string> storedExtensions;
+				storedExtensions.insert(".celldata");
+				storedExtensions.insert(RegionSnapshot::s_DeltaExtension);
+				archive.SetStoredExtensions(storedExtensions);
 				archive.AddPath(savePath, savePath.stem());
 			}
 
@@ -1857,267 +3087,4 @@ namespace FusionEngine
 		}
 	}
 
-	namespace
-	{
-
-		typedef std::array<char, 4096> CopyBuffer_t;
-
-		void CopyData(CopyBuffer_t& buffer, ICellStream& source, OCellStream& dest)
-		{
-			while (!source.eof())
-			{
-				source.read(buffer.data(), std::streamsize(buffer.size()));
-				const auto gcount = source.gcount();
-				dest.write(buffer.data(), gcount);
-			}
-		}
-
-		void CopyData(CopyBuffer_t& buffer, ICellStream& source, OCellStream& dest, std::streamsize remaining_length)
-		{
-			while (remaining_length > 0 && !source.eof())
-			{
-				source.read(buffer.data(), std::min(std::streamsize(buffer.size()), remaining_length));
-				const auto gcount = source.gcount();
-				dest.write(buffer.data(), gcount);
-
-				FSN_ASSERT(gcount <= remaining_length);
-				remaining_length -= gcount;
-			}
-		}
-
-		void SkipData(CopyBuffer_t& buffer, ICellStream& source, std::streamsize remaining_length)
-		{
-			while (remaining_length > 0 && !source.eof())
-			{
-				source.read(buffer.data(), std::min(std::streamsize(buffer.size()), remaining_length));
-				const auto gcount = source.gcount();
-
-				FSN_ASSERT(gcount <= remaining_length);
-				remaining_length -= gcount;
-			}
-		}
-
-		size_t RemoveID(std::vector<ObjectID>& objects_displaced, ObjectID id_to_remove, ICellStream& source_in, OCellStream& source_out)
-		{
-			IO::Streams::CellStreamReader src_reader(&source_in);
-			IO::Streams::CellStreamWriter src_writer(&source_out);
-
-			// Read the ID list from the source and figure out what entity data will be offset by deleting this data
-			size_t numEntsInSource = src_reader.ReadValue<size_t>();
-			bool encounteredId = false;
-			for (size_t i = 0; i < numEntsInSource; ++i)
-			{
-				const ObjectID iID = src_reader.ReadValue<ObjectID>();
-				if (iID != id_to_remove)
-				{
-					src_writer.Write(iID);
-					if (encounteredId)
-						objects_displaced.push_back(iID);
-				}
-				else
-				{
-					FSN_ASSERT(!encounteredId); // make sure the IDs aren't repeated (indicates a bug somewhere)
-					encounteredId = true;
-				}
-			}
-			return numEntsInSource;
-		}
-
-		void CopyIDList(std::vector<ObjectID>& objects_displaced, size_t numEnts, ObjectID id_causing_displacement, ICellStream& source_in, OCellStream& source_out)
-		{
-			IO::Streams::CellStreamReader src_reader(&source_in);
-			IO::Streams::CellStreamWriter src_writer(&source_out);
-
-			// Read the ID list from the source and figure out what entity data will be offset by modifying this data
-			bool encounteredId = false;
-			for (size_t i = 0; i < numEnts; ++i)
-			{
-				const ObjectID iID = src_reader.ReadValue<ObjectID>();
-				src_writer.Write(iID);
-				if (encounteredId)
-					objects_displaced.push_back(iID);
-				if (iID == id_causing_displacement)
-				{
-					FSN_ASSERT(!encounteredId); // make sure the IDs aren't repeated (indicates a bug somewhere)
-					encounteredId = true;
-				}
-			}
-		}
-
-		void CopyEditModePseudoEntityData(CopyBuffer_t& buffer, ICellStream& source_in, ICellStream& dest_in, OCellStream& dest_out)
-		{
-			IO::Streams::CellStreamReader src_reader(&source_in);
-			IO::Streams::CellStreamReader dst_reader(&dest_in);
-
-			if (source_in != dest_in)
-				src_reader.ReadValue<std::streamsize>();
-			std::streamsize unsynchedDataLength = dst_reader.ReadValue<std::streamsize>();
-
-			FSN_ASSERT(unsynchedDataLength >= 0 && unsynchedDataLength < (1 << 24));
-
-			CopyData(buffer, dest_in, dest_out, unsynchedDataLength);
-		}
-
-	} // anon namespace
-
-	std::streamsize RegionCellArchivist::MergeEntityData(std::vector<ObjectID>& objects_displaced_for, std::vector<ObjectID>& objects_displaced_back, ObjectID id, std::streamoff data_offset, std::streamsize data_length, ICellStream& source_in, OCellStream& source_out, ICellStream& dest_in, OCellStream& dest_out, RakNet::BitStream& mergeCon, RakNet::BitStream& mergeOcc) const
-	{
-		CopyBuffer_t buffer;
-
-		const bool destChanged = &source_in != &dest_in;
-
-		IO::Streams::CellStreamReader src_reader(&source_in);
-		IO::Streams::CellStreamReader dst_reader(&dest_in);
-		IO::Streams::CellStreamWriter writer(&dest_out);
-
-		// Skip the pseudo-entity data that is present in Edit Mode
-		if (m_EditMode)
-			CopyEditModePseudoEntityData(buffer, source_in, dest_in, dest_out);
-
-		size_t numEnts = dst_reader.ReadValue<size_t>();
-		if (destChanged)
-		{
-			numEnts += 1; // Since an entry is being added
-
-			// Remove the ID being moved from the source header
-			RemoveID(objects_displaced_back, id, source_in, source_out);
-		}
-		writer.Write(numEnts);
-
-		const size_t headerLength = numEnts * sizeof(ObjectID);
-
-		// Copy the existing object IDs list in the dest
-		if (destChanged)
-		{
-			std::vector<char> headerData((numEnts - 1) * sizeof(ObjectID));
-			dest_in.read(headerData.data(), headerData.size());
-			dest_out.write(headerData.data(), headerData.size());
-
-			// The the ID for the entity being merged in
-			writer.Write(id);
-		}
-		else
-		{
-			// Copy the existing ID list and note which objects come after the one being
-			//  updated, and thus will be displaced if the length changes
-			CopyIDList(objects_displaced_for, numEnts, id, dest_in, dest_out);
-		}
-
-
-		if (!destChanged)
-		{
-			auto remainingData = data_offset - (sizeof(size_t) + headerLength); // The offset is relative to the start of the cell data
-			// Copy existing cell data to the relevant entity data
-			CopyData(buffer, dest_in, dest_out, remainingData);
-		}
-		else
-		{
-			auto remainingData = data_offset - (sizeof(size_t) + headerLength); // The offset is relative to the start of the cell data
-			// Re-write the source up to the relevant entity data
-			CopyData(buffer, source_in, source_out, remainingData);
-
-			// Re-write rest of the existing dest cell data (changed data will be written at the end)
-			CopyData(buffer, dest_in, dest_out);
-		}
-
-		// Merge the data
-		std::streamsize newEntityDataLength;
-		{
-			CharCounter counter;
-			bio::filtering_ostream countingOut;
-			countingOut.push(counter);
-			countingOut.push(dest_out, 0);
-			/*auto newEntityDataLength = */EntitySerialisationUtils::MergeEntityData(source_in, countingOut, mergeCon, mergeOcc);
-			countingOut.flush();
-			newEntityDataLength = counter.count();
-		}
-
-		if (destChanged)
-		{
-			// Re-write the rest of the source (sans the moved entity)
-			CopyData(buffer, source_in, source_out);
-		}
-		else
-		{
-			// Re-write the rest of the un-changed cell data
-			CopyData(buffer, dest_in, dest_out);
-		}
-
-		return newEntityDataLength;
-	}
-
-	void RegionCellArchivist::MoveEntityData(std::vector<ObjectID>& objects_displaced, ObjectID id, std::streamoff data_offset, std::streamsize data_length, ICellStream& source_in, OCellStream& source_out, ICellStream& dest_in, OCellStream& dest_out) const
-	{
-		// Make sure the data is actually being moved!
-		FSN_ASSERT(&source_in != &dest_in);
-
-		CopyBuffer_t buffer;
-
-		IO::Streams::CellStreamReader src_reader(&source_in);
-		IO::Streams::CellStreamWriter src_writer(&source_out);
-
-		IO::Streams::CellStreamReader dst_reader(&dest_in);
-		IO::Streams::CellStreamWriter dst_writer(&dest_out);
-
-		if (m_EditMode)
-			CopyEditModePseudoEntityData(buffer, source_in, dest_in, dest_out);
-
-		size_t numEntsInSource;// = src_reader.ReadValue<size_t>();
-		numEntsInSource = RemoveID(objects_displaced, id, source_in, source_out);
-
-		const size_t sourceHeaderLength = numEntsInSource * sizeof(ObjectID);
-
-		{
-			auto remainingData = data_offset - sourceHeaderLength;
-			// Copy the source up to the relevant entity data
-			CopyData(buffer, source_in, source_out, remainingData);
-		}
-
-		if (source_in.eof())
-			FSN_EXCEPT(FileSystemException, "Failed to move entity data: source was missing data / invalid");
-
-		size_t numEnts = dst_reader.ReadValue<size_t>();
-		++numEnts;
-		dst_writer.Write(numEnts);
-
-		// Copy the dest's existing ID list
-		std::vector<char> headerData((numEnts - 1) * sizeof(ObjectID));
-		dest_in.read(headerData.data(), headerData.size());
-		dest_out.write(headerData.data(), headerData.size());
-		// Write the new ID
-		dst_writer.Write(id);
-
-		// Copy the rest of the existing dest data
-		CopyData(buffer, dest_in, dest_out);
-
-		// Copy entity data from the source into the dest (note that not copying this back into source_out effectively deletes it from there)
-		CopyData(buffer, source_in, dest_out, data_length);
-
-		// Copy the remaining source data back into the source
-		CopyData(buffer, source_in, source_out);
-	}
-
-	void RegionCellArchivist::DeleteEntityData(std::vector<ObjectID>& objects_displaced, ObjectID id, std::streamoff data_offset, std::streamsize data_length, ICellStream& source_in, OCellStream& source_out) const
-	{
-		CopyBuffer_t buffer;
-
-		IO::Streams::CellStreamReader src_reader(&source_in);
-		IO::Streams::CellStreamWriter src_writer(&source_out);
-
-		if (m_EditMode)
-			CopyEditModePseudoEntityData(buffer, source_in, source_in, source_out);
-
-		// Read the ID list from the source and figure out what entity data will be offset by deleting this data
-		auto numEnts = RemoveID(objects_displaced, id, source_in, source_out);
-
-		auto headerLength = sizeof(numEnts) + numEnts * sizeof(ObjectID);
-
-		// Copy the data for the entities before the one being removed
-		CopyData(buffer, source_in, source_out, data_offset - headerLength);
-		// Skip the removed entity
-		SkipData(buffer, source_in, data_length);
-		// Copy the rest of the data until EOF
-		CopyData(buffer, source_in, source_out);
-	}
-
 }
@@ -0,0 +1,233 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author(s):
+*
+*    Elliot Hayward
+*/
+
+#include "PrecompiledHeaders.h"
+
+#include "FusionRegionSnapshot.h"
+
+#include "FusionRegionFile.h"
+
+#include "FusionBinaryStream.h"
+
+#include <array>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/stream.hpp>
+
+namespace FusionEngine
+{
+
+	const char* const RegionSnapshot::s_DeltaExtension = ".celldelta";
+
+	static const char s_DeltaMagic[8] = { 'F', 'S', 'N', 'D', 'L', 'T', '\0', '\0' };
+	static const uint32_t s_DeltaVersion = 1;
+	static const uint64_t s_SectorSize = RegionFile::s_SectorSize;
+
+	RegionSnapshot::RegionSnapshot(const std::vector<boost::filesystem::path>& files, const boost::filesystem::path& destination)
+		: m_Destination(destination),
+		m_NextFile(0),
+		m_NumPreserved(0),
+		m_NumDeltas(0)
+	{
+		m_Files.resize(files.size());
+		for (size_t i = 0; i < files.size(); ++i)
+		{
+			m_Files[i].source = files[i];
+			m_Files[i].dest = destination / files[i].filename();
+			m_FileIndices[files[i].filename().string()] = i;
+		}
+	}
+
+	void RegionSnapshot::AddDelta(const boost::filesystem::path& file, const boost::dynamic_bitset<>& sectors)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		FSN_ASSERT_MSG(m_NextFile == 0, "Deltas must be added before the snapshot is written");
+
+		File delta;
+		delta.source = file;
+		delta.dest = (m_Destination / file.filename()).replace_extension(s_DeltaExtension);
+		delta.deltaSectors = sectors;
+		m_FileIndices[file.filename().string()] = m_Files.size();
+		m_Files.push_back(delta);
+		++m_NumDeltas;
+	}
+
+	void RegionSnapshot::Preserve(const RegionFile& region_file)
+	{
+		const auto name = boost::filesystem::path(region_file.filename).filename().string();
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		auto entry = m_FileIndices.find(name);
+		if (entry == m_FileIndices.end())
+			return; // The file was created after the snapshot was taken
+
+		auto& file = m_Files[entry->second];
+		if (file.written || file.preserved)
+			return;
+
+		const auto data = region_file.getRegionData();
+		file.preserved = std::make_shared<std::vector<char>>(data.first, data.first + data.second);
+		++m_NumPreserved;
+	}
+
+	bool RegionSnapshot::WriteNext()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		if (m_NextFile >= m_Files.size())
+			return false;
+
+		auto& file = m_Files[m_NextFile++];
+		file.written = true;
+		// If the file has been modified since the snapshot, the content that was preserved is written
+		const auto preserved = std::move(file.preserved);
+		if (preserved)
+			lock.unlock();
+		// ... otherwise the lock is held so that the file isn't modified while it is being copied
+		writeFile(file, preserved.get());
+		return true;
+	}
+
+	void RegionSnapshot::writeFile(const File& file, const std::vector<char>* preserved)
+	{
+		namespace bfs = boost::filesystem;
+		namespace bio = boost::iostreams;
+
+		if (!preserved && file.deltaSectors.empty())
+		{
+			bfs::copy_file(file.source, file.dest, bfs::copy_option::overwrite_if_exists);
+			return;
+		}
+
+		bfs::ofstream out(file.dest, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (file.deltaSectors.empty())
+		{
+			out.write(preserved->data(), preserved->size());
+		}
+		else if (preserved)
+		{
+			bio::stream<bio::array_source> source(preserved->data(), preserved->size());
+			WriteDelta(out, source, preserved->size(), file.deltaSectors);
+		}
+		else
+		{
+			bfs::ifstream source(file.source, std::ios::in | std::ios::binary);
+			WriteDelta(out, source, bfs::file_size(file.source), file.deltaSectors);
+		}
+		if (!out)
+			FSN_EXCEPT(FileSystemException, "Failed to write " + file.dest.string());
+	}
+
+	void RegionSnapshot::WriteDelta(std::ostream& delta, std::istream& region_data, uint64_t length, const boost::dynamic_bitset<>& sectors)
+	{
+		// Find the runs of modified sectors (ignoring any past the end of the file)
+		std::vector<std::pair<uint64_t, uint32_t>> runs;
+		const size_t numSectors = (size_t)std::min<uint64_t>(sectors.size(), (length + s_SectorSize - 1) / s_SectorSize);
+		for (size_t first = sectors.find_first(); first < numSectors; first = sectors.find_next(first))
+		{
+			size_t end = first + 1;
+			while (end < numSectors && sectors.test(end))
+				++end;
+			runs.push_back(std::make_pair(uint64_t(first), uint32_t(end - first)));
+			first = end - 1;
+		}
+
+		IO::Streams::CellStreamWriter writer(&delta);
+		delta.write(s_DeltaMagic, sizeof(s_DeltaMagic));
+		writer.Write(s_DeltaVersion);
+		writer.Write(length);
+		writer.WriteAs<uint32_t>(runs.size());
+
+		std::vector<char> buffer;
+		for (auto it = runs.begin(); it != runs.end(); ++it)
+		{
+			const uint64_t begin = it->first * s_SectorSize;
+			const size_t runLength = (size_t)std::min<uint64_t>(it->second * s_SectorSize, length - begin);
+
+			writer.Write(it->first);
+			writer.Write(it->second);
+
+			buffer.resize(runLength);
+			region_data.seekg(std::streamoff(begin));
+			if (!region_data.read(buffer.data(), runLength))
+				FSN_EXCEPT(FileSystemException, "Failed to read the region data for a delta");
+			delta.write(buffer.data(), runLength);
+		}
+	}
+
+	void RegionSnapshot::ApplyDelta(std::istream& delta, const boost::filesystem::path& region_file)
+	{
+		namespace bfs = boost::filesystem;
+
+		IO::Streams::CellStreamReader reader(&delta);
+		std::array<char, sizeof(s_DeltaMagic)> magic;
+		uint32_t version = 0;
+		uint64_t length = 0;
+		uint32_t numRuns = 0;
+		if (!delta.read(magic.data(), magic.size()) || !std::equal(magic.begin(), magic.end(), s_DeltaMagic) ||
+			!reader.Read(version) || version != s_DeltaVersion ||
+			!reader.Read(length) || !reader.Read(numRuns))
+		{
+			FSN_EXCEPT(FileSystemException, "Invalid region delta for " + region_file.string());
+		}
+
+		// The file in the base save, if there was one, may have been shorter or longer
+		if (!bfs::exists(region_file))
+			bfs::ofstream(region_file, std::ios::out | std::ios::binary);
+		bfs::resize_file(region_file, length);
+
+		bfs::fstream out(region_file, std::ios::in | std::ios::out | std::ios::binary);
+		std::vector<char> buffer;
+		for (uint32_t i = 0; i < numRuns; ++i)
+		{
+			uint64_t firstSector = 0;
+			uint32_t runSectors = 0;
+			if (!reader.Read(firstSector) || !reader.Read(runSectors) || firstSector * s_SectorSize >= length)
+				FSN_EXCEPT(FileSystemException, "Corrupt region delta for " + region_file.string());
+
+			const uint64_t begin = firstSector * s_SectorSize;
+			const size_t runLength = (size_t)std::min<uint64_t>(runSectors * s_SectorSize, length - begin);
+
+			buffer.resize(runLength);
+			if (!delta.read(buffer.data(), runLength))
+				FSN_EXCEPT(FileSystemException, "Corrupt region delta for " + region_file.string());
+			out.seekp(std::streamoff(begin));
+			out.write(buffer.data(), runLength);
+		}
+		if (!out)
+			FSN_EXCEPT(FileSystemException, "Failed to write " + region_file.string());
+	}
+
+	size_t RegionSnapshot::GetNumPreserved() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_NumPreserved;
+	}
+
+}
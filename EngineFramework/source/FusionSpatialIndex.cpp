@@ -0,0 +1,421 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author:
+*    Elliot Hayward
+*/
+
+#include "PrecompiledHeaders.h"
+
+#include "FusionSpatialIndex.h"
+
+#include "FusionEntity.h"
+#include "FusionScriptTypeRegistrationUtils.h"
+
+#include "scriptarray.h"
+
+#include <tbb/enumerable_thread_specific.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace FusionEngine
+{
+
+	namespace
+	{
+		//! Distance-keyed entry used when results have to be ordered
+		typedef std::pair<float, Entity*> Candidate_t;
+
+		inline bool candidateLess(const Candidate_t& l, const Candidate_t& r)
+		{
+			return l.first < r.first;
+		}
+
+		//! Returns the parameter [0, 1] of the point on the segment closest to p
+		inline float closestParameter(float px, float py, const Vector2& start, const Vector2& delta, float inverse_length_sq)
+		{
+			const float t = ((px - start.x) * delta.x + (py - start.y) * delta.y) * inverse_length_sq;
+			return fe_clamped(t, 0.f, 1.f);
+		}
+
+		inline float distanceSqToSegment(float px, float py, const Vector2& start, const Vector2& delta, float inverse_length_sq, float& t_out)
+		{
+			t_out = closestParameter(px, py, start, delta, inverse_length_sq);
+			const float dx = start.x + delta.x * t_out - px;
+			const float dy = start.y + delta.y * t_out - py;
+			return dx * dx + dy * dy;
+		}
+
+		void appendCandidates(const std::vector<Candidate_t>& candidates, std::vector<EntityPtr>& results)
+		{
+			results.reserve(results.size() + candidates.size());
+			for (auto it = candidates.begin(), end = candidates.end(); it != end; ++it)
+				results.push_back(it->second->shared_from_this());
+		}
+	}
+
+	SpatialIndex::SpatialIndex(float cell_size)
+		: m_CellSize(cell_size),
+		m_InverseCellSize(1.f / cell_size)
+	{
+		FSN_ASSERT(cell_size > 0.f);
+	}
+
+	void SpatialIndex::SetCellSize(float cell_size)
+	{
+		FSN_ASSERT(cell_size > 0.f);
+
+		Mutex_t::scoped_lock lock(m_Mutex, true);
+
+		if (cell_size == m_CellSize)
+			return;
+
+		// Collect the current entries, then re-bucket them at the new size
+		std::vector<std::pair<Entity*, Vector2>> entries;
+		entries.reserve(m_Locations.size());
+		m_Grid.for_each([&entries](const CellHandle&, const Bucket& bucket)
+		{
+			for (size_t i = 0; i < bucket.entities.size(); ++i)
+				entries.push_back(std::make_pair(bucket.entities[i], Vector2(bucket.positionsX[i], bucket.positionsY[i])));
+		});
+
+		m_Grid.clear();
+		m_Locations.clear();
+
+		m_CellSize = cell_size;
+		m_InverseCellSize = 1.f / cell_size;
+
+		for (auto it = entries.begin(), end = entries.end(); it != end; ++it)
+			addToBucket(toCellLocation(it->second.x, it->second.y), it->first, it->second);
+	}
+
+	void SpatialIndex::Update(const EntityPtr& entity, const Vector2& position)
+	{
+		const CellHandle cell = toCellLocation(position.x, position.y);
+
+		Mutex_t::scoped_lock lock(m_Mutex, true);
+
+		auto entry = m_Locations.find(entity.get());
+		if (entry == m_Locations.end())
+		{
+			addToBucket(cell, entity.get(), position);
+		}
+		else if (entry->second.cell == cell)
+		{
+			// Common case: still in the same bucket
+			Bucket* bucket = m_Grid.find(cell);
+			FSN_ASSERT(bucket);
+			bucket->positionsX[entry->second.slot] = position.x;
+			bucket->positionsY[entry->second.slot] = position.y;
+		}
+		else
+		{
+			removeFromBucket(entry->second);
+			addToBucket(cell, entity.get(), position);
+		}
+	}
+
+	void SpatialIndex::Remove(const EntityPtr& entity)
+	{
+		Mutex_t::scoped_lock lock(m_Mutex, true);
+
+		auto entry = m_Locations.find(entity.get());
+		if (entry != m_Locations.end())
+		{
+			const Location location = entry->second;
+			m_Locations.erase(entry);
+			removeFromBucket(location);
+		}
+	}
+
+	void SpatialIndex::Clear()
+	{
+		Mutex_t::scoped_lock lock(m_Mutex, true);
+
+		m_Grid.clear();
+		m_Locations.clear();
+	}
+
+	size_t SpatialIndex::GetNumEntities() const
+	{
+		Mutex_t::scoped_lock lock(m_Mutex, false);
+		return m_Locations.size();
+	}
+
+	size_t SpatialIndex::QueryRadius(const Vector2& centre, float radius, std::vector<EntityPtr>& results) const
+	{
+		const size_t initialSize = results.size();
+		const float radiusSq = radius * radius;
+
+		Mutex_t::scoped_lock lock(m_Mutex, false);
+
+		m_Grid.for_each_in_range(toCellRange(centre - Vector2(radius, radius), centre + Vector2(radius, radius)), [&](const CellHandle&, const Bucket& bucket)
+		{
+			const float* xs = bucket.positionsX.data();
+			const float* ys = bucket.positionsY.data();
+			for (size_t i = 0, count = bucket.entities.size(); i < count; ++i)
+			{
+				const float dx = xs[i] - centre.x, dy = ys[i] - centre.y;
+				if (dx * dx + dy * dy <= radiusSq)
+					results.push_back(bucket.entities[i]->shared_from_this());
+			}
+		});
+
+		return results.size() - initialSize;
+	}
+
+	size_t SpatialIndex::QueryNearest(const Vector2& point, size_t k, std::vector<EntityPtr>& results, float max_distance) const
+	{
+		if (k == 0)
+			return 0;
+
+		const float maxDistanceSq = max_distance * max_distance;
+
+		Mutex_t::scoped_lock lock(m_Mutex, false);
+
+		const size_t numEntities = m_Locations.size();
+		if (numEntities == 0)
+			return 0;
+
+		// Max-heap of the k closest entities found so far
+		std::vector<Candidate_t> closest;
+		closest.reserve(std::min(k, numEntities));
+		size_t numVisited = 0;
+
+		auto visitBucket = [&](const CellHandle&, const Bucket& bucket)
+		{
+			numVisited += bucket.entities.size();
+			for (size_t i = 0, count = bucket.entities.size(); i < count; ++i)
+			{
+				const float dx = bucket.positionsX[i] - point.x, dy = bucket.positionsY[i] - point.y;
+				const float distanceSq = dx * dx + dy * dy;
+				if (distanceSq > maxDistanceSq)
+					continue;
+				if (closest.size() < k)
+				{
+					closest.push_back(std::make_pair(distanceSq, bucket.entities[i]));
+					std::push_heap(closest.begin(), closest.end(), candidateLess);
+				}
+				else if (distanceSq < closest.front().first)
+				{
+					std::pop_heap(closest.begin(), closest.end(), candidateLess);
+					closest.back() = std::make_pair(distanceSq, bucket.entities[i]);
+					std::push_heap(closest.begin(), closest.end(), candidateLess);
+				}
+			}
+		};
+
+		// Search outwards in square rings of cells around the one containing the point
+		const CellHandle centre = toCellLocation(point.x, point.y);
+		for (int32_t ring = 0;; ++ring)
+		{
+			if (ring == 0)
+			{
+				if (const Bucket* bucket = m_Grid.find(centre))
+					visitBucket(centre, *bucket);
+			}
+			else
+			{
+				const int32_t left = centre.x - ring, right = centre.x + ring;
+				const int32_t top = centre.y - ring, bottom = centre.y + ring;
+				m_Grid.for_each_in_range(clan::Rect(left, top, right, top), visitBucket);
+				m_Grid.for_each_in_range(clan::Rect(left, bottom, right, bottom), visitBucket);
+				m_Grid.for_each_in_range(clan::Rect(left, top + 1, left, bottom - 1), visitBucket);
+				m_Grid.for_each_in_range(clan::Rect(right, top + 1, right, bottom - 1), visitBucket);
+			}
+
+			if (numVisited == numEntities)
+				break;
+			// Every entity within this distance of the point has now been visited
+			const float searched = ring * m_CellSize;
+			if (searched >= max_distance)
+				break;
+			if (closest.size() == k && closest.front().first <= searched * searched)
+				break;
+			// Once the searched area outgrows the number of occupied cells the remaining buckets are
+			//  visited directly, rather than walking out through (possibly very many) empty rings
+			const size_t side = size_t(ring) * 2 + 1;
+			if (side * side >= m_Grid.size())
+			{
+				m_Grid.for_each([&](const CellHandle& cell, const Bucket& bucket)
+				{
+					if (std::abs(cell.x - centre.x) > ring || std::abs(cell.y - centre.y) > ring)
+						visitBucket(cell, bucket);
+				});
+				break;
+			}
+		}
+
+		std::sort_heap(closest.begin(), closest.end(), candidateLess);
+		appendCandidates(closest, results);
+
+		return closest.size();
+	}
+
+	size_t SpatialIndex::QuerySegment(const Vector2& start, const Vector2& end, float radius, std::vector<EntityPtr>& results) const
+	{
+		const Vector2 delta = end - start;
+		const float lengthSq = delta.squared_length();
+		const float inverseLengthSq = lengthSq > 0.f ? 1.f / lengthSq : 0.f;
+		const float radiusSq = radius * radius;
+		// Buckets whose centres are further than this from the segment can't contain hits
+		const float bucketReach = radius + m_CellSize * 0.7071068f;
+		const float bucketReachSq = bucketReach * bucketReach;
+
+		const Vector2 lb(std::min(start.x, end.x) - radius, std::min(start.y, end.y) - radius);
+		const Vector2 ub(std::max(start.x, end.x) + radius, std::max(start.y, end.y) + radius);
+
+		std::vector<Candidate_t> hits;
+
+		Mutex_t::scoped_lock lock(m_Mutex, false);
+
+		m_Grid.for_each_in_range(toCellRange(lb, ub), [&](const CellHandle& cell, const Bucket& bucket)
+		{
+			float t;
+			if (distanceSqToSegment((cell.x + 0.5f) * m_CellSize, (cell.y + 0.5f) * m_CellSize, start, delta, inverseLengthSq, t) > bucketReachSq)
+				return;
+
+			for (size_t i = 0, count = bucket.entities.size(); i < count; ++i)
+			{
+				if (distanceSqToSegment(bucket.positionsX[i], bucket.positionsY[i], start, delta, inverseLengthSq, t) <= radiusSq)
+					hits.push_back(std::make_pair(t, bucket.entities[i]));
+			}
+		});
+
+		std::sort(hits.begin(), hits.end(), candidateLess);
+		appendCandidates(hits, results);
+
+		return hits.size();
+	}
+
+	CellHandle SpatialIndex::toCellLocation(float x, float y) const
+	{
+		return CellHandle(int32_t(std::floor(x * m_InverseCellSize)), int32_t(std::floor(y * m_InverseCellSize)));
+	}
+
+	clan::Rect SpatialIndex::toCellRange(const Vector2& lb, const Vector2& ub) const
+	{
+		const CellHandle lbCell = toCellLocation(lb.x, lb.y);
+		const CellHandle ubCell = toCellLocation(ub.x, ub.y);
+		return clan::Rect(lbCell.x, lbCell.y, ubCell.x, ubCell.y);
+	}
+
+	void SpatialIndex::addToBucket(const CellHandle& cell, Entity* entity, const Vector2& position)
+	{
+		Bucket& bucket = m_Grid[cell];
+
+		Location& location = m_Locations[entity];
+		location.cell = cell;
+		location.slot = bucket.entities.size();
+
+		bucket.entities.push_back(entity);
+		bucket.positionsX.push_back(position.x);
+		bucket.positionsY.push_back(position.y);
+	}
+
+	void SpatialIndex::removeFromBucket(const Location& location)
+	{
+		Bucket* bucket = m_Grid.find(location.cell);
+		FSN_ASSERT(bucket && location.slot < bucket->entities.size());
+
+		// Move the last entry into the vacated slot
+		const size_t last = bucket->entities.size() - 1;
+		if (location.slot != last)
+		{
+			bucket->entities[location.slot] = bucket->entities[last];
+			bucket->positionsX[location.slot] = bucket->positionsX[last];
+			bucket->positionsY[location.slot] = bucket->positionsY[last];
+
+			auto moved = m_Locations.find(bucket->entities[location.slot]);
+			FSN_ASSERT(moved != m_Locations.end());
+			moved->second.slot = location.slot;
+		}
+		bucket->entities.pop_back();
+		bucket->positionsX.pop_back();
+		bucket->positionsY.pop_back();
+
+		// Drop empty buckets so range queries don't visit them
+		if (bucket->entities.empty())
+			m_Grid.erase(location.cell);
+	}
+
+	namespace
+	{
+		//! Results buffer reused by script queries on each thread
+		tbb::enumerable_thread_specific<std::vector<EntityPtr>> s_ScriptQueryResults;
+
+		//! Copies the results into the given script array (replacing its contents)
+		asUINT copyToScriptArray(std::vector<EntityPtr>& results, CScriptArray* out)
+		{
+			const asUINT count = asUINT(results.size());
+			if (out)
+			{
+				out->Resize(count);
+				for (asUINT i = 0; i < count; ++i)
+					*static_cast<EntityPtr*>(out->At(i)) = std::move(results[i]);
+			}
+			results.clear();
+			return count;
+		}
+
+		asUINT SpatialIndex_QueryRadius(const Vector2& centre, float radius, CScriptArray* out, SpatialIndex* obj)
+		{
+			auto& results = s_ScriptQueryResults.local();
+			obj->QueryRadius(centre, radius, results);
+			return copyToScriptArray(results, out);
+		}
+
+		asUINT SpatialIndex_QueryNearest(const Vector2& point, asUINT k, CScriptArray* out, float max_distance, SpatialIndex* obj)
+		{
+			auto& results = s_ScriptQueryResults.local();
+			obj->QueryNearest(point, k, results, max_distance >= 0.f ? max_distance : std::numeric_limits<float>::infinity());
+			return copyToScriptArray(results, out);
+		}
+
+		asUINT SpatialIndex_QuerySegment(const Vector2& start, const Vector2& end, float radius, CScriptArray* out, SpatialIndex* obj)
+		{
+			auto& results = s_ScriptQueryResults.local();
+			obj->QuerySegment(start, end, radius, results);
+			return copyToScriptArray(results, out);
+		}
+	}
+
+	void SpatialIndex::Register(asIScriptEngine* engine)
+	{
+		int r;
+		RegisterSingletonType<SpatialIndex>("SpatialIndex", engine);
+		r = engine->RegisterObjectMethod("SpatialIndex",
+			"uint queryRadius(const Vector &in, float, array<Entity>@)",
+			asFUNCTION(SpatialIndex_QueryRadius), asCALL_CDECL_OBJLAST); FSN_ASSERT(r >= 0);
+		r = engine->RegisterObjectMethod("SpatialIndex",
+			"uint queryNearest(const Vector &in, uint, array<Entity>@, float max_distance = -1)",
+			asFUNCTION(SpatialIndex_QueryNearest), asCALL_CDECL_OBJLAST); FSN_ASSERT(r >= 0);
+		r = engine->RegisterObjectMethod("SpatialIndex",
+			"uint querySegment(const Vector &in, const Vector &in, float, array<Entity>@)",
+			asFUNCTION(SpatialIndex_QuerySegment), asCALL_CDECL_OBJLAST); FSN_ASSERT(r >= 0);
+		r = engine->RegisterObjectMethod("SpatialIndex",
+			"uint getNumEntities() const",
+			asMETHOD(SpatialIndex, GetNumEntities), asCALL_THISCALL); FSN_ASSERT(r >= 0);
+	}
+
+}
@@ -0,0 +1,189 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author:
+*    Elliot Hayward
+*/
+
+#include "PrecompiledHeaders.h"
+
+#include "FusionStrandedWorkerPool.h"
+
+#include "FusionLogger.h"
+
+#include <algorithm>
+
+namespace FusionEngine
+{
+
+	StrandedWorkerPool::StrandedWorkerPool(size_t num_threads, const ThreadCallback_t& on_thread_start, const ThreadCallback_t& on_thread_exit)
+		: m_NumPendingJobs(0),
+		m_Quit(false),
+		m_OnThreadStart(on_thread_start),
+		m_OnThreadExit(on_thread_exit)
+	{
+		if (num_threads == 0)
+		{
+			// hardware_concurrency can return zero if the number of cores isn't known
+			const size_t numCores = std::thread::hardware_concurrency();
+			num_threads = numCores > 1 ? numCores - 1 : 1;
+		}
+
+		m_Threads.reserve(num_threads);
+		for (size_t i = 0; i < num_threads; ++i)
+			m_Threads.push_back(std::thread(&StrandedWorkerPool::Run, this));
+	}
+
+	StrandedWorkerPool::~StrandedWorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Quit = true;
+		}
+		m_JobsReady.notify_all();
+
+		for (auto it = m_Threads.begin(); it != m_Threads.end(); ++it)
+			it->join();
+	}
+
+	void StrandedWorkerPool::Post(StrandKey_t key, const Job_t& job, Priority priority)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+
+			auto& strand = m_Strands[key];
+			const bool wasEmpty = strand.jobs.empty();
+
+			strand.jobs.push_back(QueuedJob(job, priority));
+			if (priority == High)
+				++strand.numHighPriorityJobs;
+			++m_NumPendingJobs;
+
+			if (strand.running)
+				return; // The worker running the strand will re-queue it when the current job finishes
+
+			if (wasEmpty)
+				MakeReady(key, strand);
+			else if (priority == High && strand.numHighPriorityJobs == 1)
+			{
+				// Promote the strand
+				auto entry = std::find(m_ReadyNormalPriority.begin(), m_ReadyNormalPriority.end(), key);
+				FSN_ASSERT(entry != m_ReadyNormalPriority.end());
+				m_ReadyNormalPriority.erase(entry);
+				m_ReadyHighPriority.push_back(key);
+			}
+			else
+				return; // Already in the right ready list
+		}
+		m_JobsReady.notify_one();
+	}
+
+	void StrandedWorkerPool::WaitForIdle()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_Idle.wait(lock, [this]() { return m_NumPendingJobs == 0; });
+	}
+
+	size_t StrandedWorkerPool::GetNumPendingJobs() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_NumPendingJobs;
+	}
+
+	void StrandedWorkerPool::MakeReady(StrandKey_t key, const Strand& strand)
+	{
+		if (strand.numHighPriorityJobs > 0)
+			m_ReadyHighPriority.push_back(key);
+		else
+			m_ReadyNormalPriority.push_back(key);
+	}
+
+	void StrandedWorkerPool::Run()
+	{
+		if (m_OnThreadStart)
+			m_OnThreadStart();
+
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		while (true)
+		{
+			m_JobsReady.wait(lock, [this]() { return m_Quit || !m_ReadyHighPriority.empty() || !m_ReadyNormalPriority.empty(); });
+
+			// Queued jobs are finished before quitting
+			if (m_ReadyHighPriority.empty() && m_ReadyNormalPriority.empty())
+				break;
+
+			auto& readyList = !m_ReadyHighPriority.empty() ? m_ReadyHighPriority : m_ReadyNormalPriority;
+			const StrandKey_t key = readyList.front();
+			readyList.pop_front();
+
+			// Claim the strand and take its next job
+			Job_t job;
+			{
+				auto& strand = m_Strands[key];
+				FSN_ASSERT(!strand.running && !strand.jobs.empty());
+				strand.running = true;
+				job = std::move(strand.jobs.front().fn);
+				if (strand.jobs.front().priority == High)
+					--strand.numHighPriorityJobs;
+				strand.jobs.pop_front();
+			}
+
+			lock.unlock();
+			try
+			{
+				job();
+			}
+			catch (std::exception& ex)
+			{
+				AddLogEntry(std::string("Unhandled exception in worker job: ") + ex.what(), LOG_CRITICAL);
+			}
+			catch (...)
+			{
+				AddLogEntry("Unhandled & unknown exception in worker job", LOG_CRITICAL);
+			}
+			job = Job_t(); // Release anything the job holds before it is considered finished
+			lock.lock();
+
+			// Release the strand
+			{
+				auto entry = m_Strands.find(key);
+				FSN_ASSERT(entry != m_Strands.end());
+				entry->second.running = false;
+				if (entry->second.jobs.empty())
+					m_Strands.erase(entry);
+				else
+				{
+					MakeReady(key, entry->second);
+					m_JobsReady.notify_one();
+				}
+			}
+
+			if (--m_NumPendingJobs == 0)
+				m_Idle.notify_all();
+		}
+		lock.unlock();
+
+		if (m_OnThreadExit)
+			m_OnThreadExit();
+	}
+
+}
@@ -31,6 +31,7 @@
 #include "FusionActiveEntityDirectory.h"
 #include "FusionBinaryStream.h"
 #include "FusionCellDataSource.h"
+#include "FusionDeltaTime.h"
 #include "FusionEntitySerialisationUtils.h"
 #include "FusionMaths.h"
 #include "FusionScriptTypeRegistrationUtils.h"
@@ -39,10 +40,12 @@
 #include "FusionNetworkManager.h"
 #include "FusionRakNetwork.h"
 #include "FusionNetDestinationHelpers.h"
+#include "FusionStreamingRangeKernel.h"
 
 #include "FusionLogger.h"
 
 #include <boost/thread.hpp>
+#include <tbb/parallel_for.h>
 
 #include <cmath>
 
@@ -61,6 +64,22 @@ namespace FusionEngine
 
 	const unsigned int s_MaxCellsProcessedPerFrameWhenCameraStationary = 50;
 
+	//! Number of updates between checks of every Void list (in case a load notification was missed)
+	const unsigned int s_VoidPollInterval = 30;
+
+	const size_t s_ClassifyBatchSize = 256;
+
+	const float s_DefaultPrefetchHorizon = 1.5f;
+	const size_t s_DefaultMaxPrefetchedCells = 64;
+	// Prefetch requests are only re-prioritised when the predicted time-of-need changes by more than this
+	const float s_PrefetchReprioritiseThreshold = 0.1f;
+	// Cameras moving slower than this (sim units per second) aren't projected ahead
+	const float s_MinPrefetchSpeed = 0.5f;
+
+	const size_t s_DefaultHotCellCacheSize = 32 * 1024 * 1024;
+	// Rough memory use of each component of an inactive entity (used to estimate the size of cached cells)
+	const size_t s_EstimatedComponentSize = 256;
+
 	const CellHandle s_VoidCellIndex = CellHandle(std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max());
 
 //#define FSN_CELL_LOG
@@ -105,18 +124,33 @@ namespace FusionEngine
 	StreamingManager::StreamingManager(CellArchiver* archivist)
 		: m_DeactivationTime(s_DefaultDeactivationTime),
 		m_PollArchiveInterval(s_DefaultPollArchiveInterval),
-		m_TimeUntilVoidRefresh(0.0f),
-		m_Archivist(archivist)
+		m_NumEntitiesInTheVoid(0),
+		m_Archivist(archivist),
+		m_PrefetchHorizon(s_DefaultPrefetchHorizon),
+		m_MaxPrefetchedCells(s_DefaultMaxPrefetchedCells),
+		m_PrefetchClock(0.0f),
+		m_MaxHotCellBytes(s_DefaultHotCellCacheSize)
 	{
 		m_Range = s_DefaultActivationRange;
 		m_RangeSquared = m_Range * m_Range;
 
+		m_UpdatesUntilVoidPoll = s_VoidPollInterval;
+
 		m_CellSize = s_DefaultCellSize;
 		m_InverseCellSize = 1.f / m_CellSize;
+
+		if (m_Archivist)
+		{
+			m_CellLoadedConnection = m_Archivist->SignalCellLoaded.connect([this](int32_t x, int32_t y)
+			{
+				m_LoadedCells.push(CellHandle(x, y));
+			});
+		}
 	}
 
 	StreamingManager::~StreamingManager()
 	{
+		m_CellLoadedConnection.disconnect();
 	}
 
 	void StreamingManager::Initialise(float cell_size)
@@ -136,8 +170,16 @@ namespace FusionEngine
 		m_Cells.clear();
 		m_CellsBeingLoaded.clear();
 		m_RequestedEntities.clear();
+		m_PrefetchedCells.clear();
+		m_HotCells.clear();
+		m_HotCellIndex.clear();
+		m_HotCellStats.numCells = m_HotCellStats.bytes = 0;
 
-		m_TheVoid.Reset();
+		m_TheVoid.clear();
+		m_NumEntitiesInTheVoid = 0;
+		m_LoadedCells.clear();
+		m_VoidCellsToRehome.clear();
+		m_UpdatesUntilVoidPoll = s_VoidPollInterval;
 
 		CamerasMutex_t::scoped_lock lock(m_CamerasMutex);
 		m_Cameras.clear();
@@ -149,6 +191,19 @@ namespace FusionEngine
 		m_PollArchiveInterval = interval;
 	}
 
+	void StreamingManager::SetPrefetchHorizon(const float seconds)
+	{
+		m_PrefetchHorizon = std::max(0.0f, seconds);
+		if (m_PrefetchHorizon == 0.0f)
+			cancelPrefetches();
+	}
+
+	void StreamingManager::SetHotCellCacheSize(const size_t bytes)
+	{
+		m_MaxHotCellBytes = bytes;
+		evictHotCells(m_MaxHotCellBytes);
+	}
+
 	void StreamingManager::Save(std::ostream& stream)
 	{
 		IO::Streams::CellStreamWriter writer(&stream);
@@ -182,75 +237,6 @@ namespace FusionEngine
 		}
 	}
 
-#ifndef STREAMING_USEMAP
-	namespace
-	{
-
-		//! Finds and removes entry for the given Entity from the given cell
-		void removeEntityFromCell(Cell* cell, const EntityPtr& entity)
-		{
-			if (!cell->objects.empty())
-			{
-				auto newEnd = std::remove_if(cell->objects.begin(), cell->objects.end(), [&](const Cell::EntityEntryPair& pair)->bool {
-					return pair.first == entity;
-				});
-				cell->objects.erase(newEnd);
-			}
-		}
-
-		//! Finds and removes the given entity from the given cell, starting the search from the end of the list
-		void rRemoveEntityFromCell(Cell* cell, const EntityPtr& entity)
-		{
-			if (cell->objects.size() > 1)
-			{
-				auto rEntry = std::find_if(cell->objects.rbegin(), cell->objects.rend(), [&](const Cell::EntityEntryPair& pair)->bool {
-					return pair.first == entity;
-				});
-				FSN_ASSERT(rEntry != cell->objects.rend());
-				if (rEntry != cell->objects.rend())
-					cell->objects.erase((++rEntry).base());
-			}
-			else if (!cell->objects.empty())
-				cell->objects.pop_back();
-		}
-
-		//! Finds the entry for the given Entity in the given cell
-		Cell::CellEntryMap::iterator findEntityInCell(Cell* cell, const EntityPtr& entity)
-		{
-			return std::find_if(cell->objects.begin(), cell->objects.end(), [&](const Cell::EntityEntryPair& pair)->bool {
-				return pair.first == entity;
-			});
-		}
-
-		//! Finds the entry for the given Entity in the given cell, starting the search from the end of the list
-		Cell::CellEntryMap::iterator rFindEntityInCell(Cell* cell, const EntityPtr& entity)
-		{
-			auto rWhere = std::find_if(cell->objects.rbegin(), cell->objects.rend(), [&](const Cell::EntityEntryPair& pair)->bool {
-				return pair.first == entity;
-			});
-			FSN_ASSERT(rWhere != cell->objects.rend());
-			if (rWhere != cell->objects.rend())
-				return rWhere.base() - 1;
-			else
-				return cell->objects.end();
-		}
-
-		//! Creates an entry for the given Entity in the given cell
-		CellEntry& createEntry(Cell* cell, const EntityPtr& entity, const CellEntry& copy_entry)
-		{
-			cell->objects.push_back( std::make_pair(entity, copy_entry) );
-			return cell->objects.back().second;
-		}
-
-		//! Creates an entry for the given Entity in the given cell
-		CellEntry& createEntry(Cell* cell, const EntityPtr& entity)
-		{
-			return createEntry(cell, entity, CellEntry());
-		}
-
-	}
-#endif
-
 	StreamingManager::StreamingCamera& StreamingManager::createStreamingCamera(PlayerID owner, const CameraPtr& cam, float range)
 	{
 		CamerasMutex_t::scoped_lock lock(m_CamerasMutex);
@@ -357,6 +343,13 @@ namespace FusionEngine
 		return m_Range;
 	}
 
+	void StreamingManager::GetStreamPositions(std::vector<Vector2>& positions_out)
+	{
+		CamerasMutex_t::scoped_lock lock(m_CamerasMutex);
+		for (auto it = m_Cameras.begin(), end = m_Cameras.end(); it != end; ++it)
+			positions_out.push_back(it->streamPosition);
+	}
+
 	//clan::Rectf StreamingManager::CalculateActiveArea(ObjectID net_idx) const
 	//{
 	//	clan::Rectf area;
@@ -394,10 +387,9 @@ namespace FusionEngine
 
 	Cell *StreamingManager::CellAtCellLocation(const CellHandle& cell_location)
 	{
-		//return &m_Cells[iy*m_XCellCount+ix];
-		auto _where = m_Cells.find(cell_location);
-		if (_where != m_Cells.end())
-			return _where->second.get();
+		auto entry = m_Cells.find(cell_location);
+		if (entry)
+			return entry->get();
 		else
 			return nullptr;
 	}
@@ -439,24 +431,28 @@ namespace FusionEngine
 	{
 		auto lbLoc = ToCellLocation(lb);
 		auto ubLoc = ToCellLocation(ub);
+		const clan::Rect range(lbLoc.x, lbLoc.y, ubLoc.x, ubLoc.y);
 
-		if (!runQueryOnObjects(m_TheVoid.objects, fn, lb, ub))
-			return;
-
-		auto lbEntry = m_Cells.lower_bound(lbLoc);
-		for (auto cit = lbEntry, cend = m_Cells.upper_bound(ubLoc); cit != cend; ++cit)
+		// Only the cells (and Void lists for cells) within the rect are visited
+		bool keepGoing = true;
+		m_TheVoid.for_each_in_range(range, [&](const CellHandle&, const std::shared_ptr<Cell>& waiting)
 		{
-			if (!runQueryOnObjects(cit->second->objects, fn, lb, ub))
-				return;
-		}
+			if (keepGoing)
+				keepGoing = runQueryOnObjects(waiting->objects, fn, lb, ub);
+		});
+		m_Cells.for_each_in_range(range, [&](const CellHandle&, const std::shared_ptr<Cell>& cell)
+		{
+			if (keepGoing && cell)
+				keepGoing = runQueryOnObjects(cell->objects, fn, lb, ub);
+		});
 	}
 
 	std::shared_ptr<Cell>& StreamingManager::RetrieveCell(const CellHandle &location)
 	{
-		auto _where = m_Cells.lower_bound(location);
-		if (_where != m_Cells.end() && _where->first == location)
+		auto entry = m_Cells.find(location);
+		if (entry)
 		{
-			auto& cell = _where->second;
+			auto& cell = *entry;
 
 			// If the held pointer is invalid, the cell is waiting to be stored or the cell is unloaded (and not waiting to be loaded): Retrieve
 			if (!cell || cell->waiting == Cell::Store || (!cell->IsLoaded() && cell->waiting == Cell::Ready))
@@ -470,11 +466,30 @@ namespace FusionEngine
 		else
 		{
 			// Retrieve and insert a new cell entry
-			auto cell = m_Archivist->Retrieve(location.x, location.y);
-			return m_Cells.insert(_where, std::make_pair(location, cell))->second;
+			return m_Cells.insert(location, claimOrRetrieveCell(location));
 		}
 	}
 
+	std::shared_ptr<Cell> StreamingManager::claimOrRetrieveCell(const CellHandle& location)
+	{
+		if (auto cell = claimHotCell(location))
+			return cell;
+		++m_HotCellStats.misses;
+
+		auto prefetched = m_PrefetchedCells.find(location);
+		if (prefetched != m_PrefetchedCells.end())
+		{
+			auto cell = std::move(prefetched->second.cell);
+			m_PrefetchedCells.erase(prefetched);
+			// Promote the request if the cell hasn't finished loading yet
+			if (!cell->IsLoaded())
+				cell = m_Archivist->Retrieve(location.x, location.y);
+			return cell;
+		}
+		else
+			return m_Archivist->Retrieve(location.x, location.y);
+	}
+
 	bool StreamingManager::ConfirmRetrieval(const CellHandle &location, Cell* cell)
 	{
 		if (cell->IsRetrieved())
@@ -489,8 +504,8 @@ namespace FusionEngine
 	void StreamingManager::StoreWhenDereferenced(const CellHandle& location)
 	{
 		auto entry = m_Cells.find(location);
-		if (entry != m_Cells.end())
-			m_CellsToStore.insert(*entry);
+		if (entry)
+			m_CellsToStore.insert(std::make_pair(location, *entry));
 	}
 
 	void StreamingManager::StoreWhenDereferenced(const CellHandle& location, const std::shared_ptr<Cell>& cell)
@@ -498,30 +513,126 @@ namespace FusionEngine
 		m_CellsToStore.insert(std::make_pair(location, cell));
 	}
 
-	void StreamingManager::StoreWhenDereferenced(const CellMap_t::iterator& entry)
+	void StreamingManager::StoreCell(const CellHandle& location)
 	{
-		FSN_ASSERT(entry != m_Cells.end());
-		m_CellsToStore.insert(*entry);
+		auto entry = m_Cells.find(location);
+		FSN_ASSERT(entry);
+		auto cell = std::move(*entry);
+		m_Cells.erase(location);
+		cacheOrStoreCell(location, std::move(cell));
 	}
 
-	void StreamingManager::StoreCell(const CellHandle& location)
+	namespace
 	{
-		StoreCell(m_Cells.find(location));
+		//! Estimates the memory used by a loaded cell and its (inactive) entities
+		size_t estimateCellSize(const Cell& cell)
+		{
+			size_t bytes = sizeof(Cell)
+				+ cell.objects.capacity() * sizeof(Cell::EntityEntryPair)
+				+ (cell.positionsX.capacity() + cell.positionsY.capacity()) * sizeof(float);
+			for (auto it = cell.objects.begin(), end = cell.objects.end(); it != end; ++it)
+			{
+				if (it->first)
+					bytes += sizeof(Entity) + it->first->GetComponents().size() * s_EstimatedComponentSize;
+				if (it->second.data)
+					bytes += it->second.data->GetNumberOfBytesUsed();
+			}
+			return bytes;
+		}
 	}
 
-	void StreamingManager::StoreCell(const CellMap_t::iterator& entry)
+	void StreamingManager::cacheOrStoreCell(const CellHandle& location, std::shared_ptr<Cell> cell)
 	{
-		m_Archivist->Store(entry->first.x, entry->first.y, std::move(entry->second));
-		m_Cells.erase(entry);
+		FSN_ASSERT(cell);
+		FSN_ASSERT(m_HotCellIndex.find(location) == m_HotCellIndex.end());
+
+		if (m_MaxHotCellBytes == 0)
+		{
+			m_Archivist->Store(location.x, location.y, std::move(cell));
+			return;
+		}
+
+		AddHist(location, "Added to hot-cell cache");
+
+		HotCell hot;
+		hot.location = location;
+		hot.bytes = estimateCellSize(*cell);
+		hot.cell = std::move(cell);
+
+		m_HotCellStats.bytes += hot.bytes;
+		++m_HotCellStats.numCells;
+		m_HotCells.push_front(std::move(hot));
+		m_HotCellIndex[location] = m_HotCells.begin();
+
+		evictHotCells(m_MaxHotCellBytes);
+	}
+
+	std::shared_ptr<Cell> StreamingManager::claimHotCell(const CellHandle& location)
+	{
+		auto entry = m_HotCellIndex.find(location);
+		if (entry == m_HotCellIndex.end())
+			return std::shared_ptr<Cell>();
+
+		AddHist(location, "Claimed from hot-cell cache");
+
+		auto hot = entry->second;
+		std::shared_ptr<Cell> cell = std::move(hot->cell);
+		m_HotCellStats.bytes -= hot->bytes;
+		--m_HotCellStats.numCells;
+		++m_HotCellStats.hits;
+
+		m_HotCells.erase(hot);
+		m_HotCellIndex.erase(entry);
+
+		return cell;
+	}
+
+	Cell* StreamingManager::findHotCell(const CellHandle& location) const
+	{
+		auto entry = m_HotCellIndex.find(location);
+		if (entry != m_HotCellIndex.end())
+			return entry->second->cell.get();
+		else
+			return nullptr;
+	}
+
+	void StreamingManager::evictHotCells(const size_t max_bytes)
+	{
+		while (m_HotCellStats.bytes > max_bytes && !m_HotCells.empty())
+		{
+			auto& hot = m_HotCells.back();
+
+			AddHist(hot.location, "Evicted from hot-cell cache");
+			// This should be the only reference, so the archivist will unload the cell once it's written
+			m_Archivist->Store(hot.location.x, hot.location.y, std::move(hot.cell));
+
+			m_HotCellStats.bytes -= hot.bytes;
+			--m_HotCellStats.numCells;
+			++m_HotCellStats.evictions;
+
+			m_HotCellIndex.erase(hot.location);
+			m_HotCells.pop_back();
+		}
+	}
+
+	void StreamingManager::flushHotCells()
+	{
+		for (auto it = m_HotCells.begin(), end = m_HotCells.end(); it != end; ++it)
+			m_Archivist->Store(it->location.x, it->location.y, std::move(it->cell));
+		m_HotCells.clear();
+		m_HotCellIndex.clear();
+		m_HotCellStats.numCells = m_HotCellStats.bytes = 0;
 	}
 
 	void StreamingManager::StoreAllCells(bool refresh_next_update)
 	{
+		cancelPrefetches();
+
 		const unsigned int waitLimit = 60000;
 		std::uint64_t timeWaiting = 0;
 		std::uint64_t lastTick = clan::System::get_time();
 
-		while (!m_TheVoid.objects.empty())
+		while (m_NumEntitiesInTheVoid > 0)
 		{
 			clan::System::sleep(60);
 			Update(Default);
@@ -535,14 +646,15 @@ namespace FusionEngine
 				FSN_EXCEPT(Exception, "Moving entities out of The Void took too long");
 		}
 
-		for (auto it = m_Cells.begin(), end = m_Cells.end(); it != end; ++it)
+		// Cached cells have to be written too (they are dropped, since they aren't in use)
+		flushHotCells();
+
+		m_Cells.for_each([this](const CellHandle& loc, const std::shared_ptr<Cell>& cell)
 		{
-			const auto& loc = it->first;
-			auto& cell = it->second;
 			FSN_ASSERT(cell); // validate the entry
 
 			m_Archivist->Store(loc.x, loc.y, cell);
-		}
+		});
 		// Not dropping the cell references here (which could be done by
 		//  clearing m_Cells) informs the archivist that the cells are
 		//  still in use, despite being stored (so it wont destroy their
@@ -579,28 +691,21 @@ namespace FusionEngine
 #ifdef STREAMING_USEMAP
 			entry = &cell->objects[entity.get()];
 #else
-			entry = &createEntry(cell, entity/*.get()*/);
+			entry = &cell->AddEntry(entity, entityPosition);
 #endif
 		}
 		else
 		{
-			Cell::mutex_t::scoped_lock voidLock(m_TheVoid.mutex);
-			cell = &m_TheVoid;
-			entity->SetStreamingCellIndex(s_VoidCellIndex);
-
-#ifdef STREAMING_USEMAP
-			entry = &cell->objects[entity.get()];
-#else
-			entry = &createEntry(cell, entity/*.get()*/);
-#endif
+			Cell::mutex_t::scoped_lock voidLock(m_VoidMutex);
+			entry = &addToTheVoid(cellIndex, entity, entityPosition);
+			cell = findVoidCell(entity);
 
 			m_CellsBeingLoaded.insert(std::make_pair(cellIndex, cellSpt));
 		}
 
 		FSN_ASSERT(entry);
-		entry->x = entityPosition.x; entry->y = entityPosition.y;
 
-		activateInView(cellIndex, cell, entry, entity, true);
+		activateInView(cellIndex, cell, entry, entity, entityPosition, true);
 		if (!entry->active) // activateInView assumes that the entry's current state has been propagated - it hasn't in this case, since the entry was just added
 		{
 			//cell->EntryReferenced(); // Otherwise the counter will be off when OnDeactivated is called
@@ -619,14 +724,27 @@ namespace FusionEngine
 		if (entity->GetStreamingCellIndex() != s_VoidCellIndex)
 		{
 			auto cellEntry = m_Cells.find(entity->GetStreamingCellIndex());
-			if (cellEntry != m_Cells.end())
+			if (cellEntry)
 			{
-				cell = cellEntry->second.get();
+				cell = cellEntry->get();
 			}
+			else
+				cell = findHotCell(entity->GetStreamingCellIndex());
 		}
 		else
 		{
-			cell = &m_TheVoid;
+			Cell::mutex_t::scoped_lock lock(m_VoidMutex);
+			if (Cell* waiting = findVoidCell(entity))
+			{
+				auto _where = waiting->FindEntry(entity);
+				if (_where != waiting->objects.end())
+				{
+					if (_where->second.active)
+						waiting->EntryUnreferenced();
+					removeFromTheVoid(entity->GetStreamingTargetCell(), entity->GetStreamingCellSlot());
+					AddHist(s_VoidCellIndex, "Entry removed due to entity being destroyed");
+				}
+			}
 		}
 		if (cell)
 		{
@@ -635,13 +753,17 @@ namespace FusionEngine
 #ifdef STREAMING_USEMAP
 			auto _where = cell->objects.find(entity.get());
 #else
-			auto _where = findEntityInCell(cell, entity/*.get()*/);
+			auto _where = cell->FindEntry(entity);
 #endif
 			if (_where != cell->objects.end())
 			{
 				if (_where->second.active)
 					cell->EntryUnreferenced();
+#ifdef STREAMING_USEMAP
 				cell->objects.erase(_where);
+#else
+				cell->RemoveEntry(_where);
+#endif
 				AddHist(entity->GetStreamingCellIndex(), "Entry removed due to entity being destroyed");
 			}
 			else
@@ -681,7 +803,7 @@ namespace FusionEngine
 #ifdef STREAMING_USEMAP
 				_where = currentCell->objects.find(entityKey);
 #else
-				_where = rFindEntityInCell(currentCell, entityKey);
+				_where = currentCell->FindEntry(entityKey);
 #endif
 				FSN_ASSERT(_where != currentCell->objects.end());
 				if (_where != currentCell->objects.end())
@@ -700,10 +822,11 @@ namespace FusionEngine
 		}
 		else// if (entity->GetStreamingCellIndex() == s_VoidCellIndex)
 		{
-			currentCell = &m_TheVoid;
+			currentCell_lock.acquire(m_VoidMutex);
+			currentCell = findVoidCell(entityKey);
+			FSN_ASSERT(currentCell);
 
-			currentCell_lock.acquire(currentCell->mutex);
-			_where = rFindEntityInCell(currentCell, entityKey);
+			_where = currentCell->FindEntry(entityKey);
 			FSN_ASSERT( _where != currentCell->objects.end() );
 			cellEntry = &_where->second;
 		}
@@ -714,18 +837,21 @@ namespace FusionEngine
 			currentCell = CellAtCellLocation(currentLocation);
 
 			currentCell_lock = Cell::mutex_t::scoped_lock(currentCell->mutex);
-			currentCell->objects.push_back(std::make_pair(entity, CellEntry()));
-			cellEntry = &currentCell->objects.back().second;
+			cellEntry = &currentCell->AddEntry(entity, Vector2(new_x, new_y));
 
 			entity->SetStreamingCellIndex(currentLocation);
 		}
 #endif
+		const bool inTheVoid = entity->GetStreamingCellIndex() == s_VoidCellIndex;
 
 		FSN_ASSERT(cellEntry != nullptr);
 		//FSN_ASSERT(currentCell_lock && currentCell_lock.owns_lock());
 
-		bool move = !fe_fequal(cellEntry->x, new_x, 0.001f) || !fe_fequal(cellEntry->y, new_y, 0.001f);
-		const bool warp = diff(cellEntry->x, new_x) > 50.0f || diff(cellEntry->y, new_y) > 50.0f;
+		const size_t currentSlot = entity->GetStreamingCellSlot();
+		const Vector2 storedPos = currentCell->GetEntryPosition(currentSlot);
+
+		bool move = !fe_fequal(storedPos.x, new_x, 0.001f) || !fe_fequal(storedPos.y, new_y, 0.001f);
+		const bool warp = diff(storedPos.x, new_x) > 50.0f || diff(storedPos.y, new_y) > 50.0f;
 
 		// Move the object, updating the current cell if necessary
 		CellHandle newCellLocation = ToCellLocation(new_x, new_y);
@@ -737,19 +863,18 @@ namespace FusionEngine
 			// Don't update the stored position if the object hasn't moved far enough to be re-checked for activation
 			//  (this way slow moving objects will (hopefully) eventually get re-checked)
 			if (move)
-			{
-				cellEntry->x = new_x;
-				cellEntry->y = new_y;
-			}
+				currentCell->SetEntryPosition(currentSlot, Vector2(new_x, new_y));
 		}
 		else
 		{
 			Cell::mutex_t::scoped_lock newCell_lock;
 			const bool lockAcquired = newCell_lock.try_acquire(newCell->mutex);
-			if (!lockAcquired || !newCell->IsLoaded())
+			const bool newCellLoaded = lockAcquired && newCell->IsLoaded();
+			// Where the entity will wait (in The Void) if the target cell isn't ready
+			const CellHandle targetLocation = newCellLocation;
+			if (!newCellLoaded)
 			{
 				// Since the target cell isn't ready, move the entity into The Void (temporarily)
-				newCell = &m_TheVoid;
 				newCellLocation = s_VoidCellIndex;
 
 				move = true;
@@ -757,64 +882,85 @@ namespace FusionEngine
 				// Release the lock on the new cell if it was acquired (The Void's lock applies now)
 				if (lockAcquired)
 					newCell_lock.release();
-				// Don't need a new lock if the entity is already in The Void, as that cell's lock was acquired above
-				if (currentCell != &m_TheVoid)
+				// Don't need a new lock if the entity is already in The Void, as that lock was acquired above
+				if (!inTheVoid)
 				{
-					newCell_lock.acquire(m_TheVoid.mutex);
+					newCell_lock.acquire(m_VoidMutex);
 					//FSN_ASSERT(newCell_lock);
 				}
+				// The cell has loaded, but it was locked: try to move the entities waiting for it next update
+				if (!lockAcquired && newCell->IsLoaded())
+					m_VoidCellsToRehome.push_back(targetLocation);
 			}
-			
+
+			if (!newCellLoaded && inTheVoid && entity->GetStreamingTargetCell() == targetLocation)
+			{
+				// Still waiting for the same cell (just update the stored position)
+				currentCell->SetEntryPosition(currentSlot, Vector2(new_x, new_y));
+			}
+			else
 			{
 				AddHist(newCellLocation, "Entry added from another cell");
 
+				const CellHandle currentLocation = entity->GetStreamingCellIndex();
+				const CellHandle currentTarget = entity->GetStreamingTargetCell();
+				const CellEntry currentEntry = *cellEntry;
+
 				// add the entity to its new cell
+				if (newCellLoaded)
+				{
 #ifdef STREAMING_USEMAP
-				CellEntry &newEntry = newCell->objects[entityKey];
-				newEntry = *cellEntry; // Copy the current cell data
+					CellEntry &newEntry = newCell->objects[entityKey];
+					newEntry = currentEntry; // Copy the current cell data
 #else
-				newCell->objects.emplace_back( std::make_pair(entityKey, *cellEntry) );
-				CellEntry &newEntry = newCell->objects.back().second;
+					CellEntry &newEntry = newCell->AddEntry(entityKey, Vector2(new_x, new_y), currentEntry);
 #endif
-				cellEntry = &newEntry; // Change the pointer (since it is used again below)
-			}
+					cellEntry = &newEntry; // Change the pointer (since it is used again below)
+				}
+				else
+				{
+					cellEntry = &addToTheVoid(targetLocation, entityKey, Vector2(new_x, new_y), currentEntry);
+					newCell = findVoidCell(entityKey);
+				}
 
-			if (cellEntry->active)
-				newCell->EntryReferenced();
+				if (cellEntry->active)
+					newCell->EntryReferenced();
 
-			/*if (lock.owns_lock())
-				lock.unlock();*/
+				/*if (lock.owns_lock())
+					lock.unlock();*/
 
-			// remove from current cell
-			if (currentCell != nullptr)
-			{
-				//FSN_ASSERT(currentCell_lock);
+				// remove from current cell
+				if (currentCell != nullptr)
+				{
+					//FSN_ASSERT(currentCell_lock);
+					AddHist(currentLocation, "Entry moved to another cell");
+					if (currentEntry.active)
+					{
+						currentCell->EntryUnreferenced();
+					}
 #ifdef STREAMING_USEMAP
-				currentCell->objects.erase(_where);
+					currentCell->objects.erase(_where);
 #else
-				rRemoveEntityFromCell(currentCell, entityKey);
+					// (This may drop the Void list that the entity was in, but currentCell is re-assigned below)
+					if (inTheVoid)
+						removeFromTheVoid(currentTarget, currentSlot);
+					else
+						currentCell->RemoveEntry(currentSlot);
 #endif
-				AddHist(entity->GetStreamingCellIndex(), "Entry moved to another cell");
-				if (cellEntry->active)
-				{
-					currentCell->EntryUnreferenced();
 				}
-			}
-
-			currentCell = newCell;
 
-			cellEntry->x = new_x;
-			cellEntry->y = new_y;
+				currentCell = newCell;
 
-			entity->SetStreamingCellIndex(newCellLocation);
-			if (entity->IsSyncedEntity())
-				m_Archivist->UpdateActiveEntityLocation(entity->GetID(), newCellLocation);
+				entity->SetStreamingCellIndex(newCellLocation);
+				if (entity->IsSyncedEntity())
+					m_Archivist->UpdateActiveEntityLocation(entity->GetID(), newCellLocation);
+			}
 		}
 
 		// see if the object needs to be activated or deactivated
 		if (move && !entity->IsTerrain())
 		{
-			activateInView(newCellLocation, currentCell, cellEntry, entity, warp);
+			activateInView(newCellLocation, currentCell, cellEntry, entity, Vector2(new_x, new_y), warp);
 		}
 
 		if (cellEntry->pendingDeactivation)
@@ -850,8 +996,12 @@ namespace FusionEngine
 	{
 		CellHandle location = ToCellLocation(position);
 		// Check whether the cell is loaded (cells can of course be loaded with some inactive entities)
-		auto _where = m_Cells.find(location);
-		if (_where == m_Cells.end()) // The cell isn't loaded (write directly to the cache)
+		Cell* cell = nullptr;
+		if (auto _where = m_Cells.find(location))
+			cell = _where->get();
+		else
+			cell = findHotCell(location);
+		if (!cell) // The cell isn't loaded (write directly to the cache)
 		{
 			auto con = continuous_data ? continuous_data->GetData() : nullptr;
 			auto conLength = continuous_data ? continuous_data->GetNumberOfBytesUsed() : 0;
@@ -865,9 +1015,8 @@ namespace FusionEngine
 		}
 		else // The cell is loaded, this entity just happens to be inactive
 		{
-			const auto& cell = _where->second;
 			EntityPtr entity; CellEntry* cellEntry;
-			if (findEntityById(entity, cellEntry, cell.get(), id))
+			if (findEntityById(entity, cellEntry, cell, id))
 			{
 				FSN_ASSERT_MSG(cellEntry->active != CellEntry::Active, "That entity is still active, you dope!");
 				if (continuous_data)
@@ -887,7 +1036,8 @@ namespace FusionEngine
 
 			Cell::mutex_t::scoped_lock lock(currentCell->mutex);
 
-			auto it = findEntityInCell(currentCell.get(), entity);
+			auto it = currentCell->FindEntry(entity);
+			FSN_ASSERT(it != currentCell->objects.end());
 			FSN_ASSERT(it->second.active != CellEntry::Inactive);
 			it->second.active = CellEntry::Inactive;
 
@@ -905,16 +1055,104 @@ namespace FusionEngine
 		}
 		else// if (entity->GetStreamingCellIndex() == s_VoidCellIndex)
 		{
-			auto& currentCell = m_TheVoid;
+			Cell::mutex_t::scoped_lock lock(m_VoidMutex);
 
-			Cell::mutex_t::scoped_lock lock(currentCell.mutex);
+			Cell* currentCell = findVoidCell(entity);
+			FSN_ASSERT(currentCell);
 
-			auto it = findEntityInCell(&currentCell, entity/*.get()*/);
+			auto it = currentCell->FindEntry(entity);
+			FSN_ASSERT(it != currentCell->objects.end());
 			FSN_ASSERT(it->second.active != CellEntry::Inactive);
 			it->second.active = CellEntry::Inactive;
 
-			currentCell.EntryUnreferenced();
+			currentCell->EntryUnreferenced();
+		}
+	}
+
+	CellEntry& StreamingManager::addToTheVoid(const CellHandle& target, const EntityPtr& entity, const Vector2& position, const CellEntry& entry)
+	{
+		auto waiting = m_TheVoid.find(target);
+		if (!waiting)
+			waiting = &m_TheVoid.insert(target, std::make_shared<Cell>());
+
+		entity->SetStreamingCellIndex(s_VoidCellIndex);
+		entity->SetStreamingTargetCell(target);
+		++m_NumEntitiesInTheVoid;
+
+		return (*waiting)->AddEntry(entity, position, entry);
+	}
+
+	Cell* StreamingManager::findVoidCell(const EntityPtr& entity)
+	{
+		FSN_ASSERT(entity->GetStreamingCellIndex() == s_VoidCellIndex);
+		auto waiting = m_TheVoid.find(entity->GetStreamingTargetCell());
+		return waiting ? waiting->get() : nullptr;
+	}
+
+	void StreamingManager::removeFromTheVoid(const CellHandle& target, size_t slot)
+	{
+		auto waiting = m_TheVoid.find(target);
+		FSN_ASSERT(waiting);
+
+		(*waiting)->RemoveEntry(slot);
+		FSN_ASSERT(m_NumEntitiesInTheVoid > 0);
+		--m_NumEntitiesInTheVoid;
+
+		if ((*waiting)->objects.empty())
+			m_TheVoid.erase(target);
+	}
+
+	bool StreamingManager::rehomeVoidEntities(const CellHandle& location)
+	{
+		auto waitingEntry = m_TheVoid.find(location);
+		if (!waitingEntry)
+			return true;
+		// Hold a ref, since the list is dropped from The Void below
+		std::shared_ptr<Cell> waiting = *waitingEntry;
+
+		auto actualCell = RetrieveCell(location);
+		if (!actualCell->IsLoaded())
+		{
+			// The cell may have been stored since it loaded: wait for it to load again
+			m_CellsBeingLoaded.insert(std::make_pair(location, std::move(actualCell)));
+			return true;
 		}
+
+		Cell::mutex_t::scoped_lock lock;
+		if (!lock.try_acquire(actualCell->mutex) || !actualCell->IsLoaded())
+			return false;
+
+		bool anyActive = false;
+		for (size_t i = 0, count = waiting->objects.size(); i < count; ++i)
+		{
+			auto& entityEntry = waiting->objects[i];
+			const EntityPtr entity = entityEntry.first;
+
+			auto& newEntry = actualCell->AddEntry(entity, waiting->GetEntryPosition(i), entityEntry.second);
+			if (newEntry.active)
+			{
+				actualCell->EntryReferenced();
+				anyActive = true;
+				AddHist(s_VoidCellIndex, "Entry transferred to correct cell");
+			}
+
+			entity->SetStreamingCellIndex(location);
+		}
+		AddHist(location, "Added entities that were held in The Void", (unsigned int)waiting->objects.size());
+
+		FSN_ASSERT(m_NumEntitiesInTheVoid >= waiting->objects.size());
+		m_NumEntitiesInTheVoid -= waiting->objects.size();
+		m_TheVoid.erase(location);
+
+		if (!anyActive && !actualCell->IsActive() && !actualCell->inRange)
+		{
+			AddHist(location, "Storing cell again after Retrieving it for entities held in The Void");
+			lock.release();
+			m_Cells.erase(location);
+			cacheOrStoreCell(location, std::move(actualCell));
+		}
+
+		return true;
 	}
 
 	bool StreamingManager::ActivateEntity(ObjectID id)
@@ -951,11 +1189,19 @@ namespace FusionEngine
 		}
 		else// if (loc == s_VoidCellIndex)
 		{
-			// Check The Void for the cell
-			Cell* cell = &m_TheVoid;
+			// Check The Void for the entity (the cell it's waiting for isn't known, so all the lists are searched)
+			std::shared_ptr<Cell> cell;
 			EntityPtr entity;
 			CellEntry* entry = nullptr;
-			if (findEntityById(entity, entry, cell, id))
+			{
+				Cell::mutex_t::scoped_lock lock(m_VoidMutex);
+				m_TheVoid.for_each([&](const CellHandle&, const std::shared_ptr<Cell>& waiting)
+				{
+					if (!cell && findEntityById(entity, entry, waiting.get(), id))
+						cell = waiting;
+				});
+			}
+			if (cell)
 			{
 				FSN_ASSERT(entity && entry);
 				if (!entry->active)
@@ -967,16 +1213,14 @@ namespace FusionEngine
 		return false;
 	}
 
-	void StreamingManager::activateInView(const CellHandle& cell_location, Cell *cell, CellEntry *cell_entry, const EntityPtr &entity, bool warp)
+	void StreamingManager::activateInView(const CellHandle& cell_location, Cell *cell, CellEntry *cell_entry, const EntityPtr &entity, const Vector2& entityPosition, bool warp)
 	{
 		FSN_ASSERT(cell);
 
 		CamerasMutex_t::scoped_lock lock(m_CamerasMutex);
 
-		FSN_ASSERT(cell_entry->x == entity->GetPosition().x); // Make sure the entry is up to date whenever this is called
+		FSN_ASSERT(entityPosition.x == entity->GetPosition().x); // Make sure the stored position is up to date whenever this is called
 
-		Vector2 entityPosition(cell_entry->x, cell_entry->y);// = entity->GetPosition();
-		//entityPosition.x = ToRenderUnits(entityPosition.x); entityPosition.y = ToRenderUnits(entityPosition.y);
 		if (std::any_of(m_Cameras.begin(), m_Cameras.end(), [&](const StreamingCamera& cam) { return (entityPosition - cam.streamPosition).length() <= cam.range; }))
 		{
 			if (cell_entry->active != CellEntry::Active)
@@ -991,18 +1235,23 @@ namespace FusionEngine
 	}
 
 	void StreamingManager::ActivateEntity(const CellHandle& location, Cell& cell, const EntityPtr& entity, CellEntry& cell_entry)
+	{
+		activateEntry(location, cell, entity, cell_entry);
+
+		GenerateActivationEvent( entity );
+	}
+
+	void StreamingManager::activateEntry(const CellHandle& location, Cell& cell, const EntityPtr& entity, CellEntry& cell_entry)
 	{
 		FSN_ASSERT(cell_entry.active != CellEntry::Active);
 
-		if (&cell != &m_TheVoid)
+		if (entity->GetStreamingCellIndex() != s_VoidCellIndex)
 			entity->SetStreamingCellIndex(location);
 		//activeObject.cellObjectIndex = cell.GetCellObjectIndex( cellObject );
 		cell_entry.pendingDeactivation = false;
 		cell_entry.active = CellEntry::Active;
 
 		cell.EntryReferenced();
-
-		GenerateActivationEvent( entity );
 	}
 	
 	void StreamingManager::RemoteActivateEntity(CellEntry& cell_entry, ObjectID entity, PlayerID viewer, std::shared_ptr<RakNet::BitStream> state)
@@ -1021,7 +1270,7 @@ namespace FusionEngine
 #ifdef STREAMING_USEMAP
 		auto _where = cell.objects.find(entity.get());
 #else
-		auto _where = findEntityInCell(cell, entity/*.get()*/);
+		auto _where = cell->FindEntry(entity);
 #endif
 		if (_where == cell->objects.end()) return;
 		CellEntry &cellEntry = _where->second;
@@ -1080,6 +1329,20 @@ namespace FusionEngine
 		SignalRemoteActivationEvent(ev);
 	}
 
+	void StreamingManager::publishEvents(CellEvents& events)
+	{
+		auto localIt = events.activationEvents.begin();
+		auto remoteIt = events.remoteActivationEvents.begin();
+		for (auto it = events.isRemote.begin(), end = events.isRemote.end(); it != end; ++it)
+		{
+			if (*it)
+				SignalRemoteActivationEvent(*remoteIt++);
+			else
+				SignalActivationEvent(*localIt++);
+		}
+		events.clear();
+	}
+
 	//const std::set<EntityPtr> &StreamingManager::GetActiveEntities() const
 	//{
 	//	return m_ActiveEntities;
@@ -1123,6 +1386,110 @@ namespace FusionEngine
 		return pointChanged;
 	}
 
+	void StreamingManager::updatePrefetch()
+	{
+		const float dt = DeltaTime::GetDeltaTime();
+		if (m_PrefetchHorizon <= 0.0f || m_MaxPrefetchedCells == 0 || dt <= 0.0f)
+			return;
+
+		m_PrefetchClock += dt;
+
+		// Find the cells that moving cameras will need within the horizon (and how soon each will be needed)
+		std::map<CellHandle, float, CellHandleGreater> wanted;
+		{
+			CamerasMutex_t::scoped_lock lock(m_CamerasMutex);
+			for (auto it = m_Cameras.begin(), end = m_Cameras.end(); it != end; ++it)
+			{
+				const StreamingCamera& cam = *it;
+				// lastVelocity is the distance moved during the last update
+				const Vector2 velocity = cam.lastVelocity * (1.0f / dt);
+				const float speed = velocity.length();
+				if (speed < s_MinPrefetchSpeed)
+					continue;
+
+				// Step along the projected path about a cell at a time (but limit the number of steps for very fast cameras)
+				const float step = std::max(std::min(m_PrefetchHorizon, m_CellSize / speed), m_PrefetchHorizon / 32.0f);
+				for (float t = step; t <= m_PrefetchHorizon; t += step)
+				{
+					clan::Rect range;
+					getCellRange(range, cam.streamPosition + velocity * t, cam.range);
+					for (int iy = range.top; iy <= range.bottom; ++iy)
+					{
+						for (int ix = range.left; ix <= range.right; ++ix)
+						{
+							const CellHandle location(ix, iy);
+							if (m_Cells.contains(location) || m_HotCellIndex.count(location) != 0)
+								continue;
+							auto inserted = wanted.insert(std::make_pair(location, t));
+							if (!inserted.second && t < inserted.first->second)
+								inserted.first->second = t;
+						}
+					}
+				}
+			}
+		}
+
+		// Keep the cells that will be needed soonest
+		std::vector<std::pair<float, CellHandle>> byTimeOfNeed;
+		byTimeOfNeed.reserve(wanted.size());
+		for (auto it = wanted.begin(), end = wanted.end(); it != end; ++it)
+			byTimeOfNeed.push_back(std::make_pair(m_PrefetchClock + it->second, it->first));
+		if (byTimeOfNeed.size() > m_MaxPrefetchedCells)
+		{
+			std::nth_element(byTimeOfNeed.begin(), byTimeOfNeed.begin() + m_MaxPrefetchedCells, byTimeOfNeed.end(),
+				[](const std::pair<float, CellHandle>& a, const std::pair<float, CellHandle>& b) { return a.first < b.first; });
+			byTimeOfNeed.resize(m_MaxPrefetchedCells);
+		}
+		std::sort(byTimeOfNeed.begin(), byTimeOfNeed.end(),
+			[](const std::pair<float, CellHandle>& a, const std::pair<float, CellHandle>& b) { return a.first < b.first; });
+
+		PrefetchedCellMap_t stillWanted;
+		for (auto it = byTimeOfNeed.begin(), end = byTimeOfNeed.end(); it != end; ++it)
+		{
+			const float timeOfNeed = it->first;
+			const CellHandle& location = it->second;
+
+			auto existing = m_PrefetchedCells.find(location);
+			if (existing != m_PrefetchedCells.end())
+			{
+				PrefetchedCell prefetched = std::move(existing->second);
+				m_PrefetchedCells.erase(existing);
+				// Re-prioritise the request if the camera has changed speed / direction
+				if (!prefetched.cell->IsLoaded() && std::abs(prefetched.timeOfNeed - timeOfNeed) > s_PrefetchReprioritiseThreshold)
+				{
+					prefetched.cell = m_Archivist->Prefetch(location.x, location.y, timeOfNeed);
+					prefetched.timeOfNeed = timeOfNeed;
+				}
+				stillWanted[location] = std::move(prefetched);
+			}
+			else
+			{
+				PrefetchedCell prefetched;
+				prefetched.cell = m_Archivist->Prefetch(location.x, location.y, timeOfNeed);
+				prefetched.timeOfNeed = timeOfNeed;
+				stillWanted[location] = std::move(prefetched);
+			}
+		}
+
+		// Anything left over is no longer on any camera's path
+		cancelPrefetches();
+		m_PrefetchedCells.swap(stillWanted);
+	}
+
+	void StreamingManager::cancelPrefetches()
+	{
+		// Prefetched cells haven't been activated, so there's nothing to write back: requests that are still
+		//  pending are canceled, and cells that are loading / loaded are just dropped
+		for (auto it = m_PrefetchedCells.begin(), end = m_PrefetchedCells.end(); it != end; ++it)
+		{
+			if (m_Archivist->CancelPrefetch(it->first.x, it->first.y))
+				AddHist(it->first, "Prefetch canceled");
+			else
+				AddHist(it->first, "Prefetched cell dropped");
+		}
+		m_PrefetchedCells.clear();
+	}
+
 	void StreamingManager::getCellRange(clan::Rect& range, const Vector2& pos, const float cam_range)
 	{
 		// Expand range a little bit to make sure all relevant cells are checked
@@ -1137,111 +1504,122 @@ namespace FusionEngine
 
 	void StreamingManager::deactivateCells(const clan::Rect& inactiveRange)
 	{
-		int iy = inactiveRange.top;
-		int ix = inactiveRange.left;
+		// Cells can't be removed from the grid while it is being iterated, so they are listed and stored afterwards
+		std::vector<CellHandle> cellsToStore;
 
-		auto it = m_Cells.find(CellHandle(ix, iy));
-
-		for (; iy <= inactiveRange.bottom; ++iy)
+		m_Cells.for_each_in_range(inactiveRange, [&](const CellHandle& location, std::shared_ptr<Cell>& cell)
 		{
-			for (ix = inactiveRange.left; ix <= inactiveRange.right; ++ix)
+			cell->inRange = false;
+
+			if (cell->IsLoaded())
 			{
-				// NOTE: this is similar to the code in Update, but it DOESN'T insert a new
-				//  cell if the expected cell is missing:
-				// Check that the next stored cell is the next cell expected in the sequence...
-				if (it == m_Cells.end() || it->first.x != ix || it->first.y != iy)
+				if (!cell->IsActive() && !cell->inRange)
 				{
-					// ... if not, skip to the next cell
-					CellHandle expectedLocation(ix, iy);
-					// Using lower_bound here means that there is a possibility the cell found will be the NEXT expected cell,
-					//  even if it misses this time (the missing cell will be skipped by 'continue'-ing below)
-					auto _where = m_Cells.lower_bound(expectedLocation);
-					if (_where != m_Cells.end() && _where->first == expectedLocation)
-						it = _where;
-					else
-					{
-						it = _where;
-						continue;
-					}
+					AddHist(location, "Store Attempted due to leaving range");
+					cellsToStore.push_back(location);
 				}
-				auto& cell = it->second;
-				
-
-				cell->inRange = false;
-
-				if (cell->IsLoaded())
+				else
 				{
-					if (!cell->IsActive() && !cell->inRange)
-					{
-						AddHist(CellHandle(ix, iy), "Store Attempted due to leaving range");
-						m_Archivist->Store(ix, iy, std::move(cell));
-						m_Cells.erase(it++);
-						//StoreCell(it++);
-						continue;
-					}
-					else
+					// Attempt to access the cell (it will be locked if the archivist is in the process of loading it)
+					Cell::mutex_t::scoped_lock lock;
+					if (lock.try_acquire(cell->mutex))
 					{
-						// Attempt to access the cell (it will be locked if the archivist is in the process of loading it)
-						Cell::mutex_t::scoped_lock lock;
-						if (lock.try_acquire(cell->mutex))
+						for (auto cell_it = cell->objects.begin(), cell_end = cell->objects.end(); cell_it != cell_end; ++cell_it)
 						{
-							for (auto cell_it = cell->objects.begin(), cell_end = cell->objects.end(); cell_it != cell_end; ++cell_it)
-							{
-								CellEntry &cellEntry = cell_it->second;
+							CellEntry &cellEntry = cell_it->second;
 
-								if (cellEntry.active && !cellEntry.pendingDeactivation)
-								{
-									QueueEntityForDeactivation(cellEntry);
-								}
+							if (cellEntry.active && !cellEntry.pendingDeactivation)
+							{
+								QueueEntityForDeactivation(cellEntry);
 							}
 						}
 					}
 				}
-				// Increment the iterator (ready for next iteration) - done
-				//  here so it is still available for potential erase() above
-				++it;
 			}
-			//i += stride;
+		});
+
+		for (auto it = cellsToStore.begin(), end = cellsToStore.end(); it != end; ++it)
+			StoreCell(*it);
+	}
+
+	StreamingManager::StreamCircles::StreamCircles(const LocalStreamPositionsList_t& local_positions, const RemoteStreamPositionsList_t& remote_positions)
+		: numLocal(local_positions.size())
+	{
+		const size_t total = local_positions.size() + remote_positions.size();
+		x.reserve(total); y.reserve(total); rangeSquared.reserve(total);
+		remoteOwners.reserve(remote_positions.size());
+
+		for (auto it = local_positions.begin(), end = local_positions.end(); it != end; ++it)
+		{
+			x.push_back(it->first.x);
+			y.push_back(it->first.y);
+			rangeSquared.push_back(it->second * it->second);
+		}
+		for (auto it = remote_positions.begin(), end = remote_positions.end(); it != end; ++it)
+		{
+			x.push_back(it->first.first.x);
+			y.push_back(it->first.first.y);
+			rangeSquared.push_back(it->first.second * it->first.second);
+			remoteOwners.push_back(it->second);
 		}
 	}
 
-	void StreamingManager::processCell(const CellHandle& cell_location, Cell& cell, const std::list<std::pair<Vector2, float>>& cams, const std::list<std::pair<std::pair<Vector2, float>, PlayerID>>& remote_cams)
+	void StreamingManager::processCell(const CellHandle& cell_location, Cell& cell, const StreamCircles& circles, CellEvents& events_out)
 	{
 		Cell::mutex_t::scoped_lock lock;
 		if (cell.IsLoaded() && lock.try_acquire(cell.mutex) && cell.IsLoaded())
 		{
-			//try
-			//{
-				for (auto cell_it = cell.objects.begin(), cell_end = cell.objects.end(); cell_it != cell_end; ++cell_it)
+			const size_t numCircles = circles.rangeSquared.size();
+
+			// Entries are classified against all stream positions in batches (so the results can stay on the stack)
+			std::array<int32_t, s_ClassifyBatchSize> containingCircle;
+			const size_t count = cell.objects.size();
+			for (size_t batchStart = 0; batchStart < count; batchStart += s_ClassifyBatchSize)
+			{
+				const size_t batchSize = std::min(s_ClassifyBatchSize, count - batchStart);
+				StreamingRangeKernel::ClassifyPositions(
+					cell.positionsX.data() + batchStart, cell.positionsY.data() + batchStart, batchSize,
+					circles.x.data(), circles.y.data(), circles.rangeSquared.data(), numCircles,
+					containingCircle.data());
+
+				for (size_t i = 0; i < batchSize; ++i)
 				{
-//#ifdef _DEBUG
-//				FSN_ASSERT(std::count_if(cell.objects.begin(), cell.objects.end(), [&](const Cell::EntityEntryPair& p) { return p.first == cell_it->first; }) == 1);
-//#endif
-					CellEntry &cellEntry = cell_it->second;
-					Vector2 entityPosition(cellEntry.x, cellEntry.y);
+					auto& entityEntry = cell.objects[batchStart + i];
+					CellEntry &cellEntry = entityEntry.second;
+
+					const int32_t circle = containingCircle[i];
+					const bool inLocalRange = circle != StreamingRangeKernel::s_OutOfRange && size_t(circle) < circles.numLocal;
 
 					// Check if the entry is in range of any cameras, or if it is terrain
 					//  Note that this means terrain will only be deactivated when deactivateCells
 					//  is called on this cell (a range that includes this cell, to be precise)
-					if (cell_it->first->IsTerrain() || std::any_of(cams.begin(), cams.end(),
-						[&](const std::pair<Vector2, float>& cam) { return (entityPosition - cam.first).length() <= cam.second; }))
+					if (inLocalRange || entityEntry.first->IsTerrain())
 					{
 						if (cellEntry.active != CellEntry::Active)
 						{
-							ActivateEntity(cell_location, cell, cell_it->first/*->shared_from_this()*/, cellEntry);
+							activateEntry(cell_location, cell, entityEntry.first, cellEntry);
+
+							ActivationEvent ev;
+							ev.type = ActivationEvent::Activate;
+							ev.entity = entityEntry.first;
+							events_out.push_back(ev);
 						}
 						else
 						{
-							cellEntry.pendingDeactivation = false;						
+							cellEntry.pendingDeactivation = false;
 						}
 					}
 					else
 					{
-						auto camEntry = std::find_if(remote_cams.begin(), remote_cams.end(),
-							[&](const std::pair<std::pair<Vector2, float>, PlayerID>& remote_cam) { return (entityPosition - remote_cam.first.first).length() <= remote_cam.first.second; });
-						if (camEntry != remote_cams.end())
+						// Local circles come first, so any other match is the first remote camera in range
+						if (circle != StreamingRangeKernel::s_OutOfRange)
 						{
-							RemoteActivateEntity(cellEntry, cellEntry.id, camEntry->second, cellEntry.data);
+							RemoteActivationEvent ev;
+							ev.type = RemoteActivationEvent::Activate;
+							ev.entity = cellEntry.id;
+							ev.viewer = circles.remoteOwners[circle - circles.numLocal];
+							ev.state = cellEntry.data;
+							events_out.push_back(ev);
 						}
 
 						if (cellEntry.active)
@@ -1251,13 +1629,7 @@ namespace FusionEngine
 						}
 					}
 				}
-			//}
-			//catch (Exception&)
-			//{
-			//	cell.mutex.unlock();
-			//	throw;
-			//}
-			//cell.mutex.unlock();
+			}
 		}
 	}
 
@@ -1355,67 +1727,41 @@ namespace FusionEngine
 
 		{
 			FSN_PROFILE("TryToClearTheVoid");
-			// Try to clear The Void
-			Cell::mutex_t::scoped_lock lock;
-			if (lock.try_acquire(m_TheVoid.mutex))
+			// Move entities out of The Void when the cells they are waiting for finish loading
+			CellHandle loadedLocation;
+			while (m_LoadedCells.try_pop(loadedLocation))
 			{
-				FSN_PROFILE("VoidLockedWhileClearing");
-				for (auto it = m_TheVoid.objects.begin(), end = m_TheVoid.objects.end(); it != end;/* ++it*/)
+				if (m_TheVoid.contains(loadedLocation))
+					m_VoidCellsToRehome.push_back(loadedLocation);
+			}
+			// Every list is also checked now and then, so entities can't be left waiting if a notification
+			//  is missed (e.g. the cell finished loading just before they started waiting for it)
+			if (m_UpdatesUntilVoidPoll > 0)
+				--m_UpdatesUntilVoidPoll;
+			const bool pollTheVoid = m_UpdatesUntilVoidPoll == 0 && m_NumEntitiesInTheVoid > 0;
+			if (!m_VoidCellsToRehome.empty() || pollTheVoid)
+			{
+				Cell::mutex_t::scoped_lock lock;
+				if (lock.try_acquire(m_VoidMutex))
 				{
-					auto location = ToCellLocation(it->second.x, it->second.y);
-					auto actualCell = RetrieveCell(location);
-
-					if (!actualCell->IsLoaded())
+					FSN_PROFILE("VoidLockedWhileClearing");
+					if (pollTheVoid)
 					{
-						//Cell::mutex_t::scoped_try_lock lock(actualCell->mutex);
-						//if (lock && !actualCell->IsLoaded())
-						//{
-							m_CellsBeingLoaded.insert(std::make_pair(std::move(location), std::move(actualCell)));
-						//}
+						m_TheVoid.for_each([this](const CellHandle& location, const std::shared_ptr<Cell>&)
+						{
+							m_VoidCellsToRehome.push_back(location);
+						});
+						m_UpdatesUntilVoidPoll = s_VoidPollInterval;
 					}
-					else
+					std::vector<CellHandle> toRehome;
+					toRehome.swap(m_VoidCellsToRehome);
+					std::sort(toRehome.begin(), toRehome.end(), CellHandleGreater());
+					toRehome.erase(std::unique(toRehome.begin(), toRehome.end()), toRehome.end());
+					for (auto it = toRehome.begin(), end = toRehome.end(); it != end; ++it)
 					{
-						Cell::mutex_t::scoped_lock lock;
-						if (lock.try_acquire(actualCell->mutex) && actualCell->IsLoaded())
-						{
-							auto entity = it->first;
-							// TODO:
-							//changeCell(*it, m_TheVoid, *cell);
-							// OR
-							// m_TheVoid.RemoveEntry(it); <- one of the overloads will take an iterator, the others will take index / entry
-							// cell->AddEntry(*it);
-
-							actualCell->objects.push_back( std::move(*it) );
-							auto& newEntry = actualCell->objects.back().second;
-
-							AddHist(location, "Added entity that was held in The Void");
-
-							if (newEntry.active)
-								actualCell->EntryReferenced();
-							else if (!actualCell->IsActive())
-							{
-								AddHist(location, "Storing cell again after Retrieving it for an entity spawned in The Void");
-								m_Archivist->Store(location.x, location.y, std::move(actualCell));
-								m_Cells.erase(location);
-								//StoreCell(location);
-							}
-
-							// remove from current cell
-							{
-								it = m_TheVoid.objects.erase(it);
-								end = m_TheVoid.objects.end();
-								if (newEntry.active)
-								{
-									AddHist(s_VoidCellIndex, "Entry transferred to correct cell");
-									m_TheVoid.EntryUnreferenced();
-								}
-							}
-
-							entity->SetStreamingCellIndex(location);
-							continue;
-						}
+						if (!rehomeVoidEntities(*it))
+							m_VoidCellsToRehome.push_back(*it);
 					}
-					++it;
 				}
 			}
 		}
@@ -1428,7 +1774,7 @@ namespace FusionEngine
 			{
 				auto& cellLocation = it->first;
 
-				FSN_ASSERT(m_Cells.find(cellLocation) != m_Cells.end());
+				FSN_ASSERT(m_Cells.contains(cellLocation));
 				auto cell = CellAtCellLocation(cellLocation);
 
 				if (cell->IsLoaded())
@@ -1564,6 +1910,11 @@ namespace FusionEngine
 			}
 		} // don't need the scoped mutex lock for the cameras collection after here
 
+		{
+			FSN_PROFILE("PrefetchCells");
+			updatePrefetch();
+		}
+
 		// TODO: separate activeRanges and staleActiveRanges? (processCell on activeRanges, check m_CellsBeingLoaded for cells to process on staleActiveRanges)
 
 		// This set is just used to make sure cells are processed if they finish loading after the camera that requested them stops moving (see else clause below):
@@ -1621,7 +1972,22 @@ namespace FusionEngine
 
 			{
 				FSN_PROFILE("ProcessEntitiesInActiveCells");
-			processCell(s_VoidCellIndex, m_TheVoid, allLocalStreamPositions, allRemoteStreamPositions);
+			{
+				const StreamCircles allCircles(allLocalStreamPositions, allRemoteStreamPositions);
+				CellEvents voidEvents;
+				{
+					Cell::mutex_t::scoped_lock lock(m_VoidMutex);
+					m_TheVoid.for_each([&](const CellHandle&, const std::shared_ptr<Cell>& waiting)
+					{
+						processCell(s_VoidCellIndex, *waiting, allCircles, voidEvents);
+					});
+				}
+				publishEvents(voidEvents);
+			}
+
+			// Loaded cells within the active ranges are listed here, to be processed in parallel below
+			std::list<StreamCircles> activeRangeCircles;
+			std::vector<std::tuple<CellHandle, std::shared_ptr<Cell>, const StreamCircles*>> cellsToProcess;
 
 			for (auto it = activeRanges.begin(), end = activeRanges.end(); it != end; ++it)
 			{
@@ -1631,50 +1997,41 @@ namespace FusionEngine
 
 				if (activeRange.get_width() >= 0 && activeRange.get_height() >= 0)
 				{
-					int iy = activeRange.top;
-					int ix = activeRange.left;
+					activeRangeCircles.push_back(StreamCircles(streamPositions, remotePositions));
+					const StreamCircles& circles = activeRangeCircles.back();
 
-					auto it = m_Cells.find(CellHandle(ix, iy));
+					Cell::mutex_t::scoped_lock lock(m_VoidMutex); // So m_CellsBeingLoaded can be accessed safely
 
-					Cell::mutex_t::scoped_lock lock(m_TheVoid.mutex); // So m_CellsBeingLoaded can be accessed safely
-
-					for (; iy <= activeRange.bottom; ++iy)
+					for (int iy = activeRange.top; iy <= activeRange.bottom; ++iy)
 					{
-						for (ix = activeRange.left; ix <= activeRange.right; ++ix)
+						for (int ix = activeRange.left; ix <= activeRange.right; ++ix)
 						{
-							// Check that the next stored cell is the next cell expected in the sequence...
-							if (it == m_Cells.end() || it->first.x != ix || it->first.y != iy)
+							const CellHandle location(ix, iy);
+
+							// Find the cell or create a new cell to load
+							auto entry = m_Cells.find(location);
+							if (!entry)
 							{
-								// ... if not, find the next cell or create a new cell to load
-								CellHandle expectedLocation(ix, iy);
-								auto _where = m_Cells.lower_bound(expectedLocation);
-								if (_where != m_Cells.end() && _where->first == expectedLocation)
-									it = _where;
-								else
-								{
-									auto newCell = m_Archivist->Retrieve(expectedLocation.x, expectedLocation.y);
-									auto result = m_Cells.insert(_where, std::make_pair(std::move(expectedLocation), std::move(newCell)));
-									it = result;
+								entry = &m_Cells.insert(location, claimOrRetrieveCell(location));
 
 #ifdef FSN_PROFILING_ENABLED
-									it->second->timeRequested = tbb::tick_count::now();
-									it->second->loadTimeRecorded = false;
+								(*entry)->timeRequested = tbb::tick_count::now();
+								(*entry)->loadTimeRecorded = false;
 #endif
-									AddHist(expectedLocation, "Retrieved due to entering range");
-									
-									m_CellsBeingLoaded.insert(*it);
-								}
+								AddHist(location, "Retrieved due to entering range");
+
+								m_CellsBeingLoaded.insert(std::make_pair(location, *entry));
 							}
 
-							Cell* cell = it->second.get();
+							Cell* cell = entry->get();
 
 							cell->inRange = true;
 
 							// Check if the cell needs to be loaded
 							if (cell->IsLoaded())
 							{
-								// Attempt to access the cell (it will be locked if the archivist is in the process of loading it)
-								processCell(it->first, *cell, streamPositions, remotePositions);
+								// The cell will be skipped if it is locked (i.e. if the archivist is in the process of loading it)
+								cellsToProcess.push_back(std::make_tuple(location, *entry, &circles));
 #ifdef FSN_PROFILING_ENABLED
 								if (!cell->loadTimeRecorded)
 								{
@@ -1685,22 +2042,35 @@ namespace FusionEngine
 									Profiling::getSingleton().AddStat("AvgCellLoadTime", loadTime.seconds());
 								}
 #endif
-								m_CellsBeingLoaded.erase(it->first);
+								m_CellsBeingLoaded.erase(location);
 							}
 							// Failsafe (in case this cell was indexed while in some broken state)
 							else if (cell->waiting != Cell::Retrieve)
 							{
 								AddLogEntry("Streaming", "Cell loading failed to work as expected; cell had to be re-retrieved.", LOG_CRITICAL);
-								it->second = m_Archivist->Retrieve(ix, iy);
+								*entry = m_Archivist->Retrieve(ix, iy);
 							}
-							// Go to the next cell in the sequence
-							++it;
 						}
-						//i += stride;
 					}
 
 				}
 			}
+
+			// Cells lock themselves while being processed, so independent cells can be processed concurrently.
+			//  Each cell gets its own event buffer, so events are published in the same order as they would be
+			//  if the cells were processed serially.
+			if (m_CellEvents.size() < cellsToProcess.size())
+				m_CellEvents.resize(cellsToProcess.size());
+			tbb::parallel_for(tbb::blocked_range<size_t>(0, cellsToProcess.size()), [&](const tbb::blocked_range<size_t>& r)
+			{
+				for (size_t i = r.begin(), end = r.end(); i != end; ++i)
+				{
+					const auto& toProcess = cellsToProcess[i];
+					processCell(std::get<0>(toProcess), *std::get<1>(toProcess), *std::get<2>(toProcess), m_CellEvents[i]);
+				}
+			});
+			for (size_t i = 0, count = cellsToProcess.size(); i < count; ++i)
+				publishEvents(m_CellEvents[i]);
 			}
 		}
 		else // All active ranges stale
@@ -1708,16 +2078,19 @@ namespace FusionEngine
 			FSN_PROFILE("LoadingCellsAfterCamerasStoppedMoving");
 			// Clear loaded cells
 			Cell::mutex_t::scoped_lock lock; // TheVoid's mutex is used to lock m_CellsBeingLoaded
-			if (lock.try_acquire(m_TheVoid.mutex))
+			if (lock.try_acquire(m_VoidMutex))
 			{
 				FSN_PROFILE("VoidMutexLocked");
+				const StreamCircles allCircles(allLocalStreamPositions, allRemoteStreamPositions);
+				CellEvents events;
 				unsigned int cellsProcessed = 0;
 				for (auto it = m_CellsBeingLoaded.begin(); it != m_CellsBeingLoaded.end() && cellsProcessed < s_MaxCellsProcessedPerFrameWhenCameraStationary; ++cellsProcessed)
 				{
 					auto cell = it->second;
 					if (cell->IsLoaded())
 					{
-						processCell(it->first, *cell, allLocalStreamPositions, allRemoteStreamPositions);
+						processCell(it->first, *cell, allCircles, events);
+						publishEvents(events);
 
 #ifdef FSN_PROFILING_ENABLED
 						const auto loadTime = tbb::tick_count::now() - cell->timeRequested;
@@ -0,0 +1,633 @@
+/*
+*  Copyright (c) 2013 Fusion Project Team
+*
+*  This software is provided 'as-is', without any express or implied warranty.
+*  In noevent will the authors be held liable for any damages arising from the
+*  use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute it
+*  freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software in a
+*    product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source distribution.
+*
+*
+*  File Author:
+*    Elliot Hayward
+*/
+
+// Headless streaming benchmark: generates a world in a temporary cache, then
+//  drives scripted cameras through it and reports how streaming kept up.
+
+#include "PrecompiledHeaders.h"
+
+#include "FusionCamera.h"
+#include "FusionComponentProperty.h"
+#include "FusionComponentScriptTypeRegistration.h"
+#include "FusionComponentUniverse.h"
+#include "FusionConsole.h"
+#include "FusionEntity.h"
+#include "FusionEntityManager.h"
+#include "FusionEntitySynchroniser.h"
+#include "FusionExceptionFactory.h"
+#include "FusionInputHandler.h"
+#include "FusionLogger.h"
+#include "FusionNetworkManager.h"
+#include "FusionP2PEntityInstantiator.h"
+#include "FusionPacketDispatcher.h"
+#include "FusionPhysFS.h"
+#include "FusionPlayerRegistry.h"
+#include "FusionProfiling.h"
+#include "FusionPropertySignalingSystem.h"
+#include "FusionRakNetwork.h"
+#include "FusionRegionCellCache.h"
+#include "FusionRegionMapLoader.h"
+#include "FusionResourceManager.h"
+#include "FusionScriptManager.h"
+#include "FusionStreamingManager.h"
+#include "FusionTransformComponent.h"
+
+// Systems
+#include "FusionBox2DSystem.h"
+
+#include <ClanLib/application.h>
+#include <ClanLib/core.h>
+
+#include <boost/lexical_cast.hpp>
+#include <tbb/tick_count.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace FusionEngine;
+
+namespace
+{
+
+	//! Simulated time that passes each frame (cameras move by this much regardless of how long frames take)
+	const float s_FrameTime = 1.f / 60.f;
+	//! Number of waypoints used to approximate circular paths
+	const size_t s_OrbitWaypoints = 32;
+	//! Number of waypoints in each random path
+	const size_t s_RandomWaypoints = 16;
+
+	struct BenchmarkOptions
+	{
+		unsigned int numCameras;
+		unsigned int entitiesPerCell;
+		// Width & height of the generated world
+		int32_t worldSizeInCells;
+		int32_t cellsPerRegion;
+		float cellSize;
+		float range;
+		// Sim units per second
+		float cameraSpeed;
+		unsigned int frames;
+		// "orbit", "sweep" or "random"
+		std::string path;
+		unsigned int seed;
+		std::string cachePath;
+		bool keepCache;
+
+		BenchmarkOptions()
+			: numCameras(1),
+			entitiesPerCell(8),
+			worldSizeInCells(64),
+			cellsPerRegion(16),
+			cellSize(5.f),
+			range(20.f),
+			cameraSpeed(10.f),
+			frames(3600),
+			path("orbit"),
+			seed(1234),
+			cachePath("/benchmark_cache"),
+			keepCache(false)
+		{}
+
+		//! Reads "--name=value" args, returning false if any aren't recognised
+		bool Parse(const std::vector<std::string>& args)
+		{
+			for (auto it = args.begin() + (args.empty() ? 0 : 1), end = args.end(); it != end; ++it)
+			{
+				const std::string& arg = *it;
+				const auto equals = arg.find('=');
+				if (arg.compare(0, 2, "--") != 0)
+					return false;
+				const std::string name = arg.substr(2, equals == std::string::npos ? std::string::npos : equals - 2);
+				const std::string value = equals == std::string::npos ? std::string() : arg.substr(equals + 1);
+				try
+				{
+					if (name == "cameras")
+						numCameras = boost::lexical_cast<unsigned int>(value);
+					else if (name == "density")
+						entitiesPerCell = boost::lexical_cast<unsigned int>(value);
+					else if (name == "world")
+						worldSizeInCells = boost::lexical_cast<int32_t>(value);
+					else if (name == "region")
+						cellsPerRegion = boost::lexical_cast<int32_t>(value);
+					else if (name == "cell-size")
+						cellSize = boost::lexical_cast<float>(value);
+					else if (name == "range")
+						range = boost::lexical_cast<float>(value);
+					else if (name == "speed")
+						cameraSpeed = boost::lexical_cast<float>(value);
+					else if (name == "frames")
+						frames = boost::lexical_cast<unsigned int>(value);
+					else if (name == "path")
+						path = value;
+					else if (name == "seed")
+						seed = boost::lexical_cast<unsigned int>(value);
+					else if (name == "cache")
+						cachePath = value;
+					else if (name == "keep-cache")
+						keepCache = true;
+					else
+						return false;
+				}
+				catch (boost::bad_lexical_cast&)
+				{
+					return false;
+				}
+			}
+			return numCameras > 0 && worldSizeInCells > 0 && cellsPerRegion > 0 && cellSize > 0.f &&
+				(path == "orbit" || path == "sweep" || path == "random");
+		}
+
+		static void PrintUsage()
+		{
+			std::cout << "StreamingBenchmark [options]" << std::endl
+				<< "  --cameras=N      Number of cameras (default 1)" << std::endl
+				<< "  --density=N      Entities generated in each cell (default 8)" << std::endl
+				<< "  --world=N        Width / height of the world in cells (default 64)" << std::endl
+				<< "  --region=N       Width / height of each region file in cells (default 16)" << std::endl
+				<< "  --cell-size=F    Cell size in sim units (default 5)" << std::endl
+				<< "  --range=F        Camera streaming range in sim units (default 20)" << std::endl
+				<< "  --speed=F        Camera speed in sim units per second (default 10)" << std::endl
+				<< "  --frames=N       Frames to run (default 3600)" << std::endl
+				<< "  --path=NAME      orbit, sweep or random (default orbit)" << std::endl
+				<< "  --seed=N         Seed for entity placement and random paths" << std::endl
+				<< "  --cache=PATH     Write-dir relative cache path (default /benchmark_cache)" << std::endl
+				<< "  --keep-cache     Don't delete the generated cache when done" << std::endl;
+		}
+	};
+
+	//! Moves through a loop of waypoints at a constant speed
+	struct ScriptedPath
+	{
+		std::vector<Vector2> waypoints;
+		size_t next;
+		Vector2 position;
+		float speed;
+
+		ScriptedPath() : next(0), speed(0.f) {}
+
+		void Advance(float dt)
+		{
+			float remaining = speed * dt;
+			while (remaining > 0.f && !waypoints.empty())
+			{
+				const Vector2 toNext = waypoints[next] - position;
+				const float distance = toNext.length();
+				if (distance <= remaining)
+				{
+					position = waypoints[next];
+					remaining -= distance;
+					next = (next + 1) % waypoints.size();
+				}
+				else
+				{
+					position += toNext * (remaining / distance);
+					remaining = 0.f;
+				}
+			}
+		}
+	};
+
+	//! Generates the path for the given camera
+	ScriptedPath buildPath(const BenchmarkOptions& options, unsigned int camera_index)
+	{
+		ScriptedPath path;
+		path.speed = options.cameraSpeed;
+
+		// Keep the cameras' ranges within the generated area
+		const float halfExtent = std::max(options.worldSizeInCells * options.cellSize * 0.5f - options.range, options.cellSize);
+		const float phase = camera_index / float(options.numCameras);
+
+		if (options.path == "orbit")
+		{
+			// Evenly spaced around a circle
+			const float radius = halfExtent * 0.75f;
+			for (size_t i = 0; i < s_OrbitWaypoints; ++i)
+			{
+				const float angle = 2.f * s_pi * (phase + i / float(s_OrbitWaypoints));
+				path.waypoints.push_back(Vector2(std::cos(angle) * radius, std::sin(angle) * radius));
+			}
+		}
+		else if (options.path == "sweep")
+		{
+			// Back and forth across the world in rows, with each camera starting on a different row
+			const float rowSpacing = std::max(options.range * 2.f, options.cellSize);
+			const size_t numRows = std::max<size_t>(size_t(2.f * halfExtent / rowSpacing), 1);
+			for (size_t i = 0; i < numRows; ++i)
+			{
+				const size_t row = (i + size_t(phase * numRows)) % numRows;
+				const float y = -halfExtent + row * rowSpacing;
+				const bool leftToRight = (i % 2) == 0;
+				path.waypoints.push_back(Vector2(leftToRight ? -halfExtent : halfExtent, y));
+				path.waypoints.push_back(Vector2(leftToRight ? halfExtent : -halfExtent, y));
+			}
+		}
+		else // random
+		{
+			std::mt19937 rng(options.seed + camera_index);
+			std::uniform_real_distribution<float> coord(-halfExtent, halfExtent);
+			for (size_t i = 0; i < s_RandomWaypoints; ++i)
+				path.waypoints.push_back(Vector2(coord(rng), coord(rng)));
+		}
+
+		path.position = path.waypoints.front();
+		path.next = 1 % path.waypoints.size();
+		return path;
+	}
+
+	//! Collects samples so percentiles can be reported
+	struct Samples
+	{
+		std::vector<double> values;
+
+		void Add(double value) { values.push_back(value); }
+
+		double Percentile(double p) const
+		{
+			if (values.empty())
+				return 0.0;
+			std::vector<double> sorted(values);
+			const size_t index = std::min(size_t(p * (sorted.size() - 1) + 0.5), sorted.size() - 1);
+			std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+			return sorted[index];
+		}
+
+		double Mean() const
+		{
+			if (values.empty())
+				return 0.0;
+			double total = 0.0;
+			for (auto it = values.begin(), end = values.end(); it != end; ++it)
+				total += *it;
+			return total / values.size();
+		}
+
+		double Max() const
+		{
+			return values.empty() ? 0.0 : *std::max_element(values.begin(), values.end());
+		}
+	};
+
+	void printDistribution(const std::string& name, const Samples& samples, const std::string& unit)
+	{
+		std::cout << std::fixed << std::setprecision(3)
+			<< "  " << name << " (" << samples.values.size() << " samples, " << unit << "): "
+			<< "mean " << samples.Mean()
+			<< ", p50 " << samples.Percentile(0.5)
+			<< ", p90 " << samples.Percentile(0.9)
+			<< ", p99 " << samples.Percentile(0.99)
+			<< ", max " << samples.Max() << std::endl;
+	}
+
+	//! Measures how long cells take to load after they come within range of a camera
+	/*!
+	* This is measured from the main thread (the start of the frame where the cell
+	* came into range to the end of the frame where it was first seen loaded), so
+	* it is the delay players would see, at frame granularity.
+	*/
+	class CellLoadTracker
+	{
+	public:
+		CellLoadTracker() : m_Abandoned(0) {}
+
+		void Update(StreamingManager& streaming, const std::vector<Vector2>& positions, float range, const tbb::tick_count& frame_start, const tbb::tick_count& frame_end)
+		{
+			std::set<CellHandle, CellHandleGreater> inRange;
+			for (auto it = positions.begin(), end = positions.end(); it != end; ++it)
+			{
+				const auto lb = streaming.ToCellLocation(*it - Vector2(range, range));
+				const auto ub = streaming.ToCellLocation(*it + Vector2(range, range));
+				for (int32_t y = lb.y; y <= ub.y; ++y)
+					for (int32_t x = lb.x; x <= ub.x; ++x)
+						inRange.insert(CellHandle(x, y));
+			}
+
+			// Forget cells that left range (counting those that never loaded)
+			for (auto it = m_Tracked.begin(); it != m_Tracked.end();)
+			{
+				if (inRange.count(it->first) == 0)
+				{
+					if (!it->second.loaded)
+						++m_Abandoned;
+					it = m_Tracked.erase(it);
+				}
+				else
+					++it;
+			}
+
+			for (auto it = inRange.begin(), end = inRange.end(); it != end; ++it)
+			{
+				auto entry = m_Tracked.find(*it);
+				if (entry == m_Tracked.end())
+					entry = m_Tracked.insert(std::make_pair(*it, TrackedCell(frame_start))).first;
+
+				if (!entry->second.loaded)
+				{
+					Cell* cell = streaming.CellAtCellLocation(*it);
+					if (cell && cell->IsLoaded())
+					{
+						entry->second.loaded = true;
+						m_Latency.Add((frame_end - entry->second.timeEnteredRange).seconds() * 1000.0);
+					}
+				}
+			}
+		}
+
+		const Samples& GetLatency() const { return m_Latency; }
+		size_t GetAbandoned() const { return m_Abandoned; }
+		size_t GetStillLoading() const
+		{
+			size_t count = 0;
+			for (auto it = m_Tracked.begin(), end = m_Tracked.end(); it != end; ++it)
+				if (!it->second.loaded)
+					++count;
+			return count;
+		}
+
+	private:
+		struct TrackedCell
+		{
+			tbb::tick_count timeEnteredRange;
+			bool loaded;
+
+			explicit TrackedCell(const tbb::tick_count& time) : timeEnteredRange(time), loaded(false) {}
+		};
+		std::map<CellHandle, TrackedCell, CellHandleGreater> m_Tracked;
+		Samples m_Latency;
+		size_t m_Abandoned;
+	};
+
+	void registerScriptTypes(ScriptManager* script_manager)
+	{
+		auto engine = script_manager->GetEnginePtr();
+
+		Console::Register(script_manager);
+
+		engine->RegisterTypedef("PlayerID", "uint8");
+
+		EvesdroppingManager::RegisterScriptInterface(engine);
+		ComponentProperty::Register(engine);
+		EntityComponent::RegisterType<EntityComponent>(engine, "EntityComponent");
+		ITransform_RegisterScriptInterface(engine);
+		Entity::Register(engine);
+		P2PEntityInstantiator::Register(engine);
+	}
+
+	//! Fills the world with static entities, then streams them all out to the archivist's cache
+	void generateWorld(const BenchmarkOptions& options, ComponentFactory* factory, P2PEntityInstantiator* instantiator, EntityManager* entity_manager)
+	{
+		std::mt19937 rng(options.seed);
+		std::uniform_real_distribution<float> offset(0.f, options.cellSize);
+
+		const int32_t first = -options.worldSizeInCells / 2;
+		const int32_t last = first + options.worldSizeInCells;
+		for (int32_t cy = first; cy < last; ++cy)
+		{
+			for (int32_t cx = first; cx < last; ++cx)
+			{
+				for (unsigned int i = 0; i < options.entitiesPerCell; ++i)
+				{
+					auto transformCom = factory->InstantiateComponent("StaticTransform");
+					if (!transformCom)
+						FSN_EXCEPT(InvalidArgumentException, "StaticTransform components are needed to generate the world");
+
+					auto entity = std::make_shared<Entity>(entity_manager, transformCom);
+					entity->SetID(instantiator->GetFreeGlobalID());
+
+					auto transform = entity->GetComponent<ITransform>();
+					transform->Position.Set(Vector2(cx * options.cellSize + offset(rng), cy * options.cellSize + offset(rng)));
+					transform->Angle.Set(0.f);
+					transformCom->SynchronisePropertiesNow();
+
+					entity_manager->AddEntity(entity);
+				}
+			}
+		}
+	}
+
+	//! Writes all queued cell data to disk and unloads the region files (so the benchmark starts cold)
+	void flushCellCache(RegionCellArchivist* archivist, ResourceManager* resource_manager)
+	{
+		// Stopping the archivist finishes all queued writes
+		archivist->Stop();
+		// Load any region files that the writes are waiting for, and deliver them so the data is written to them
+		resource_manager->StopLoaderThreadWhenDone();
+		resource_manager->DeliverLoadedResources();
+		archivist->GetCellCache()->FlushCache();
+		archivist->GetCellCache()->DropCache();
+		resource_manager->UnloadUnreferencedResources();
+		resource_manager->StartLoaderThread();
+		archivist->Start();
+	}
+
+}
+
+class EntryPoint
+{
+public:
+	static int main(const std::vector<std::string> &args)
+	{
+		BenchmarkOptions options;
+		if (!options.Parse(args))
+		{
+			BenchmarkOptions::PrintUsage();
+			return 1;
+		}
+
+		clan::SetupCore setupCore;
+
+		SetupPhysFS setupPhysfs(clan::System::get_exe_path().c_str());
+		if (!SetupPhysFS::is_init())
+			return 1;
+		SetupPhysFS::configure("lastflare", "Fusion", "zip");
+
+		std::unique_ptr<Logger> logger(new Logger);
+		std::unique_ptr<Profiling> profiling(new Profiling);
+		std::unique_ptr<Console> console(new Console);
+
+		try
+		{
+			// Start with an empty cache
+			if (PHYSFS_exists(options.cachePath.c_str()))
+				PhysFSHelp::clear_folder(options.cachePath);
+			else if (PHYSFS_mkdir(options.cachePath.c_str()) == 0)
+				FSN_EXCEPT(FileSystemException, "Failed to create cache path (" + options.cachePath + "): " + std::string(PHYSFS_getLastError()));
+
+			auto scriptManager = std::make_shared<ScriptManager>();
+			registerScriptTypes(scriptManager.get());
+
+			// Not used, but the entity systems expect them to exist
+			std::unique_ptr<InputManager> inputManager(new InputManager());
+			std::unique_ptr<PlayerRegistry> playerRegistry(new PlayerRegistry());
+			std::unique_ptr<RakNetwork> network(new RakNetwork());
+			std::unique_ptr<PacketDispatcher> packetDispatcher(new PacketDispatcher());
+			std::unique_ptr<NetworkManager> networkManager(new NetworkManager(network.get(), packetDispatcher.get()));
+			std::unique_ptr<EvesdroppingManager> evesdroppingManager(new EvesdroppingManager());
+
+			// No GC: only region files are loaded as resources here
+			std::unique_ptr<ResourceManager> resourceManager(new ResourceManager(clan::GraphicContext()));
+
+			std::unique_ptr<RegionCellArchivist> archivist(new RegionCellArchivist(false, options.cachePath, options.cellsPerRegion));
+			auto streamingManager = std::make_shared<StreamingManager>(archivist.get());
+			streamingManager->Initialise(options.cellSize);
+			streamingManager->SetRange(options.range);
+
+			std::unique_ptr<ComponentUniverse> componentUniverse(new ComponentUniverse());
+			std::unique_ptr<EntitySynchroniser> entitySynchroniser(new EntitySynchroniser(inputManager.get(), nullptr, streamingManager.get()));
+			std::unique_ptr<EntityManager> entityManager(new EntityManager(inputManager.get(), entitySynchroniser.get(), streamingManager.get(), componentUniverse.get(), archivist.get()));
+			std::unique_ptr<P2PEntityInstantiator> instantiator(new P2PEntityInstantiator(componentUniverse.get(), entityManager.get()));
+
+			archivist->SetInstantiator(instantiator.get(), componentUniverse.get(), entityManager.get(), nullptr);
+
+			// Transforms come from the physics system (which is never stepped here)
+			Box2DSystem box2dSystem;
+			componentUniverse->AddWorld(box2dSystem.CreateWorld());
+
+			resourceManager->StartLoaderThread();
+			archivist->Start();
+
+			std::cout << "Generating " << options.worldSizeInCells << "x" << options.worldSizeInCells << " cells with "
+				<< options.entitiesPerCell << " entities each..." << std::endl;
+			{
+				const tbb::tick_count start = tbb::tick_count::now();
+
+				generateWorld(options, componentUniverse.get(), instantiator.get(), entityManager.get());
+				entityManager->ProcessActivationQueues();
+				streamingManager->StoreAllCells(false);
+				flushCellCache(archivist.get(), resourceManager.get());
+
+				const auto ioStats = archivist->GetCellCache()->GetIOStats();
+				std::cout << "  Wrote " << ioStats.cellsWritten << " cells (" << ioStats.bytesWritten << " bytes) in "
+					<< (tbb::tick_count::now() - start).seconds() << " s" << std::endl;
+				archivist->GetCellCache()->ResetIOStats();
+			}
+
+			std::vector<ScriptedPath> paths;
+			std::vector<CameraPtr> cameras;
+			for (unsigned int i = 0; i < options.numCameras; ++i)
+			{
+				paths.push_back(buildPath(options, i));
+				auto camera = std::make_shared<Camera>();
+				camera->SetSimPosition(paths.back().position);
+				streamingManager->AddCamera(camera, options.range);
+				cameras.push_back(camera);
+			}
+
+			std::cout << "Running " << options.frames << " frames with " << options.numCameras << " " << options.path << " camera(s)..." << std::endl;
+
+			Samples frameTimes, updateTimes, activationTimes, activationBacklog, activationWait;
+			size_t maxBacklog = 0;
+			CellLoadTracker loadTracker;
+			std::vector<Vector2> cameraPositions(options.numCameras);
+
+			const tbb::tick_count runStart = tbb::tick_count::now();
+			for (unsigned int frame = 0; frame < options.frames; ++frame)
+			{
+				const tbb::tick_count frameStart = tbb::tick_count::now();
+
+				for (size_t i = 0; i < paths.size(); ++i)
+				{
+					paths[i].Advance(s_FrameTime);
+					cameras[i]->SetSimPosition(paths[i].position);
+					cameraPositions[i] = paths[i].position;
+				}
+
+				streamingManager->Update(StreamingManager::Default);
+				const tbb::tick_count updateEnd = tbb::tick_count::now();
+
+				entityManager->ProcessActivationQueues(s_FrameTime - float((updateEnd - frameStart).seconds()));
+				const tbb::tick_count activationEnd = tbb::tick_count::now();
+
+				resourceManager->UnloadUnreferencedResources();
+				resourceManager->DeliverLoadedResources(s_FrameTime - float((activationEnd - frameStart).seconds()));
+
+				const tbb::tick_count frameEnd = tbb::tick_count::now();
+
+				frameTimes.Add((frameEnd - frameStart).seconds() * 1000.0);
+				updateTimes.Add((updateEnd - frameStart).seconds() * 1000.0);
+				activationTimes.Add((activationEnd - updateEnd).seconds() * 1000.0);
+
+				const auto& queueStats = entityManager->GetActivationQueueStats();
+				activationBacklog.Add(double(queueStats.activationBacklog));
+				activationWait.Add(queueStats.oldestWaitTime * 1000.0);
+				maxBacklog = std::max(maxBacklog, queueStats.activationBacklog);
+
+				loadTracker.Update(*streamingManager, cameraPositions, options.range, frameStart, frameEnd);
+			}
+			const double runTime = (tbb::tick_count::now() - runStart).seconds();
+
+			const auto ioStats = archivist->GetCellCache()->GetIOStats();
+			const auto fragmentation = archivist->GetCellCache()->GetFragmentationMetrics();
+			const auto& hotCellStats = streamingManager->GetHotCellCacheStats();
+
+			std::cout << std::endl << "Results (" << options.frames << " frames in " << runTime << " s):" << std::endl;
+			printDistribution("Frame time", frameTimes, "ms");
+			printDistribution("  StreamingManager::Update", updateTimes, "ms");
+			printDistribution("  EntityManager::ProcessActivationQueues", activationTimes, "ms");
+			printDistribution("Cell load latency", loadTracker.GetLatency(), "ms");
+			std::cout << "    " << loadTracker.GetAbandoned() << " cells left range before loading, "
+				<< loadTracker.GetStillLoading() << " still loading at the end" << std::endl;
+			printDistribution("Activation backlog", activationBacklog, "entities");
+			printDistribution("Oldest queued activation", activationWait, "ms");
+			std::cout << "  Bytes read: " << ioStats.bytesRead << " (" << ioStats.cellsRead << " cells)" << std::endl
+				<< "  Bytes written: " << ioStats.bytesWritten << " (" << ioStats.cellsWritten << " cells)" << std::endl
+				<< "  Hot-cell cache: " << hotCellStats.hits << " hits, " << hotCellStats.misses << " misses, "
+				<< hotCellStats.evictions << " evictions" << std::endl
+				<< "  Region files: " << fragmentation.regions << " loaded, " << fragmentation.freeSectors << "/" << fragmentation.totalSectors
+				<< " sectors free (" << fragmentation.holeSectors << " in holes), largest free run " << fragmentation.largestFreeRun
+				<< ", " << fragmentation.sectorsDefragmented << " sectors defragmented" << std::endl;
+
+			for (auto it = cameras.begin(), end = cameras.end(); it != end; ++it)
+				streamingManager->RemoveCamera(*it);
+
+			archivist->Stop();
+			resourceManager->StopLoaderThread();
+
+			if (!options.keepCache)
+			{
+				PhysFSHelp::clear_folder(options.cachePath);
+				PHYSFS_delete(options.cachePath.c_str());
+			}
+		}
+		catch (std::exception& ex)
+		{
+			std::cerr << "Benchmark failed: " << ex.what() << std::endl;
+			return 1;
+		}
+
+		return 0;
+	}
+};
+
+clan::Application app(&EntryPoint::main);
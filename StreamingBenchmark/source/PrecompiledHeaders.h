@@ -0,0 +1,5 @@
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "FusionStableHeaders.h"
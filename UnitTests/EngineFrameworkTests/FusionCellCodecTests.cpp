@@ -0,0 +1,106 @@
+#include "PrecompiledHeaders.h"
+
+#include "FusionPrerequisites.h"
+
+#include "FusionCellCodec.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+using namespace FusionEngine;
+
+namespace
+{
+	std::vector<char> makeCell(int seed)
+	{
+		std::stringstream str;
+		for (int i = 0; i < 64; ++i)
+			str << "StaticTransform Position " << (i * seed) % 17 << " Velocity " << (i + seed) % 5 << ";";
+		const auto data = str.str();
+		return std::vector<char>(data.begin(), data.end());
+	}
+
+	void testRoundTrip(CellCodec codec)
+	{
+		ASSERT_TRUE(IsCellCodecAvailable(codec)) << CellCodecToString(codec) << " should have been compiled in";
+
+		const auto cell = makeCell(3);
+		std::vector<char> compressed, decompressed;
+		CellCodecs::Compress(codec, cell.data(), cell.size(), compressed);
+		EXPECT_LT(compressed.size(), cell.size());
+
+		ASSERT_TRUE(CellCodecs::Decompress(codec, compressed.data(), compressed.size(), decompressed));
+		EXPECT_EQ(cell, decompressed);
+
+		// Truncated data should be rejected rather than producing garbage
+		EXPECT_FALSE(CellCodecs::Decompress(codec, compressed.data(), compressed.size() / 2, decompressed));
+	}
+}
+
+TEST(cell_codec, zlibIsAlwaysAvailable)
+{
+	EXPECT_TRUE(IsCellCodecAvailable(CellCodec::Zlib));
+	EXPECT_EQ(CellCodec::Zlib, GetAvailableCellCodec(CellCodec::Zlib));
+}
+
+TEST(cell_codec, namesRoundTrip)
+{
+	EXPECT_EQ(CellCodec::Zlib, CellCodecFromString(CellCodecToString(CellCodec::Zlib)));
+	EXPECT_EQ(CellCodec::LZ4, CellCodecFromString(CellCodecToString(CellCodec::LZ4)));
+	EXPECT_EQ(CellCodec::Zstd, CellCodecFromString(CellCodecToString(CellCodec::Zstd)));
+}
+
+TEST(cell_codec, roundTripZlib)
+{
+	testRoundTrip(CellCodec::Zlib);
+}
+
+// The optional codecs are only tested when they are compiled in (FusionUseLZ4 / FusionUseZstd in CommonProperties.props)
+#ifdef FSN_USE_LZ4
+TEST(cell_codec, roundTripLZ4)
+{
+	testRoundTrip(CellCodec::LZ4);
+}
+#else
+TEST(cell_codec, lz4FallsBackToZlib)
+{
+	EXPECT_FALSE(IsCellCodecAvailable(CellCodec::LZ4));
+	EXPECT_EQ(CellCodec::Zlib, GetAvailableCellCodec(CellCodec::LZ4));
+}
+#endif
+
+#ifdef FSN_USE_ZSTD
+TEST(cell_codec, roundTripZstd)
+{
+	testRoundTrip(CellCodec::Zstd);
+}
+
+TEST(cell_codec, dictionaryIsRequiredToDecompress)
+{
+	std::vector<std::vector<char>> samples;
+	for (int i = 1; i < 200; ++i)
+		samples.push_back(makeCell(i));
+	auto dictionary = CellCodecDictionary::Train(samples, 4096);
+	ASSERT_TRUE(dictionary != nullptr);
+
+	const auto cell = makeCell(7);
+	std::vector<char> compressed, decompressed;
+	CellCodecs::Compress(CellCodec::Zstd, cell.data(), cell.size(), compressed, dictionary.get());
+
+	EXPECT_FALSE(CellCodecs::Decompress(CellCodec::Zstd, compressed.data(), compressed.size(), decompressed));
+
+	// A dictionary loaded from saved data should work the same as the trained one
+	CellCodecDictionary reloaded(dictionary->GetData());
+	EXPECT_EQ(dictionary->GetID(), reloaded.GetID());
+	ASSERT_TRUE(CellCodecs::Decompress(CellCodec::Zstd, compressed.data(), compressed.size(), decompressed, &reloaded));
+	EXPECT_EQ(cell, decompressed);
+}
+#else
+TEST(cell_codec, zstdFallsBackToZlib)
+{
+	EXPECT_FALSE(IsCellCodecAvailable(CellCodec::Zstd));
+	EXPECT_EQ(CellCodec::Zlib, GetAvailableCellCodec(CellCodec::Zstd));
+	EXPECT_TRUE(CellCodecDictionary::Train(std::vector<std::vector<char>>(1, makeCell(1))) == nullptr);
+}
+#endif
@@ -0,0 +1,89 @@
+#include "PrecompiledHeaders.h"
+
+#include "FusionPrerequisites.h"
+
+#include "FusionCellDataCursor.h"
+
+#include "FusionBinaryStream.h"
+
+#include <gtest/gtest.h>
+
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <sstream>
+
+using namespace FusionEngine;
+
+namespace
+{
+	std::string writeSample()
+	{
+		std::stringstream stream(std::ios::in | std::ios::out | std::ios::binary);
+		IO::Streams::CellStreamWriter writer(&stream);
+		writer.Write(size_t(3));
+		writer.Write(uint32_t(0xDEADBEEF));
+		writer.WriteString("entity");
+		writer.Write(true);
+		return stream.str();
+	}
+
+	std::string compress(const std::string& data)
+	{
+		std::stringstream compressed(std::ios::in | std::ios::out | std::ios::binary);
+		{
+			boost::iostreams::filtering_ostream stream;
+			stream.push(boost::iostreams::zlib_compressor());
+			stream.push(compressed);
+			stream.write(data.data(), data.size());
+		}
+		return compressed.str();
+	}
+}
+
+TEST(cell_data_cursor, readsWhatCellStreamWriterWrites)
+{
+	const auto sample = writeSample();
+	CellDataCursor cursor(sample.data(), sample.size());
+
+	EXPECT_EQ(3u, cursor.ReadValue<size_t>());
+	uint32_t value = 0;
+	ASSERT_TRUE(cursor.Read(value));
+	EXPECT_EQ(0xDEADBEEF, value);
+	EXPECT_EQ("entity", cursor.ReadString());
+	EXPECT_TRUE(cursor.ReadValue<bool>());
+	EXPECT_TRUE(cursor.AtEnd());
+	EXPECT_EQ(sample.size(), cursor.Tell());
+}
+
+TEST(cell_data_cursor, shortReadsFail)
+{
+	const char data[] = { 1, 2, 3 };
+	CellDataCursor cursor(data, sizeof(data));
+
+	uint32_t value = 0;
+	EXPECT_FALSE(cursor.Read(value));
+	EXPECT_EQ(nullptr, cursor.ReadBytes(4));
+	// Failed reads don't move the cursor
+	EXPECT_EQ(3u, cursor.GetRemaining());
+	EXPECT_EQ(data, cursor.ReadBytes(3));
+	EXPECT_TRUE(cursor.AtEnd());
+}
+
+TEST(cell_data, inflate)
+{
+	// Big enough that the output buffer has to grow
+	std::string sample;
+	for (int i = 0; i < 1000; ++i)
+		sample += writeSample();
+	const auto compressed = compress(sample);
+
+	CellData data;
+	ASSERT_TRUE(data.Inflate(compressed.data(), compressed.size()));
+	ASSERT_EQ(sample.size(), data.GetRemaining());
+	EXPECT_EQ(0, std::memcmp(sample.data(), data.ReadBytes(sample.size()), sample.size()));
+
+	// Truncated data is reported
+	CellData truncated;
+	EXPECT_FALSE(truncated.Inflate(compressed.data(), compressed.size() / 2));
+}
@@ -0,0 +1,136 @@
+#include "PrecompiledHeaders.h"
+
+#include "FusionPrerequisites.h"
+
+#include "FusionEntityLocationIndex.h"
+
+#include "TempDirectoryFixture.h"
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+using namespace FusionEngine;
+
+namespace
+{
+	typedef EntityLocationIndex::Location Location;
+	typedef EntityLocationIndex::CellCoord_t CellCoord_t;
+
+	struct entity_location_index_f : public temp_dir_f
+	{
+		entity_location_index_f()
+			: temp_dir_f("locations")
+		{
+		}
+
+		void SetUp()
+		{
+			temp_dir_f::SetUp();
+			path = (base / "entitylocations.kc").string();
+		}
+
+		std::string path;
+	};
+}
+
+TEST_F(entity_location_index_f, storeGetRemove)
+{
+	EntityLocationIndex index;
+	index.Open(path, true);
+
+	index.Store(1, Location(CellCoord_t(2, 3), 4, 5));
+	index.Store(1, Location(CellCoord_t(-2, 3), 1, 6));
+
+	Location location;
+	ASSERT_TRUE(index.Get(1, location));
+	EXPECT_EQ(CellCoord_t(-2, 3), location.cell);
+	EXPECT_EQ(1, location.offset);
+	EXPECT_EQ(6, location.length);
+	EXPECT_EQ(1, index.GetSize());
+
+	EXPECT_FALSE(index.Get(2, location));
+
+	EXPECT_TRUE(index.Remove(1));
+	EXPECT_FALSE(index.Remove(1));
+	EXPECT_FALSE(index.Get(1, location));
+	EXPECT_EQ(0, index.GetSize());
+}
+
+TEST_F(entity_location_index_f, grows)
+{
+	EntityLocationIndex index;
+	index.Open(path, true);
+
+	for (ObjectID id = 1; id <= 10000; ++id)
+		index.Store(id, Location(CellCoord_t(id, -(int32_t)id), id, 1));
+	for (ObjectID id = 1; id <= 10000; id += 2)
+		index.Remove(id);
+
+	EXPECT_EQ(5000, index.GetSize());
+	Location location;
+	for (ObjectID id = 1; id <= 10000; ++id)
+	{
+		ASSERT_EQ(id % 2 == 0, index.Get(id, location));
+		if (id % 2 == 0)
+		{
+			EXPECT_EQ(CellCoord_t(id, -(int32_t)id), location.cell);
+		}
+	}
+}
+
+TEST_F(entity_location_index_f, logIsReplayed)
+{
+	const std::string copyPath = path + ".copy";
+	{
+		EntityLocationIndex index;
+		index.Open(path, true);
+		index.Store(1, Location(CellCoord_t(1, 1), 0, 10));
+		index.Store(2, Location(CellCoord_t(2, 2), 0, 20));
+		index.Checkpoint();
+		index.Store(3, Location(CellCoord_t(3, 3), 0, 30));
+		index.Remove(1);
+		index.FlushLog();
+
+		// Simulate a crash by copying the files while the log has changes that aren't in the snapshot
+		boost::filesystem::copy_file(path, copyPath);
+		boost::filesystem::copy_file(path + ".log", copyPath + ".log");
+	}
+
+	EntityLocationIndex index;
+	index.Open(copyPath);
+	Location location;
+	EXPECT_FALSE(index.Get(1, location));
+	ASSERT_TRUE(index.Get(2, location));
+	EXPECT_EQ(20, location.length);
+	ASSERT_TRUE(index.Get(3, location));
+	EXPECT_EQ(CellCoord_t(3, 3), location.cell);
+
+	// The log was folded into the snapshot
+	EXPECT_FALSE(boost::filesystem::exists(copyPath + ".log.old"));
+	EXPECT_EQ(0, boost::filesystem::file_size(copyPath + ".log"));
+
+	index.Close();
+	boost::filesystem::remove(copyPath);
+	boost::filesystem::remove(copyPath + ".log");
+}
+
+TEST_F(entity_location_index_f, saveSnapshot)
+{
+	const std::string copyPath = path + ".copy";
+	{
+		EntityLocationIndex index;
+		index.Open(path, true);
+		index.Store(7, Location(CellCoord_t(7, 7), 1, 70));
+		index.SaveSnapshot(copyPath);
+	}
+
+	EntityLocationIndex copy;
+	copy.Open(copyPath);
+	Location location;
+	EXPECT_TRUE(copy.Get(7, location));
+	copy.Close();
+
+	boost::filesystem::remove(copyPath);
+	boost::filesystem::remove(copyPath + ".log");
+}
@@ -0,0 +1,152 @@
+#include "PrecompiledHeaders.h"
+
+#include "FusionPrerequisites.h"
+
+#include "FusionCellSerialisationUtils.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+using namespace FusionEngine;
+using namespace FusionEngine::CellSerialisationUtils;
+
+namespace
+{
+	std::string getData(const EntitySlotTable& table, size_t slot)
+	{
+		return std::string(table.GetData(slot), table.GetSlot(slot).length);
+	}
+
+	void put(EntitySlotTable& table, ObjectID id, const std::string& data)
+	{
+		table.Put(id, data.data(), data.size());
+	}
+}
+
+TEST(entity_slot_table, putAndFind)
+{
+	EntitySlotTable table;
+	put(table, 1, "one");
+	put(table, 2, "two");
+	put(table, 3, "three");
+
+	ASSERT_EQ(3, table.GetNumEntities());
+	EXPECT_EQ(1, table.Find(2));
+	EXPECT_EQ(1, table.Find(2, 1));
+	EXPECT_EQ(1, table.Find(2, 0)); // Wrong hint
+	const size_t noSlot = EntitySlotTable::s_NoSlot;
+	EXPECT_EQ(noSlot, table.Find(4));
+	EXPECT_EQ("three", getData(table, table.Find(3)));
+}
+
+TEST(entity_slot_table, resizingDoesntMoveOtherEntities)
+{
+	EntitySlotTable table;
+	put(table, 1, "one");
+	put(table, 2, "two");
+	put(table, 3, "three");
+	const auto slot3 = table.GetSlot(2);
+
+	// Grow
+	const size_t slot = table.Put(2, "two, but longer", 15, 1);
+	EXPECT_EQ(1, slot);
+	EXPECT_EQ("two, but longer", getData(table, slot));
+	// Shrink
+	put(table, 1, "1");
+	EXPECT_EQ("1", getData(table, 0));
+
+	EXPECT_EQ(slot3.offset, table.GetSlot(2).offset);
+	EXPECT_EQ("three", getData(table, 2));
+	EXPECT_EQ(5u, table.GetUnusedLength()); // "two" and "ne"
+}
+
+TEST(entity_slot_table, removedSlotsAreReused)
+{
+	EntitySlotTable table;
+	put(table, 1, "one");
+	put(table, 2, "two");
+
+	EXPECT_TRUE(table.Remove(1));
+	EXPECT_FALSE(table.Remove(1));
+	EXPECT_EQ(1, table.GetNumEntities());
+	EXPECT_EQ(1, table.Find(2));
+
+	put(table, 3, "three");
+	EXPECT_EQ(0, table.Find(3));
+	EXPECT_EQ(2, table.GetNumSlots());
+}
+
+TEST(entity_slot_table, compactionKeepsSlots)
+{
+	EntitySlotTable table;
+	for (ObjectID id = 1; id <= 4; ++id)
+		put(table, id, std::string(1000, char('a' + id)));
+	EXPECT_FALSE(table.NeedsCompaction());
+
+	table.Remove(1);
+	table.Remove(4);
+	put(table, 2, std::string(1200, 'x'));
+	EXPECT_TRUE(table.NeedsCompaction());
+
+	table.Compact();
+	EXPECT_EQ(0u, table.GetUnusedLength());
+	EXPECT_EQ(2200u, table.GetPayloadLength());
+	EXPECT_EQ(3, table.GetNumSlots()); // The free slot at the end is dropped, the one at the start has to stay
+	EXPECT_EQ(std::string(1200, 'x'), getData(table, 1));
+	EXPECT_EQ(std::string(1000, 'd'), getData(table, 2));
+}
+
+TEST(entity_slot_table, writeRead)
+{
+	EntitySlotTable table;
+	put(table, 1, "one");
+	put(table, 2, "two");
+	put(table, 3, "three");
+	table.Remove(2);
+
+	std::stringstream stream;
+	table.Write(stream);
+	const std::string data = stream.str();
+
+	CellDataCursor cursor(data.data(), data.size());
+	EXPECT_TRUE(EntitySlotTable::IsSlotTable(cursor));
+	EXPECT_EQ(0u, cursor.Tell());
+
+	EntitySlotTable readTable;
+	ASSERT_TRUE(readTable.Read(cursor));
+	EXPECT_TRUE(cursor.AtEnd());
+	EXPECT_EQ(2, readTable.GetNumEntities());
+	EXPECT_EQ(3, readTable.GetNumSlots());
+	EXPECT_EQ("three", getData(readTable, readTable.Find(3)));
+	EXPECT_EQ(table.GetUnusedLength(), readTable.GetUnusedLength());
+
+	// Truncated data is rejected
+	CellDataCursor truncated(data.data(), data.size() - 1);
+	EXPECT_FALSE(EntitySlotTable().Read(truncated));
+}
+
+TEST(entity_slot_table, readCellIntroGivesOffsets)
+{
+	EntitySlotTable table;
+	put(table, 1, "one");
+	put(table, 2, "two");
+	put(table, 1, "one, but longer"); // Moves 1 after 2
+
+	std::stringstream stream;
+	table.Write(stream);
+	const std::string data = stream.str();
+
+	CellDataCursor cursor(data.data(), data.size());
+	std::vector<size_t> offsets;
+	auto intro = ReadCellIntro(CellCoord_t(0, 0), cursor, true, EntitySerialisationUtils::FastBinary, &offsets);
+
+	ASSERT_EQ(2, intro.first);
+	ASSERT_EQ(2, offsets.size());
+	// In the order stored
+	EXPECT_EQ(2, intro.second[0]);
+	EXPECT_EQ(1, intro.second[1]);
+
+	ASSERT_TRUE(cursor.Seek(offsets[1]));
+	EXPECT_EQ("one, but longer", std::string(cursor.ReadBytes(15), 15));
+}
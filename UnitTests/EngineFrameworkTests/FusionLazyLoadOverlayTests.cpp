@@ -0,0 +1,182 @@
+#include "PrecompiledHeaders.h"
+
+#include "FusionPrerequisites.h"
+
+#include "FusionLazyLoadOverlay.h"
+#include "FusionRegionFile.h"
+#include "FusionRegionSnapshot.h"
+
+#include "TempDirectoryFixture.h"
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <sstream>
+
+using namespace FusionEngine;
+
+namespace
+{
+	namespace bfs = boost::filesystem;
+
+	const size_t s_SectorSize = RegionFile::s_SectorSize;
+
+	struct lazy_load_f : public temp_dir_f
+	{
+		lazy_load_f()
+			: temp_dir_f("lazyload")
+		{
+		}
+
+		void SetUp()
+		{
+			temp_dir_f::SetUp();
+			cache = base / "cache";
+			bfs::create_directories(cache);
+			// The save the others are based on first
+			for (int i = 0; i < 3; ++i)
+			{
+				std::stringstream folder; folder << "save" << i;
+				saves.push_back(base / folder.str());
+				bfs::create_directories(saves.back());
+			}
+		}
+
+		//! Writes a delta of the given sectors of modified to the given path
+		void writeDelta(const bfs::path& path, const std::string& modified, const boost::dynamic_bitset<>& sectors)
+		{
+			std::stringstream regionData(modified);
+			bfs::ofstream delta(path, std::ios::out | std::ios::binary | std::ios::trunc);
+			RegionSnapshot::WriteDelta(delta, regionData, modified.size(), sectors);
+		}
+
+		std::shared_ptr<LazyLoadOverlay> createOverlay(const std::vector<std::string>& filenames)
+		{
+			auto savePaths = saves;
+			auto openFile = [savePaths](size_t save_index, const std::string& relative_path)->std::unique_ptr<std::istream>
+			{
+				const auto path = savePaths[save_index] / relative_path;
+				if (!bfs::exists(path))
+					return std::unique_ptr<std::istream>();
+				return std::unique_ptr<std::istream>(new bfs::ifstream(path, std::ios::in | std::ios::binary));
+			};
+			return std::make_shared<LazyLoadOverlay>(saves.size(), openFile, filenames, "", cache.string());
+		}
+
+		//! 0.0.celldata is in the base save, and each of the later saves has a delta for it
+		std::string writeDeltaChain()
+		{
+			std::string data = std::string(s_SectorSize, 'a') + std::string(s_SectorSize, 'b');
+			writeFile(saves[0] / "0.0.celldata", data);
+
+			data.replace(s_SectorSize, s_SectorSize, s_SectorSize, 'X');
+			boost::dynamic_bitset<> second(2);
+			second.set(1);
+			writeDelta(saves[1] / "0.0.celldelta", data, second);
+
+			data.replace(0, s_SectorSize, s_SectorSize, 'Y');
+			data.append(s_SectorSize, 'Z');
+			boost::dynamic_bitset<> third(3);
+			third.set(0);
+			third.set(2);
+			writeDelta(saves[2] / "0.0.celldelta", data, third);
+
+			return data;
+		}
+
+		bfs::path cache;
+		std::vector<bfs::path> saves;
+	};
+}
+
+TEST_F(lazy_load_f, regionFilenames)
+{
+	EXPECT_EQ("0.0.celldata", LazyLoadOverlay::GetRegionFilename("0.0.celldata"));
+	EXPECT_EQ("-1.2.celldata", LazyLoadOverlay::GetRegionFilename("-1.2" + std::string(RegionSnapshot::s_DeltaExtension)));
+	EXPECT_EQ("", LazyLoadOverlay::GetRegionFilename("entitylocations.kc"));
+}
+
+TEST_F(lazy_load_f, baseThenDeltas)
+{
+	const auto expected = writeDeltaChain();
+	// A later save replaces the file in the base save entirely
+	writeFile(saves[0] / "1.0.celldata", "base");
+	writeFile(saves[2] / "1.0.celldata", "replaced");
+
+	std::vector<std::string> filenames;
+	filenames.push_back("0.0.celldata");
+	filenames.push_back("1.0.celldata");
+	auto overlay = createOverlay(filenames);
+
+	EXPECT_TRUE(overlay->Provides("0.0.celldata"));
+	EXPECT_FALSE(overlay->Provides("2.0.celldata"));
+	EXPECT_FALSE(bfs::exists(cache / "0.0.celldata"));
+
+	overlay->FaultIn("0.0.celldata");
+	overlay->FaultIn("1.0.celldata");
+	EXPECT_EQ(expected, readFile(cache / "0.0.celldata"));
+	EXPECT_EQ("replaced", readFile(cache / "1.0.celldata"));
+
+	// Files that don't come from the overlay are left alone
+	overlay->FaultIn("2.0.celldata");
+	EXPECT_FALSE(bfs::exists(cache / "2.0.celldata"));
+}
+
+TEST_F(lazy_load_f, filesAreOnlyCopiedOnce)
+{
+	writeFile(saves[0] / "0.0.celldata", "base");
+	writeFile(saves[1] / "1.0.celldata", "other");
+
+	std::vector<std::string> filenames;
+	filenames.push_back("0.0.celldata");
+	filenames.push_back("1.0.celldata");
+	auto overlay = createOverlay(filenames);
+
+	overlay->FaultIn("0.0.celldata");
+	// The cache's copy is modified once it has been faulted in: faulting it in again mustn't replace it
+	writeFile(cache / "0.0.celldata", "modified");
+	overlay->FaultIn("0.0.celldata");
+	EXPECT_EQ("modified", readFile(cache / "0.0.celldata"));
+
+	const std::atomic<bool> cancel(true);
+	overlay->FaultInAll(cancel);
+	EXPECT_FALSE(bfs::exists(cache / "1.0.celldata"));
+
+	const std::atomic<bool> dontCancel(false);
+	overlay->FaultInAll(dontCancel);
+	EXPECT_EQ("modified", readFile(cache / "0.0.celldata"));
+	EXPECT_EQ("other", readFile(cache / "1.0.celldata"));
+}
+
+TEST_F(lazy_load_f, regionFaultedInAfterSnapshotIsTaken)
+{
+	const auto expected = writeDeltaChain();
+	writeFile(saves[0] / "1.0.celldata", "unchanged");
+
+	std::vector<std::string> filenames;
+	filenames.push_back("0.0.celldata");
+	filenames.push_back("1.0.celldata");
+	auto overlay = createOverlay(filenames);
+
+	// 1.0 has been loaded (and modified) before the save, 0.0 hasn't been needed yet
+	overlay->FaultIn("1.0.celldata");
+	writeFile(cache / "1.0.celldata", "modified");
+
+	// Like a full snapshot (see RegionCellCache::BeginSnapshot), which includes the files still to come from the overlay
+	const auto dest = base / "snapshot";
+	bfs::create_directories(dest);
+	std::vector<bfs::path> files;
+	files.push_back(cache / "0.0.celldata");
+	files.push_back(cache / "1.0.celldata");
+	RegionSnapshot snapshot(files, dest);
+
+	// The snapshot thread faults in the rest before writing
+	const std::atomic<bool> cancel(false);
+	overlay->FaultInAll(cancel);
+	while (snapshot.WriteNext());
+
+	EXPECT_EQ(expected, readFile(dest / "0.0.celldata"));
+	EXPECT_EQ("modified", readFile(dest / "1.0.celldata"));
+}
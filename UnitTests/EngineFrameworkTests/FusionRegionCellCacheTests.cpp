@@ -0,0 +1,184 @@
+#include "PrecompiledHeaders.h"
+
+#include "FusionPrerequisites.h"
+
+#include "FusionCellCodec.h"
+#include "FusionRegionCellCache.h"
+#include "FusionRegionFile.h"
+#include "FusionResourceManager.h"
+
+#include "TempDirectoryFixture.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+using namespace FusionEngine;
+
+namespace
+{
+	const int32_t s_RegionSize = 4;
+
+	typedef std::pair<int32_t, int32_t> CellIndex_t;
+
+	struct region_cell_cache_f : public temp_dir_f
+	{
+		region_cell_cache_f()
+			: temp_dir_f("cellcache")
+		{
+		}
+
+		void SetUp()
+		{
+			temp_dir_f::SetUp();
+			cachePath = base.string() + "/";
+
+			resourceManager.reset(new ResourceManager(gc));
+			resourceManager->StartLoaderThread();
+		}
+
+		void TearDown()
+		{
+			// The cache holds resources, so it goes before the resource manager
+			cache.reset();
+			resourceManager.reset();
+			temp_dir_f::TearDown();
+		}
+
+		//! Writes the given data to a cell (before the cache is created)
+		void writeCell(int32_t x, int32_t y, const std::string& contents)
+		{
+			const int32_t regionX = (int32_t)std::floor(x / (float)s_RegionSize), regionY = (int32_t)std::floor(y / (float)s_RegionSize);
+			std::stringstream filename; filename << regionX << "." << regionY << ".celldata";
+
+			std::vector<char> compressed;
+			CellCodecs::Compress(CellCodec::Zlib, contents.data(), contents.size(), compressed);
+			RegionFile region(cachePath + filename.str(), s_RegionSize, false);
+			region.write(std::make_pair(x - regionX * s_RegionSize, y - regionY * s_RegionSize), compressed, CellCodec::Zlib);
+		}
+
+		//! Returns a callback that records the data passed to it for each cell
+		RegionCellCache::GotCellDataBatchCallback recordResults()
+		{
+			return [this](int32_t x, int32_t y, std::shared_ptr<CellData> data)
+			{
+				std::lock_guard<std::mutex> lock(resultsMutex);
+				auto& result = results[std::make_pair(x, y)];
+				++result.first;
+				if (data)
+				{
+					const size_t length = data->GetRemaining();
+					result.second.assign(data->ReadBytes(length), length);
+				}
+			};
+		}
+
+		size_t numCallbacks()
+		{
+			std::lock_guard<std::mutex> lock(resultsMutex);
+			size_t count = 0;
+			for (auto it = results.begin(); it != results.end(); ++it)
+				count += it->second.first;
+			return count;
+		}
+
+		//! Delivers loaded regions until there have been the given number of callbacks (or a few seconds have passed)
+		bool waitForCallbacks(size_t expected)
+		{
+			for (int i = 0; i < 500 && numCallbacks() < expected; ++i)
+			{
+				resourceManager->DeliverLoadedResources();
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			return numCallbacks() == expected;
+		}
+
+		std::string cachePath;
+
+		clan::GraphicContext gc;
+		std::unique_ptr<ResourceManager> resourceManager;
+		std::unique_ptr<RegionCellCache> cache;
+
+		std::mutex resultsMutex;
+		// Number of times the callback was called for each cell, and the data it got
+		std::map<CellIndex_t, std::pair<int, std::string>> results;
+	};
+}
+
+TEST_F(region_cell_cache_f, batchMixesCachedUncachedAndMissingCells)
+{
+	writeCell(0, 0, "first");
+	writeCell(3, 3, "corner");
+	writeCell(5, 1, "cached");
+	writeCell(-2, 0, "negative");
+
+	cache.reset(new RegionCellCache(cachePath, s_RegionSize, false, false));
+
+	// Load region (1, 0) before the batch
+	std::vector<RegionCellCache::RegionCoord_t> cells;
+	cells.push_back(RegionCellCache::RegionCoord_t(5, 1));
+	cache->GetCellDataBatchForReading(recordResults(), cells);
+	ASSERT_TRUE(waitForCallbacks(1));
+	{
+		std::lock_guard<std::mutex> lock(resultsMutex);
+		results.clear();
+	}
+
+	cells.clear();
+	// Region (1, 0) is loaded: one cell with data, one without
+	cells.push_back(RegionCellCache::RegionCoord_t(5, 1));
+	cells.push_back(RegionCellCache::RegionCoord_t(6, 2));
+	// Region (0, 0) hasn't been loaded yet
+	cells.push_back(RegionCellCache::RegionCoord_t(3, 3));
+	cells.push_back(RegionCellCache::RegionCoord_t(0, 0));
+	cells.push_back(RegionCellCache::RegionCoord_t(1, 1));
+	// Region (-1, 0) hasn't been loaded yet either
+	cells.push_back(RegionCellCache::RegionCoord_t(-2, 0));
+	// Region (2, 2) doesn't exist
+	cells.push_back(RegionCellCache::RegionCoord_t(9, 9));
+	cache->GetCellDataBatchForReading(recordResults(), cells);
+	ASSERT_TRUE(waitForCallbacks(cells.size()));
+
+	// Callbacks are only called once for each cell (deliver anything else that's pending, to make sure)
+	resourceManager->DeliverLoadedResources();
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	resourceManager->DeliverLoadedResources();
+
+	std::lock_guard<std::mutex> lock(resultsMutex);
+	ASSERT_EQ(cells.size(), results.size());
+	for (auto it = results.begin(); it != results.end(); ++it)
+		EXPECT_EQ(1, it->second.first) << "cell " << it->first.first << ", " << it->first.second;
+
+	EXPECT_EQ("cached", results[std::make_pair(5, 1)].second);
+	EXPECT_EQ("", results[std::make_pair(6, 2)].second);
+	EXPECT_EQ("corner", results[std::make_pair(3, 3)].second);
+	EXPECT_EQ("first", results[std::make_pair(0, 0)].second);
+	EXPECT_EQ("", results[std::make_pair(1, 1)].second);
+	EXPECT_EQ("negative", results[std::make_pair(-2, 0)].second);
+	EXPECT_EQ("", results[std::make_pair(9, 9)].second);
+}
+
+TEST_F(region_cell_cache_f, batchRectangle)
+{
+	writeCell(1, 1, "a");
+	writeCell(4, 2, "b");
+
+	cache.reset(new RegionCellCache(cachePath, s_RegionSize, false, false));
+
+	// Spans two regions
+	cache->GetCellDataBatchForReading(recordResults(), clan::Rect(0, 0, 6, 3));
+	ASSERT_TRUE(waitForCallbacks(6 * 3));
+
+	std::lock_guard<std::mutex> lock(resultsMutex);
+	EXPECT_EQ(size_t(6 * 3), results.size());
+	for (auto it = results.begin(); it != results.end(); ++it)
+		EXPECT_EQ(1, it->second.first);
+	EXPECT_EQ("a", results[std::make_pair(1, 1)].second);
+	EXPECT_EQ("b", results[std::make_pair(4, 2)].second);
+	EXPECT_EQ("", results[std::make_pair(0, 0)].second);
+}
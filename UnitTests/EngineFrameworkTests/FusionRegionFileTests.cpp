@@ -0,0 +1,252 @@
+#include "PrecompiledHeaders.h"
+
+#include "FusionPrerequisites.h"
+
+#include "FusionRegionFile.h"
+
+#include "FusionBinaryStream.h"
+#include "FusionCellCodec.h"
+
+#include <gtest/gtest.h>
+
+#include <tbb/parallel_for.h>
+
+#include <sstream>
+
+using namespace FusionEngine;
+
+namespace
+{
+	std::unique_ptr<RegionFile> createRegionFile(size_t width = 4, const std::string& contents = std::string())
+	{
+		// An in-memory region: the data is loaded into a buffer, so it can be written to as well
+		return std::unique_ptr<RegionFile>(new RegionFile(std::unique_ptr<std::istream>(new std::stringstream(contents)), width));
+	}
+
+	std::unique_ptr<RegionFile> reopen(const RegionFile& region)
+	{
+		return createRegionFile(region.region_width, std::string(region.regionData->begin(), region.regionData->end()));
+	}
+
+	std::vector<char> makeData(size_t length, char fill)
+	{
+		return std::vector<char>(length, fill);
+	}
+
+	bool hasData(RegionFile& region, int32_t x, int32_t y, const std::vector<char>& expected)
+	{
+		const auto view = region.getCellDataView(x, y);
+		return view.data && view.length >= expected.size() && std::equal(expected.begin(), expected.end(), view.data);
+	}
+
+	const size_t s_SectorData = RegionFile::s_SectorSize - RegionFile::s_CellHeaderSize;
+}
+
+TEST(region_file, fragmentationStats)
+{
+	auto region = createRegionFile();
+
+	auto small = makeData(100, 'a');
+	auto large = makeData(RegionFile::s_SectorSize * 2, 'b'); // Three sectors (with the header)
+	region->write(std::make_pair(0, 0), small);
+	region->write(std::make_pair(1, 0), large);
+	region->write(std::make_pair(2, 0), small);
+
+	auto stats = region->getFragmentationStats();
+	EXPECT_EQ(6, stats.totalSectors); // Including the index
+	EXPECT_EQ(0, stats.freeSectors);
+
+	// Shrinking the middle cell leaves a hole
+	region->write(std::make_pair(1, 0), small);
+	stats = region->getFragmentationStats();
+	EXPECT_EQ(2, stats.freeSectors);
+	EXPECT_EQ(2, stats.holeSectors);
+	EXPECT_EQ(2, stats.largestFreeRun);
+	EXPECT_EQ(1, stats.freeRuns);
+}
+
+TEST(region_file, defragmentStep)
+{
+	auto region = createRegionFile();
+
+	std::vector<std::vector<char>> data;
+	for (int32_t i = 0; i < 8; ++i)
+	{
+		data.push_back(makeData(s_SectorData * (i % 3) + 10, char('a' + i)));
+		region->write(std::make_pair(i % 4, i / 4), data.back());
+	}
+	// Move some cells to the end of the file
+	for (int32_t i = 0; i < 8; i += 3)
+	{
+		data[i] = makeData(s_SectorData * 3, char('A' + i));
+		region->write(std::make_pair(i % 4, i / 4), data[i]);
+	}
+	const auto before = region->getFragmentationStats();
+	ASSERT_GT(before.holeSectors, 0u);
+
+	// Small steps
+	size_t steps = 0;
+	while (region->defragmentStep(1) > 0)
+		ASSERT_LT(++steps, 100u);
+	EXPECT_GT(steps, 1u);
+
+	const auto after = region->getFragmentationStats();
+	EXPECT_EQ(0, after.holeSectors);
+	EXPECT_EQ(before.freeSectors, after.freeSectors);
+	EXPECT_EQ(after.freeSectors, after.largestFreeRun); // All the free space is at the end
+
+	for (int32_t i = 0; i < 8; ++i)
+		EXPECT_TRUE(hasData(*region, i % 4, i / 4, data[i])) << "cell " << i;
+
+	// Writes after defragmenting still find the right space
+	data[1] = makeData(s_SectorData + 10, 'z');
+	region->write(std::make_pair(1, 0), data[1]);
+	for (int32_t i = 0; i < 8; ++i)
+		EXPECT_TRUE(hasData(*region, i % 4, i / 4, data[i])) << "cell " << i;
+}
+
+TEST(region_file, exactSectorMultiples)
+{
+	auto region = createRegionFile();
+
+	// Header and data exactly fill two sectors, so no third sector should be allocated
+	auto exact = makeData(s_SectorData + RegionFile::s_SectorSize, 'e');
+	auto small = makeData(10, 's');
+	region->write(std::make_pair(0, 0), small);
+	region->write(std::make_pair(1, 0), exact);
+	EXPECT_EQ(2u, region->getCellDataLocation(std::make_pair(1, 0)).sectorsAllocated);
+
+	// Moving it into the hole left by the first cell keeps the same length
+	small = makeData(s_SectorData * 3, 'S');
+	region->write(std::make_pair(0, 0), small);
+	size_t steps = 0;
+	while (region->defragmentStep(1) > 0)
+		ASSERT_LT(++steps, 10u);
+	EXPECT_EQ(2u, region->getCellDataLocation(std::make_pair(1, 0)).sectorsAllocated);
+	EXPECT_TRUE(hasData(*region, 1, 0, exact));
+	EXPECT_EQ(0, region->getFragmentationStats().holeSectors);
+
+	auto reopened = reopen(*region);
+	EXPECT_TRUE(hasData(*reopened, 1, 0, exact));
+}
+
+TEST(region_file, largeCellsAndWideRegions)
+{
+	auto region = createRegionFile(64);
+	EXPECT_EQ(RegionFile::indexSectorsFor(64), region->index_sectors);
+	EXPECT_GT(region->index_sectors, 1u);
+
+	auto large = makeData(RegionFile::s_SectorSize * 300, 'L'); // More than the 255 sectors that version 1 allowed
+	auto small = makeData(100, 's');
+	region->write(std::make_pair(63, 63), large);
+	region->write(std::make_pair(0, 0), small);
+	EXPECT_EQ(301u, region->getCellDataLocation(std::make_pair(63, 63)).sectorsAllocated);
+
+	auto reopened = reopen(*region);
+	EXPECT_TRUE(hasData(*reopened, 63, 63, large));
+	EXPECT_TRUE(hasData(*reopened, 0, 0, small));
+	EXPECT_EQ(region->getFragmentationStats().freeSectors, reopened->getFragmentationStats().freeSectors);
+}
+
+TEST(region_file, upgradesVersion1Files)
+{
+	// Build a version 1 file: 1024 packed (24 / 8 bit) index entries, then the cell data
+	std::stringstream v1;
+	IO::Streams::CellStreamWriter writer(&v1);
+	std::vector<std::pair<size_t, std::vector<char>>> cells;
+	cells.push_back(std::make_pair(5, makeData(100, 'a')));
+	cells.push_back(std::make_pair(0, makeData(RegionFile::s_SectorSize, 'b')));
+	uint32_t sector = 1;
+	std::vector<uint32_t> index(1024, 0);
+	for (auto it = cells.begin(); it != cells.end(); ++it)
+	{
+		const uint32_t numSectors = uint32_t((it->second.size() + RegionFile::s_CellHeaderSize) / RegionFile::s_SectorSize + 1);
+		index[it->first] = sector | (numSectors << 24);
+		sector += numSectors;
+	}
+	for (auto it = index.begin(); it != index.end(); ++it)
+		writer.Write(*it);
+	for (auto it = cells.begin(); it != cells.end(); ++it)
+	{
+		const auto start = v1.tellp();
+		writer.WriteAs<size_t>(it->second.size() + 2);
+		writer.WriteAs<uint8_t>(3);
+		writer.WriteAs<uint8_t>(0);
+		writer.WriteAs<size_t>(it->first);
+		v1.write(it->second.data(), it->second.size());
+		while ((v1.tellp() - start) % RegionFile::s_SectorSize != 0)
+			v1.put(0);
+	}
+
+	auto region = createRegionFile(4, v1.str());
+	EXPECT_TRUE(hasData(*region, 1, 1, cells[0].second));
+	EXPECT_TRUE(hasData(*region, 0, 0, cells[1].second));
+
+	// Upgraded in place
+	auto reopened = reopen(*region);
+	EXPECT_EQ(0, std::string(reopened->regionData->data(), 6).compare("FSNRGN"));
+	EXPECT_TRUE(hasData(*reopened, 1, 1, cells[0].second));
+	EXPECT_TRUE(hasData(*reopened, 0, 0, cells[1].second));
+	EXPECT_EQ(0u, reopened->getFragmentationStats().holeSectors);
+}
+
+TEST(region_file, parallelRecompressionMatchesSerial)
+{
+	// Compiled maps use zstd, if it's in this build
+	const CellCodec codec = GetAvailableCellCodec(CellCodec::Zstd);
+
+	const size_t numRegions = 16;
+	std::vector<std::unique_ptr<RegionFile>> sources, serial, parallel;
+	std::vector<std::vector<std::vector<char>>> originals(numRegions);
+	for (size_t r = 0; r < numRegions; ++r)
+	{
+		sources.push_back(createRegionFile());
+		serial.push_back(createRegionFile());
+		parallel.push_back(createRegionFile());
+
+		originals[r].resize(16);
+		for (size_t i = 0; i < 16; ++i)
+		{
+			// Leave some cells empty
+			if ((i + r) % 5 == 0)
+				continue;
+			auto& cellData = originals[r][i];
+			for (size_t k = 0, length = 200 + 97 * i; k < length; ++k)
+				cellData.push_back(char('a' + (k * (r + 1) + i) % 26));
+
+			std::vector<char> compressed;
+			CellCodecs::Compress(CellCodec::Zlib, cellData.data(), cellData.size(), compressed);
+			sources[r]->write(std::make_pair(int32_t(i % 4), int32_t(i / 4)), compressed, CellCodec::Zlib);
+		}
+	}
+
+	for (size_t r = 0; r < numRegions; ++r)
+		sources[r]->recompressTo(*serial[r], codec);
+	tbb::parallel_for(size_t(0), numRegions, [&](size_t r)
+	{
+		sources[r]->recompressTo(*parallel[r], codec);
+	});
+
+	std::vector<char> serialData, parallelData;
+	for (size_t r = 0; r < numRegions; ++r)
+	{
+		for (size_t i = 0; i < 16; ++i)
+		{
+			const auto serialView = serial[r]->getCellDataView(int32_t(i % 4), int32_t(i / 4));
+			const auto parallelView = parallel[r]->getCellDataView(int32_t(i % 4), int32_t(i / 4));
+			if (originals[r][i].empty())
+			{
+				EXPECT_EQ(nullptr, serialView.data);
+				EXPECT_EQ(nullptr, parallelView.data);
+				continue;
+			}
+			ASSERT_TRUE(serialView.data && parallelView.data);
+			EXPECT_EQ(codec, serialView.codec);
+			EXPECT_EQ(codec, parallelView.codec);
+			ASSERT_TRUE(CellCodecs::Decompress(serialView.codec, serialView.data, serialView.length, serialData));
+			ASSERT_TRUE(CellCodecs::Decompress(parallelView.codec, parallelView.data, parallelView.length, parallelData));
+			EXPECT_EQ(originals[r][i], serialData);
+			EXPECT_EQ(serialData, parallelData);
+		}
+	}
+}
@@ -0,0 +1,136 @@
+#include "PrecompiledHeaders.h"
+
+#include "FusionPrerequisites.h"
+
+#include "FusionRegionFile.h"
+#include "FusionRegionSnapshot.h"
+
+#include "TempDirectoryFixture.h"
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <sstream>
+
+using namespace FusionEngine;
+
+namespace
+{
+	namespace bfs = boost::filesystem;
+
+	struct region_snapshot_f : public temp_dir_f
+	{
+		region_snapshot_f()
+			: temp_dir_f("snapshot")
+		{
+		}
+
+		void SetUp()
+		{
+			temp_dir_f::SetUp();
+			source = base / "cache";
+			dest = base / "save";
+			bfs::create_directories(source);
+			bfs::create_directories(dest);
+		}
+
+		bfs::path source, dest;
+	};
+}
+
+TEST_F(region_snapshot_f, filesAreWrittenAsTheyWere)
+{
+	// An in-memory region standing in for the cached copy of 0.0.celldata
+	RegionFile region(std::unique_ptr<std::istream>(new std::stringstream()), 4);
+	std::vector<char> cellData(100, 'a');
+	region.write(std::make_pair(0, 0), cellData);
+	const auto data = region.getRegionData();
+	const std::string original(data.first, data.second);
+	region.filename = (source / "0.0.celldata").string();
+
+	writeFile(source / "0.0.celldata", original);
+	writeFile(source / "0.1.celldata", "unmodified");
+
+	std::vector<bfs::path> files;
+	files.push_back(source / "0.0.celldata");
+	files.push_back(source / "0.1.celldata");
+	RegionSnapshot snapshot(files, dest);
+	EXPECT_EQ(2, snapshot.GetNumFiles());
+
+	// Modify the first file before it is written
+	snapshot.Preserve(region);
+	writeFile(source / "0.0.celldata", "modified");
+
+	EXPECT_TRUE(snapshot.WriteNext());
+	EXPECT_TRUE(snapshot.WriteNext());
+	EXPECT_FALSE(snapshot.WriteNext());
+
+	EXPECT_EQ(original, readFile(dest / "0.0.celldata"));
+	EXPECT_EQ("unmodified", readFile(dest / "0.1.celldata"));
+	EXPECT_EQ(1, snapshot.GetNumPreserved());
+
+	// Files that have been written (or aren't in the snapshot) aren't kept
+	snapshot.Preserve(region);
+	region.filename = (source / "1.0.celldata").string();
+	snapshot.Preserve(region);
+	EXPECT_EQ(1, snapshot.GetNumPreserved());
+	region.filename.clear();
+}
+
+TEST_F(region_snapshot_f, deltasOnlyContainModifiedSectors)
+{
+	const size_t sectorSize = RegionFile::s_SectorSize;
+	std::string baseData;
+	for (char c = 'a'; c < 'e'; ++c)
+		baseData.append(sectorSize, c);
+	std::string modified = baseData;
+	modified.replace(sectorSize, sectorSize, sectorSize, 'X');
+	modified.replace(sectorSize * 3, sectorSize, sectorSize, 'Y');
+	modified.append(sectorSize, 'Z');
+	writeFile(source / "0.0.celldata", modified);
+
+	// An in-memory region (standing in for the cached 0.1.celldata) that is modified after the snapshot is taken
+	RegionFile region(std::unique_ptr<std::istream>(new std::stringstream()), 4);
+	std::vector<char> cellData(100, 'a');
+	region.write(std::make_pair(0, 0), cellData);
+	const auto data = region.getRegionData();
+	const std::string original(data.first, data.second);
+	region.filename = (source / "0.1.celldata").string();
+	writeFile(source / "0.1.celldata", original);
+
+	boost::dynamic_bitset<> sectors(5);
+	sectors.set(1);
+	sectors.set(3);
+	sectors.set(4);
+	boost::dynamic_bitset<> allSectors(original.size() / sectorSize);
+	allSectors.set();
+
+	RegionSnapshot snapshot(std::vector<bfs::path>(), dest);
+	snapshot.AddDelta(source / "0.0.celldata", sectors);
+	snapshot.AddDelta(source / "0.1.celldata", allSectors);
+	EXPECT_EQ(2, snapshot.GetNumDeltas());
+
+	snapshot.Preserve(region);
+	writeFile(source / "0.1.celldata", "modified");
+	while (snapshot.WriteNext());
+	region.filename.clear();
+
+	ASSERT_TRUE(bfs::exists(dest / "0.0.celldelta"));
+	EXPECT_LT(bfs::file_size(dest / "0.0.celldelta"), modified.size());
+
+	// Applying the deltas to the base files gives the files as they were when the snapshot was taken
+	writeFile(base / "0.0.celldata", baseData);
+	{
+		bfs::ifstream delta(dest / "0.0.celldelta", std::ios::in | std::ios::binary);
+		RegionSnapshot::ApplyDelta(delta, base / "0.0.celldata");
+	}
+	EXPECT_EQ(modified, readFile(base / "0.0.celldata"));
+
+	{
+		bfs::ifstream delta(dest / "0.1.celldelta", std::ios::in | std::ios::binary);
+		RegionSnapshot::ApplyDelta(delta, base / "0.1.celldata");
+	}
+	EXPECT_EQ(original, readFile(base / "0.1.celldata"));
+}
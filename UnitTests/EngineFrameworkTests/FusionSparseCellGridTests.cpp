@@ -0,0 +1,96 @@
+#include "PrecompiledHeaders.h"
+
+#include "FusionPrerequisites.h"
+
+#include "FusionSparseCellGrid.h"
+
+#include <gtest/gtest.h>
+
+#include <set>
+
+using namespace FusionEngine;
+
+namespace
+{
+	typedef SparseCellGrid<int> Grid_t;
+
+	std::set<std::pair<int32_t, int32_t>> collectRange(const Grid_t& grid, const clan::Rect& range)
+	{
+		std::set<std::pair<int32_t, int32_t>> visited;
+		grid.for_each_in_range(range, [&](const CellHandle& location, const int&)
+		{
+			visited.insert(std::make_pair(location.x, location.y));
+		});
+		return visited;
+	}
+}
+
+TEST(sparse_cell_grid, insertFindErase)
+{
+	Grid_t grid;
+	ASSERT_TRUE(grid.empty());
+	ASSERT_EQ(nullptr, grid.find(CellHandle(0, 0)));
+
+	grid.insert(CellHandle(3, 4), 34);
+	grid.insert(CellHandle(-1, -1), -11);
+	grid[CellHandle(-17, 40)] = 1740;
+
+	ASSERT_EQ(3u, grid.size());
+	ASSERT_TRUE(grid.find(CellHandle(3, 4)) != nullptr);
+	EXPECT_EQ(34, *grid.find(CellHandle(3, 4)));
+	EXPECT_EQ(-11, *grid.find(CellHandle(-1, -1)));
+	EXPECT_EQ(1740, *grid.find(CellHandle(-17, 40)));
+	EXPECT_FALSE(grid.contains(CellHandle(4, 3)));
+
+	EXPECT_TRUE(grid.erase(CellHandle(-1, -1)));
+	EXPECT_FALSE(grid.erase(CellHandle(-1, -1)));
+	EXPECT_FALSE(grid.contains(CellHandle(-1, -1)));
+	EXPECT_EQ(2u, grid.size());
+}
+
+TEST(sparse_cell_grid, manyChunks)
+{
+	Grid_t grid;
+	// Spread values over enough chunks to force the chunk table to grow
+	for (int32_t y = -200; y < 200; y += 7)
+		for (int32_t x = -200; x < 200; x += 11)
+			grid.insert(CellHandle(x, y), x * 1000 + y);
+
+	for (int32_t y = -200; y < 200; y += 7)
+		for (int32_t x = -200; x < 200; x += 11)
+		{
+			auto value = grid.find(CellHandle(x, y));
+			ASSERT_TRUE(value != nullptr);
+			ASSERT_EQ(x * 1000 + y, *value);
+		}
+
+	// Remove every other value, then make sure the rest can still be found (removal mustn't break probe sequences)
+	for (int32_t y = -200; y < 200; y += 14)
+		for (int32_t x = -200; x < 200; x += 11)
+			ASSERT_TRUE(grid.erase(CellHandle(x, y)));
+
+	for (int32_t y = -193; y < 200; y += 14)
+		for (int32_t x = -200; x < 200; x += 11)
+			ASSERT_TRUE(grid.contains(CellHandle(x, y)));
+}
+
+TEST(sparse_cell_grid, rangeOnlyVisitsCellsInside)
+{
+	Grid_t grid;
+	for (int32_t y = -20; y <= 20; ++y)
+		for (int32_t x = -20; x <= 20; ++x)
+			grid.insert(CellHandle(x, y), 0);
+
+	const clan::Rect range(-3, -18, 5, 2);
+	auto visited = collectRange(grid, range);
+
+	EXPECT_EQ(size_t((range.right - range.left + 1) * (range.bottom - range.top + 1)), visited.size());
+	for (auto it = visited.begin(); it != visited.end(); ++it)
+	{
+		EXPECT_TRUE(it->first >= range.left && it->first <= range.right);
+		EXPECT_TRUE(it->second >= range.top && it->second <= range.bottom);
+	}
+
+	// Empty (inverted) ranges visit nothing
+	EXPECT_TRUE(collectRange(grid, clan::Rect(2, 2, 1, 1)).empty());
+}
@@ -0,0 +1,242 @@
+#include "PrecompiledHeaders.h"
+
+#include "FusionPrerequisites.h"
+
+#include "FusionSpatialIndex.h"
+
+#include "FusionEntity.h"
+#include "FusionTransformComponent.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+using namespace FusionEngine;
+
+namespace
+{
+	//! Minimal transform, just enough to construct an Entity
+	class TestTransform : public SynchronisingComponent, public ITransform
+	{
+	public:
+		FSN_LIST_INTERFACES((ITransform))
+
+		std::string GetType() const { return "TestTransform"; }
+
+		bool HasContinuousPosition() const { return false; }
+
+		Vector2 GetPosition() const { return m_Position; }
+		void SetPosition(const Vector2& pos) { m_Position = pos; }
+
+	private:
+		Vector2 m_Position;
+
+		float GetAngle() const { return 0.f; }
+		void SetAngle(float) {}
+
+		int GetDepth() const { return 0; }
+		void SetDepth(int) {}
+	};
+
+	EntityPtr makeEntity()
+	{
+		return std::make_shared<Entity>(nullptr, ComponentPtr(new TestTransform()));
+	}
+
+	bool contains(const std::vector<EntityPtr>& results, const EntityPtr& entity)
+	{
+		return std::find(results.begin(), results.end(), entity) != results.end();
+	}
+
+	struct spatial_index_f : public testing::Test
+	{
+		spatial_index_f()
+			: index(10.f)
+		{
+		}
+
+		SpatialIndex index;
+	};
+}
+
+TEST_F(spatial_index_f, insertAndQueryRadius)
+{
+	auto a = makeEntity(), b = makeEntity(), c = makeEntity();
+	index.Update(a, Vector2(1.f, 1.f));
+	index.Update(b, Vector2(-4.f, 3.f));
+	index.Update(c, Vector2(55.f, -20.f));
+	ASSERT_EQ(3u, index.GetNumEntities());
+
+	std::vector<EntityPtr> results;
+	EXPECT_EQ(2u, index.QueryRadius(Vector2(0.f, 0.f), 6.f, results));
+	EXPECT_TRUE(contains(results, a));
+	EXPECT_TRUE(contains(results, b));
+	EXPECT_FALSE(contains(results, c));
+
+	// Results are appended
+	EXPECT_EQ(1u, index.QueryRadius(Vector2(50.f, -20.f), 6.f, results));
+	EXPECT_EQ(3u, results.size());
+	EXPECT_TRUE(contains(results, c));
+}
+
+TEST_F(spatial_index_f, moveBetweenCells)
+{
+	auto entity = makeEntity();
+	index.Update(entity, Vector2(2.f, 2.f));
+	// Move within the same cell, then across several cells
+	index.Update(entity, Vector2(8.f, 3.f));
+	index.Update(entity, Vector2(-35.f, 42.f));
+	EXPECT_EQ(1u, index.GetNumEntities());
+
+	std::vector<EntityPtr> results;
+	EXPECT_EQ(0u, index.QueryRadius(Vector2(5.f, 5.f), 10.f, results));
+	EXPECT_EQ(1u, index.QueryRadius(Vector2(-35.f, 40.f), 3.f, results));
+	EXPECT_EQ(entity, results.front());
+}
+
+TEST_F(spatial_index_f, remove)
+{
+	auto a = makeEntity(), b = makeEntity();
+	index.Update(a, Vector2(0.f, 0.f));
+	index.Update(b, Vector2(1.f, 0.f));
+
+	index.Remove(a);
+	EXPECT_EQ(1u, index.GetNumEntities());
+	// Removing an entity that isn't indexed does nothing
+	index.Remove(a);
+	EXPECT_EQ(1u, index.GetNumEntities());
+
+	std::vector<EntityPtr> results;
+	EXPECT_EQ(1u, index.QueryRadius(Vector2(0.f, 0.f), 5.f, results));
+	EXPECT_EQ(b, results.front());
+
+	index.Clear();
+	EXPECT_EQ(0u, index.GetNumEntities());
+	results.clear();
+	EXPECT_EQ(0u, index.QueryNearest(Vector2(0.f, 0.f), 1, results));
+}
+
+TEST_F(spatial_index_f, queryNearestOrdering)
+{
+	std::vector<EntityPtr> entities;
+	for (int i = 0; i < 6; ++i)
+	{
+		entities.push_back(makeEntity());
+		// Alternate sides so insertion order doesn't match distance order
+		const float offset = (i % 2 == 0 ? 1.f : -1.f) * (3.f + 7.f * (5 - i));
+		index.Update(entities.back(), Vector2(offset, 0.5f));
+	}
+
+	std::vector<EntityPtr> results;
+	ASSERT_EQ(3u, index.QueryNearest(Vector2(0.f, 0.f), 3, results));
+	EXPECT_EQ(entities[5], results[0]);
+	EXPECT_EQ(entities[4], results[1]);
+	EXPECT_EQ(entities[3], results[2]);
+
+	// Asking for more than exist returns all of them
+	results.clear();
+	EXPECT_EQ(6u, index.QueryNearest(Vector2(0.f, 0.f), 10, results));
+	EXPECT_EQ(entities[0], results.back());
+}
+
+TEST_F(spatial_index_f, queryNearestMaxDistance)
+{
+	auto nearby = makeEntity(), distant = makeEntity();
+	index.Update(nearby, Vector2(12.f, 0.f));
+	index.Update(distant, Vector2(0.f, 40.f));
+
+	std::vector<EntityPtr> results;
+	EXPECT_EQ(1u, index.QueryNearest(Vector2(0.f, 0.f), 2, results, 20.f));
+	EXPECT_EQ(nearby, results.front());
+
+	results.clear();
+	EXPECT_EQ(0u, index.QueryNearest(Vector2(0.f, 0.f), 2, results, 5.f));
+}
+
+TEST_F(spatial_index_f, queryNearestDistantEntity)
+{
+	// A single entity very far from the query point should be found without walking every ring between them
+	auto distant = makeEntity();
+	index.Update(distant, Vector2(1.0e6f, -1.0e6f));
+
+	std::vector<EntityPtr> results;
+	ASSERT_EQ(1u, index.QueryNearest(Vector2(0.f, 0.f), 1, results));
+	EXPECT_EQ(distant, results.front());
+
+	// A closer entity beyond the initial rings must still win over the distant one
+	auto closer = makeEntity();
+	index.Update(closer, Vector2(-500.f, 300.f));
+	results.clear();
+	ASSERT_EQ(1u, index.QueryNearest(Vector2(0.f, 0.f), 1, results));
+	EXPECT_EQ(closer, results.front());
+}
+
+TEST_F(spatial_index_f, queryRadiusAcrossCells)
+{
+	// The query circle overlaps the four cells around the origin
+	auto a = makeEntity(), b = makeEntity(), c = makeEntity(), d = makeEntity();
+	index.Update(a, Vector2(3.f, 2.f));
+	index.Update(b, Vector2(-3.f, 2.f));
+	index.Update(c, Vector2(2.f, -3.f));
+	index.Update(d, Vector2(-2.f, -2.5f));
+	// In cells that overlap the circle, but outside it
+	auto corner = makeEntity(), side = makeEntity();
+	index.Update(corner, Vector2(3.5f, 3.5f));
+	index.Update(side, Vector2(-4.5f, 0.f));
+
+	std::vector<EntityPtr> results;
+	EXPECT_EQ(4u, index.QueryRadius(Vector2(0.f, 0.f), 4.f, results));
+	EXPECT_TRUE(contains(results, a));
+	EXPECT_TRUE(contains(results, b));
+	EXPECT_TRUE(contains(results, c));
+	EXPECT_TRUE(contains(results, d));
+
+	// A small circle just inside a cell's edge reaches into the next cell
+	auto left = makeEntity(), right = makeEntity();
+	index.Update(left, Vector2(18.9f, 5.f));
+	index.Update(right, Vector2(20.2f, 5.f));
+	results.clear();
+	EXPECT_EQ(2u, index.QueryRadius(Vector2(19.5f, 5.f), 1.f, results));
+	EXPECT_TRUE(contains(results, left));
+	EXPECT_TRUE(contains(results, right));
+}
+
+TEST_F(spatial_index_f, querySegmentOrdering)
+{
+	auto last = makeEntity(), second = makeEntity(), third = makeEntity(), beforeStart = makeEntity(), afterEnd = makeEntity();
+	// Added out of order, and spread across several cells
+	index.Update(last, Vector2(30.f, 1.f));
+	index.Update(second, Vector2(-20.f, -1.5f));
+	index.Update(third, Vector2(5.f, 0.f));
+	// Within the radius of the ends of the segment
+	index.Update(beforeStart, Vector2(-26.5f, 0.f));
+	index.Update(afterEnd, Vector2(36.f, 1.5f));
+
+	std::vector<EntityPtr> results;
+	ASSERT_EQ(5u, index.QuerySegment(Vector2(-25.f, 0.f), Vector2(35.f, 0.f), 2.f, results));
+	EXPECT_EQ(beforeStart, results[0]);
+	EXPECT_EQ(second, results[1]);
+	EXPECT_EQ(third, results[2]);
+	EXPECT_EQ(last, results[3]);
+	EXPECT_EQ(afterEnd, results[4]);
+}
+
+TEST_F(spatial_index_f, querySegmentRadius)
+{
+	// Either side of a diagonal segment, 2.9 and 3.1 units away from it
+	auto inside = makeEntity(), outside = makeEntity();
+	index.Update(inside, Vector2(7.95f, 12.05f));
+	index.Update(outside, Vector2(22.2f, 17.8f));
+	// Beyond the end, inside the bounding box of the swept circle but not the circle itself
+	auto beyondEnd = makeEntity();
+	index.Update(beyondEnd, Vector2(32.5f, 32.5f));
+
+	std::vector<EntityPtr> results;
+	EXPECT_EQ(1u, index.QuerySegment(Vector2(0.f, 0.f), Vector2(30.f, 30.f), 3.f, results));
+	EXPECT_EQ(inside, results.front());
+
+	// A zero-length segment is a radius query
+	results.clear();
+	EXPECT_EQ(1u, index.QuerySegment(Vector2(30.f, 30.f), Vector2(30.f, 30.f), 4.f, results));
+	EXPECT_EQ(beyondEnd, results.front());
+}
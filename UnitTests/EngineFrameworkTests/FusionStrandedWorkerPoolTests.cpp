@@ -0,0 +1,100 @@
+#include "PrecompiledHeaders.h"
+
+#include "FusionPrerequisites.h"
+
+#include "FusionStrandedWorkerPool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+
+using namespace FusionEngine;
+
+TEST(stranded_worker_pool, jobsOnAStrandRunInOrder)
+{
+	const size_t numStrands = 8;
+	const size_t jobsPerStrand = 200;
+
+	std::vector<std::vector<size_t>> order(numStrands);
+	{
+		StrandedWorkerPool pool(4);
+		for (size_t i = 0; i < jobsPerStrand; ++i)
+		{
+			for (size_t strand = 0; strand < numStrands; ++strand)
+			{
+				auto& strandOrder = order[strand];
+				pool.Post(strand, [&strandOrder, i]() { strandOrder.push_back(i); }, i % 3 == 0 ? StrandedWorkerPool::High : StrandedWorkerPool::Normal);
+			}
+		}
+		pool.WaitForIdle();
+		EXPECT_EQ(0, pool.GetNumPendingJobs());
+	}
+
+	for (size_t strand = 0; strand < numStrands; ++strand)
+	{
+		ASSERT_EQ(jobsPerStrand, order[strand].size());
+		for (size_t i = 0; i < jobsPerStrand; ++i)
+			EXPECT_EQ(i, order[strand][i]);
+	}
+}
+
+TEST(stranded_worker_pool, jobsOnAStrandDontOverlap)
+{
+	std::atomic<int> running(0);
+	std::atomic<bool> overlapped(false);
+
+	StrandedWorkerPool pool(4);
+	for (int i = 0; i < 100; ++i)
+	{
+		pool.Post(1, [&]()
+		{
+			if (++running > 1)
+				overlapped = true;
+			std::this_thread::yield();
+			--running;
+		});
+	}
+	pool.WaitForIdle();
+
+	EXPECT_FALSE(overlapped);
+}
+
+TEST(stranded_worker_pool, highPriorityStrandsRunFirst)
+{
+	std::vector<int> order;
+	std::mutex blocker;
+	{
+		StrandedWorkerPool pool(1);
+
+		// Occupy the only worker so the following jobs queue up
+		blocker.lock();
+		pool.Post(0, [&]() { std::lock_guard<std::mutex> lock(blocker); });
+
+		pool.Post(1, [&]() { order.push_back(1); });
+		pool.Post(2, [&]() { order.push_back(2); });
+		pool.Post(3, [&]() { order.push_back(3); }, StrandedWorkerPool::High);
+		// Promotes strand 2 (along with the normal job queued before this one)
+		pool.Post(2, [&]() { order.push_back(4); }, StrandedWorkerPool::High);
+
+		blocker.unlock();
+		pool.WaitForIdle();
+	}
+
+	ASSERT_EQ(4, order.size());
+	EXPECT_EQ(3, order[0]);
+	EXPECT_EQ(2, order[1]);
+	EXPECT_EQ(4, order[2]);
+	EXPECT_EQ(1, order[3]);
+}
+
+TEST(stranded_worker_pool, queuedJobsFinishOnDestruction)
+{
+	std::atomic<int> count(0);
+	{
+		StrandedWorkerPool pool(2);
+		for (int i = 0; i < 50; ++i)
+			pool.Post(i % 5, [&count]() { ++count; });
+	}
+	EXPECT_EQ(50, count);
+}
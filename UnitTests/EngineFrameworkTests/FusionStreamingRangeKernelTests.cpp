@@ -0,0 +1,69 @@
+#include "PrecompiledHeaders.h"
+
+#include "FusionPrerequisites.h"
+
+#include "FusionStreamingRangeKernel.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+using namespace FusionEngine;
+
+TEST(streaming_range_kernel, firstCircleWins)
+{
+	// Two overlapping circles: positions inside both should report the first
+	const float cx[] = { 0.f, 2.f };
+	const float cy[] = { 0.f, 0.f };
+	const float rsq[] = { 4.f, 4.f };
+
+	const float xs[] = { 0.f, 1.f, 3.f, 10.f, 2.f };
+	const float ys[] = { 0.f, 0.f, 0.f, 10.f, 2.f };
+	int32_t result[5];
+
+	StreamingRangeKernel::ClassifyPositions(xs, ys, 5, cx, cy, rsq, 2, result);
+
+	EXPECT_EQ(0, result[0]);
+	EXPECT_EQ(0, result[1]);
+	EXPECT_EQ(1, result[2]);
+	EXPECT_EQ(StreamingRangeKernel::s_OutOfRange, result[3]);
+	EXPECT_EQ(1, result[4]); // on the edge of the second circle (inclusive)
+}
+
+TEST(streaming_range_kernel, matchesScalar)
+{
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> coord(-50.f, 50.f);
+	std::uniform_real_distribution<float> radius(1.f, 20.f);
+
+	const size_t numCircles = 5;
+	std::vector<float> cx, cy, rsq;
+	for (size_t c = 0; c < numCircles; ++c)
+	{
+		cx.push_back(coord(rng));
+		cy.push_back(coord(rng));
+		const float r = radius(rng);
+		rsq.push_back(r * r);
+	}
+
+	// Not a multiple of four, to exercise the remainder
+	const size_t count = 1003;
+	std::vector<float> xs, ys;
+	for (size_t i = 0; i < count; ++i)
+	{
+		xs.push_back(coord(rng));
+		ys.push_back(coord(rng));
+	}
+
+	std::vector<int32_t> expected(count), actual(count);
+	StreamingRangeKernel::ClassifyPositionsScalar(xs.data(), ys.data(), count, cx.data(), cy.data(), rsq.data(), numCircles, expected.data());
+	StreamingRangeKernel::ClassifyPositions(xs.data(), ys.data(), count, cx.data(), cy.data(), rsq.data(), numCircles, actual.data());
+
+	EXPECT_EQ(expected, actual);
+
+	// No circles: everything is out of range
+	StreamingRangeKernel::ClassifyPositions(xs.data(), ys.data(), count, cx.data(), cy.data(), rsq.data(), 0, actual.data());
+	for (size_t i = 0; i < count; ++i)
+		ASSERT_EQ(StreamingRangeKernel::s_OutOfRange, actual[i]);
+}
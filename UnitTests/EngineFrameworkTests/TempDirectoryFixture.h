@@ -0,0 +1,54 @@
+#ifndef H_TempDirectoryFixture
+#define H_TempDirectoryFixture
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <sstream>
+#include <string>
+
+//! Fixture that gives each test an empty temporary directory, which is removed after the test
+struct temp_dir_f : public testing::Test
+{
+	//! The directory is named fsn-[name]-[random characters]
+	explicit temp_dir_f(const std::string& name)
+		: name(name)
+	{
+	}
+
+	void SetUp()
+	{
+		base = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("fsn-" + name + "-%%%%%%%%");
+		boost::filesystem::create_directories(base);
+	}
+
+	void TearDown()
+	{
+		boost::filesystem::remove_all(base);
+	}
+
+	static void writeFile(const boost::filesystem::path& path, const std::string& contents)
+	{
+		boost::filesystem::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		file << contents;
+	}
+
+	static std::string readFile(const boost::filesystem::path& path)
+	{
+		boost::filesystem::ifstream file(path, std::ios::in | std::ios::binary);
+		std::stringstream contents;
+		contents << file.rdbuf();
+		return contents.str();
+	}
+
+	std::string name;
+	boost::filesystem::path base;
+};
+
+#endif